@@ -19,7 +19,10 @@
 #ifndef __CMODULE_H
 #define __CMODULE_H
 
+#include <pthread.h>
+
 #include <module.h>
+#include <lockstat.h>
 #include <sysdeps.h>
 
 /*
@@ -63,10 +66,15 @@ class CModule {
      */
     /* library name */
     const OMX_STRING GetLibraryName(void);
+    /* file the library was loaded from, NULL if not loaded */
+    const char *GetLibraryPath(void);
+    bool IsLoaded(void);
 
     /* component name and roles */
     const OMX_STRING GetComponentName(void);
     OMX_ERRORTYPE GetComponentRoles(OMX_U32 *nr_roles, OMX_U8 **roles);
+    OMX_U32 GetNumberOfRoles(void);
+    const OMX_STRING GetRole(OMX_U32 index);
 
     bool QueryHavingThisRole(const OMX_STRING role);
 
@@ -74,6 +82,13 @@ class CModule {
 
     /* library symbol method and helpers */
     OMX_ERRORTYPE QueryComponentNameAndRoles(void);
+    /*
+     * registers name and roles without loading the library (e.g. from a
+     * cache), then the library is loaded by the first InstantiateComponent()
+     */
+    OMX_ERRORTYPE SetComponentNameAndRoles(const char *name,
+                                           const char **roles,
+                                           OMX_U32 nr_roles);
     OMX_ERRORTYPE InstantiateComponent(ComponentBase **instance);
 
     /* end of library symbol method and helpers */
@@ -101,6 +116,9 @@ class CModule {
     void * parser_handle;
     /* preload: using preload libraries*/
     OMX_U32 preload_libraries;
+
+    /* serializes the lazy Load() of concurrent InstantiateComponent() */
+    struct lockstat_mutex load_lock;
 };
 
 #endif /* __CMODULE_H */
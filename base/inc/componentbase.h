@@ -22,14 +22,19 @@
 #include <OMX_Core.h>
 #include <OMX_Component.h>
 #include <OMX_IndexExt.h>
+#include <OMX_CoreExt.h>
 
 #include <cmodule.h>
 #include <portbase.h>
 
 #include <queue.h>
 #include <workqueue.h>
+#include <lockstat.h>
 
 
+/* max buffer sets per ProcessorProcessBatch() */
+#define MAX_PROCESSOR_BATCH_SIZE 32
+
 /* retain buffers */
 typedef enum buffer_retain_e {
     BUFFER_RETAIN_NOT_RETAIN = 0,
@@ -52,7 +57,7 @@ typedef struct param_struct {
     } param_struct_t;
 
 enum {
-  NUM_EXT_PARAMS = 8,  // number of parameter extensions we are supporting right now.
+  NUM_EXT_PARAMS = 15,  // number of parameter extensions we are supporting right now.
 };
 
 // Parameter Extension Array.
@@ -88,6 +93,34 @@ const param_struct_t PARAMEXT[NUM_EXT_PARAMS] = {
      {"OMX.Intel.index.GlxPictures",
        static_cast<OMX_INDEXTYPE>(OMX_IndexParamIntelGlxPictures),
        OMX_ErrorNone
+     },
+     {"OMX.Intel.index.reconfigureInPlace",
+       static_cast<OMX_INDEXTYPE>(OMX_IndexParamIntelReconfigureInPlace),
+       OMX_ErrorNone
+     },
+     {"OMX.Intel.index.shareableBuffers",
+       static_cast<OMX_INDEXTYPE>(OMX_IndexParamIntelShareableBuffers),
+       OMX_ErrorNone
+     },
+     {"OMX.Intel.index.sharedBufferInfo",
+       static_cast<OMX_INDEXTYPE>(OMX_IndexParamIntelSharedBufferInfo),
+       OMX_ErrorNone
+     },
+     {"OMX.Intel.index.submitBuffers",
+       static_cast<OMX_INDEXTYPE>(OMX_IndexConfigIntelSubmitBuffers),
+       OMX_ErrorNone
+     },
+     {"OMX.Intel.index.workPriority",
+       static_cast<OMX_INDEXTYPE>(OMX_IndexConfigIntelWorkPriority),
+       OMX_ErrorNone
+     },
+     {"OMX.Intel.index.threadPlacement",
+       static_cast<OMX_INDEXTYPE>(OMX_IndexConfigIntelThreadPlacement),
+       OMX_ErrorNone
+     },
+     {"OMX.Intel.index.portLatency",
+       static_cast<OMX_INDEXTYPE>(OMX_IndexConfigIntelPortLatency),
+       OMX_ErrorNone
      }
 };
 
@@ -101,11 +134,19 @@ public:
 class CmdProcessWork : public WorkableInterface
 {
 public:
-    CmdProcessWork(CmdHandlerInterface *ci);
+    /*
+     * runs on the shared executor if shared, else on a thread of its own.
+     * attr places the own thread if any, NULL to leave as created
+     */
+    CmdProcessWork(CmdHandlerInterface *ci, const struct thread_attr *attr,
+                   bool shared);
     ~CmdProcessWork();
 
     OMX_ERRORTYPE PushCmdQueue(struct cmd_s *cmd);
 
+    void SetPriority(work_priority_t priority);
+    WorkQueue *GetWorkQueue(void);
+
 private:
     struct cmd_s *PopCmdQueue(void);
 
@@ -114,11 +155,83 @@ private:
     WorkQueue *workq;
 
     struct queue q;
-    pthread_mutex_t lock;
+    struct lockstat_mutex lock;
 
     CmdHandlerInterface *ci; /* to run ComponentBase::CmdHandler() */
 };
 
+/*
+ * CallbackDispatchWork delivers EventHandler/EmptyBufferDone/FillBufferDone
+ * to omx-il client out of the component's buffer processing, so that a slow
+ * client doesn't stall Work() holding ports_block.
+ *
+ * completions're delivered in the order they're pushed, a pending batch is
+ * taken at once and delivered without holding the lock.
+ *
+ * OMXIL_ASYNC_CALLBACKS=1 environment variable enables it.
+ */
+class CallbackDispatchWork : public WorkableInterface
+{
+public:
+    /*
+     * runs on the shared executor if shared, else on a thread of its own.
+     * attr places the own thread if any, NULL to leave as created
+     */
+    CallbackDispatchWork(const OMX_CALLBACKTYPE *callbacks,
+                         const struct thread_attr *attr, bool shared);
+    /* delivers the completions still queued */
+    ~CallbackDispatchWork();
+
+    /* omx-il client callbacks */
+    void SetCallbacks(const OMX_CALLBACKTYPE *callbacks);
+
+    void SetPriority(work_priority_t priority);
+    WorkQueue *GetWorkQueue(void);
+
+    OMX_ERRORTYPE PushEvent(OMX_HANDLETYPE hComponent, OMX_PTR pAppData,
+                            OMX_EVENTTYPE eEvent, OMX_U32 nData1,
+                            OMX_U32 nData2, OMX_PTR pEventData);
+    OMX_ERRORTYPE PushBufferDone(OMX_HANDLETYPE hComponent, OMX_PTR pAppData,
+                                 OMX_DIRTYPE direction,
+                                 OMX_BUFFERHEADERTYPE *pBuffer);
+
+    static bool IsEnabled(void);
+
+private:
+    struct callback_s {
+        OMX_HANDLETYPE hComponent;
+        OMX_PTR pAppData;
+        OMX_BUFFERHEADERTYPE *pBuffer; /* NULL for EventHandler */
+        OMX_DIRTYPE direction;
+        OMX_EVENTTYPE eEvent;
+        OMX_U32 nData1;
+        OMX_U32 nData2;
+        OMX_PTR pEventData;
+    };
+
+    /* must be held lock */
+    OMX_ERRORTYPE Push(const struct callback_s *callback);
+    void Deliver(const struct callback_s *callbacks, OMX_U32 nr_callbacks,
+                 const OMX_CALLBACKTYPE *client);
+
+    virtual void Work(void); /* deliver all pending completions */
+
+    WorkQueue *workq;
+
+    /* pushed, not yet taken by Work() */
+    struct callback_s *pending;
+    OMX_U32 nr_pending;
+    OMX_U32 nr_pending_alloc;
+    /* taken batch, swapped with pending */
+    struct callback_s *batch;
+    OMX_U32 nr_batch_alloc;
+    /* Work() is scheduled or running */
+    bool scheduled;
+    struct lockstat_mutex lock;
+
+    OMX_CALLBACKTYPE callbacks;
+};
+
 class ComponentBase : public CmdHandlerInterface, public WorkableInterface
 {
 public:
@@ -362,6 +475,49 @@ protected:
 
     void DumpBuffer(const OMX_BUFFERHEADERTYPE *bufferheader, bool dumpdata);
 
+    /*
+     * by default, ProcessorProcess() is called when every port has a buffer.
+     * a component can declare port subsets instead, a mask is a set of port
+     * index bits (port 0 is bit 0, up to 32 ports). ProcessorProcess() is
+     * called when all ports of any mask have a buffer, the first satisfied
+     * mask wins. buffers of the ports not in the mask are passed as NULL.
+     * a mask whose buffers're all GETAGAIN gives way to the next masks until
+     * some buffer is consumed. up to 32 masks, NULL or 0 restore the default.
+     */
+    OMX_ERRORTYPE SetRequiredPortMasks(const OMX_U32 *masks, OMX_U32 nr_masks);
+
+    /*
+     * let Work() pop up to nr_sets buffer sets before calling the processor,
+     * they're passed to ProcessorProcessBatch() at once. 1 (default) keeps
+     * calling ProcessorProcess() per set. up to MAX_PROCESSOR_BATCH_SIZE.
+     */
+    OMX_ERRORTYPE SetProcessorBatchSize(OMX_U32 nr_sets);
+
+    /*
+     * priority of the command, buffer and callback works on the shared
+     * executor. WORK_PRIORITY_NORMAL by default. if timestamp_deadline, the
+     * buffer work is due at the input nTimeStamp, relative to the first
+     * input after start or flush.
+     */
+    void SetWorkPriority(work_priority_t priority, bool timestamp_deadline);
+
+    /*
+     * if ProcessorProcess() can block for long (e.g. waiting for the
+     * hardware), the buffer work gets a thread of its own instead of
+     * holding a worker of the shared executor. call it in the constructor.
+     */
+    void SetBlockingProcessor(bool blocking);
+
+    /*
+     * for pacing sources and rate-limited sinks, run the buffer work
+     * after delay nsec, or every period nsec (0 stops it) without a thread
+     * of their own. ProcessorProcess() is still called only when the
+     * buffers're ready. the timers're cancelled on going to Idle, so arm
+     * them from ProcessorStart() on.
+     */
+    void ScheduleBufferWork(unsigned long long delay);
+    void SetBufferWorkPeriod(unsigned long long period);
+
     /* end of helpers for derived class */
 
     /* ports */
@@ -373,7 +529,7 @@ protected:
     OMX_PORT_PARAM_TYPE portparam;
 
     /* ports big lock, must be held when accessing all ports at one time */
-    pthread_mutex_t ports_block;
+    struct lockstat_mutex ports_block;
 
 private:
     /* common routines for constructor */
@@ -421,6 +577,10 @@ private:
     /* SendCommand:OMX_CommandPortDisable/Enable */
     /* state: PortBase::OMX_PortEnabled/Disabled */
     void TransStatePort(OMX_U32 port_index, OMX_U8 state);
+    /* supplier ports send their buffers into the tunnels */
+    void PrimeTunnelPorts(OMX_U32 from_index, OMX_U32 to_index);
+    /* hands the returned buffers to the peers, after ports_block's released */
+    void SendTunnelPorts(void);
 
     /* Get/SetParameter */
     virtual OMX_ERRORTYPE
@@ -438,11 +598,57 @@ private:
         ComponentSetConfig(OMX_INDEXTYPE nIndex,
                            OMX_PTR pComponentConfigStructure) = 0;
 
+    /* Empty/FillThisBuffer, *port is set if pBuffer is valid */
+    OMX_ERRORTYPE CheckThisBuffer(OMX_BUFFERHEADERTYPE *pBuffer, bool input,
+                                  PortBase **port);
+    /* pBuffer is to be emptied by one of this->ports, otherwise filled */
+    bool IsInputBuffer(const OMX_BUFFERHEADERTYPE *pBuffer);
+    /* push a checked buffer, the caller schedules the buffer work */
+    OMX_ERRORTYPE QueueThisBuffer(OMX_BUFFERHEADERTYPE *pBuffer, bool input,
+                                  PortBase *port);
+    /*
+     * SetConfig:OMX_IndexConfigIntelSubmitBuffers
+     *
+     * Empty/FillThisBuffer() for an array of headers, the buffer work is
+     * scheduled once for the whole batch
+     */
+    OMX_ERRORTYPE SubmitBuffers(OMX_CONFIG_INTEL_SUBMITBUFFERSTYPE *p);
+
+    /*
+     * thread placement of a role, named <last part of the component
+     * name>:<role> by default and then by the placement rules. false if
+     * no rule matches
+     */
+    bool GetThreadPlacement(OMX_INTEL_THREADROLETYPE role,
+                            struct thread_attr *attr);
+    /* logs whether the rules matching role (placed) apply to its thread */
+    void CheckThreadPlacement(OMX_INTEL_THREADROLETYPE role, bool placed);
+    /* the WorkQueue running the works of role, NULL if none */
+    WorkQueue *GetThreadRoleWorkQueue(OMX_INTEL_THREADROLETYPE role);
+    /* Get/SetConfig:OMX_IndexConfigIntelThreadPlacement */
+    OMX_ERRORTYPE GetThreadPlacementConfig(
+        OMX_CONFIG_INTEL_THREADPLACEMENTTYPE *p);
+    OMX_ERRORTYPE SetThreadPlacementConfig(
+        OMX_CONFIG_INTEL_THREADPLACEMENTTYPE *p);
+    /* GetConfig:OMX_IndexConfigIntelPortLatency */
+    OMX_ERRORTYPE GetPortLatencyConfig(OMX_CONFIG_INTEL_PORTLATENCYTYPE *p);
+
+    /* buffer work deadline of an input buffer, 0 if none */
+    unsigned long long BufferDeadline(const OMX_BUFFERHEADERTYPE *pBuffer);
+    /* the next input anchors the deadlines, on start and flush */
+    void ResetBufferDeadline(void);
+
     /* buffer processing */
     /* implement WorkableInterface */
     virtual void Work(void); /* handle this->ports, hold ports_block */
     /* check if all port has own pending buffer */
     bool IsAllBufferAvailable(void);
+    /*
+     * ports to be processed, 0 if not ready. see SetRequiredPortMasks().
+     * masks whose index bit is set in stalled are skipped, the index of the
+     * returned one is stored in index
+     */
+    OMX_U32 GetReadyPortMask(OMX_U32 stalled, OMX_U32 *index);
 
     /* called in Work() after ProcessorProcess() */
     void PostProcessBuffers(OMX_BUFFERHEADERTYPE **buffers,
@@ -468,6 +674,16 @@ private:
     virtual OMX_ERRORTYPE ProcessorProcess(OMX_BUFFERHEADERTYPE **buffers,
                                            buffer_retain_t *retain,
                                            OMX_U32 nr_buffers) = 0;
+    /*
+     * buffers and retain hold nr_sets sets of nr_buffers entries, set s of
+     * port i is at [s * nr_buffers + i]. retain results of a port're applied
+     * in order of sets, buffers to get again must be the last ones of a port.
+     * the default calls ProcessorProcess() for each set.
+     */
+    virtual OMX_ERRORTYPE ProcessorProcessBatch(OMX_BUFFERHEADERTYPE **buffers,
+                                                buffer_retain_t *retain,
+                                                OMX_U32 nr_buffers,
+                                                OMX_U32 nr_sets);
 
     /* invoked when buffer is to be filled */
     virtual  OMX_ERRORTYPE ProcessorPreFillBuffer(OMX_BUFFERHEADERTYPE* pBuffer);
@@ -487,6 +703,57 @@ private:
     /* buffer processing work */
     WorkQueue *bufferwork;
 
+    /* SetRequiredPortMasks(), NULL if every port is required */
+    OMX_U32 *required_port_masks;
+    OMX_U32 nr_required_port_masks;
+
+    /* SetProcessorBatchSize() */
+    OMX_U32 processor_batch_size;
+    /*
+     * the sets popped by Work(), nr_ports * MAX_PROCESSOR_BATCH_SIZE.
+     * allocated with the ports, used under ports_block
+     */
+    OMX_BUFFERHEADERTYPE **work_buffers;
+    buffer_retain_t *work_retain;
+
+    /* SetWorkPriority() */
+    work_priority_t work_priority;
+    bool timestamp_deadline;
+
+    /* SetBlockingProcessor() */
+    bool blocking_processor;
+
+    /* BufferDeadline(), first input's nTimeStamp and when it came */
+    struct lockstat_mutex deadline_lock;
+    bool deadline_anchored;
+    OMX_TICKS deadline_anchor_ts;
+    unsigned long long deadline_anchor_time;
+
+    /*
+     * asynchronous client callbacks, NULL if disabled.
+     * callbacks passed to ports're replaced with Dispatch*(), which queue
+     * the completions into callbackwork
+     */
+    CallbackDispatchWork *callbackwork;
+
+    static OMX_ERRORTYPE DispatchEventHandler(
+        OMX_IN OMX_HANDLETYPE hComponent,
+        OMX_IN OMX_PTR pAppData,
+        OMX_IN OMX_EVENTTYPE eEvent,
+        OMX_IN OMX_U32 nData1,
+        OMX_IN OMX_U32 nData2,
+        OMX_IN OMX_PTR pEventData);
+    static OMX_ERRORTYPE DispatchEmptyBufferDone(
+        OMX_IN OMX_HANDLETYPE hComponent,
+        OMX_IN OMX_PTR pAppData,
+        OMX_IN OMX_BUFFERHEADERTYPE* pBuffer);
+    static OMX_ERRORTYPE DispatchFillBufferDone(
+        OMX_IN OMX_HANDLETYPE hComponent,
+        OMX_IN OMX_PTR pAppData,
+        OMX_IN OMX_BUFFERHEADERTYPE* pBuffer);
+    /* set callbacks, replaced with Dispatch*() if callbackwork */
+    void SetClientCallbacks(const OMX_CALLBACKTYPE *pCallbacks);
+
     /* component variant */
     typedef enum component_variant_e {
         CVARIANT_NULL = 0,
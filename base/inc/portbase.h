@@ -23,11 +23,18 @@
 
 #include <OMX_Core.h>
 #include <OMX_Component.h>
+#include <OMX_CoreExt.h>
 #ifdef ANDROID
 #include <utils/RefBase.h>
 #endif
 #include <list.h>
 #include <queue.h>
+#include <ring.h>
+#include <shmbuf.h>
+#include <histogram.h>
+#include <lockstat.h>
+
+struct port_buffer_stamp;
 
 class PortBase
 {
@@ -52,6 +59,31 @@ public:
     OMX_ERRORTYPE SetCallbacks(OMX_HANDLETYPE hComponent,
                                OMX_CALLBACKTYPE *pCallbacks,
                                OMX_PTR pAppData);
+    /* tunnel peer, set by ComponentTunnelRequest(), NULL if not tunneled */
+    void SetTunnel(OMX_HANDLETYPE hTunneledComp, OMX_U32 nTunneledPort);
+    OMX_HANDLETYPE GetTunnelPeer(void);
+    OMX_U32 GetTunnelPort(void);
+
+    /* OMX_IndexParamCompBufferSupplier */
+    void SetBufferSupplier(OMX_BUFFERSUPPLIERTYPE supplier);
+    OMX_BUFFERSUPPLIERTYPE GetBufferSupplier(void);
+    /* tunneled and this port supplies the buffers */
+    bool IsBufferSupplier(void);
+
+    /* OMX_IndexParamIntelReconfigureInPlace */
+    void SetReconfigureInPlace(bool enable);
+    bool GetReconfigureInPlace(void);
+
+    /*
+     * OMX_IndexParamIntelShareableBuffers, AllocateBuffer() gives payloads
+     * in one memfd shared mapping. only while the port has no buffer
+     */
+    OMX_ERRORTYPE SetShareableBuffers(bool enable, bool seal);
+    bool GetShareableBuffers(bool *seal);
+    /* OMX_IndexParamIntelSharedBufferInfo */
+    OMX_ERRORTYPE GetSharedBufferInfo(OMX_BUFFERHEADERTYPE *pBuffer,
+                                      OMX_S32 *fd, OMX_U32 *offset,
+                                      OMX_U32 *length);
     /* end of accessor */
 
     /*
@@ -78,18 +110,53 @@ public:
     /*
      * called in ComponentBase::TransStateToLoaded(OMX_StateIdle) or
      * in ComponentBase::TransStateToIdle(OMX_StateLoaded)
-     * wokeup by Use/Allocate/FreeBuffer
+     * wokeup by Use/Allocate/FreeBuffer, until the port is populated or
+     * all buffers are freed
      */
-    void WaitPortBufferCompletion(void);
+    void WaitPortBufferCompletion(bool populate);
 
     /* Empty/FillThisBuffer */
     OMX_ERRORTYPE PushThisBuffer(OMX_BUFFERHEADERTYPE *pBuffer);
+    /* must be held ComponentBase::ports_block */
     OMX_BUFFERHEADERTYPE *PopBuffer(void);
     OMX_U32 BufferQueueLength(void);
     OMX_ERRORTYPE RemoveThisBuffer(OMX_BUFFERHEADERTYPE *pBuffer);
 
-    /* Empty/FillBufferDone */
+    /*
+     * Empty/FillBufferDone
+     * a tunneled port queues the buffer for SendTunnelBuffers() instead of
+     * calling back omx-il client
+     */
     OMX_ERRORTYPE ReturnThisBuffer(OMX_BUFFERHEADERTYPE *pBuffer);
+    /*
+     * hands the buffers returned by a tunneled port to the peer's
+     * Empty/FillThisBuffer, in order, one caller at a time.
+     * the peer takes its own locks, must not be held ports_block or any
+     * lock of this port
+     */
+    void SendTunnelBuffers(void);
+
+    /*
+     * buffer latencies (OMX_IndexConfigIntelPortLatency) in nsec. the
+     * stamps of the buffers in flight're kept in a side table keyed by the
+     * header, taken without lock, a buffer's handed over from a stamp to
+     * the next by the queues.
+     *
+     * OMXIL_PORT_LATENCY=0 environment variable disables them.
+     */
+    static bool IsLatencyEnabled(void);
+    /* Empty/FillThisBuffer */
+    void StampQueued(OMX_BUFFERHEADERTYPE *pBuffer, unsigned long long now);
+    /*
+     * a ProcessorProcess() call taking the buffer from start to end, done
+     * if it's returned right after, ReturnThisBuffer() won't stamp it again
+     */
+    void StampProcessed(OMX_BUFFERHEADERTYPE *pBuffer,
+                        unsigned long long start, unsigned long long end,
+                        bool done);
+    /* snapshot of a histogram */
+    void GetLatency(OMX_INTEL_LATENCYTYPE type, struct histogram *h);
+    void ResetLatency(void);
 
     /* retain buffer */
     OMX_ERRORTYPE RetainThisBuffer(OMX_BUFFERHEADERTYPE *pBuffer,
@@ -100,11 +167,42 @@ public:
      */
     void ReturnAllRetainedBuffers(void);
 
-    /* flush all buffers not under processing */
+    /*
+     * flush all buffers not under processing
+     * a buffer supplier keeps its buffers, see PrimeTunnelBuffers()
+     */
     OMX_ERRORTYPE FlushPort(void);
 
+    /*
+     * buffer supplier only.
+     * Allocate: called in ComponentBase::TransStateToIdle(OMX_StateLoaded)
+     * and before port enable, allocates buffers and gives them to the peer
+     * port by its UseBuffer().
+     * Free: called in ComponentBase::TransStateToLoaded(OMX_StateIdle) and
+     * before port disable, frees the buffers. if wait, the peer may still be
+     * processing, waits for the buffers coming back first and fails with
+     * OMX_ErrorTimeout keeping them if they don't.
+     * Prime: sends the kept buffers into the tunnel again, the empty ones
+     * to this output port or to the peer output port. called when the owner
+     * goes to OMX_StateExecuting and after flush, the queued ones're to be
+     * flushed first.
+     * these call into the peer, must not be held ComponentBase::ports_block
+     * or any lock of this port. the buffer processing must be stopped or
+     * the port ceased while allocating or freeing
+     */
+    OMX_ERRORTYPE AllocateTunnelBuffers(void);
+    OMX_ERRORTYPE FreeTunnelBuffers(bool wait);
+    void PrimeTunnelBuffers(void);
+
     bool IsEnabled(void);
     bool IsCeased();
+    /*
+     * port disable is in progress, set under ComponentBase::ports_block
+     * before the port's flushed. the port is ceased and a tunneled port
+     * not supplying sends the buffers coming in straight back. cleared by
+     * TransState()
+     */
+    void SetDisabling(bool disabling);
 
     OMX_DIRTYPE GetPortDirection(void);
     OMX_U32 GetPortBufferCount(void);
@@ -112,10 +210,23 @@ public:
     OMX_ERRORTYPE PushMark(OMX_MARKTYPE *mark);
     OMX_MARKTYPE *PopMark(void);
 
-    /* SendCommand(OMX_CommandPortDisable/Enable) */
+    /*
+     * SendCommand(OMX_CommandPortDisable/Enable)
+     * waits for the buffers to be populated or freed, must not be held
+     * ComponentBase::ports_block
+     */
     OMX_ERRORTYPE TransState(OMX_U8 state);
 
-    /* EventHandler(OMX_EventPortSettingChanged) */
+    /*
+     * EventHandler(OMX_EventPortSettingChanged)
+     *
+     * if the client enabled OMX_IndexParamIntelReconfigureInPlace and the
+     * buffers can follow the new nBufferSize, the port is flushed but not
+     * ceased, nData2 is OMX_IndexParamIntelReconfigureInPlace and the client
+     * doesn't have to disable and re-populate the port. buffers smaller than
+     * nBufferSize get new payloads when they come back to the port, so the
+     * processor must return the buffers in hand instead of retaining them.
+     */
     OMX_ERRORTYPE ReportPortSettingsChanged(void);
 
     /* EventHandler(OMX_IndexConfigCommonOutputCrop) */
@@ -141,29 +252,96 @@ private:
 
     void SetPortSettingsChangedPending(bool isPending);
 
+    /* called in Use/AllocateBuffer() before the first buffer header */
+    OMX_ERRORTYPE ReserveBufferQueue(void);
+
+    /* side table of the buffer stamps */
+    struct port_buffer_stamp *FindStamp(const OMX_BUFFERHEADERTYPE *pBuffer);
+    /* must be held hdrs_lock */
+    void AddStamp(const OMX_BUFFERHEADERTYPE *pBuffer);
+    void RemoveStamp(const OMX_BUFFERHEADERTYPE *pBuffer);
+
+    /* buffer supplier keeps pBuffer until PrimeTunnelBuffers() */
+    void HoldTunnelBuffer(OMX_BUFFERHEADERTYPE *pBuffer);
+    /* number of supplied buffers not held by the peer */
+    OMX_U32 TunnelBuffersAtHome(void);
+
+    /* the buffers can be kept for the current port definition */
+    bool CanReconfigureInPlace(void);
+    /*
+     * give pBuffer a payload large enough for nBufferSize, pBuffer's
+     * payload was allocated by the port
+     */
+    OMX_ERRORTYPE GrowBuffer(OMX_BUFFERHEADERTYPE *pBuffer);
+
     /* end of component methods & helpers */
 
     /* buffer headers */
     struct list *buffer_hdrs;
     OMX_U32 nr_buffer_hdrs;
-    bool buffer_hdrs_completion; /* Use/Allocate/FreeBuffer completion flag */
-    pthread_mutex_t hdrs_lock;
+    struct lockstat_mutex hdrs_lock;
     pthread_cond_t hdrs_wait;
 
-    struct queue bufferq;
-    pthread_mutex_t bufferq_lock;
+    /*
+     * buffers queued by Empty/FillThisBuffer(), pushed without any lock.
+     * sized to nBufferCountActual before the first buffer is allocated
+     */
+    struct ring bufferq;
+    /*
+     * buffers pushed back at head of bufferq (stack, top is the next one)
+     * only the buffer processing side touches it under ports_block
+     */
+    OMX_BUFFERHEADERTYPE **headq;
+    OMX_U32 nr_headq;
+
+    /*
+     * stamps of buffer_hdrs, open addressing, nr_stamps is a power of two.
+     * sized and cleared with bufferq
+     */
+    struct port_buffer_stamp *stamps;
+    OMX_U32 nr_stamps;
+    /* OMX_INTEL_LATENCYTYPE */
+    struct histogram latency[OMX_IntelLatencyResidency + 1];
 
     /* retained buffers (only accumulated buffer) */
     struct queue retainedbufferq;
-    pthread_mutex_t retainedbufferq_lock;
+    struct lockstat_mutex retainedbufferq_lock;
 
     struct queue markq;
-    pthread_mutex_t markq_lock;
+    struct lockstat_mutex markq_lock;
+
+    /* tunnel */
+    OMX_HANDLETYPE tunnel_peer;
+    OMX_U32 tunnel_port;
+    OMX_BUFFERSUPPLIERTYPE buffer_supplier;
+    /* supplied buffers kept by this port, not queued anywhere */
+    struct queue tunnel_heldq;
+    struct lockstat_mutex tunnel_lock;
+    pthread_cond_t tunnel_wait;
+    /* FreeTunnelBuffers() is waiting for the buffers from the peer */
+    volatile bool tunnel_draining;
+    /* returned buffers to send to the peer, sized with bufferq */
+    struct ring tunnel_sendq;
+    /* SendTunnelBuffers() is running, taken by compare and swap */
+    volatile int tunnel_sending;
+
+    /* OMX_IndexParamIntelReconfigureInPlace */
+    bool reconfigure_in_place;
+    /* headers left to grow after ReportPortSettingsChanged() */
+    volatile OMX_U32 nr_reconfiguring;
+
+    /* OMX_IndexParamIntelShareableBuffers */
+    bool shareable;
+    bool shareable_seal;
+    /* created by the first AllocateBuffer(), destroyed by the last free */
+    struct shmbuf *shm;
 
     /* state */
     OMX_U8 state;
-    pthread_mutex_t state_lock;
+    struct lockstat_mutex state_lock;
     bool port_settings_changed_pending;
+    /* SetDisabling(), read without lock by PushThisBuffer() */
+    volatile bool disabling;
 
     /* parameter */
     OMX_PARAM_PORTDEFINITIONTYPE portdefinition;
@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <dlfcn.h>
 
 #include <OMX_Core.h>
 
@@ -36,6 +37,9 @@ CModule::CModule(const OMX_STRING lname)
     roles = NULL;
     nr_roles = 0;
     preload_libraries=0;
+    parser_handle = NULL;
+
+    lockstat_mutex_init(&load_lock, "CModule::load_lock", NULL);
 
     memset(cname, 0, OMX_MAX_STRINGNAME_SIZE);
 
@@ -57,6 +61,8 @@ CModule::~CModule()
             free(roles[0]);
         free(roles);
     }
+
+    lockstat_mutex_destroy(&load_lock);
 }
 
 /* end of constructor / deconstructor */
@@ -66,6 +72,7 @@ CModule::~CModule()
  */
 OMX_ERRORTYPE CModule::Load(int flag, void *preload)
 {
+    struct wrs_omxil_cmodule_s *symbol;
     struct module *m;
 
     if (preload) {
@@ -80,9 +87,9 @@ OMX_ERRORTYPE CModule::Load(int flag, void *preload)
     if (m == module)
         return OMX_ErrorNone;
 
-    wrs_omxil_cmodule = (struct wrs_omxil_cmodule_s *)
+    symbol = (struct wrs_omxil_cmodule_s *)
         module_symbol(m, WRS_OMXIL_CMODULE_SYMBOL_STRING);
-    if (!wrs_omxil_cmodule) {
+    if (!symbol) {
         omx_errorLog("module %s symbol not founded (%s)",
              lname, WRS_OMXIL_CMODULE_SYMBOL_STRING);
 
@@ -90,7 +97,20 @@ OMX_ERRORTYPE CModule::Load(int flag, void *preload)
         return OMX_ErrorInvalidComponent;
     }
 
+    /* name registered without loading, the library has been replaced */
+    if (cname[0] && strncmp(cname, symbol->name,
+                            OMX_MAX_STRINGNAME_SIZE-1)) {
+        omx_errorLog("module %s has %s, not registered %s",
+             lname, symbol->name, cname);
+
+        module_close(m, preload_libraries);
+        return OMX_ErrorInvalidComponent;
+    }
+
     module = m;
+    /* InstantiateComponent() tests it without load_lock */
+    __sync_synchronize();
+    wrs_omxil_cmodule = symbol;
     omx_infoLog("module %s successfully loaded", lname);
 
     return OMX_ErrorNone;
@@ -100,6 +120,10 @@ OMX_U32 CModule::Unload(void)
 {
     int ref_count;
 
+    /* registered from the cache and never loaded */
+    if (!module)
+        return 0;
+
     ref_count = module_close(module, preload_libraries);
     if (!ref_count) {
         module = NULL;
@@ -121,6 +145,21 @@ const OMX_STRING CModule::GetLibraryName(void)
     return lname;
 }
 
+const char *CModule::GetLibraryPath(void)
+{
+    Dl_info info;
+
+    if (!wrs_omxil_cmodule || !dladdr(wrs_omxil_cmodule, &info))
+        return NULL;
+
+    return info.dli_fname;
+}
+
+bool CModule::IsLoaded(void)
+{
+    return wrs_omxil_cmodule ? true : false;
+}
+
 const OMX_STRING CModule::GetComponentName(void)
 {
     return cname;
@@ -156,6 +195,19 @@ OMX_ERRORTYPE CModule::GetComponentRoles(OMX_U32 *nr_roles, OMX_U8 **roles)
     return OMX_ErrorNone;
 }
 
+OMX_U32 CModule::GetNumberOfRoles(void)
+{
+    return nr_roles;
+}
+
+const OMX_STRING CModule::GetRole(OMX_U32 index)
+{
+    if (!roles || index >= nr_roles)
+        return NULL;
+
+    return (OMX_STRING)&roles[index][0];
+}
+
 bool CModule::QueryHavingThisRole(const OMX_STRING role)
 {
     OMX_U32 i;
@@ -185,6 +237,19 @@ OMX_ERRORTYPE CModule::InstantiateComponent(ComponentBase **instance)
         return OMX_ErrorBadParameter;
     *instance = NULL;
 
+    /* registered without loading, load the library on the first use */
+    if (!wrs_omxil_cmodule && cname[0]) {
+        lockstat_mutex_lock(&load_lock);
+        if (!wrs_omxil_cmodule)
+            ret = Load(MODULE_NOW, NULL);
+        else
+            ret = OMX_ErrorNone;
+        lockstat_mutex_unlock(&load_lock);
+
+        if (ret != OMX_ErrorNone)
+            return ret;
+    }
+
     if (!wrs_omxil_cmodule)
         return OMX_ErrorUndefined;
 
@@ -208,27 +273,35 @@ OMX_ERRORTYPE CModule::InstantiateComponent(ComponentBase **instance)
 
 OMX_ERRORTYPE CModule::QueryComponentNameAndRoles(void)
 {
-    const char *name;
+    if (this->roles)
+        return OMX_ErrorNone;
+
+    if (!wrs_omxil_cmodule)
+        return OMX_ErrorUndefined;
+
+    return SetComponentNameAndRoles(wrs_omxil_cmodule->name,
+                                    (const char **)wrs_omxil_cmodule->roles,
+                                    wrs_omxil_cmodule->nr_roles);
+}
+
+OMX_ERRORTYPE CModule::SetComponentNameAndRoles(const char *name,
+                                                const char **roles,
+                                                OMX_U32 nr_roles)
+{
     OMX_U32 name_len;
     OMX_U32 copy_name_len;
 
-    const OMX_U8 **roles;
-    OMX_U32 nr_roles;
     OMX_U32 role_len;
     OMX_U32 copy_role_len;
     OMX_U8 **this_roles;
 
     OMX_U32 i;
-    OMX_ERRORTYPE ret;
 
     if (this->roles)
         return OMX_ErrorNone;
 
-    if (!wrs_omxil_cmodule)
-        return OMX_ErrorUndefined;
-
-    roles = (const OMX_U8 **)wrs_omxil_cmodule->roles;
-    nr_roles = wrs_omxil_cmodule->nr_roles;
+    if (!name || !roles || !nr_roles)
+        return OMX_ErrorBadParameter;
 
     this_roles = (OMX_U8 **)malloc(sizeof(OMX_STRING) * nr_roles);
     if (!this_roles)
@@ -244,19 +317,17 @@ OMX_ERRORTYPE CModule::QueryComponentNameAndRoles(void)
         if (i < nr_roles - 1)
             this_roles[i+1] = this_roles[i] + OMX_MAX_STRINGNAME_SIZE;
 
-        role_len = strlen((const OMX_STRING)&roles[i][0]);
+        role_len = strlen(roles[i]);
         copy_role_len = role_len > OMX_MAX_STRINGNAME_SIZE-1 ?
             OMX_MAX_STRINGNAME_SIZE-1 : role_len;
 
-        strncpy((OMX_STRING)&this_roles[i][0],
-                (const OMX_STRING)&roles[i][0], copy_role_len);
+        strncpy((OMX_STRING)&this_roles[i][0], roles[i], copy_role_len);
         this_roles[i][copy_role_len] = '\0';
     }
 
     this->roles = this_roles;
     this->nr_roles = nr_roles;
 
-    name = wrs_omxil_cmodule->name;
     name_len = strlen(name);
     copy_name_len = name_len > OMX_MAX_STRINGNAME_SIZE-1 ?
         OMX_MAX_STRINGNAME_SIZE-1 : name_len;
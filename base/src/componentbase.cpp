@@ -16,32 +16,41 @@
  * limitations under the License.
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sched.h>
 
 #include <pthread.h>
 
 #include <OMX_Core.h>
 #include <OMX_Component.h>
+#include <OMX_CoreExt.h>
 
 #include <componentbase.h>
 
 #include <queue.h>
 #include <workqueue.h>
+#include <executor.h>
+#include <threadplace.h>
+#include <trace.h>
 
 #define DUMP 0
 
 /*
  * CmdProcessWork
  */
-CmdProcessWork::CmdProcessWork(CmdHandlerInterface *ci)
+CmdProcessWork::CmdProcessWork(CmdHandlerInterface *ci,
+                               const struct thread_attr *attr, bool shared)
 {
     this->ci = ci;
 
-    workq = new WorkQueue;
+    workq = new WorkQueue(shared);
+    if (attr)
+        workq->SetAttributes(attr);
 
     __queue_init(&q);
-    pthread_mutex_init(&lock, NULL);
+    lockstat_mutex_init(&lock, "CmdProcessWork::lock", NULL);
 
     workq->StartWork(true);
 
@@ -58,7 +67,7 @@ CmdProcessWork::~CmdProcessWork()
     while ((temp = PopCmdQueue()))
         free(temp);
 
-    pthread_mutex_destroy(&lock);
+    lockstat_mutex_destroy(&lock);
 
     omx_verboseLog("command process workqueue stopped\n");
 }
@@ -67,15 +76,15 @@ OMX_ERRORTYPE CmdProcessWork::PushCmdQueue(struct cmd_s *cmd)
 {
     int ret;
 
-    pthread_mutex_lock(&lock);
+    lockstat_mutex_lock(&lock);
     ret = queue_push_tail(&q, cmd);
     if (ret) {
-        pthread_mutex_unlock(&lock);
+        lockstat_mutex_unlock(&lock);
         return OMX_ErrorInsufficientResources;
     }
 
     workq->ScheduleWork(this);
-    pthread_mutex_unlock(&lock);
+    lockstat_mutex_unlock(&lock);
 
     return OMX_ErrorNone;
 }
@@ -84,26 +93,236 @@ struct cmd_s *CmdProcessWork::PopCmdQueue(void)
 {
     struct cmd_s *cmd;
 
-    pthread_mutex_lock(&lock);
+    lockstat_mutex_lock(&lock);
     cmd = (struct cmd_s *)queue_pop_head(&q);
-    pthread_mutex_unlock(&lock);
+    lockstat_mutex_unlock(&lock);
 
     return cmd;
 }
 
+void CmdProcessWork::SetPriority(work_priority_t priority)
+{
+    workq->SetPriority(priority);
+}
+
+WorkQueue *CmdProcessWork::GetWorkQueue(void)
+{
+    return workq;
+}
+
+/* scheduling is coalesced, handle all the commands queued so far */
 void CmdProcessWork::Work(void)
 {
     struct cmd_s *cmd;
 
-    cmd = PopCmdQueue();
-    if (cmd) {
+    while ((cmd = PopCmdQueue())) {
+        /*
+         * a command waits for the buffer work to flush, pause or stop, for
+         * the tunneled peers' buffers, and in ProcessorDeinit() and so on,
+         * don't hold up the shared executor meanwhile
+         */
+        Executor::BeginBlocking();
         ci->CmdHandler(cmd);
+        Executor::EndBlocking();
         free(cmd);
     }
 }
 
 /* end of CmdProcessWork */
 
+/*
+ * CallbackDispatchWork
+ */
+CallbackDispatchWork::CallbackDispatchWork(const OMX_CALLBACKTYPE *callbacks,
+                                           const struct thread_attr *attr,
+                                           bool shared)
+{
+    pending = NULL;
+    nr_pending = 0;
+    nr_pending_alloc = 0;
+    batch = NULL;
+    nr_batch_alloc = 0;
+    scheduled = false;
+    lockstat_mutex_init(&lock, "CallbackDispatchWork::lock", NULL);
+
+    SetCallbacks(callbacks);
+
+    workq = new WorkQueue(shared);
+    if (attr)
+        workq->SetAttributes(attr);
+    workq->StartWork(true);
+
+    omx_verboseLog("callback dispatch workqueue started\n");
+}
+
+CallbackDispatchWork::~CallbackDispatchWork()
+{
+    workq->StopWork();
+    delete workq;
+
+    /* nobody pushes any more, deliver the rest here */
+    Deliver(pending, nr_pending, &callbacks);
+
+    free(pending);
+    free(batch);
+    lockstat_mutex_destroy(&lock);
+
+    omx_verboseLog("callback dispatch workqueue stopped\n");
+}
+
+bool CallbackDispatchWork::IsEnabled(void)
+{
+    const char *env = getenv("OMXIL_ASYNC_CALLBACKS");
+
+    return env && atoi(env) > 0;
+}
+
+void CallbackDispatchWork::SetCallbacks(const OMX_CALLBACKTYPE *callbacks)
+{
+    lockstat_mutex_lock(&lock);
+    this->callbacks.EventHandler = callbacks->EventHandler;
+    this->callbacks.EmptyBufferDone = callbacks->EmptyBufferDone;
+    this->callbacks.FillBufferDone = callbacks->FillBufferDone;
+    lockstat_mutex_unlock(&lock);
+}
+
+void CallbackDispatchWork::SetPriority(work_priority_t priority)
+{
+    workq->SetPriority(priority);
+}
+
+WorkQueue *CallbackDispatchWork::GetWorkQueue(void)
+{
+    return workq;
+}
+
+OMX_ERRORTYPE CallbackDispatchWork::PushEvent(OMX_HANDLETYPE hComponent,
+                                              OMX_PTR pAppData,
+                                              OMX_EVENTTYPE eEvent,
+                                              OMX_U32 nData1,
+                                              OMX_U32 nData2,
+                                              OMX_PTR pEventData)
+{
+    struct callback_s callback;
+
+    callback.hComponent = hComponent;
+    callback.pAppData = pAppData;
+    callback.pBuffer = NULL;
+    callback.direction = OMX_DirMax;
+    callback.eEvent = eEvent;
+    callback.nData1 = nData1;
+    callback.nData2 = nData2;
+    callback.pEventData = pEventData;
+
+    return Push(&callback);
+}
+
+OMX_ERRORTYPE CallbackDispatchWork::PushBufferDone(OMX_HANDLETYPE hComponent,
+                                                   OMX_PTR pAppData,
+                                                   OMX_DIRTYPE direction,
+                                                   OMX_BUFFERHEADERTYPE *pBuffer)
+{
+    struct callback_s callback;
+
+    callback.hComponent = hComponent;
+    callback.pAppData = pAppData;
+    callback.pBuffer = pBuffer;
+    callback.direction = direction;
+    callback.eEvent = OMX_EventMax;
+    callback.nData1 = 0;
+    callback.nData2 = 0;
+    callback.pEventData = NULL;
+
+    return Push(&callback);
+}
+
+OMX_ERRORTYPE CallbackDispatchWork::Push(const struct callback_s *callback)
+{
+    lockstat_mutex_lock(&lock);
+
+    if (nr_pending == nr_pending_alloc) {
+        OMX_U32 nr_alloc = nr_pending_alloc ? nr_pending_alloc * 2 : 16;
+        struct callback_s *temp;
+
+        temp = (struct callback_s *)
+            realloc(pending, sizeof(*pending) * nr_alloc);
+        if (!temp) {
+            lockstat_mutex_unlock(&lock);
+            omx_errorLog("cannot queue callback, out of memory\n");
+            return OMX_ErrorInsufficientResources;
+        }
+        pending = temp;
+        nr_pending_alloc = nr_alloc;
+    }
+
+    pending[nr_pending++] = *callback;
+
+    /* Work() takes everything pushed until it returns */
+    if (!scheduled) {
+        scheduled = true;
+        workq->ScheduleWork(this);
+    }
+
+    lockstat_mutex_unlock(&lock);
+
+    return OMX_ErrorNone;
+}
+
+void CallbackDispatchWork::Deliver(const struct callback_s *callbacks,
+                                   OMX_U32 nr_callbacks,
+                                   const OMX_CALLBACKTYPE *client)
+{
+    OMX_U32 i;
+
+    /* the client may take its time, don't hold up the shared executor */
+    Executor::BeginBlocking();
+
+    for (i = 0; i < nr_callbacks; i++) {
+        const struct callback_s *c = &callbacks[i];
+
+        if (!c->pBuffer)
+            client->EventHandler(c->hComponent, c->pAppData, c->eEvent,
+                                 c->nData1, c->nData2, c->pEventData);
+        else if (c->direction == OMX_DirInput)
+            client->EmptyBufferDone(c->hComponent, c->pAppData, c->pBuffer);
+        else
+            client->FillBufferDone(c->hComponent, c->pAppData, c->pBuffer);
+    }
+
+    Executor::EndBlocking();
+}
+
+void CallbackDispatchWork::Work(void)
+{
+    OMX_CALLBACKTYPE client;
+    struct callback_s *temp;
+    OMX_U32 nr_callbacks, nr_alloc;
+
+    lockstat_mutex_lock(&lock);
+    while (nr_pending) {
+        /* take the pending batch, give back the delivered one */
+        temp = batch;
+        batch = pending;
+        pending = temp;
+        nr_alloc = nr_batch_alloc;
+        nr_batch_alloc = nr_pending_alloc;
+        nr_pending_alloc = nr_alloc;
+
+        nr_callbacks = nr_pending;
+        nr_pending = 0;
+        client = callbacks;
+        lockstat_mutex_unlock(&lock);
+
+        Deliver(batch, nr_callbacks, &client);
+
+        lockstat_mutex_lock(&lock);
+    }
+    scheduled = false;
+    lockstat_mutex_unlock(&lock);
+}
+
+/* end of CallbackDispatchWork */
+
 /*
  * ComponentBase
  */
@@ -131,7 +350,24 @@ void ComponentBase::__ComponentBase(void)
 
     bufferwork = NULL;
 
-    pthread_mutex_init(&ports_block, NULL);
+    required_port_masks = NULL;
+    nr_required_port_masks = 0;
+    processor_batch_size = 1;
+    work_buffers = NULL;
+    work_retain = NULL;
+
+    callbackwork = NULL;
+
+    work_priority = WORK_PRIORITY_NORMAL;
+    timestamp_deadline = false;
+    blocking_processor = false;
+    deadline_anchored = false;
+    deadline_anchor_ts = 0;
+    deadline_anchor_time = 0;
+    lockstat_mutex_init(&deadline_lock, "ComponentBase::deadline_lock",
+                        name);
+
+    lockstat_mutex_init(&ports_block, "ComponentBase::ports_block", name);
 }
 
 ComponentBase::ComponentBase()
@@ -147,7 +383,10 @@ ComponentBase::ComponentBase(const OMX_STRING name)
 
 ComponentBase::~ComponentBase()
 {
-    pthread_mutex_destroy(&ports_block);
+    lockstat_mutex_destroy(&deadline_lock);
+    lockstat_mutex_destroy(&ports_block);
+
+    free(required_port_masks);
 
     if (roles) {
         if (roles[0])
@@ -234,6 +473,8 @@ OMX_ERRORTYPE ComponentBase::GetHandle(OMX_HANDLETYPE *pHandle,
 {
     OMX_U32 i;
     OMX_ERRORTYPE ret;
+    struct thread_attr attr;
+    bool placed;
 
     if (!pHandle)
         return OMX_ErrorBadParameter;
@@ -241,15 +482,21 @@ OMX_ERRORTYPE ComponentBase::GetHandle(OMX_HANDLETYPE *pHandle,
     if (handle)
         return OMX_ErrorUndefined;
 
-    cmdwork = new CmdProcessWork(this);
+    /* a role matched by a placement rule needs a thread to place */
+    placed = GetThreadPlacement(OMX_IntelThreadRoleCommand, &attr);
+    cmdwork = new CmdProcessWork(this, &attr, !placed);
     if (!cmdwork)
         return OMX_ErrorInsufficientResources;
+    CheckThreadPlacement(OMX_IntelThreadRoleCommand, placed);
 
-    bufferwork = new WorkQueue();
+    placed = GetThreadPlacement(OMX_IntelThreadRoleBuffer, &attr);
+    bufferwork = new WorkQueue(!(blocking_processor || placed));
     if (!bufferwork) {
         ret = OMX_ErrorInsufficientResources;
         goto free_cmdwork;
     }
+    bufferwork->SetAttributes(&attr);
+    CheckThreadPlacement(OMX_IntelThreadRoleBuffer, placed);
 
     handle = (OMX_COMPONENTTYPE *)calloc(1, sizeof(*handle));
     if (!handle) {
@@ -282,10 +529,21 @@ OMX_ERRORTYPE ComponentBase::GetHandle(OMX_HANDLETYPE *pHandle,
     handle->UseEGLImage = UseEGLImage;
     handle->ComponentRoleEnum = ComponentRoleEnum;
 
+    if (CallbackDispatchWork::IsEnabled()) {
+        placed = GetThreadPlacement(OMX_IntelThreadRoleCallback, &attr);
+        callbackwork = new CallbackDispatchWork(pCallBacks, &attr, !placed);
+        if (!callbackwork) {
+            ret = OMX_ErrorInsufficientResources;
+            goto free_handle;
+        }
+        CheckThreadPlacement(OMX_IntelThreadRoleCallback, placed);
+    }
+
     appdata = pAppData;
-    callbacks.EventHandler=pCallBacks->EventHandler;
-    callbacks.EmptyBufferDone=pCallBacks->EmptyBufferDone;
-    callbacks.FillBufferDone=pCallBacks->FillBufferDone;
+    SetClientCallbacks(pCallBacks);
+
+    /* set by the derived class before the works're created */
+    SetWorkPriority(work_priority, timestamp_deadline);
 
     if (nr_roles == 1) {
         SetWorkingRole((OMX_STRING)&roles[0][0]);
@@ -301,7 +559,11 @@ OMX_ERRORTYPE ComponentBase::GetHandle(OMX_HANDLETYPE *pHandle,
     return OMX_ErrorNone;
 
 free_handle:
+    delete callbackwork;
+    callbackwork = NULL;
+
     free(handle);
+    handle = NULL;
 
     appdata = NULL;
     *pHandle = NULL;
@@ -327,12 +589,18 @@ OMX_ERRORTYPE ComponentBase::FreeHandle(OMX_HANDLETYPE hComponent)
 
     FreePorts();
 
+    /* delivers completions still queued, before the handle goes away */
+    delete callbackwork;
+    callbackwork = NULL;
+
     free(handle);
 
     appdata = NULL;
 
     delete cmdwork;
+    cmdwork = NULL;
     delete bufferwork;
+    bufferwork = NULL;
 
     state = OMX_StateUnloaded;
     return OMX_ErrorNone;
@@ -498,7 +766,7 @@ OMX_ERRORTYPE ComponentBase::CBaseGetParameter(
     if (hComponent != handle)
         return OMX_ErrorBadParameter;
 
-    switch (nParamIndex) {
+    switch ((OMX_U32)nParamIndex) {
     case OMX_IndexParamAudioInit:
     case OMX_IndexParamVideoInit:
     case OMX_IndexParamImageInit:
@@ -532,13 +800,85 @@ OMX_ERRORTYPE ComponentBase::CBaseGetParameter(
         memcpy(p, port->GetPortDefinition(), sizeof(*p));
         break;
     }
-    case OMX_IndexParamCompBufferSupplier:
-        /*
-         * Todo
-         */
+    case OMX_IndexParamCompBufferSupplier: {
+        OMX_PARAM_BUFFERSUPPLIERTYPE *p =
+            (OMX_PARAM_BUFFERSUPPLIERTYPE *)pComponentParameterStructure;
+        OMX_U32 index = p->nPortIndex;
+        PortBase *port = NULL;
 
-        ret = OMX_ErrorUnsupportedIndex;
+        ret = CheckTypeHeader(p, sizeof(*p));
+        if (ret != OMX_ErrorNone)
+            return ret;
+
+        if (index < nr_ports)
+            port = ports[index];
+
+        if (!port)
+            return OMX_ErrorBadPortIndex;
+
+        p->eBufferSupplier = port->GetBufferSupplier();
         break;
+    }
+    case OMX_IndexParamIntelReconfigureInPlace: {
+        OMX_PARAM_INTEL_RECONFIGUREINPLACETYPE *p =
+            (OMX_PARAM_INTEL_RECONFIGUREINPLACETYPE *)pComponentParameterStructure;
+        OMX_U32 index = p->nPortIndex;
+        PortBase *port = NULL;
+
+        ret = CheckTypeHeader(p, sizeof(*p));
+        if (ret != OMX_ErrorNone)
+            return ret;
+
+        if (index < nr_ports)
+            port = ports[index];
+
+        if (!port)
+            return OMX_ErrorBadPortIndex;
+
+        p->bEnable = port->GetReconfigureInPlace() ? OMX_TRUE : OMX_FALSE;
+        break;
+    }
+    case OMX_IndexParamIntelShareableBuffers: {
+        OMX_PARAM_INTEL_SHAREABLEBUFFERSTYPE *p =
+            (OMX_PARAM_INTEL_SHAREABLEBUFFERSTYPE *)pComponentParameterStructure;
+        OMX_U32 index = p->nPortIndex;
+        PortBase *port = NULL;
+        bool seal;
+
+        ret = CheckTypeHeader(p, sizeof(*p));
+        if (ret != OMX_ErrorNone)
+            return ret;
+
+        if (index < nr_ports)
+            port = ports[index];
+
+        if (!port)
+            return OMX_ErrorBadPortIndex;
+
+        p->bEnable = port->GetShareableBuffers(&seal) ? OMX_TRUE : OMX_FALSE;
+        p->bSeal = seal ? OMX_TRUE : OMX_FALSE;
+        break;
+    }
+    case OMX_IndexParamIntelSharedBufferInfo: {
+        OMX_PARAM_INTEL_SHAREDBUFFERINFOTYPE *p =
+            (OMX_PARAM_INTEL_SHAREDBUFFERINFOTYPE *)pComponentParameterStructure;
+        OMX_U32 index = p->nPortIndex;
+        PortBase *port = NULL;
+
+        ret = CheckTypeHeader(p, sizeof(*p));
+        if (ret != OMX_ErrorNone)
+            return ret;
+
+        if (index < nr_ports)
+            port = ports[index];
+
+        if (!port)
+            return OMX_ErrorBadPortIndex;
+
+        ret = port->GetSharedBufferInfo(p->pBufferHeader, &p->nFd,
+                                        &p->nOffset, &p->nLength);
+        break;
+    }
     default:
         ret = ComponentGetParameter(nParamIndex, pComponentParameterStructure);
     } /* switch */
@@ -575,7 +915,7 @@ OMX_ERRORTYPE ComponentBase::CBaseSetParameter(
     if (hComponent != handle)
         return OMX_ErrorBadParameter;
 
-    switch (nIndex) {
+    switch ((OMX_U32)nIndex) {
     case OMX_IndexParamAudioInit:
     case OMX_IndexParamVideoInit:
     case OMX_IndexParamImageInit:
@@ -607,13 +947,90 @@ OMX_ERRORTYPE ComponentBase::CBaseSetParameter(
         port->SetPortDefinition(p, false);
         break;
     }
-    case OMX_IndexParamCompBufferSupplier:
-        /*
-         * Todo
-         */
+    case OMX_IndexParamCompBufferSupplier: {
+        OMX_PARAM_BUFFERSUPPLIERTYPE *p =
+            (OMX_PARAM_BUFFERSUPPLIERTYPE *)pComponentParameterStructure;
+        OMX_U32 index = p->nPortIndex;
+        PortBase *port = NULL;
 
-        ret = OMX_ErrorUnsupportedIndex;
+        ret = CheckTypeHeader(p, sizeof(*p));
+        if (ret != OMX_ErrorNone)
+            return ret;
+
+        if (index < nr_ports)
+            port = ports[index];
+
+        if (!port)
+            return OMX_ErrorBadPortIndex;
+
+        if (port->IsEnabled()) {
+            if (state != OMX_StateLoaded && state != OMX_StateWaitForResources)
+                return OMX_ErrorIncorrectStateOperation;
+        }
+
+        if (p->eBufferSupplier == port->GetBufferSupplier())
+            break;
+
+        /* a tunneled input port tells the output port the new supplier */
+        if (port->GetTunnelPeer() &&
+            port->GetPortDirection() == OMX_DirInput) {
+            OMX_PARAM_BUFFERSUPPLIERTYPE peer;
+
+            memcpy(&peer, p, sizeof(peer));
+            peer.nPortIndex = port->GetTunnelPort();
+            ret = OMX_SetParameter(port->GetTunnelPeer(),
+                                   OMX_IndexParamCompBufferSupplier, &peer);
+            if (ret != OMX_ErrorNone)
+                return ret;
+        }
+
+        port->SetBufferSupplier(p->eBufferSupplier);
+        break;
+    }
+    case OMX_IndexParamIntelReconfigureInPlace: {
+        OMX_PARAM_INTEL_RECONFIGUREINPLACETYPE *p =
+            (OMX_PARAM_INTEL_RECONFIGUREINPLACETYPE *)pComponentParameterStructure;
+        OMX_U32 index = p->nPortIndex;
+        PortBase *port = NULL;
+
+        ret = CheckTypeHeader(p, sizeof(*p));
+        if (ret != OMX_ErrorNone)
+            return ret;
+
+        if (index < nr_ports)
+            port = ports[index];
+
+        if (!port)
+            return OMX_ErrorBadPortIndex;
+
+        port->SetReconfigureInPlace(p->bEnable ? true : false);
         break;
+    }
+    case OMX_IndexParamIntelShareableBuffers: {
+        OMX_PARAM_INTEL_SHAREABLEBUFFERSTYPE *p =
+            (OMX_PARAM_INTEL_SHAREABLEBUFFERSTYPE *)pComponentParameterStructure;
+        OMX_U32 index = p->nPortIndex;
+        PortBase *port = NULL;
+
+        ret = CheckTypeHeader(p, sizeof(*p));
+        if (ret != OMX_ErrorNone)
+            return ret;
+
+        if (index < nr_ports)
+            port = ports[index];
+
+        if (!port)
+            return OMX_ErrorBadPortIndex;
+
+        if (port->IsEnabled()) {
+            if (state != OMX_StateLoaded && state != OMX_StateWaitForResources)
+                return OMX_ErrorIncorrectStateOperation;
+        }
+
+        ret = port->SetShareableBuffers(p->bEnable ? true : false,
+                                        p->bSeal ? true : false);
+        break;
+    }
     case OMX_IndexParamStandardComponentRole: {
         OMX_PARAM_COMPONENTROLETYPE *p =
             (OMX_PARAM_COMPONENTROLETYPE *)pComponentParameterStructure;
@@ -675,7 +1092,27 @@ OMX_ERRORTYPE ComponentBase::CBaseGetConfig(
     if (hComponent != handle)
         return OMX_ErrorBadParameter;
 
-    switch (nIndex) {
+    switch ((OMX_U32)nIndex) {
+    case OMX_IndexConfigIntelWorkPriority: {
+        OMX_CONFIG_INTEL_WORKPRIORITYTYPE *p =
+            (OMX_CONFIG_INTEL_WORKPRIORITYTYPE *)pComponentConfigStructure;
+
+        ret = CheckTypeHeader(p, sizeof(*p));
+        if (ret != OMX_ErrorNone)
+            return ret;
+
+        p->ePriority = (OMX_INTEL_WORKPRIORITYTYPE)work_priority;
+        p->bTimestampDeadline = timestamp_deadline ? OMX_TRUE : OMX_FALSE;
+        break;
+    }
+    case OMX_IndexConfigIntelThreadPlacement:
+        ret = GetThreadPlacementConfig(
+            (OMX_CONFIG_INTEL_THREADPLACEMENTTYPE *)pComponentConfigStructure);
+        break;
+    case OMX_IndexConfigIntelPortLatency:
+        ret = GetPortLatencyConfig(
+            (OMX_CONFIG_INTEL_PORTLATENCYTYPE *)pComponentConfigStructure);
+        break;
     default:
         ret = ComponentGetConfig(nIndex, pComponentConfigStructure);
     }
@@ -712,7 +1149,44 @@ OMX_ERRORTYPE ComponentBase::CBaseSetConfig(
     if (hComponent != handle)
         return OMX_ErrorBadParameter;
 
-    switch (nIndex) {
+    switch ((OMX_U32)nIndex) {
+    case OMX_IndexConfigIntelSubmitBuffers:
+        ret = SubmitBuffers(
+            (OMX_CONFIG_INTEL_SUBMITBUFFERSTYPE *)pComponentConfigStructure);
+        break;
+    case OMX_IndexConfigIntelWorkPriority: {
+        OMX_CONFIG_INTEL_WORKPRIORITYTYPE *p =
+            (OMX_CONFIG_INTEL_WORKPRIORITYTYPE *)pComponentConfigStructure;
+
+        ret = CheckTypeHeader(p, sizeof(*p));
+        if (ret != OMX_ErrorNone)
+            return ret;
+
+        if (p->ePriority > OMX_IntelWorkPriorityRealtime)
+            return OMX_ErrorBadParameter;
+
+        SetWorkPriority((work_priority_t)p->ePriority,
+                        p->bTimestampDeadline ? true : false);
+        break;
+    }
+    case OMX_IndexConfigIntelThreadPlacement:
+        ret = SetThreadPlacementConfig(
+            (OMX_CONFIG_INTEL_THREADPLACEMENTTYPE *)pComponentConfigStructure);
+        break;
+    case OMX_IndexConfigIntelPortLatency: {
+        OMX_CONFIG_INTEL_PORTLATENCYTYPE *p =
+            (OMX_CONFIG_INTEL_PORTLATENCYTYPE *)pComponentConfigStructure;
+
+        ret = CheckTypeHeader(p, sizeof(*p));
+        if (ret != OMX_ErrorNone)
+            return ret;
+
+        if (!ports || p->nPortIndex >= nr_ports)
+            return OMX_ErrorBadPortIndex;
+
+        ports[p->nPortIndex]->ResetLatency();
+        break;
+    }
     default:
         ret = ComponentSetConfig(nIndex, pComponentConfigStructure);
     }
@@ -822,11 +1296,89 @@ OMX_ERRORTYPE ComponentBase::CBaseComponentTunnelRequest(
     OMX_IN  OMX_U32 nTunneledPort,
     OMX_INOUT  OMX_TUNNELSETUPTYPE* pTunnelSetup)
 {
+    PortBase *port = NULL;
+    OMX_PARAM_PORTDEFINITIONTYPE peerdef;
+    OMX_PARAM_BUFFERSUPPLIERTYPE supplier;
+    const OMX_PARAM_PORTDEFINITIONTYPE *portdefinition;
+    OMX_ERRORTYPE ret;
+
+    if (hComp != handle)
+        return OMX_ErrorBadParameter;
+
+    if (ports)
+        if (nPort < nr_ports)
+            port = ports[nPort];
+
+    if (!port)
+        return OMX_ErrorBadPortIndex;
+
+    if (port->IsEnabled()) {
+        if (state != OMX_StateLoaded && state != OMX_StateWaitForResources)
+            return OMX_ErrorIncorrectStateOperation;
+    }
+
+    /* tear down */
+    if (!hTunneledComp) {
+        port->SetTunnel(NULL, 0);
+        omx_verboseLog("%s:%s: port %lu untunneled\n",
+             GetName(), GetWorkingRole(), nPort);
+        return OMX_ErrorNone;
+    }
+
+    if (!pTunnelSetup)
+        return OMX_ErrorBadParameter;
+
+    portdefinition = port->GetPortDefinition();
+
     /*
-     * Todo
+     * OMX_SetupTunnel() calls the output port first, it tells its supplier
+     * preference, then the input port makes the decision and tells it to
+     * the output port.
      */
+    if (portdefinition->eDir == OMX_DirOutput) {
+        pTunnelSetup->nTunnelFlags = 0;
+        pTunnelSetup->eSupplier = port->GetBufferSupplier();
+        port->SetTunnel(hTunneledComp, nTunneledPort);
+        port->SetBufferSupplier(pTunnelSetup->eSupplier);
+        goto done;
+    }
+
+    SetTypeHeader(&peerdef, sizeof(peerdef));
+    peerdef.nPortIndex = nTunneledPort;
+    ret = OMX_GetParameter(hTunneledComp, OMX_IndexParamPortDefinition,
+                           &peerdef);
+    if (ret != OMX_ErrorNone)
+        return OMX_ErrorPortsNotCompatible;
+
+    if (peerdef.eDir != OMX_DirOutput ||
+        peerdef.eDomain != portdefinition->eDomain) {
+        omx_errorLog("%s:%s: port %lu is not compatible with tunneled "
+             "port %lu\n", GetName(), GetWorkingRole(), nPort, nTunneledPort);
+        return OMX_ErrorPortsNotCompatible;
+    }
+
+    /* input's preference wins, the output port supplies if none */
+    if (port->GetBufferSupplier() != OMX_BufferSupplyUnspecified)
+        pTunnelSetup->eSupplier = port->GetBufferSupplier();
+    else if (pTunnelSetup->eSupplier == OMX_BufferSupplyUnspecified)
+        pTunnelSetup->eSupplier = OMX_BufferSupplyOutput;
+
+    SetTypeHeader(&supplier, sizeof(supplier));
+    supplier.nPortIndex = nTunneledPort;
+    supplier.eBufferSupplier = pTunnelSetup->eSupplier;
+    ret = OMX_SetParameter(hTunneledComp, OMX_IndexParamCompBufferSupplier,
+                           &supplier);
+    if (ret != OMX_ErrorNone)
+        return OMX_ErrorPortsNotCompatible;
 
-    return OMX_ErrorNotImplemented;
+    port->SetTunnel(hTunneledComp, nTunneledPort);
+    port->SetBufferSupplier(pTunnelSetup->eSupplier);
+
+done:
+    omx_verboseLog("%s:%s: port %lu tunneled to port %lu, %s supplies buffers\n",
+         GetName(), GetWorkingRole(), nPort, nTunneledPort,
+         port->IsBufferSupplier() ? "this port" : "tunneled port");
+    return OMX_ErrorNone;
 }
 
 OMX_ERRORTYPE ComponentBase::UseBuffer(
@@ -1008,51 +1560,22 @@ OMX_ERRORTYPE ComponentBase::CBaseEmptyThisBuffer(
     OMX_IN  OMX_HANDLETYPE hComponent,
     OMX_IN  OMX_BUFFERHEADERTYPE *pBuffer)
 {
-    PortBase *port = NULL;
-    OMX_U32 port_index;
+    PortBase *port;
+    unsigned long long deadline;
     OMX_ERRORTYPE ret;
 
     if ((hComponent != handle) || !pBuffer)
         return OMX_ErrorBadParameter;
 
-    ret = CheckTypeHeader(pBuffer, sizeof(OMX_BUFFERHEADERTYPE));
+    ret = CheckThisBuffer(pBuffer, true, &port);
     if (ret != OMX_ErrorNone)
         return ret;
 
-    port_index = pBuffer->nInputPortIndex;
-    if (port_index == (OMX_U32)-1)
-        return OMX_ErrorBadParameter;
-
-    if (ports)
-        if (port_index < nr_ports)
-            port = ports[port_index];
-
-    if (!port)
-        return OMX_ErrorBadParameter;
-
-    if (pBuffer->pInputPortPrivate != port)
-        return OMX_ErrorBadParameter;
-
-    if (port->IsEnabled()) {
-        if (state != OMX_StateIdle && state != OMX_StateExecuting &&
-            state != OMX_StatePause)
-            return OMX_ErrorIncorrectStateOperation;
-    }
-
-    if (!pBuffer->hMarkTargetComponent) {
-        OMX_MARKTYPE *mark;
-
-        mark = port->PopMark();
-        if (mark) {
-            pBuffer->hMarkTargetComponent = mark->hMarkTargetComponent;
-            pBuffer->pMarkData = mark->pMarkData;
-            free(mark);
-        }
-    }
-
-    ret = port->PushThisBuffer(pBuffer);
+    /* once queued, the buffer may be returned and freed at any time */
+    deadline = BufferDeadline(pBuffer);
+    ret = QueueThisBuffer(pBuffer, true, port);
     if (ret == OMX_ErrorNone)
-        bufferwork->ScheduleWork(this);
+        bufferwork->ScheduleWork(this, deadline);
 
     return ret;
 }
@@ -1078,42 +1601,189 @@ OMX_ERRORTYPE ComponentBase::CBaseFillThisBuffer(
     OMX_IN  OMX_HANDLETYPE hComponent,
     OMX_IN  OMX_BUFFERHEADERTYPE *pBuffer)
 {
-    PortBase *port = NULL;
-    OMX_U32 port_index;
+    PortBase *port;
     OMX_ERRORTYPE ret;
 
     if ((hComponent != handle) || !pBuffer)
         return OMX_ErrorBadParameter;
 
+    ret = CheckThisBuffer(pBuffer, false, &port);
+    if (ret != OMX_ErrorNone)
+        return ret;
+
+    ret = QueueThisBuffer(pBuffer, false, port);
+    if (ret == OMX_ErrorNone)
+        bufferwork->ScheduleWork(this);
+
+    return ret;
+}
+
+OMX_ERRORTYPE ComponentBase::CheckThisBuffer(OMX_BUFFERHEADERTYPE *pBuffer,
+                                             bool input, PortBase **port)
+{
+    PortBase *p = NULL;
+    OMX_U32 port_index;
+    OMX_ERRORTYPE ret;
+
     ret = CheckTypeHeader(pBuffer, sizeof(OMX_BUFFERHEADERTYPE));
     if (ret != OMX_ErrorNone)
         return ret;
 
-    port_index = pBuffer->nOutputPortIndex;
+    if (input)
+        port_index = pBuffer->nInputPortIndex;
+    else
+        port_index = pBuffer->nOutputPortIndex;
     if (port_index == (OMX_U32)-1)
         return OMX_ErrorBadParameter;
 
     if (ports)
         if (port_index < nr_ports)
-            port = ports[port_index];
+            p = ports[port_index];
+
+    if (!p)
+        return OMX_ErrorBadParameter;
+
+    if (input && pBuffer->pInputPortPrivate != p)
+        return OMX_ErrorBadParameter;
+
+    if (p->IsEnabled()) {
+        if (state != OMX_StateIdle && state != OMX_StateExecuting &&
+            state != OMX_StatePause)
+            return OMX_ErrorIncorrectStateOperation;
+    }
+
+    *port = p;
+    return OMX_ErrorNone;
+}
+
+bool ComponentBase::IsInputBuffer(const OMX_BUFFERHEADERTYPE *pBuffer)
+{
+    OMX_U32 port_index = pBuffer->nInputPortIndex;
+
+    return ports && port_index < nr_ports &&
+        pBuffer->pInputPortPrivate == ports[port_index];
+}
+
+OMX_ERRORTYPE ComponentBase::QueueThisBuffer(OMX_BUFFERHEADERTYPE *pBuffer,
+                                             bool input, PortBase *port)
+{
+    if (input) {
+        if (!pBuffer->hMarkTargetComponent) {
+            OMX_MARKTYPE *mark;
+
+            mark = port->PopMark();
+            if (mark) {
+                pBuffer->hMarkTargetComponent = mark->hMarkTargetComponent;
+                pBuffer->pMarkData = mark->pMarkData;
+                free(mark);
+            }
+        }
+    }
+    else {
+        omx_verboseLog("CBaseFillThisBuffer , sending %p", pBuffer->pBuffer);
+        ProcessorPreFillBuffer(pBuffer);
+    }
+
+    if (PortBase::IsLatencyEnabled())
+        port->StampQueued(pBuffer, WorkQueue::Now());
+
+    return port->PushThisBuffer(pBuffer);
+}
+
+/*
+ * all headers are checked before any is pushed, so a bad header rejects
+ * the whole batch. if pushing fails midway, the headers before the failed
+ * one are already queued and counted in nSubmitted.
+ */
+OMX_ERRORTYPE ComponentBase::SubmitBuffers(
+    OMX_CONFIG_INTEL_SUBMITBUFFERSTYPE *p)
+{
+    OMX_BUFFERHEADERTYPE *pBuffer;
+    PortBase *port;
+    unsigned long long deadline = 0, d;
+    OMX_U32 i;
+    OMX_ERRORTYPE ret;
+
+    ret = CheckTypeHeader(p, sizeof(*p));
+    if (ret != OMX_ErrorNone)
+        return ret;
+
+    p->nSubmitted = 0;
+    if (!p->nBuffers)
+        return OMX_ErrorNone;
+    if (!p->ppBuffers || !ports)
+        return OMX_ErrorBadParameter;
+
+    for (i = 0; i < p->nBuffers; i++) {
+        pBuffer = p->ppBuffers[i];
+        if (!pBuffer)
+            return OMX_ErrorBadParameter;
+
+        ret = CheckThisBuffer(pBuffer, IsInputBuffer(pBuffer), &port);
+        if (ret != OMX_ErrorNone)
+            return ret;
+    }
+
+    for (i = 0; i < p->nBuffers; i++) {
+        bool input;
+
+        pBuffer = p->ppBuffers[i];
+        input = IsInputBuffer(pBuffer);
+        if (input)
+            port = ports[pBuffer->nInputPortIndex];
+        else
+            port = ports[pBuffer->nOutputPortIndex];
+
+        /* once queued, the buffer may be returned and freed at any time */
+        d = input ? BufferDeadline(pBuffer) : 0;
+
+        ret = QueueThisBuffer(pBuffer, input, port);
+        if (ret != OMX_ErrorNone)
+            break;
+        p->nSubmitted++;
+
+        if (d && (!deadline || d < deadline))
+            deadline = d;
+    }
+
+    if (p->nSubmitted)
+        bufferwork->ScheduleWork(this, deadline);
+
+    return ret;
+}
+
+unsigned long long ComponentBase::BufferDeadline(
+    const OMX_BUFFERHEADERTYPE *pBuffer)
+{
+    unsigned long long now, deadline;
+    OMX_TICKS delta;
 
-    if (!port)
-        return OMX_ErrorBadParameter;
+    if (!timestamp_deadline)
+        return 0;
 
-    if (port->IsEnabled()) {
-        if (state != OMX_StateIdle && state != OMX_StateExecuting &&
-            state != OMX_StatePause)
-            return OMX_ErrorIncorrectStateOperation;
-    }
+    now = WorkQueue::Now();
 
-    omx_verboseLog("CBaseFillThisBuffer , sending %p", pBuffer->pBuffer);
-    ProcessorPreFillBuffer(pBuffer);
+    lockstat_mutex_lock(&deadline_lock);
+    if (!deadline_anchored) {
+        deadline_anchored = true;
+        deadline_anchor_ts = pBuffer->nTimeStamp;
+        deadline_anchor_time = now;
+    }
+    /* nTimeStamp is in usec, earlier than the first one is due at once */
+    delta = pBuffer->nTimeStamp - deadline_anchor_ts;
+    deadline = deadline_anchor_time;
+    if (delta > 0)
+        deadline += (unsigned long long)delta * 1000;
+    lockstat_mutex_unlock(&deadline_lock);
 
-    ret = port->PushThisBuffer(pBuffer);
-    if (ret == OMX_ErrorNone)
-        bufferwork->ScheduleWork(this);
+    return deadline;
+}
 
-    return ret;
+void ComponentBase::ResetBufferDeadline(void)
+{
+    lockstat_mutex_lock(&deadline_lock);
+    deadline_anchored = false;
+    lockstat_mutex_unlock(&deadline_lock);
 }
 
 OMX_ERRORTYPE ComponentBase::SetCallbacks(
@@ -1143,12 +1813,65 @@ OMX_ERRORTYPE ComponentBase::CBaseSetCallbacks(
         return OMX_ErrorBadParameter;
 
     appdata = pAppData;
+    SetClientCallbacks(pCallbacks);
+
+
+    return OMX_ErrorNone;
+}
+
+void ComponentBase::SetClientCallbacks(const OMX_CALLBACKTYPE *pCallbacks)
+{
+    if (callbackwork) {
+        callbackwork->SetCallbacks(pCallbacks);
+
+        callbacks.EventHandler = DispatchEventHandler;
+        callbacks.EmptyBufferDone = DispatchEmptyBufferDone;
+        callbacks.FillBufferDone = DispatchFillBufferDone;
+        return;
+    }
+
     callbacks.EventHandler=pCallbacks->EventHandler;
     callbacks.EmptyBufferDone=pCallbacks->EmptyBufferDone;
     callbacks.FillBufferDone=pCallbacks->FillBufferDone;
+}
 
+OMX_ERRORTYPE ComponentBase::DispatchEventHandler(
+    OMX_IN OMX_HANDLETYPE hComponent,
+    OMX_IN OMX_PTR pAppData,
+    OMX_IN OMX_EVENTTYPE eEvent,
+    OMX_IN OMX_U32 nData1,
+    OMX_IN OMX_U32 nData2,
+    OMX_IN OMX_PTR pEventData)
+{
+    ComponentBase *cbase = static_cast<ComponentBase *>
+        (((OMX_COMPONENTTYPE *)hComponent)->pComponentPrivate);
 
-    return OMX_ErrorNone;
+    return cbase->callbackwork->PushEvent(hComponent, pAppData, eEvent,
+                                          nData1, nData2, pEventData);
+}
+
+OMX_ERRORTYPE ComponentBase::DispatchEmptyBufferDone(
+    OMX_IN OMX_HANDLETYPE hComponent,
+    OMX_IN OMX_PTR pAppData,
+    OMX_IN OMX_BUFFERHEADERTYPE* pBuffer)
+{
+    ComponentBase *cbase = static_cast<ComponentBase *>
+        (((OMX_COMPONENTTYPE *)hComponent)->pComponentPrivate);
+
+    return cbase->callbackwork->PushBufferDone(hComponent, pAppData,
+                                               OMX_DirInput, pBuffer);
+}
+
+OMX_ERRORTYPE ComponentBase::DispatchFillBufferDone(
+    OMX_IN OMX_HANDLETYPE hComponent,
+    OMX_IN OMX_PTR pAppData,
+    OMX_IN OMX_BUFFERHEADERTYPE* pBuffer)
+{
+    ComponentBase *cbase = static_cast<ComponentBase *>
+        (((OMX_COMPONENTTYPE *)hComponent)->pComponentPrivate);
+
+    return cbase->callbackwork->PushBufferDone(hComponent, pAppData,
+                                               OMX_DirOutput, pBuffer);
 }
 
 OMX_ERRORTYPE ComponentBase::ComponentDeInit(
@@ -1266,6 +1989,8 @@ static inline const char *GetCmdName(OMX_COMMANDTYPE cmd)
 
 void ComponentBase::CmdHandler(struct cmd_s *cmd)
 {
+    unsigned long long start = TRACE_START();
+
     omx_verboseLog("%s:%s: handling %s command\n",
          GetName(), GetWorkingRole(), GetCmdName(cmd->cmd));
 
@@ -1280,9 +2005,9 @@ void ComponentBase::CmdHandler(struct cmd_s *cmd)
         OMX_U32 port_index = cmd->param1;
         ProcessorReleaseLock();
         FlushPort(port_index, 1);
-        pthread_mutex_lock(&ports_block);
+        lockstat_mutex_lock(&ports_block);
         ProcessorFlush(port_index);
-        pthread_mutex_unlock(&ports_block);
+        lockstat_mutex_unlock(&ports_block);
         break;
     }
     case OMX_CommandPortDisable: {
@@ -1313,6 +2038,9 @@ void ComponentBase::CmdHandler(struct cmd_s *cmd)
 
     omx_verboseLog("%s:%s: command %s handling done\n",
          GetName(), GetWorkingRole(), GetCmdName(cmd->cmd));
+
+    TRACE_COMPLETE("cmd", GetCmdName(cmd->cmd), GetName(), cmd->param1,
+                   TRACE_NO_PORT, start);
 }
 
 /*
@@ -1393,6 +2121,8 @@ notify_event:
         data2 = transition;
 
         state = transition;
+        TRACE_INSTANT("state", GetStateName(transition), GetName(), current,
+                      TRACE_NO_PORT);
         omx_debugLog("%s:%s: transition from %s to %s completed",
              GetName(), GetWorkingRole(),
              GetStateName(current), GetStateName(transition));
@@ -1426,10 +2156,22 @@ inline OMX_ERRORTYPE ComponentBase::TransStateToLoaded(OMX_STATETYPE current)
     if (current == OMX_StateIdle) {
         OMX_U32 i;
 
+        /*
+         * supplied buffers're freed here, the peer waits for them.
+         * no buffer processing in idle, the peer's called without locks.
+         * the buffers queued in idle go back to the suppliers first
+         */
+        FlushPort(OMX_ALL, 0);
+        for (i = 0; i < nr_ports; i++) {
+            ret = ports[i]->FreeTunnelBuffers(true);
+            if (ret != OMX_ErrorNone)
+                goto out;
+        }
+
         for (i = 0; i < nr_ports; i++)
 	{
             if (ports[i]->GetPortBufferCount() > 0) {
-                ports[i]->WaitPortBufferCompletion();
+                ports[i]->WaitPortBufferCompletion(false);
 	    };
 	};
 
@@ -1474,9 +2216,31 @@ inline OMX_ERRORTYPE ComponentBase::TransStateToIdle(OMX_STATETYPE current)
             goto out;
         }
 
+        /*
+         * buffer supplier populates the peer port as well.
+         * no buffer processing in loaded, the peer's called without locks
+         */
+        for (i = 0; i < nr_ports; i++) {
+            if (!ports[i]->IsEnabled())
+                continue;
+
+            ret = ports[i]->AllocateTunnelBuffers();
+            if (ret != OMX_ErrorNone)
+                break;
+        }
+        if (ret != OMX_ErrorNone) {
+            while (i--)
+                ports[i]->FreeTunnelBuffers(false);
+        }
+
+        if (ret != OMX_ErrorNone) {
+            ProcessorDeinit();
+            goto out;
+        }
+
         for (i = 0; i < nr_ports; i++) {
             if (ports[i]->IsEnabled())
-                ports[i]->WaitPortBufferCompletion();
+                ports[i]->WaitPortBufferCompletion(true);
         }
     }
     else if ((current == OMX_StatePause) || (current == OMX_StateExecuting)) {
@@ -1494,8 +2258,9 @@ inline OMX_ERRORTYPE ComponentBase::TransStateToIdle(OMX_STATETYPE current)
                  GetName(), GetWorkingRole());
         }
 
-        bufferwork->StopWork();
-        omx_verboseLog("%s:%s: buffer process work stopped\n",
+        /* the thread's kept to be restarted by next Executing or Pause */
+        bufferwork->ParkWork();
+        omx_verboseLog("%s:%s: buffer process work parked\n",
              GetName(), GetWorkingRole());
 
         ret = ProcessorStop();
@@ -1527,6 +2292,7 @@ ComponentBase::TransStateToExecuting(OMX_STATETYPE current)
     OMX_ERRORTYPE ret;
 
     if (current == OMX_StateIdle) {
+        ResetBufferDeadline();
         bufferwork->StartWork(true);
         omx_verboseLog("%s:%s: buffer process work started with executing state\n",
              GetName(), GetWorkingRole());
@@ -1537,8 +2303,12 @@ ComponentBase::TransStateToExecuting(OMX_STATETYPE current)
                  GetName(), GetWorkingRole(), ret);
             goto out;
         }
+
+        PrimeTunnelPorts(0, nr_ports - 1);
     }
     else if (current == OMX_StatePause) {
+        /* the clock's gone on while paused */
+        ResetBufferDeadline();
         bufferwork->ResumeWork();
         omx_verboseLog("%s:%s: buffer process work resumed\n",
              GetName(), GetWorkingRole());
@@ -1667,6 +2437,9 @@ void ComponentBase::FlushPort(OMX_U32 port_index, bool notify)
     if ((port_index != OMX_ALL) && (port_index > nr_ports-1))
         return;
 
+    /* e.g. seek, the timestamps start over */
+    ResetBufferDeadline();
+
     if (port_index == OMX_ALL) {
         from_index = 0;
         to_index = nr_ports - 1;
@@ -1679,18 +2452,50 @@ void ComponentBase::FlushPort(OMX_U32 port_index, bool notify)
     omx_verboseLog("%s:%s: flush ports (from index %lu to %lu)\n",
          GetName(), GetWorkingRole(), from_index, to_index);
 
-    pthread_mutex_lock(&ports_block);
+    lockstat_mutex_lock(&ports_block);
     for (i = from_index; i <= to_index; i++) {
         ports[i]->FlushPort();
         if (notify)
             callbacks.EventHandler(handle, appdata, OMX_EventCmdComplete,
                                     OMX_CommandFlush, i, NULL);
     }
-    pthread_mutex_unlock(&ports_block);
+    lockstat_mutex_unlock(&ports_block);
+
+    SendTunnelPorts();
+
+    /* supplier ports keep running after flush command */
+    if (notify && (state == OMX_StateExecuting || state == OMX_StatePause))
+        PrimeTunnelPorts(from_index, to_index);
 
     omx_verboseLog("%s:%s: flush ports done\n", GetName(), GetWorkingRole());
 }
 
+void ComponentBase::PrimeTunnelPorts(OMX_U32 from_index, OMX_U32 to_index)
+{
+    OMX_U32 i;
+
+    /* queued buffers're stale, prime all the buffers at home */
+    lockstat_mutex_lock(&ports_block);
+    for (i = from_index; i <= to_index; i++) {
+        if (ports[i]->IsEnabled() && ports[i]->IsBufferSupplier())
+            ports[i]->FlushPort();
+    }
+    lockstat_mutex_unlock(&ports_block);
+
+    for (i = from_index; i <= to_index; i++) {
+        if (ports[i]->IsEnabled())
+            ports[i]->PrimeTunnelBuffers();
+    }
+}
+
+void ComponentBase::SendTunnelPorts(void)
+{
+    OMX_U32 i;
+
+    for (i = 0; i < nr_ports; i++)
+        ports[i]->SendTunnelBuffers();
+}
+
 extern const char *GetPortStateName(OMX_U8 state); //portbase.cpp
 
 void ComponentBase::TransStatePort(OMX_U32 port_index, OMX_U8 state)
@@ -1716,9 +2521,29 @@ void ComponentBase::TransStatePort(OMX_U32 port_index, OMX_U8 state)
          GetName(), GetWorkingRole(), GetPortStateName(state),
          from_index, to_index);
 
-    pthread_mutex_lock(&ports_block);
     for (i = from_index; i <= to_index; i++) {
-        ret = ports[i]->TransState(state);
+        /* the tunnel buffers're allocated and freed without locks */
+        ret = OMX_ErrorNone;
+        if (state == PortBase::OMX_PortEnabled) {
+            /* disabled, no buffer processing on it */
+            if (!ports[i]->IsEnabled())
+                ret = ports[i]->AllocateTunnelBuffers();
+        }
+        else if (ports[i]->IsEnabled()) {
+            lockstat_mutex_lock(&ports_block);
+            ports[i]->SetDisabling(true);
+            ports[i]->FlushPort();
+            lockstat_mutex_unlock(&ports_block);
+
+            ports[i]->SendTunnelBuffers();
+            ret = ports[i]->FreeTunnelBuffers(true);
+            if (ret != OMX_ErrorNone)
+                ports[i]->SetDisabling(false);
+        }
+
+        if (ret == OMX_ErrorNone)
+            ret = ports[i]->TransState(state);
+
         if (ret == OMX_ErrorNone) {
             event = OMX_EventCmdComplete;
             if (state == PortBase::OMX_PortEnabled)
@@ -1735,7 +2560,13 @@ void ComponentBase::TransStatePort(OMX_U32 port_index, OMX_U8 state)
         callbacks.EventHandler(handle, appdata, OMX_EventCmdComplete,
                                 data1, data2, NULL);
     }
-    pthread_mutex_unlock(&ports_block);
+
+    if (state == PortBase::OMX_PortEnabled &&
+        (this->state == OMX_StateExecuting || this->state == OMX_StatePause))
+        PrimeTunnelPorts(from_index, to_index);
+
+    /* buffers may have been queued while the ports were ceased */
+    bufferwork->ScheduleWork(this);
 
     omx_verboseLog("%s:%s: transit ports state to %s completed\n",
          GetName(), GetWorkingRole(), GetPortStateName(state));
@@ -1840,6 +2671,14 @@ OMX_ERRORTYPE ComponentBase::AllocatePorts(void)
     else
         goto free_ports;
 
+    work_buffers = new OMX_BUFFERHEADERTYPE *[nr_ports *
+                                              MAX_PROCESSOR_BATCH_SIZE];
+    work_retain = new buffer_retain_t[nr_ports * MAX_PROCESSOR_BATCH_SIZE];
+    if (!work_buffers || !work_retain) {
+        FreePorts();
+        return OMX_ErrorInsufficientResources;
+    }
+
     return OMX_ErrorNone;
 
 free_ports:
@@ -1869,6 +2708,11 @@ OMX_ERRORTYPE ComponentBase::FreePorts(void)
         ports = NULL;
     }
 
+    delete []work_buffers;
+    work_buffers = NULL;
+    delete []work_retain;
+    work_retain = NULL;
+
     return OMX_ErrorNone;
 }
 
@@ -1876,34 +2720,125 @@ OMX_ERRORTYPE ComponentBase::FreePorts(void)
 /* implement WorkableInterface */
 void ComponentBase::Work(void)
 {
-    OMX_BUFFERHEADERTYPE *buffers[nr_ports];
-    buffer_retain_t retain[nr_ports];
-    OMX_U32 i;
+    OMX_BUFFERHEADERTYPE **buffers = work_buffers;
+    buffer_retain_t *retain = work_retain;
+    OMX_U32 i, j, k, ready, nr_getagain, nr_buffers, index, stalled = 0;
+    OMX_U32 nr_sets;
+    unsigned long long start = 0, per_set, iteration;
+    bool all, latency = PortBase::IsLatencyEnabled();
     OMX_ERRORTYPE ret;
 
-    pthread_mutex_lock(&ports_block);
+    lockstat_mutex_lock(&ports_block);
+
+    all = !nr_required_port_masks;
 
-    while(IsAllBufferAvailable())
+    while ((ready = GetReadyPortMask(stalled, &index)))
     {
-        for (i = 0; i < nr_ports; i++) {
-            buffers[i] = ports[i]->PopBuffer();
-            retain[i] = BUFFER_RETAIN_NOT_RETAIN;
-        }
+        iteration = TRACE_START();
+
+        /* pop sets while the same ports're ready */
+        nr_sets = 0;
+        do {
+            for (i = 0; i < nr_ports; i++) {
+                k = nr_sets * nr_ports + i;
 
-        ret = ProcessorProcess(buffers, &retain[0], nr_ports);
+                /* masks cover the first 32 ports, as GetReadyPortMask() */
+                if (all || (i < 32 && (ready & (1U << i)))) {
+                    buffers[k] = ports[i]->PopBuffer();
+                    if (!buffers[k])
+                        break;
+                }
+                else
+                    buffers[k] = NULL;
+                retain[k] = BUFFER_RETAIN_NOT_RETAIN;
+            }
+
+            /*
+             * counted but still being pushed, put the set back. the pusher
+             * schedules this work once it's done
+             */
+            if (i < nr_ports) {
+                for (k = nr_sets * nr_ports; i-- > 0;) {
+                    if (buffers[k + i])
+                        ports[i]->RetainThisBuffer(buffers[k + i], false);
+                }
+                break;
+            }
+            nr_sets++;
+        } while (nr_sets < processor_batch_size &&
+                 GetReadyPortMask(stalled, &j) == ready);
+
+        if (!nr_sets)
+            break;
+
+        if (latency)
+            start = WorkQueue::Now();
+
+        if (nr_sets == 1)
+            ret = ProcessorProcess(buffers, &retain[0], nr_ports);
+        else
+            ret = ProcessorProcessBatch(buffers, &retain[0], nr_ports,
+                                        nr_sets);
+
+        /*
+         * a batch's spread evenly over its sets. the buffers returned below
+         * take their residency from here, saves a clock read
+         */
+        if (latency) {
+            per_set = (WorkQueue::Now() - start) / nr_sets;
+            for (k = 0; k < nr_sets * nr_ports; k++) {
+                if (buffers[k])
+                    ports[k % nr_ports]->StampProcessed(buffers[k],
+                        start + (k / nr_ports) * per_set,
+                        start + (k / nr_ports + 1) * per_set,
+                        ret != OMX_ErrorNone ||
+                        retain[k] == BUFFER_RETAIN_NOT_RETAIN);
+            }
+        }
 
         if (ret == OMX_ErrorNone) {
-            PostProcessBuffers(buffers, &retain[0]);
+            nr_getagain = nr_buffers = 0;
+            for (j = 0; j < nr_sets; j++) {
+                k = j * nr_ports;
+
+                PostProcessBuffers(&buffers[k], &retain[k]);
+
+                for (i = 0; i < nr_ports; i++, k++) {
+                    if (!buffers[k])
+                        continue;
+                    nr_buffers++;
+
+                    if (retain[k] == BUFFER_RETAIN_GETAGAIN)
+                        nr_getagain++;
+                    else if (retain[k] == BUFFER_RETAIN_ACCUMULATE)
+                        ports[i]->RetainThisBuffer(buffers[k], true);
+                    else if (retain[k] == BUFFER_RETAIN_PUSHBACK)
+                        ports[i]->PushThisBuffer(buffers[k]);
+                    else
+                        ports[i]->ReturnThisBuffer(buffers[k]);
+                }
+            }
 
-            for (i = 0; i < nr_ports; i++) {
-                if (retain[i] == BUFFER_RETAIN_GETAGAIN)
-                    ports[i]->RetainThisBuffer(buffers[i], false);
-                else if (retain[i] == BUFFER_RETAIN_ACCUMULATE)
-                    ports[i]->RetainThisBuffer(buffers[i], true);
-                else if (retain[i] == BUFFER_RETAIN_PUSHBACK)
-                    ports[i]->PushThisBuffer(buffers[i]);
+            /*
+             * buffers to get again're stacked at the head of the queues,
+             * push the later sets first to keep them in order
+             */
+            for (j = nr_sets; nr_getagain && j-- > 0;) {
+                for (i = 0, k = j * nr_ports; i < nr_ports; i++, k++) {
+                    if (buffers[k] && retain[k] == BUFFER_RETAIN_GETAGAIN)
+                        ports[i]->RetainThisBuffer(buffers[k], false);
+                }
+            }
+
+            /*
+             * nothing consumed, the same mask would be ready again.
+             * let the next masks go, or wait for the next buffer to come
+             */
+            if (!all) {
+                if (nr_getagain == nr_buffers)
+                    stalled |= 1U << index;
                 else
-                    ports[i]->ReturnThisBuffer(buffers[i]);
+                    stalled = 0;
             }
         }
         else {
@@ -1912,14 +2847,23 @@ void ComponentBase::Work(void)
 
             for (i = 0; i < nr_ports; i++) {
                 /* return buffers by hands, these buffers're not in queue */
-                ports[i]->ReturnThisBuffer(buffers[i]);
+                for (j = 0, k = i; j < nr_sets; j++, k += nr_ports) {
+                    if (buffers[k])
+                        ports[i]->ReturnThisBuffer(buffers[k]);
+                }
                 /* flush ports */
                 ports[i]->FlushPort();
             }
         }
+
+        /* id is the sets processed at once */
+        TRACE_COMPLETE("work", "process", GetName(), nr_sets, TRACE_NO_PORT,
+                       iteration);
     }
 
-    pthread_mutex_unlock(&ports_block);
+    lockstat_mutex_unlock(&ports_block);
+
+    SendTunnelPorts();
 }
 
 bool ComponentBase::IsAllBufferAvailable(void)
@@ -1943,6 +2887,33 @@ bool ComponentBase::IsAllBufferAvailable(void)
         return false;
 }
 
+OMX_U32 ComponentBase::GetReadyPortMask(OMX_U32 stalled, OMX_U32 *index)
+{
+    OMX_U32 i, avail = 0;
+
+    *index = 0;
+
+    if (!nr_required_port_masks)
+        return IsAllBufferAvailable() ? ~0U : 0;
+
+    for (i = 0; i < nr_ports && i < 32; i++) {
+        if (!ports[i]->IsCeased() && ports[i]->BufferQueueLength())
+            avail |= 1U << i;
+    }
+
+    for (i = 0; i < nr_required_port_masks; i++) {
+        if (stalled & (1U << i))
+            continue;
+
+        if ((avail & required_port_masks[i]) == required_port_masks[i]) {
+            *index = i;
+            return required_port_masks[i];
+        }
+    }
+
+    return 0;
+}
+
 inline void ComponentBase::SourcePostProcessBuffers(
     OMX_BUFFERHEADERTYPE **buffers,
     const buffer_retain_t *retain)
@@ -1950,6 +2921,9 @@ inline void ComponentBase::SourcePostProcessBuffers(
     OMX_U32 i;
 
     for (i = 0; i < nr_ports; i++) {
+        if (!buffers[i])
+            continue;
+
         /*
          * in case of source component, buffers're marked when they come
          * from the ouput ports
@@ -1976,10 +2950,16 @@ inline void ComponentBase::FilterPostProcessBuffers(
     OMX_U32 i, j;
 
     for (i = 0; i < nr_ports; i++) {
+        if (!buffers[i])
+            continue;
+
         if (ports[i]->GetPortDirection() == OMX_DirInput) {
             for (j = 0; j < nr_ports; j++) {
                 if (ports[j]->GetPortDirection() != OMX_DirOutput)
                     continue;
+                /* not processed by this call (SetRequiredPortMasks) */
+                if (!buffers[j])
+                    continue;
 
                 /* propagates EOS flag */
                 /* clear input EOS at the end of this loop */
@@ -2104,6 +3084,42 @@ OMX_ERRORTYPE ComponentBase::ProcessorPreFillBuffer(OMX_BUFFERHEADERTYPE* pBuffe
     return OMX_ErrorNone;
 }
 
+OMX_ERRORTYPE ComponentBase::ProcessorProcessBatch(
+    OMX_BUFFERHEADERTYPE **buffers,
+    buffer_retain_t *retain,
+    OMX_U32 nr_buffers,
+    OMX_U32 nr_sets)
+{
+    OMX_U32 i, j, k;
+    bool getagain = false;
+    OMX_ERRORTYPE ret;
+
+    for (j = 0; j < nr_sets; j++) {
+        k = j * nr_buffers;
+
+        /*
+         * ProcessorProcess() would see the same buffers again, the later
+         * sets're deferred as they are
+         */
+        if (getagain) {
+            for (i = 0; i < nr_buffers; i++)
+                retain[k + i] = BUFFER_RETAIN_GETAGAIN;
+            continue;
+        }
+
+        ret = ProcessorProcess(&buffers[k], &retain[k], nr_buffers);
+        if (ret != OMX_ErrorNone)
+            return ret;
+
+        for (i = 0; i < nr_buffers; i++) {
+            if (buffers[k + i] && retain[k + i] == BUFFER_RETAIN_GETAGAIN)
+                getagain = true;
+        }
+    }
+
+    return OMX_ErrorNone;
+}
+
 OMX_ERRORTYPE ComponentBase::ProcessorUseNativeBuffer(OMX_U32 nPortIndex, OMX_BUFFERHEADERTYPE* pBuffer)
 {
  return OMX_ErrorNone;
@@ -2127,6 +3143,284 @@ const OMX_STRING ComponentBase::GetWorkingRole(void)
     return &working_role[0];
 }
 
+OMX_ERRORTYPE ComponentBase::SetRequiredPortMasks(const OMX_U32 *masks,
+                                                  OMX_U32 nr_masks)
+{
+    OMX_U32 *temp = NULL;
+    OMX_U32 i;
+
+    if (masks && nr_masks) {
+        if (nr_masks > 32)
+            return OMX_ErrorBadParameter;
+
+        for (i = 0; i < nr_masks; i++) {
+            if (!masks[i])
+                return OMX_ErrorBadParameter;
+        }
+
+        temp = (OMX_U32 *)malloc(sizeof(*temp) * nr_masks);
+        if (!temp)
+            return OMX_ErrorInsufficientResources;
+        memcpy(temp, masks, sizeof(*temp) * nr_masks);
+    }
+    else
+        nr_masks = 0;
+
+    lockstat_mutex_lock(&ports_block);
+    free(required_port_masks);
+    required_port_masks = temp;
+    nr_required_port_masks = nr_masks;
+    lockstat_mutex_unlock(&ports_block);
+
+    return OMX_ErrorNone;
+}
+
+OMX_ERRORTYPE ComponentBase::SetProcessorBatchSize(OMX_U32 nr_sets)
+{
+    if (!nr_sets || nr_sets > MAX_PROCESSOR_BATCH_SIZE)
+        return OMX_ErrorBadParameter;
+
+    lockstat_mutex_lock(&ports_block);
+    processor_batch_size = nr_sets;
+    lockstat_mutex_unlock(&ports_block);
+
+    return OMX_ErrorNone;
+}
+
+void ComponentBase::SetWorkPriority(work_priority_t priority,
+                                    bool timestamp_deadline)
+{
+    work_priority = priority;
+    this->timestamp_deadline = timestamp_deadline;
+    ResetBufferDeadline();
+
+    if (cmdwork)
+        cmdwork->SetPriority(priority);
+    if (bufferwork)
+        bufferwork->SetPriority(priority);
+    if (callbackwork)
+        callbackwork->SetPriority(priority);
+}
+
+void ComponentBase::SetBlockingProcessor(bool blocking)
+{
+    blocking_processor = blocking;
+}
+
+void ComponentBase::ScheduleBufferWork(unsigned long long delay)
+{
+    bufferwork->ScheduleDelayedWork(this, delay);
+}
+
+void ComponentBase::SetBufferWorkPeriod(unsigned long long period)
+{
+    if (period)
+        bufferwork->SchedulePeriodicWork(this, period);
+    else
+        bufferwork->CancelDelayedWork(this);
+}
+
+/* OMX_INTEL_THREADPOLICYTYPE - 1 */
+static const int thread_policies[] = {
+    SCHED_OTHER,
+    SCHED_FIFO,
+    SCHED_RR,
+    SCHED_BATCH,
+    SCHED_IDLE,
+};
+
+static const char *thread_role_names[] = {
+    "cmd",
+    "buffer",
+    "callback",
+};
+
+bool ComponentBase::GetThreadPlacement(OMX_INTEL_THREADROLETYPE role,
+                                       struct thread_attr *attr)
+{
+    static const char *tags[] = { "cmd", "buf", "cb", };
+    const char *last = strrchr(name, '.');
+
+    last = last ? last + 1 : name;
+
+    memset(attr, 0, sizeof(*attr));
+    attr->flags = THREAD_ATTR_NAME;
+    /* "AVCDec:buf", the tag's kept if truncated */
+    snprintf(attr->name, sizeof(attr->name), "%.*s:%s",
+             (int)(sizeof(attr->name) - 1 - 1 - strlen(tags[role])), last,
+             tags[role]);
+
+    return thread_placement_lookup(name, thread_role_names[role], attr);
+}
+
+void ComponentBase::CheckThreadPlacement(OMX_INTEL_THREADROLETYPE role,
+                                         bool placed)
+{
+    WorkQueue *wq = GetThreadRoleWorkQueue(role);
+
+    if (!placed || !wq)
+        return;
+
+    if (wq->HasOwnThread()) {
+        omx_verboseLog("%s: %s thread placed by the rules\n", name,
+                       thread_role_names[role]);
+    }
+    else {
+        omx_warnLog("%s: %s placement rules ignored, the role runs on the "
+                    "shared executor\n", name, thread_role_names[role]);
+    }
+}
+
+WorkQueue *ComponentBase::GetThreadRoleWorkQueue(OMX_INTEL_THREADROLETYPE role)
+{
+    switch (role) {
+    case OMX_IntelThreadRoleCommand:
+        return cmdwork ? cmdwork->GetWorkQueue() : NULL;
+    case OMX_IntelThreadRoleBuffer:
+        return bufferwork;
+    case OMX_IntelThreadRoleCallback:
+        return callbackwork ? callbackwork->GetWorkQueue() : NULL;
+    default:
+        return NULL;
+    }
+}
+
+OMX_ERRORTYPE ComponentBase::GetThreadPlacementConfig(
+    OMX_CONFIG_INTEL_THREADPLACEMENTTYPE *p)
+{
+    WorkQueue *wq;
+    struct thread_attr attr;
+    OMX_U32 i;
+    OMX_ERRORTYPE ret;
+
+    ret = CheckTypeHeader(p, sizeof(*p));
+    if (ret != OMX_ErrorNone)
+        return ret;
+
+    wq = GetThreadRoleWorkQueue(p->eRole);
+    if (!wq || !wq->HasOwnThread())
+        return OMX_ErrorUnsupportedSetting;
+
+    wq->GetAttributes(&attr);
+
+    p->nCpuMask = (attr.flags & THREAD_ATTR_AFFINITY) ? attr.cpu_mask : 0;
+    p->ePolicy = OMX_IntelThreadPolicyInherit;
+    p->nPriority = 0;
+    if (attr.flags & THREAD_ATTR_SCHED) {
+        for (i = 0; i < sizeof(thread_policies) / sizeof(thread_policies[0]);
+             i++) {
+            if (thread_policies[i] == attr.policy) {
+                p->ePolicy = (OMX_INTEL_THREADPOLICYTYPE)(i + 1);
+                break;
+            }
+        }
+        p->nPriority = attr.priority;
+    }
+    p->nStackSize = (attr.flags & THREAD_ATTR_STACK) ? attr.stack_size : 0;
+    memset(p->cName, 0, sizeof(p->cName));
+    if (attr.flags & THREAD_ATTR_NAME)
+        snprintf((char *)p->cName, sizeof(p->cName), "%s", attr.name);
+
+    return OMX_ErrorNone;
+}
+
+OMX_ERRORTYPE ComponentBase::SetThreadPlacementConfig(
+    OMX_CONFIG_INTEL_THREADPLACEMENTTYPE *p)
+{
+    WorkQueue *wq;
+    struct thread_attr attr;
+    OMX_ERRORTYPE ret;
+
+    ret = CheckTypeHeader(p, sizeof(*p));
+    if (ret != OMX_ErrorNone)
+        return ret;
+
+    if (p->ePolicy > OMX_IntelThreadPolicyIdle)
+        return OMX_ErrorBadParameter;
+
+    /*
+     * the WorkQueue can't be replaced while ports and peers may schedule on
+     * it, a role gets its own thread from a rule matched at GetHandle()
+     */
+    wq = GetThreadRoleWorkQueue(p->eRole);
+    if (!wq || !wq->HasOwnThread()) {
+        omx_errorLog("%s: role %u has no own thread, a %s/%s placement rule "
+                     "gives it one, see also executor/worker rules\n", name,
+                     (unsigned int)p->eRole, name,
+                     p->eRole <= OMX_IntelThreadRoleCallback ?
+                     thread_role_names[p->eRole] : "?");
+        return OMX_ErrorUnsupportedSetting;
+    }
+
+    memset(&attr, 0, sizeof(attr));
+    if (p->nCpuMask) {
+        attr.flags |= THREAD_ATTR_AFFINITY;
+        attr.cpu_mask = p->nCpuMask;
+    }
+    if (p->ePolicy != OMX_IntelThreadPolicyInherit) {
+        attr.flags |= THREAD_ATTR_SCHED;
+        attr.policy = thread_policies[p->ePolicy - 1];
+        attr.priority = p->nPriority;
+    }
+    if (p->nStackSize) {
+        attr.flags |= THREAD_ATTR_STACK;
+        attr.stack_size = p->nStackSize;
+    }
+    if (p->cName[0]) {
+        attr.flags |= THREAD_ATTR_NAME;
+        /* cName may not be null-terminated */
+        snprintf(attr.name, sizeof(attr.name), "%.*s",
+                 (int)sizeof(p->cName), (const char *)p->cName);
+    }
+
+    wq->SetAttributes(&attr);
+    return OMX_ErrorNone;
+}
+
+OMX_ERRORTYPE ComponentBase::GetPortLatencyConfig(
+    OMX_CONFIG_INTEL_PORTLATENCYTYPE *p)
+{
+    struct histogram h;
+    unsigned long long count;
+    OMX_U32 i, n = 0;
+    OMX_ERRORTYPE ret;
+
+    ret = CheckTypeHeader(p, sizeof(*p));
+    if (ret != OMX_ErrorNone)
+        return ret;
+
+    if (!ports || p->nPortIndex >= nr_ports)
+        return OMX_ErrorBadPortIndex;
+    if (p->eLatency > OMX_IntelLatencyResidency)
+        return OMX_ErrorBadParameter;
+    if (p->nBuckets && (!p->pBucketValues || !p->pBucketCounts))
+        return OMX_ErrorBadParameter;
+
+    /* a snapshot, the buffer processing keeps recording */
+    ports[p->nPortIndex]->GetLatency(p->eLatency, &h);
+
+    count = histogram_count(&h);
+    p->nCount = count;
+    p->nMin = count ? h.min : 0;
+    p->nMean = count ? h.sum / count : 0;
+    p->nMax = h.max;
+    p->nP50 = histogram_percentile(&h, 500);
+    p->nP90 = histogram_percentile(&h, 900);
+    p->nP99 = histogram_percentile(&h, 990);
+    p->nP999 = histogram_percentile(&h, 999);
+
+    for (i = 0; i < HISTOGRAM_NR_BUCKETS && n < p->nBuckets; i++) {
+        if (!h.counts[i])
+            continue;
+        p->pBucketValues[n] = histogram_lowest(i);
+        p->pBucketCounts[n] = h.counts[i];
+        n++;
+    }
+    p->nBuckets = n;
+
+    return OMX_ErrorNone;
+}
+
 const OMX_COMPONENTTYPE *ComponentBase::GetComponentHandle(void)
 {
     return handle;
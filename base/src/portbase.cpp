@@ -18,6 +18,8 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
 
 #include <OMX_Core.h>
 #include <OMX_Component.h>
@@ -25,29 +27,104 @@
 #include <portbase.h>
 #include <componentbase.h>
 
+#include <bufpool.h>
+#include <trace.h>
+
+/*
+ * headers given by Use/AllocateBuffer(), payloads of AllocateBuffer() come
+ * from bufpool (or a shmbuf slot) and are kept apart from the headers
+ */
+struct port_buffer_hdr {
+    OMX_BUFFERHEADERTYPE hdr;
+    OMX_U8 *payload;        /* NULL if given by UseBuffer() or shmbuf */
+    size_t payload_size;
+    struct shmbuf *shm;     /* shareable buffer, slot is shm_slot */
+    OMX_U8 *shm_slot;
+};
+
+/* must be held hdrs_lock */
+static void free_port_buffer_hdr(OMX_BUFFERHEADERTYPE *buffer_hdr)
+{
+    struct port_buffer_hdr *hdr = (struct port_buffer_hdr *)buffer_hdr;
+
+    if (hdr->shm)
+        shmbuf_free(hdr->shm, hdr->shm_slot);
+    bufpool_free(hdr->payload, hdr->payload_size);
+    free(hdr);
+}
+
+/* stamps of a buffer in flight, see PortBase::FindStamp() */
+struct port_buffer_stamp {
+    const OMX_BUFFERHEADERTYPE *hdr;
+    /* Empty/FillThisBuffer(), 0 if not queued */
+    unsigned long long queued;
+    /* queue wait's recorded on the first ProcessorProcess() */
+    bool processed;
+};
+
+/* freed slot, keeps the probe sequence going */
+#define STAMP_FREED     ((const OMX_BUFFERHEADERTYPE *)1)
+
+/* secs FreeTunnelBuffers() waits for the tunneled port to return the buffers */
+#define TUNNEL_RETURN_TIMEOUT   5
+
+static inline OMX_U32 stamp_hash(const OMX_BUFFERHEADERTYPE *hdr)
+{
+    return (OMX_U32)(((uintptr_t)hdr >> 4) * 2654435761U);
+}
+
 /*
  * constructor & destructor
  */
 void PortBase::__PortBase(void)
 {
+    pthread_condattr_t tunnel_wait_attr;
+
     buffer_hdrs = NULL;
     nr_buffer_hdrs = 0;
-    buffer_hdrs_completion = false;
 
-    pthread_mutex_init(&hdrs_lock, NULL);
+    lockstat_mutex_init(&hdrs_lock, "PortBase::hdrs_lock", NULL);
     pthread_cond_init(&hdrs_wait, NULL);
 
-    __queue_init(&bufferq);
-    pthread_mutex_init(&bufferq_lock, NULL);
+    __ring_init(&bufferq);
+    headq = NULL;
+    nr_headq = 0;
+
+    stamps = NULL;
+    nr_stamps = 0;
+    ResetLatency();
 
     __queue_init(&retainedbufferq);
-    pthread_mutex_init(&retainedbufferq_lock, NULL);
+    lockstat_mutex_init(&retainedbufferq_lock, "PortBase::retainedbufferq_lock",
+                        NULL);
 
     __queue_init(&markq);
-    pthread_mutex_init(&markq_lock, NULL);
+    lockstat_mutex_init(&markq_lock, "PortBase::markq_lock", NULL);
+
+    tunnel_peer = NULL;
+    tunnel_port = 0;
+    buffer_supplier = OMX_BufferSupplyUnspecified;
+    __queue_init(&tunnel_heldq);
+    lockstat_mutex_init(&tunnel_lock, "PortBase::tunnel_lock", NULL);
+    /* FreeTunnelBuffers() waits on CLOCK_MONOTONIC */
+    pthread_condattr_init(&tunnel_wait_attr);
+    pthread_condattr_setclock(&tunnel_wait_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&tunnel_wait, &tunnel_wait_attr);
+    pthread_condattr_destroy(&tunnel_wait_attr);
+    tunnel_draining = false;
+    __ring_init(&tunnel_sendq);
+    tunnel_sending = 0;
+
+    reconfigure_in_place = false;
+    nr_reconfiguring = 0;
+
+    shareable = false;
+    shareable_seal = false;
+    shm = NULL;
 
     state = OMX_PortEnabled;
-    pthread_mutex_init(&state_lock, NULL);
+    lockstat_mutex_init(&state_lock, "PortBase::state_lock", NULL);
+    disabling = false;
 
     memset(&portdefinition, 0, sizeof(portdefinition));
     ComponentBase::SetTypeHeader(&portdefinition, sizeof(portdefinition));
@@ -82,26 +159,34 @@ PortBase::~PortBase()
 
     /* should've been already freed at FreeBuffer() */
     list_foreach_safe(buffer_hdrs, entry, temp) {
-        free(entry->data); /* OMX_BUFFERHEADERTYPE */
+        free_port_buffer_hdr((OMX_BUFFERHEADERTYPE *)entry->data);
         __list_delete(buffer_hdrs, entry);
     }
+    shmbuf_destroy(shm);
 
     pthread_cond_destroy(&hdrs_wait);
-    pthread_mutex_destroy(&hdrs_lock);
+    lockstat_mutex_destroy(&hdrs_lock);
 
     /* should've been already freed at buffer processing */
-    queue_free_all(&bufferq);
-    pthread_mutex_destroy(&bufferq_lock);
+    ring_free(&bufferq);
+    free(headq);
+    free(stamps);
 
     /* should've been already freed at buffer processing */
     queue_free_all(&retainedbufferq);
-    pthread_mutex_destroy(&retainedbufferq_lock);
+    lockstat_mutex_destroy(&retainedbufferq_lock);
 
     /* should've been already empty in PushThisBuffer () */
     queue_free_all(&markq);
-    pthread_mutex_destroy(&markq_lock);
+    lockstat_mutex_destroy(&markq_lock);
+
+    /* should've been already empty in FreeTunnelBuffers() */
+    queue_free_all(&tunnel_heldq);
+    ring_free(&tunnel_sendq);
+    pthread_cond_destroy(&tunnel_wait);
+    lockstat_mutex_destroy(&tunnel_lock);
 
-    pthread_mutex_destroy(&state_lock);
+    lockstat_mutex_destroy(&state_lock);
 }
 
 /* end of constructor & destructor */
@@ -137,6 +222,108 @@ OMX_ERRORTYPE PortBase::SetCallbacks(OMX_HANDLETYPE hComponent,
     return OMX_ErrorNone;
 }
 
+/* tunnel */
+void PortBase::SetTunnel(OMX_HANDLETYPE hTunneledComp, OMX_U32 nTunneledPort)
+{
+    tunnel_peer = hTunneledComp;
+    tunnel_port = nTunneledPort;
+
+    if (!tunnel_peer)
+        buffer_supplier = OMX_BufferSupplyUnspecified;
+}
+
+OMX_HANDLETYPE PortBase::GetTunnelPeer(void)
+{
+    return tunnel_peer;
+}
+
+OMX_U32 PortBase::GetTunnelPort(void)
+{
+    return tunnel_port;
+}
+
+void PortBase::SetBufferSupplier(OMX_BUFFERSUPPLIERTYPE supplier)
+{
+    buffer_supplier = supplier;
+}
+
+OMX_BUFFERSUPPLIERTYPE PortBase::GetBufferSupplier(void)
+{
+    return buffer_supplier;
+}
+
+bool PortBase::IsBufferSupplier(void)
+{
+    if (!tunnel_peer)
+        return false;
+
+    if (portdefinition.eDir == OMX_DirInput)
+        return buffer_supplier == OMX_BufferSupplyInput;
+    else
+        return buffer_supplier == OMX_BufferSupplyOutput;
+}
+
+void PortBase::SetReconfigureInPlace(bool enable)
+{
+    reconfigure_in_place = enable;
+}
+
+bool PortBase::GetReconfigureInPlace(void)
+{
+    return reconfigure_in_place;
+}
+
+OMX_ERRORTYPE PortBase::SetShareableBuffers(bool enable, bool seal)
+{
+    OMX_ERRORTYPE ret = OMX_ErrorNone;
+
+    lockstat_mutex_lock(&hdrs_lock);
+    if (nr_buffer_hdrs)
+        ret = OMX_ErrorIncorrectStateOperation;
+    else {
+        shareable = enable;
+        shareable_seal = enable ? seal : false;
+
+        /* left by a failed AllocateBuffer() */
+        shmbuf_destroy(shm);
+        shm = NULL;
+    }
+    lockstat_mutex_unlock(&hdrs_lock);
+
+    return ret;
+}
+
+bool PortBase::GetShareableBuffers(bool *seal)
+{
+    if (seal)
+        *seal = shareable_seal;
+
+    return shareable;
+}
+
+OMX_ERRORTYPE PortBase::GetSharedBufferInfo(OMX_BUFFERHEADERTYPE *pBuffer,
+                                            OMX_S32 *fd, OMX_U32 *offset,
+                                            OMX_U32 *length)
+{
+    struct port_buffer_hdr *hdr;
+    OMX_ERRORTYPE ret = OMX_ErrorBadParameter;
+
+    lockstat_mutex_lock(&hdrs_lock);
+    if (pBuffer && list_find(buffer_hdrs, pBuffer)) {
+        hdr = (struct port_buffer_hdr *)pBuffer;
+
+        if (hdr->shm) {
+            *fd = hdr->shm->fd;
+            *offset = shmbuf_offset(hdr->shm, hdr->shm_slot);
+            *length = hdr->shm->slot_size;
+            ret = OMX_ErrorNone;
+        }
+    }
+    lockstat_mutex_unlock(&hdrs_lock);
+
+    return ret;
+}
+
 
 OMX_U32 PortBase::getFrameBufSize(OMX_COLOR_FORMATTYPE colorFormat, OMX_U32 width, OMX_U32 height)
 {
@@ -307,19 +494,28 @@ OMX_ERRORTYPE PortBase::UseBuffer(OMX_BUFFERHEADERTYPE **ppBufferHdr,
     omx_verboseLog("%s(): %s:%s:PortIndex %lu: enter, nSizeBytes=%lu\n", __FUNCTION__,
          cbase->GetName(), cbase->GetWorkingRole(), nPortIndex, nSizeBytes);
 
-    pthread_mutex_lock(&hdrs_lock);
+    lockstat_mutex_lock(&hdrs_lock);
 
     if (portdefinition.bPopulated == OMX_TRUE) {
-        pthread_mutex_unlock(&hdrs_lock);
+        lockstat_mutex_unlock(&hdrs_lock);
         omx_verboseLog("%s(): %s:%s:PortIndex %lu: exit done, already populated\n",
              __FUNCTION__, cbase->GetName(), cbase->GetWorkingRole(),
              nPortIndex);
         return OMX_ErrorNone;
     }
 
-    buffer_hdr = (OMX_BUFFERHEADERTYPE *)calloc(1, sizeof(*buffer_hdr));
+    if (!nr_buffer_hdrs && ReserveBufferQueue() != OMX_ErrorNone) {
+        lockstat_mutex_unlock(&hdrs_lock);
+        omx_errorLog("%s(): %s:%s:PortIndex %lu: exit failure, "
+             "cannot allocate buffer queue\n", __FUNCTION__,
+             cbase->GetName(), cbase->GetWorkingRole(), nPortIndex);
+        return OMX_ErrorInsufficientResources;
+    }
+
+    buffer_hdr = (OMX_BUFFERHEADERTYPE *)
+                 calloc(1, sizeof(struct port_buffer_hdr));
     if (!buffer_hdr) {
-        pthread_mutex_unlock(&hdrs_lock);
+        lockstat_mutex_unlock(&hdrs_lock);
         omx_errorLog("%s(): %s:%s:PortIndex %lu: exit failure, "
              "connot allocate buffer header\n", __FUNCTION__,
              cbase->GetName(), cbase->GetWorkingRole(), nPortIndex);
@@ -328,8 +524,8 @@ OMX_ERRORTYPE PortBase::UseBuffer(OMX_BUFFERHEADERTYPE **ppBufferHdr,
 
     entry = list_alloc(buffer_hdr);
     if (!entry) {
-        free(buffer_hdr);
-        pthread_mutex_unlock(&hdrs_lock);
+        free_port_buffer_hdr(buffer_hdr);
+        lockstat_mutex_unlock(&hdrs_lock);
         omx_errorLog("%s(): %s:%s:PortIndex %lu: exit failure, "
              "cannot allocate list entry\n", __FUNCTION__,
              cbase->GetName(), cbase->GetWorkingRole(), nPortIndex);
@@ -355,6 +551,7 @@ OMX_ERRORTYPE PortBase::UseBuffer(OMX_BUFFERHEADERTYPE **ppBufferHdr,
 
     buffer_hdrs = __list_add_tail(buffer_hdrs, entry);
     nr_buffer_hdrs++;
+    AddStamp(buffer_hdr);
 
     omx_verboseLog("%s(): %s:%s:PortIndex %lu: a buffer allocated (%p:%lu/%lu)\n",
          __FUNCTION__,
@@ -363,7 +560,6 @@ OMX_ERRORTYPE PortBase::UseBuffer(OMX_BUFFERHEADERTYPE **ppBufferHdr,
 
     if (nr_buffer_hdrs >= portdefinition.nBufferCountActual) {
         portdefinition.bPopulated = OMX_TRUE;
-        buffer_hdrs_completion = true;
         pthread_cond_signal(&hdrs_wait);
         omx_verboseLog("%s(): %s:%s:PortIndex %lu: allocate all buffers (%lu)\n",
              __FUNCTION__, cbase->GetName(), cbase->GetWorkingRole(),
@@ -372,7 +568,7 @@ OMX_ERRORTYPE PortBase::UseBuffer(OMX_BUFFERHEADERTYPE **ppBufferHdr,
 
     *ppBufferHdr = buffer_hdr;
 
-    pthread_mutex_unlock(&hdrs_lock);
+    lockstat_mutex_unlock(&hdrs_lock);
 
     omx_verboseLog("%s(): %s:%s:PortIndex %lu: exit done\n", __FUNCTION__,
          cbase->GetName(), cbase->GetWorkingRole(), nPortIndex);
@@ -385,34 +581,84 @@ OMX_ERRORTYPE PortBase::AllocateBuffer(OMX_BUFFERHEADERTYPE **ppBuffer,
                                        OMX_U32 nSizeBytes)
 {
     OMX_BUFFERHEADERTYPE *buffer_hdr;
+    struct port_buffer_hdr *hdr;
     struct list *entry;
 
     omx_verboseLog("%s(): %s:%s:PortIndex %lu: enter, nSizeBytes=%lu\n", __FUNCTION__,
          cbase->GetName(), cbase->GetWorkingRole(), nPortIndex, nSizeBytes);
 
-    pthread_mutex_lock(&hdrs_lock);
+    lockstat_mutex_lock(&hdrs_lock);
     if (portdefinition.bPopulated == OMX_TRUE) {
-        pthread_mutex_unlock(&hdrs_lock);
+        lockstat_mutex_unlock(&hdrs_lock);
         omx_verboseLog("%s(): %s:%s:PortIndex %lu: exit done, already populated\n",
              __FUNCTION__, cbase->GetName(), cbase->GetWorkingRole(),
              nPortIndex);
         return OMX_ErrorNone;
     }
 
-    buffer_hdr = (OMX_BUFFERHEADERTYPE *)
-                 calloc(1, sizeof(*buffer_hdr) + nSizeBytes);
-    if (!buffer_hdr) {
-        pthread_mutex_unlock(&hdrs_lock);
+    if (!nr_buffer_hdrs && ReserveBufferQueue() != OMX_ErrorNone) {
+        lockstat_mutex_unlock(&hdrs_lock);
+        omx_errorLog("%s(): %s:%s:PortIndex %lu: exit failure, "
+             "cannot allocate buffer queue\n", __FUNCTION__,
+             cbase->GetName(), cbase->GetWorkingRole(), nPortIndex);
+        return OMX_ErrorInsufficientResources;
+    }
+
+    hdr = (struct port_buffer_hdr *)calloc(1, sizeof(*hdr));
+    if (!hdr) {
+        lockstat_mutex_unlock(&hdrs_lock);
         omx_errorLog("%s(): %s:%s:PortIndex %lu: exit failure, "
              "connot allocate buffer header\n", __FUNCTION__,
              cbase->GetName(), cbase->GetWorkingRole(), nPortIndex);
         return OMX_ErrorInsufficientResources;
     }
+    buffer_hdr = &hdr->hdr;
+
+    if (shareable) {
+        size_t offset;
+
+        /* one memfd for all buffers, sized by the first one */
+        if (!shm) {
+            OMX_U32 slot_size = portdefinition.nBufferSize;
+
+            if (slot_size < nSizeBytes)
+                slot_size = nSizeBytes;
+            shm = shmbuf_create("omxil-port", slot_size,
+                                portdefinition.nBufferCountActual,
+                                shareable_seal);
+        }
+
+        if (shm && nSizeBytes <= shm->slot_size)
+            hdr->shm_slot = (OMX_U8 *)shmbuf_alloc(shm, &offset);
+        if (!hdr->shm_slot) {
+            free(hdr);
+            lockstat_mutex_unlock(&hdrs_lock);
+            omx_errorLog("%s(): %s:%s:PortIndex %lu: exit failure, "
+                 "connot allocate shareable buffer\n", __FUNCTION__,
+                 cbase->GetName(), cbase->GetWorkingRole(), nPortIndex);
+            return OMX_ErrorInsufficientResources;
+        }
+        hdr->shm = shm;
+    }
+    else {
+        /* aligned, not zero-filled, maybe reused */
+        hdr->payload_size = nSizeBytes;
+        hdr->payload = (OMX_U8 *)bufpool_alloc(&hdr->payload_size);
+    }
+
+    if (!hdr->payload && !hdr->shm) {
+        free(hdr);
+        lockstat_mutex_unlock(&hdrs_lock);
+        omx_errorLog("%s(): %s:%s:PortIndex %lu: exit failure, "
+             "connot allocate buffer payload\n", __FUNCTION__,
+             cbase->GetName(), cbase->GetWorkingRole(), nPortIndex);
+        return OMX_ErrorInsufficientResources;
+    }
 
     entry = list_alloc(buffer_hdr);
     if (!entry) {
-        free(buffer_hdr);
-        pthread_mutex_unlock(&hdrs_lock);
+        free_port_buffer_hdr(buffer_hdr);
+        lockstat_mutex_unlock(&hdrs_lock);
         omx_errorLog("%s(): %s:%s:PortIndex %lu: exit failure, "
              "connot allocate list entry\n", __FUNCTION__,
              cbase->GetName(), cbase->GetWorkingRole(), nPortIndex);
@@ -420,7 +666,7 @@ OMX_ERRORTYPE PortBase::AllocateBuffer(OMX_BUFFERHEADERTYPE **ppBuffer,
     }
 
     ComponentBase::SetTypeHeader(buffer_hdr, sizeof(*buffer_hdr));
-    buffer_hdr->pBuffer = (OMX_U8 *)buffer_hdr + sizeof(*buffer_hdr);
+    buffer_hdr->pBuffer = hdr->shm ? hdr->shm_slot : hdr->payload;
     buffer_hdr->nAllocLen = nSizeBytes;
     buffer_hdr->pAppPrivate = pAppPrivate;
     if (portdefinition.eDir == OMX_DirInput) {
@@ -438,6 +684,7 @@ OMX_ERRORTYPE PortBase::AllocateBuffer(OMX_BUFFERHEADERTYPE **ppBuffer,
 
     buffer_hdrs = __list_add_tail(buffer_hdrs, entry);
     nr_buffer_hdrs++;
+    AddStamp(buffer_hdr);
 
     omx_verboseLog("%s(): %s:%s:PortIndex %lu: a buffer allocated (%p:%lu/%lu)\n",
          __FUNCTION__,
@@ -446,7 +693,6 @@ OMX_ERRORTYPE PortBase::AllocateBuffer(OMX_BUFFERHEADERTYPE **ppBuffer,
 
     if (nr_buffer_hdrs == portdefinition.nBufferCountActual) {
         portdefinition.bPopulated = OMX_TRUE;
-        buffer_hdrs_completion = true;
         pthread_cond_signal(&hdrs_wait);
         omx_verboseLog("%s(): %s:%s:PortIndex %lu: allocate all buffers (%lu)\n",
              __FUNCTION__, cbase->GetName(), cbase->GetWorkingRole(),
@@ -455,7 +701,7 @@ OMX_ERRORTYPE PortBase::AllocateBuffer(OMX_BUFFERHEADERTYPE **ppBuffer,
 
     *ppBuffer = buffer_hdr;
 
-    pthread_mutex_unlock(&hdrs_lock);
+    lockstat_mutex_unlock(&hdrs_lock);
 
     omx_verboseLog("%s(): %s:%s:PortIndex %lu: exit done\n", __FUNCTION__,
          cbase->GetName(), cbase->GetWorkingRole(), nPortIndex);
@@ -471,11 +717,11 @@ OMX_ERRORTYPE PortBase::FreeBuffer(OMX_U32 nPortIndex,
     omx_verboseLog("%s(): %s:%s:PortIndex %lu:pBuffer %p: enter\n", __FUNCTION__,
          cbase->GetName(), cbase->GetWorkingRole(), nPortIndex, pBuffer);
 
-    pthread_mutex_lock(&hdrs_lock);
+    lockstat_mutex_lock(&hdrs_lock);
     entry = list_find(buffer_hdrs, pBuffer);
 
     if (!entry) {
-        pthread_mutex_unlock(&hdrs_lock);
+        lockstat_mutex_unlock(&hdrs_lock);
         omx_errorLog("%s(): %s:%s:PortIndex %lu:pBuffer %p: exit failure, "
              "cannot find list entry for pBuffer\n", __FUNCTION__,
              cbase->GetName(), cbase->GetWorkingRole(), nPortIndex, pBuffer);
@@ -483,7 +729,7 @@ OMX_ERRORTYPE PortBase::FreeBuffer(OMX_U32 nPortIndex,
     }
 
     if (entry->data != pBuffer) {
-        pthread_mutex_unlock(&hdrs_lock);
+        lockstat_mutex_unlock(&hdrs_lock);
         omx_errorLog("%s(): %s:%s:PortIndex %lu:pBuffer %p: exit failure,"
              "mismatch list entry\n" , __FUNCTION__,
              cbase->GetName(), cbase->GetWorkingRole(), nPortIndex, pBuffer);
@@ -492,7 +738,7 @@ OMX_ERRORTYPE PortBase::FreeBuffer(OMX_U32 nPortIndex,
 
     ret = ComponentBase::CheckTypeHeader(pBuffer, sizeof(*pBuffer));
     if (ret != OMX_ErrorNone) {
-        pthread_mutex_unlock(&hdrs_lock);
+        lockstat_mutex_unlock(&hdrs_lock);
         omx_errorLog("%s(): %s:%s:PortIndex %lu:pBuffer %p: exit failure,"
              "invalid type header\n", __FUNCTION__,
              cbase->GetName(), cbase->GetWorkingRole(), nPortIndex, pBuffer);
@@ -501,60 +747,183 @@ OMX_ERRORTYPE PortBase::FreeBuffer(OMX_U32 nPortIndex,
 
     buffer_hdrs = __list_delete(buffer_hdrs, entry);
     nr_buffer_hdrs--;
+    RemoveStamp(pBuffer);
 
     omx_verboseLog("%s(): %s:%s:PortIndex %lu:pBuffer %p: free a buffer (%lu/%lu)\n",
          __FUNCTION__, cbase->GetName(), cbase->GetWorkingRole(), nPortIndex,
          pBuffer, nr_buffer_hdrs, portdefinition.nBufferCountActual);
 
-    free(pBuffer);
+    free_port_buffer_hdr(pBuffer);
 
     portdefinition.bPopulated = OMX_FALSE;
     if (!nr_buffer_hdrs) {
-        buffer_hdrs_completion = true;
+        /* a process having mapped the memfd keeps its pages */
+        shmbuf_destroy(shm);
+        shm = NULL;
+        nr_reconfiguring = 0;
+
+        /*
+         * a tunnel supplier may free the buffers it sent to this port
+         * after this port has been flushed, forget them
+         */
+        if (tunnel_peer) {
+            while (ring_pop(&bufferq))
+                ;
+            nr_headq = 0;
+            while (ring_pop(&tunnel_sendq))
+                ;
+        }
+
         pthread_cond_signal(&hdrs_wait);
         omx_verboseLog("%s(): %s:%s:PortIndex %lu: free all allocated buffers (%lu)\n",
              __FUNCTION__, cbase->GetName(), cbase->GetWorkingRole(),
              nPortIndex, portdefinition.nBufferCountActual);
     }
 
-    pthread_mutex_unlock(&hdrs_lock);
+    lockstat_mutex_unlock(&hdrs_lock);
 
     omx_verboseLog("%s(): %s:%s:PortIndex %lu: exit done\n", __FUNCTION__,
          cbase->GetName(), cbase->GetWorkingRole(), nPortIndex);
     return OMX_ErrorNone;
 }
 
-void PortBase::WaitPortBufferCompletion(void)
+void PortBase::WaitPortBufferCompletion(bool populate)
 {
-    pthread_mutex_lock(&hdrs_lock);
-    if (!buffer_hdrs_completion) {
+    lockstat_mutex_lock(&hdrs_lock);
+    /*
+     * checks the headers rather than the wakeups, the client or the tunnel
+     * peer may have completed them before this is called
+     */
+    while (populate ? nr_buffer_hdrs < portdefinition.nBufferCountActual :
+                      nr_buffer_hdrs > 0) {
         omx_verboseLog("%s(): %s:%s:PortIndex %lu: wait for buffer header completion\n",
              __FUNCTION__, cbase->GetName(), cbase->GetWorkingRole(),
              portdefinition.nPortIndex);
-        pthread_cond_wait(&hdrs_wait, &hdrs_lock);
+        /* waiting for omx-il client, don't occupy a shared executor thread */
+        Executor::BeginBlocking();
+        lockstat_cond_wait(&hdrs_wait, &hdrs_lock);
+        Executor::EndBlocking();
         omx_verboseLog("%s(): %s:%s:PortIndex %lu: wokeup (buffer header completion)\n",
              __FUNCTION__, cbase->GetName(), cbase->GetWorkingRole(),
              portdefinition.nPortIndex);
     }
-    buffer_hdrs_completion = !buffer_hdrs_completion;
-    pthread_mutex_unlock(&hdrs_lock);
+    lockstat_mutex_unlock(&hdrs_lock);
+}
+
+/* must be held hdrs_lock, no buffer is queued */
+OMX_ERRORTYPE PortBase::ReserveBufferQueue(void)
+{
+    OMX_U32 nr_buffers = portdefinition.nBufferCountActual;
+    OMX_BUFFERHEADERTYPE **temp;
+    struct port_buffer_stamp *temp_stamps;
+    OMX_U32 nr_slots;
+
+    if (!nr_buffers)
+        nr_buffers = 1;
+
+    /* at most half full, the stamps're optional, keep going without them */
+    for (nr_slots = 4; nr_slots < nr_buffers * 2; nr_slots <<= 1)
+        ;
+    if (nr_stamps < nr_slots) {
+        temp_stamps = (struct port_buffer_stamp *)
+            realloc(stamps, sizeof(*stamps) * nr_slots);
+        if (temp_stamps) {
+            stamps = temp_stamps;
+            nr_stamps = nr_slots;
+        }
+    }
+    if (stamps)
+        memset(stamps, 0, sizeof(*stamps) * nr_stamps);
+
+    /* a tunneled port returns the buffers through tunnel_sendq */
+    if (tunnel_peer && ring_capacity(&tunnel_sendq) < nr_buffers) {
+        if (ring_init(&tunnel_sendq, nr_buffers))
+            return OMX_ErrorInsufficientResources;
+    }
+
+    if (ring_capacity(&bufferq) >= nr_buffers)
+        return OMX_ErrorNone;
+
+    if (ring_init(&bufferq, nr_buffers))
+        return OMX_ErrorInsufficientResources;
+
+    temp = (OMX_BUFFERHEADERTYPE **)
+        realloc(headq, sizeof(*headq) * ring_capacity(&bufferq));
+    if (!temp) {
+        ring_free(&bufferq);
+        return OMX_ErrorInsufficientResources;
+    }
+    headq = temp;
+    nr_headq = 0;
+
+    omx_verboseLog("%s(): %s:%s:PortIndex %lu: bufferq for %u buffers\n",
+         __FUNCTION__, cbase->GetName(), cbase->GetWorkingRole(),
+         portdefinition.nPortIndex, ring_capacity(&bufferq));
+
+    return OMX_ErrorNone;
 }
 
 /* Empty/FillThisBuffer */
 OMX_ERRORTYPE PortBase::PushThisBuffer(OMX_BUFFERHEADERTYPE *pBuffer)
 {
-    int ret;
+    OMX_ERRORTYPE ret;
 
     omx_verboseLog("%s(): %s:%s:PortIndex %lu:pBuffer %p:\n",
                     __FUNCTION__, cbase->GetName(), cbase->GetWorkingRole(),
                     portdefinition.nPortIndex, pBuffer);
 
-    pthread_mutex_lock(&bufferq_lock);
-    ret = queue_push_tail(&bufferq, pBuffer);
-    pthread_mutex_unlock(&bufferq_lock);
+    /*
+     * left behind by ReportPortSettingsChanged(), or by a port definition
+     * set while disabled. payloads given by UseBuffer() are the client's
+     */
+    if (pBuffer->nAllocLen < portdefinition.nBufferSize &&
+        reconfigure_in_place && !tunnel_peer &&
+        ((struct port_buffer_hdr *)pBuffer)->payload &&
+        (nr_reconfiguring || !IsEnabled())) {
+        ret = GrowBuffer(pBuffer);
+        if (ret != OMX_ErrorNone)
+            return ret;
+    }
 
-    if (ret)
+    if (ring_push(&bufferq, pBuffer)) {
+        omx_errorLog("%s(): %s:%s:PortIndex %lu:pBuffer %p: bufferq is full "
+             "(%u)\n", __FUNCTION__, cbase->GetName(), cbase->GetWorkingRole(),
+             portdefinition.nPortIndex, pBuffer, ring_capacity(&bufferq));
         return OMX_ErrorInsufficientResources;
+    }
+    TRACE_INSTANT("buffer", "push", cbase->GetName(), (uintptr_t)pBuffer,
+                  portdefinition.nPortIndex);
+
+    /* a buffer came back from the peer, wake up FreeTunnelBuffers() */
+    if (IsBufferSupplier()) {
+        __sync_synchronize();
+        if (tunnel_draining) {
+            lockstat_mutex_lock(&tunnel_lock);
+            pthread_cond_signal(&tunnel_wait);
+            lockstat_mutex_unlock(&tunnel_lock);
+        }
+    }
+    /*
+     * the supplier waits for its buffers while this port's disabled, send
+     * back the ones it pushed after the flush. pairs with SetDisabling()
+     */
+    else if (tunnel_peer) {
+        __sync_synchronize();
+        if (disabling) {
+            OMX_BUFFERHEADERTYPE *buffer;
+
+            /* the flag's cleared under tunnel_lock, not after the pop */
+            lockstat_mutex_lock(&tunnel_lock);
+            while (disabling &&
+                   (buffer = (OMX_BUFFERHEADERTYPE *)ring_pop(&bufferq))) {
+                lockstat_mutex_unlock(&tunnel_lock);
+                ReturnThisBuffer(buffer);
+                lockstat_mutex_lock(&tunnel_lock);
+            }
+            lockstat_mutex_unlock(&tunnel_lock);
+            SendTunnelBuffers();
+        }
+    }
 
     return OMX_ErrorNone;
 }
@@ -563,9 +932,14 @@ OMX_BUFFERHEADERTYPE *PortBase::PopBuffer(void)
 {
     OMX_BUFFERHEADERTYPE *buffer;
 
-    pthread_mutex_lock(&bufferq_lock);
-    buffer = (OMX_BUFFERHEADERTYPE *)queue_pop_head(&bufferq);
-    pthread_mutex_unlock(&bufferq_lock);
+    if (nr_headq)
+        buffer = headq[--nr_headq];
+    else
+        buffer = (OMX_BUFFERHEADERTYPE *)ring_pop(&bufferq);
+
+    if (buffer)
+        TRACE_INSTANT("buffer", "pop", cbase->GetName(), (uintptr_t)buffer,
+                      portdefinition.nPortIndex);
 
     omx_verboseLog("%s(): %s:%s:PortIndex %lu:pBuffer %p:\n",
             __FUNCTION__, cbase->GetName(), cbase->GetWorkingRole(),
@@ -576,32 +950,54 @@ OMX_BUFFERHEADERTYPE *PortBase::PopBuffer(void)
 
 OMX_U32 PortBase::BufferQueueLength(void)
 {
-    OMX_U32 length;
+    return nr_headq + ring_length(&bufferq);
+}
 
-    pthread_mutex_lock(&bufferq_lock);
-    length = queue_length(&bufferq);
-    pthread_mutex_unlock(&bufferq_lock);
+static void reverse_buffers(OMX_BUFFERHEADERTYPE **buffers, OMX_U32 nr)
+{
+    OMX_BUFFERHEADERTYPE *temp;
+    OMX_U32 i;
 
-    return length;
+    for (i = 0; i < nr / 2; i++) {
+        temp = buffers[i];
+        buffers[i] = buffers[nr - 1 - i];
+        buffers[nr - 1 - i] = temp;
+    }
 }
 
+/* must be held ComponentBase::ports_block */
 OMX_ERRORTYPE PortBase::RemoveThisBuffer(OMX_BUFFERHEADERTYPE *pBuffer)
 {
-    void *data;
+    OMX_BUFFERHEADERTYPE *buffer;
+    OMX_U32 nr_old = nr_headq, i;
 
     omx_verboseLog("%s(): %s:%s:PortIndex %lu:pBuffer %p:\n",
             __FUNCTION__, cbase->GetName(), cbase->GetWorkingRole(),
             portdefinition.nPortIndex, pBuffer);
 
-    pthread_mutex_lock(&bufferq_lock);
-    data = queue_remove(&bufferq, pBuffer);
-    pthread_mutex_unlock(&bufferq_lock);
-
-    if (NULL == data) {
+    /*
+     * move all buffers of bufferq into headq in order, under the ones
+     * already there. they're stacked on top and rotated down in place,
+     * headq has room for all the buffers of the port
+     */
+    while ((nr_headq < ring_capacity(&bufferq)) &&
+           (buffer = (OMX_BUFFERHEADERTYPE *)ring_pop(&bufferq)))
+        headq[nr_headq++] = buffer;
+    reverse_buffers(headq, nr_headq);
+    reverse_buffers(headq + nr_headq - nr_old, nr_old);
+
+    for (i = nr_headq; i > 0; i--) {
+        if (headq[i - 1] == pBuffer)
+            break;
+    }
+    if (!i) {
         omx_errorLog("%s(): Did not find the data %p", __FUNCTION__, pBuffer);
         return OMX_ErrorBadParameter;
     }
 
+    memmove(&headq[i - 1], &headq[i], sizeof(*headq) * (nr_headq - i));
+    nr_headq--;
+
     return OMX_ErrorNone;
 }
 
@@ -651,6 +1047,20 @@ OMX_ERRORTYPE PortBase::ReturnThisBuffer(OMX_BUFFERHEADERTYPE *pBuffer)
         return OMX_ErrorBadParameter;
     }
 
+    TRACE_INSTANT("buffer", "return", cbase->GetName(), (uintptr_t)pBuffer,
+                  port_index);
+
+    /* before the handoff, the buffer may come back at once */
+    if (IsLatencyEnabled()) {
+        struct port_buffer_stamp *stamp = FindStamp(pBuffer);
+
+        if (stamp && stamp->queued) {
+            histogram_record(&latency[OMX_IntelLatencyResidency],
+                             WorkQueue::Now() - stamp->queued);
+            stamp->queued = 0;
+        }
+    }
+
     // Per spec 1.1.2 section 3.1.1.4.5 EventBufferFlag is to be sent
     // only on output port
 
@@ -677,7 +1087,22 @@ OMX_ERRORTYPE PortBase::ReturnThisBuffer(OMX_BUFFERHEADERTYPE *pBuffer)
         pBuffer->pMarkData = NULL;
     }
 
-    ret = bufferdone_callback(owner, appdata, pBuffer);
+    if (tunnel_peer) {
+        /* the caller may hold locks the peer takes, see SendTunnelBuffers() */
+        ret = OMX_ErrorNone;
+        if (ring_push(&tunnel_sendq, pBuffer)) {
+            ret = OMX_ErrorInsufficientResources;
+            omx_errorLog("%s(): %s:%s:PortIndex %lu:pBuffer %p: "
+                 "tunnel sendq is full (%u)\n", __FUNCTION__,
+                 cbase->GetName(), cbase->GetWorkingRole(),
+                 portdefinition.nPortIndex, pBuffer,
+                 ring_capacity(&tunnel_sendq));
+            if (IsBufferSupplier())
+                HoldTunnelBuffer(pBuffer);
+        }
+    }
+    else
+        ret = bufferdone_callback(owner, appdata, pBuffer);
 
     omx_verboseLog("%s(): %s:%s:PortIndex %lu: exit done, "
          "callback returned (0x%08x)\n", __FUNCTION__,
@@ -687,6 +1112,168 @@ OMX_ERRORTYPE PortBase::ReturnThisBuffer(OMX_BUFFERHEADERTYPE *pBuffer)
     return OMX_ErrorNone;
 }
 
+void PortBase::SendTunnelBuffers(void)
+{
+    OMX_BUFFERHEADERTYPE *buffer;
+    OMX_ERRORTYPE ret;
+
+    if (!tunnel_peer)
+        return;
+
+    /*
+     * the running one sends what the others queue, it looks at the queue
+     * again after letting go, a buffer queued meanwhile isn't left behind
+     */
+    do {
+        if (!__sync_bool_compare_and_swap(&tunnel_sending, 0, 1))
+            return;
+
+        while ((buffer = (OMX_BUFFERHEADERTYPE *)ring_pop(&tunnel_sendq))) {
+            /* zero-copy, the peer port queues it and schedules its work */
+            if (portdefinition.eDir == OMX_DirOutput)
+                ret = OMX_EmptyThisBuffer(tunnel_peer, buffer);
+            else
+                ret = OMX_FillThisBuffer(tunnel_peer, buffer);
+
+            if (ret != OMX_ErrorNone) {
+                omx_errorLog("%s(): %s:%s:PortIndex %lu:pBuffer %p: "
+                     "tunneled port %lu refused buffer (0x%08x)\n",
+                     __FUNCTION__, cbase->GetName(), cbase->GetWorkingRole(),
+                     portdefinition.nPortIndex, buffer, tunnel_port, ret);
+                if (IsBufferSupplier())
+                    HoldTunnelBuffer(buffer);
+            }
+        }
+
+        tunnel_sending = 0;
+        __sync_synchronize();
+        /* a push in progress sends by itself once done */
+    } while (ring_length(&tunnel_sendq) && !ring_pushing(&tunnel_sendq));
+}
+
+/* buffer latency */
+bool PortBase::IsLatencyEnabled(void)
+{
+    static int enabled = -1;
+
+    if (enabled < 0) {
+        const char *env = getenv("OMXIL_PORT_LATENCY");
+
+        enabled = !(env && !strcmp(env, "0"));
+    }
+
+    return enabled;
+}
+
+/*
+ * lock-free lookup. a slot never goes back to empty while the port has
+ * buffers, so the probe sequence of a buffer in flight stays intact across
+ * AddStamp() and RemoveStamp() of the other buffers
+ */
+struct port_buffer_stamp *PortBase::FindStamp(
+    const OMX_BUFFERHEADERTYPE *pBuffer)
+{
+    OMX_U32 i, slot;
+
+    if (!nr_stamps)
+        return NULL;
+
+    slot = stamp_hash(pBuffer);
+    for (i = 0; i < nr_stamps; i++, slot++) {
+        const OMX_BUFFERHEADERTYPE *hdr = stamps[slot & (nr_stamps - 1)].hdr;
+
+        if (hdr == pBuffer)
+            return &stamps[slot & (nr_stamps - 1)];
+        if (!hdr)
+            break;
+    }
+
+    return NULL;
+}
+
+/* must be held hdrs_lock */
+void PortBase::AddStamp(const OMX_BUFFERHEADERTYPE *pBuffer)
+{
+    struct port_buffer_stamp *stamp;
+    OMX_U32 i, slot;
+
+    if (!nr_stamps)
+        return;
+
+    slot = stamp_hash(pBuffer);
+    for (i = 0; i < nr_stamps; i++, slot++) {
+        stamp = &stamps[slot & (nr_stamps - 1)];
+
+        if (!stamp->hdr || stamp->hdr == STAMP_FREED) {
+            stamp->queued = 0;
+            stamp->processed = false;
+            __sync_synchronize();
+            stamp->hdr = pBuffer;
+            return;
+        }
+    }
+}
+
+/* must be held hdrs_lock */
+void PortBase::RemoveStamp(const OMX_BUFFERHEADERTYPE *pBuffer)
+{
+    struct port_buffer_stamp *stamp = FindStamp(pBuffer);
+
+    if (stamp)
+        stamp->hdr = STAMP_FREED;
+}
+
+void PortBase::StampQueued(OMX_BUFFERHEADERTYPE *pBuffer,
+                           unsigned long long now)
+{
+    struct port_buffer_stamp *stamp = FindStamp(pBuffer);
+
+    if (!stamp)
+        return;
+
+    stamp->queued = now;
+    stamp->processed = false;
+}
+
+void PortBase::StampProcessed(OMX_BUFFERHEADERTYPE *pBuffer,
+                              unsigned long long start,
+                              unsigned long long end, bool done)
+{
+    struct port_buffer_stamp *stamp = FindStamp(pBuffer);
+
+    if (!stamp || !stamp->queued)
+        return;
+
+    /* a retained buffer's processed again, it waited only once */
+    if (!stamp->processed) {
+        histogram_record(&latency[OMX_IntelLatencyQueueWait],
+                         start > stamp->queued ? start - stamp->queued : 0);
+        stamp->processed = true;
+    }
+    histogram_record(&latency[OMX_IntelLatencyProcessing], end - start);
+
+    if (done) {
+        histogram_record(&latency[OMX_IntelLatencyResidency],
+                         end - stamp->queued);
+        stamp->queued = 0;
+    }
+}
+
+void PortBase::GetLatency(OMX_INTEL_LATENCYTYPE type, struct histogram *h)
+{
+    memcpy(h, &latency[type], sizeof(*h));
+}
+
+void PortBase::ResetLatency(void)
+{
+    OMX_U32 i;
+
+    for (i = 0; i < sizeof(latency) / sizeof(latency[0]); i++)
+        histogram_reset(&latency[i]);
+}
+
+/* end of buffer latency */
+
 /* retain buffer */
 OMX_ERRORTYPE PortBase::RetainThisBuffer(OMX_BUFFERHEADERTYPE *pBuffer,
         bool accumulate)
@@ -708,7 +1295,7 @@ OMX_ERRORTYPE PortBase::RetainThisBuffer(OMX_BUFFERHEADERTYPE *pBuffer,
             return OMX_ErrorBadParameter;
         }
 
-        pthread_mutex_lock(&retainedbufferq_lock);
+        lockstat_mutex_lock(&retainedbufferq_lock);
         if ((OMX_U32)queue_length(&retainedbufferq) <
                 portdefinition.nBufferCountActual)
             ret = queue_push_tail(&retainedbufferq, pBuffer);
@@ -722,16 +1309,19 @@ OMX_ERRORTYPE PortBase::RetainThisBuffer(OMX_BUFFERHEADERTYPE *pBuffer,
                  queue_length(&retainedbufferq),
                  portdefinition.nBufferCountActual);
         }
-        pthread_mutex_unlock(&retainedbufferq_lock);
+        lockstat_mutex_unlock(&retainedbufferq_lock);
     }
     /*
      * just push at head of bufferq to get this buffer again in
      * ComponentBase::ProcessorProcess()
      */
     else {
-        pthread_mutex_lock(&bufferq_lock);
-        ret = queue_push_head(&bufferq, pBuffer);
-        pthread_mutex_unlock(&bufferq_lock);
+        if (nr_headq < ring_capacity(&bufferq)) {
+            headq[nr_headq++] = pBuffer;
+            ret = 0;
+        }
+        else
+            ret = -1;
     }
 
     if (ret)
@@ -749,7 +1339,7 @@ void PortBase::ReturnAllRetainedBuffers(void)
     OMX_ERRORTYPE ret;
     int i = 0;
 
-    pthread_mutex_lock(&retainedbufferq_lock);
+    lockstat_mutex_lock(&retainedbufferq_lock);
 
     do {
         buffer = (OMX_BUFFERHEADERTYPE *)queue_pop_head(&retainedbufferq);
@@ -769,7 +1359,7 @@ void PortBase::ReturnAllRetainedBuffers(void)
         }
     } while (buffer);
 
-    pthread_mutex_unlock(&retainedbufferq_lock);
+    lockstat_mutex_unlock(&retainedbufferq_lock);
 
     omx_verboseLog(
             "%s(): %s:%s:PortIndex %lu: returned all retained buffers (%d)\n",
@@ -787,10 +1377,30 @@ OMX_ERRORTYPE PortBase::FlushPort(void)
          cbase->GetName(), cbase->GetWorkingRole(),
          portdefinition.nPortIndex);
 
-    ReturnAllRetainedBuffers();
+    if (IsBufferSupplier()) {
+        /* supplier keeps its buffers, these're sent again when primed */
+        lockstat_mutex_lock(&retainedbufferq_lock);
+        while ((buffer = (OMX_BUFFERHEADERTYPE *)
+                queue_pop_head(&retainedbufferq)))
+            HoldTunnelBuffer(buffer);
+        lockstat_mutex_unlock(&retainedbufferq_lock);
 
-    while ((buffer = PopBuffer()))
-        ReturnThisBuffer(buffer);
+        while ((buffer = PopBuffer()))
+            HoldTunnelBuffer(buffer);
+    }
+    else {
+        OMX_U32 nr_queued;
+
+        ReturnAllRetainedBuffers();
+
+        /*
+         * the ones queued by now, a client resubmitting from its callback
+         * would keep the flush going. the later ones stay queued
+         */
+        nr_queued = BufferQueueLength();
+        while (nr_queued-- && (buffer = PopBuffer()))
+            ReturnThisBuffer(buffer);
+    }
 
     omx_verboseLog("%s(): %s:%s:PortIndex %lu: exit\n", __FUNCTION__,
          cbase->GetName(), cbase->GetWorkingRole(),
@@ -799,6 +1409,262 @@ OMX_ERRORTYPE PortBase::FlushPort(void)
     return OMX_ErrorNone;
 }
 
+/* tunnel buffer supplier */
+void PortBase::HoldTunnelBuffer(OMX_BUFFERHEADERTYPE *pBuffer)
+{
+    lockstat_mutex_lock(&tunnel_lock);
+    if (queue_push_tail(&tunnel_heldq, pBuffer))
+        omx_errorLog("%s(): %s:%s:PortIndex %lu:pBuffer %p: "
+             "cannot hold buffer\n", __FUNCTION__,
+             cbase->GetName(), cbase->GetWorkingRole(),
+             portdefinition.nPortIndex, pBuffer);
+    lockstat_mutex_unlock(&tunnel_lock);
+}
+
+/* must be held tunnel_lock */
+OMX_U32 PortBase::TunnelBuffersAtHome(void)
+{
+    return queue_length(&tunnel_heldq) + BufferQueueLength() +
+        queue_length(&retainedbufferq);
+}
+
+OMX_ERRORTYPE PortBase::AllocateTunnelBuffers(void)
+{
+    OMX_PARAM_PORTDEFINITIONTYPE peerdef;
+    OMX_BUFFERHEADERTYPE *buffer_hdr;
+    OMX_U32 nr_buffers, size, i;
+    struct list *entry;
+    OMX_U8 *payload;
+    size_t payload_size;
+    OMX_ERRORTYPE ret;
+
+    if (!IsBufferSupplier())
+        return OMX_ErrorNone;
+
+    ComponentBase::SetTypeHeader(&peerdef, sizeof(peerdef));
+    peerdef.nPortIndex = tunnel_port;
+    ret = OMX_GetParameter(tunnel_peer, OMX_IndexParamPortDefinition, &peerdef);
+    if (ret != OMX_ErrorNone) {
+        omx_errorLog("%s(): %s:%s:PortIndex %lu: exit failure, "
+             "cannot get tunneled port definition (0x%08x)\n", __FUNCTION__,
+             cbase->GetName(), cbase->GetWorkingRole(),
+             portdefinition.nPortIndex, ret);
+        return ret;
+    }
+
+    /* both ports must be populated with the same buffers */
+    nr_buffers = portdefinition.nBufferCountActual;
+    if (nr_buffers < peerdef.nBufferCountActual)
+        nr_buffers = peerdef.nBufferCountActual;
+    size = portdefinition.nBufferSize;
+    if (size < peerdef.nBufferSize)
+        size = peerdef.nBufferSize;
+
+    if (peerdef.nBufferCountActual != nr_buffers) {
+        peerdef.nBufferCountActual = nr_buffers;
+        ret = OMX_SetParameter(tunnel_peer, OMX_IndexParamPortDefinition,
+                               &peerdef);
+        if (ret != OMX_ErrorNone) {
+            omx_errorLog("%s(): %s:%s:PortIndex %lu: exit failure, "
+                 "cannot set tunneled port buffer count %lu (0x%08x)\n",
+                 __FUNCTION__, cbase->GetName(), cbase->GetWorkingRole(),
+                 portdefinition.nPortIndex, nr_buffers, ret);
+            return ret;
+        }
+    }
+
+    lockstat_mutex_lock(&hdrs_lock);
+    portdefinition.nBufferCountActual = nr_buffers;
+    lockstat_mutex_unlock(&hdrs_lock);
+
+    for (i = 0; i < nr_buffers; i++) {
+        payload_size = size;
+        payload = (OMX_U8 *)bufpool_alloc(&payload_size);
+        if (!payload) {
+            ret = OMX_ErrorInsufficientResources;
+            goto free_buffers;
+        }
+
+        /* nAllocLen is the usable size, given back to bufpool_free() */
+        ret = OMX_UseBuffer(tunnel_peer, &buffer_hdr, tunnel_port, NULL,
+                            payload_size, payload);
+        if (ret != OMX_ErrorNone) {
+            bufpool_free(payload, payload_size);
+            goto free_buffers;
+        }
+
+        /* the peer owns the header, fill this port's half of it */
+        if (portdefinition.eDir == OMX_DirInput) {
+            buffer_hdr->nInputPortIndex = portdefinition.nPortIndex;
+            buffer_hdr->pInputPortPrivate = this;
+        }
+        else {
+            buffer_hdr->nOutputPortIndex = portdefinition.nPortIndex;
+            buffer_hdr->pOutputPortPrivate = this;
+        }
+
+        lockstat_mutex_lock(&hdrs_lock);
+        entry = NULL;
+        if (nr_buffer_hdrs || ReserveBufferQueue() == OMX_ErrorNone)
+            entry = list_alloc(buffer_hdr);
+        if (!entry) {
+            lockstat_mutex_unlock(&hdrs_lock);
+            OMX_FreeBuffer(tunnel_peer, tunnel_port, buffer_hdr);
+            bufpool_free(payload, payload_size);
+            ret = OMX_ErrorInsufficientResources;
+            goto free_buffers;
+        }
+        buffer_hdrs = __list_add_tail(buffer_hdrs, entry);
+        nr_buffer_hdrs++;
+        AddStamp(buffer_hdr);
+
+        if (nr_buffer_hdrs == portdefinition.nBufferCountActual) {
+            portdefinition.bPopulated = OMX_TRUE;
+            pthread_cond_signal(&hdrs_wait);
+        }
+        lockstat_mutex_unlock(&hdrs_lock);
+
+        HoldTunnelBuffer(buffer_hdr);
+    }
+
+    omx_verboseLog("%s(): %s:%s:PortIndex %lu: supplied %lu buffers (%lu bytes) "
+         "to tunneled port %lu\n", __FUNCTION__,
+         cbase->GetName(), cbase->GetWorkingRole(),
+         portdefinition.nPortIndex, nr_buffers, size, tunnel_port);
+    return OMX_ErrorNone;
+
+free_buffers:
+    omx_errorLog("%s(): %s:%s:PortIndex %lu: exit failure, "
+         "cannot supply buffer %lu/%lu (0x%08x)\n", __FUNCTION__,
+         cbase->GetName(), cbase->GetWorkingRole(),
+         portdefinition.nPortIndex, i, nr_buffers, ret);
+    FreeTunnelBuffers(false);
+    return ret;
+}
+
+OMX_ERRORTYPE PortBase::FreeTunnelBuffers(bool wait)
+{
+    OMX_BUFFERHEADERTYPE *buffer;
+    struct list *hdrs, *entry, *temp;
+    struct timespec deadline;
+    OMX_U8 *payload;
+    size_t payload_size;
+    OMX_ERRORTYPE ret = OMX_ErrorNone;
+
+    if (!IsBufferSupplier() || !nr_buffer_hdrs)
+        return OMX_ErrorNone;
+
+    lockstat_mutex_lock(&tunnel_lock);
+    if (wait) {
+        /* the peer returns the buffers it holds when it flushes */
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += TUNNEL_RETURN_TIMEOUT;
+
+        Executor::BeginBlocking();
+        tunnel_draining = true;
+        __sync_synchronize();
+        while (TunnelBuffersAtHome() < nr_buffer_hdrs) {
+            if (lockstat_cond_timedwait(&tunnel_wait, &tunnel_lock,
+                                        &deadline)) {
+                ret = OMX_ErrorTimeout;
+                break;
+            }
+        }
+        tunnel_draining = false;
+        Executor::EndBlocking();
+    }
+
+    /* the peer may still use the others, free none of them */
+    if (ret != OMX_ErrorNone) {
+        omx_errorLog("%s(): %s:%s:PortIndex %lu: exit failure, %lu/%lu "
+             "buffers returned from tunneled port\n", __FUNCTION__,
+             cbase->GetName(), cbase->GetWorkingRole(),
+             portdefinition.nPortIndex, TunnelBuffersAtHome(),
+             nr_buffer_hdrs);
+        lockstat_mutex_unlock(&tunnel_lock);
+        return ret;
+    }
+
+    /* buffers're freed by the list, just drop them from the queues */
+    while (queue_pop_head(&tunnel_heldq))
+        ;
+    lockstat_mutex_unlock(&tunnel_lock);
+
+    while (PopBuffer())
+        ;
+    while (ring_pop(&tunnel_sendq))
+        ;
+    lockstat_mutex_lock(&retainedbufferq_lock);
+    while (queue_pop_head(&retainedbufferq))
+        ;
+    lockstat_mutex_unlock(&retainedbufferq_lock);
+
+    lockstat_mutex_lock(&hdrs_lock);
+    hdrs = buffer_hdrs;
+    buffer_hdrs = NULL;
+    nr_buffer_hdrs = 0;
+    list_foreach(hdrs, entry)
+        RemoveStamp((OMX_BUFFERHEADERTYPE *)entry->data);
+
+    portdefinition.bPopulated = OMX_FALSE;
+    pthread_cond_signal(&hdrs_wait);
+    lockstat_mutex_unlock(&hdrs_lock);
+
+    /* the headers're freed by the peer, it takes its own locks */
+    list_foreach_safe(hdrs, entry, temp) {
+        buffer = (OMX_BUFFERHEADERTYPE *)entry->data;
+        payload = buffer->pBuffer;
+        payload_size = buffer->nAllocLen;
+
+        hdrs = __list_delete(hdrs, entry);
+        OMX_FreeBuffer(tunnel_peer, tunnel_port, buffer);
+        bufpool_free(payload, payload_size);
+    }
+
+    omx_verboseLog("%s(): %s:%s:PortIndex %lu: freed all supplied buffers\n",
+         __FUNCTION__, cbase->GetName(), cbase->GetWorkingRole(),
+         portdefinition.nPortIndex);
+    return OMX_ErrorNone;
+}
+
+void PortBase::PrimeTunnelBuffers(void)
+{
+    OMX_BUFFERHEADERTYPE *buffer;
+    OMX_HANDLETYPE target;
+    OMX_ERRORTYPE ret;
+
+    if (!IsBufferSupplier())
+        return;
+
+    /* empty buffers go to the output port of the tunnel */
+    if (portdefinition.eDir == OMX_DirOutput)
+        target = owner;
+    else
+        target = tunnel_peer;
+
+    lockstat_mutex_lock(&tunnel_lock);
+    while ((buffer = (OMX_BUFFERHEADERTYPE *)
+            queue_pop_head(&tunnel_heldq))) {
+        lockstat_mutex_unlock(&tunnel_lock);
+
+        buffer->nFilledLen = 0;
+        buffer->nOffset = 0;
+        buffer->nFlags = 0;
+        ret = OMX_FillThisBuffer(target, buffer);
+
+        lockstat_mutex_lock(&tunnel_lock);
+        if (ret != OMX_ErrorNone) {
+            omx_errorLog("%s(): %s:%s:PortIndex %lu:pBuffer %p: "
+                 "cannot prime buffer (0x%08x)\n", __FUNCTION__,
+                 cbase->GetName(), cbase->GetWorkingRole(),
+                 portdefinition.nPortIndex, buffer, ret);
+            queue_push_head(&tunnel_heldq, buffer);
+            break;
+        }
+    }
+    lockstat_mutex_unlock(&tunnel_lock);
+}
+
 OMX_STATETYPE PortBase::GetOwnerState(void)
 {
     OMX_STATETYPE state = OMX_StateInvalid;
@@ -820,13 +1686,13 @@ bool PortBase::IsEnabled(void)
     bool enabled;
     bool unlock = true;
 
-    if (pthread_mutex_trylock(&state_lock))
+    if (lockstat_mutex_trylock(&state_lock))
         unlock = false;
 
     enabled = (state == OMX_PortEnabled) ? true : false;
 
     if (unlock)
-        pthread_mutex_unlock(&state_lock);
+        lockstat_mutex_unlock(&state_lock);
 
     return enabled;
 }
@@ -834,12 +1700,24 @@ bool PortBase::IsEnabled(void)
 bool PortBase::IsCeased(void)
 {
     bool ceased;
-    pthread_mutex_lock(&state_lock);
-    ceased = (port_settings_changed_pending || (state != OMX_PortEnabled));
-    pthread_mutex_unlock(&state_lock);
+    lockstat_mutex_lock(&state_lock);
+    ceased = (port_settings_changed_pending || (state != OMX_PortEnabled) ||
+              disabling);
+    lockstat_mutex_unlock(&state_lock);
     return ceased;
 }
 
+void PortBase::SetDisabling(bool disabling)
+{
+    lockstat_mutex_lock(&state_lock);
+    lockstat_mutex_lock(&tunnel_lock);
+    this->disabling = disabling;
+    /* pairs with PushThisBuffer(), either sees the other's buffer or flag */
+    __sync_synchronize();
+    lockstat_mutex_unlock(&tunnel_lock);
+    lockstat_mutex_unlock(&state_lock);
+}
+
 OMX_DIRTYPE PortBase::GetPortDirection(void)
 {
     return portdefinition.eDir;
@@ -854,9 +1732,9 @@ OMX_ERRORTYPE PortBase::PushMark(OMX_MARKTYPE *mark)
 {
     int ret;
 
-    pthread_mutex_lock(&markq_lock);
+    lockstat_mutex_lock(&markq_lock);
     ret = queue_push_tail(&markq, mark);
-    pthread_mutex_unlock(&markq_lock);
+    lockstat_mutex_unlock(&markq_lock);
 
     if (ret)
         return OMX_ErrorInsufficientResources;
@@ -868,9 +1746,9 @@ OMX_MARKTYPE *PortBase::PopMark(void)
 {
     OMX_MARKTYPE *mark;
 
-    pthread_mutex_lock(&markq_lock);
+    lockstat_mutex_lock(&markq_lock);
     mark = (OMX_MARKTYPE *)queue_pop_head(&markq);
-    pthread_mutex_unlock(&markq_lock);
+    lockstat_mutex_unlock(&markq_lock);
 
     return mark;
 }
@@ -899,8 +1777,7 @@ OMX_ERRORTYPE PortBase::TransState(OMX_U8 transition)
          cbase->GetName(), cbase->GetWorkingRole(), portdefinition.nPortIndex,
          GetPortStateName(state), GetPortStateName(transition));
 
-    pthread_mutex_lock(&state_lock);
-
+    /* only the command handler changes the state */
     current = state;
 
     if (current == transition) {
@@ -909,56 +1786,100 @@ OMX_ERRORTYPE PortBase::TransState(OMX_U8 transition)
              __FUNCTION__,
              cbase->GetName(), cbase->GetWorkingRole(),
              portdefinition.nPortIndex, GetPortStateName(current));
-        goto unlock;
+        goto out;
     }
 
-    if (transition == OMX_PortEnabled) {
-        WaitPortBufferCompletion();
-        portdefinition.bEnabled = OMX_TRUE;
-        port_settings_changed_pending = false;
-    }
-    else if(transition == OMX_PortDisabled) {
-        /*need to flush only if port is not empty*/
-        if (nr_buffer_hdrs)
-        {
-           FlushPort();
-           WaitPortBufferCompletion();
-        }
-        portdefinition.bEnabled = OMX_FALSE;
-    }
-    else {
+    if (transition != OMX_PortEnabled && transition != OMX_PortDisabled) {
         ret = OMX_ErrorBadParameter;
         omx_errorLog("%s(): %s:%s:PortIndex %lu: exit failure, invalid transition "
              "(%s)\n", __FUNCTION__,
              cbase->GetName(), cbase->GetWorkingRole(),
              portdefinition.nPortIndex, GetPortStateName(transition));
-        goto unlock;
+        goto out;
     }
 
+    /*
+     * the tunnel buffers're allocated or freed and the port's flushed by
+     * the caller. the port is ceased while waiting, no lock is held, the
+     * buffer processing may go on with the other ports
+     */
+    WaitPortBufferCompletion(transition == OMX_PortEnabled);
+
+    lockstat_mutex_lock(&state_lock);
+    if (transition == OMX_PortEnabled) {
+        portdefinition.bEnabled = OMX_TRUE;
+        port_settings_changed_pending = false;
+    }
+    else
+        portdefinition.bEnabled = OMX_FALSE;
     state = transition;
+    lockstat_mutex_unlock(&state_lock);
+    SetDisabling(false);
+
+    TRACE_INSTANT("state", GetPortStateName(state), cbase->GetName(), current,
+                  portdefinition.nPortIndex);
 
     omx_verboseLog("%s(): %s:%s:PortIndex %lu: transition from %s to %s complete\n",
          __FUNCTION__,
          cbase->GetName(), cbase->GetWorkingRole(), portdefinition.nPortIndex,
          GetPortStateName(current), GetPortStateName(state));
+    return OMX_ErrorNone;
 
-unlock:
-    pthread_mutex_unlock(&state_lock);
+out:
+    SetDisabling(false);
     return ret;
 }
 
 
 void PortBase::SetPortSettingsChangedPending(bool isPeding)
 {
-    pthread_mutex_lock(&state_lock);
+    lockstat_mutex_lock(&state_lock);
     port_settings_changed_pending = isPeding;
-    pthread_mutex_unlock(&state_lock);
+    lockstat_mutex_unlock(&state_lock);
 }
 
 OMX_ERRORTYPE PortBase::ReportPortSettingsChanged(void)
 {
+    OMX_BUFFERHEADERTYPE *buffer;
+    struct list *entry;
+    OMX_U32 nr_queued, nr_small = 0;
     OMX_ERRORTYPE ret;
 
+    if (CanReconfigureInPlace()) {
+        /* the headers PushThisBuffer() grows */
+        lockstat_mutex_lock(&hdrs_lock);
+        list_foreach(buffer_hdrs, entry) {
+            buffer = (OMX_BUFFERHEADERTYPE *)entry->data;
+            if (buffer->nAllocLen < portdefinition.nBufferSize)
+                nr_small++;
+        }
+        nr_reconfiguring = nr_small;
+        lockstat_mutex_unlock(&hdrs_lock);
+
+        omx_verboseLog("%s(): %s:%s:PortIndex %lu: reconfigure %lu buffers in "
+             "place (%lu bytes)\n", __FUNCTION__,
+             cbase->GetName(), cbase->GetWorkingRole(),
+             portdefinition.nPortIndex, nr_buffer_hdrs,
+             portdefinition.nBufferSize);
+
+        ret = callbacks.EventHandler(owner, appdata,
+                        OMX_EventPortSettingsChanged,
+                        portdefinition.nPortIndex,
+                        (OMX_U32)OMX_IndexParamIntelReconfigureInPlace, NULL);
+
+        /*
+         * the buffers come back through Empty/FillThisBuffer(), resized.
+         * the port keeps running, so only the buffers queued by now're
+         * returned, a client may send them again from its callback
+         */
+        ReturnAllRetainedBuffers();
+        nr_queued = BufferQueueLength();
+        while (nr_queued-- && (buffer = PopBuffer()))
+            ReturnThisBuffer(buffer);
+
+        return ret;
+    }
+
     SetPortSettingsChangedPending(true);
     ret = callbacks.EventHandler(owner, appdata,
                                   OMX_EventPortSettingsChanged,
@@ -983,6 +1904,79 @@ OMX_ERRORTYPE PortBase::ReportConfigOutputCrop(void)
     return ret;
 }
 
+bool PortBase::CanReconfigureInPlace(void)
+{
+    OMX_BUFFERHEADERTYPE *buffer;
+    struct list *entry;
+    bool can = true;
+
+    if (!reconfigure_in_place || tunnel_peer)
+        return false;
+
+    lockstat_mutex_lock(&hdrs_lock);
+    if (!nr_buffer_hdrs ||
+        nr_buffer_hdrs < portdefinition.nBufferCountActual)
+        can = false;
+
+    /* payloads given by UseBuffer() can't grow */
+    list_foreach(buffer_hdrs, entry) {
+        if (!can)
+            break;
+
+        buffer = (OMX_BUFFERHEADERTYPE *)entry->data;
+        if (buffer->nAllocLen < portdefinition.nBufferSize &&
+            !((struct port_buffer_hdr *)buffer)->payload)
+            can = false;
+    }
+    lockstat_mutex_unlock(&hdrs_lock);
+
+    return can;
+}
+
+/* pBuffer is neither queued nor being processed */
+OMX_ERRORTYPE PortBase::GrowBuffer(OMX_BUFFERHEADERTYPE *pBuffer)
+{
+    struct port_buffer_hdr *hdr = (struct port_buffer_hdr *)pBuffer;
+    OMX_U32 size = portdefinition.nBufferSize;
+    size_t payload_size = size;
+    OMX_U8 *payload;
+
+    /* the old payload is large enough up to its usable size */
+    if (hdr->payload_size >= size) {
+        pBuffer->nAllocLen = size;
+        goto grown;
+    }
+
+    payload = (OMX_U8 *)bufpool_alloc(&payload_size);
+    if (!payload) {
+        omx_errorLog("%s(): %s:%s:PortIndex %lu:pBuffer %p: exit failure, "
+             "cannot grow buffer to %lu bytes\n", __FUNCTION__,
+             cbase->GetName(), cbase->GetWorkingRole(),
+             portdefinition.nPortIndex, pBuffer, size);
+        return OMX_ErrorInsufficientResources;
+    }
+
+    /* keep what the client put in an input buffer */
+    if (pBuffer->nFilledLen &&
+        pBuffer->nOffset + pBuffer->nFilledLen <= pBuffer->nAllocLen)
+        memcpy(payload, hdr->payload, pBuffer->nOffset + pBuffer->nFilledLen);
+
+    bufpool_free(hdr->payload, hdr->payload_size);
+    hdr->payload = payload;
+    hdr->payload_size = payload_size;
+    pBuffer->pBuffer = payload;
+    pBuffer->nAllocLen = size;
+
+grown:
+    if (nr_reconfiguring)
+        __sync_sub_and_fetch(&nr_reconfiguring, 1);
+
+    omx_verboseLog("%s(): %s:%s:PortIndex %lu:pBuffer %p: grown to %lu bytes\n",
+         __FUNCTION__, cbase->GetName(), cbase->GetWorkingRole(),
+         portdefinition.nPortIndex, pBuffer, size);
+    return OMX_ErrorNone;
+}
+
 /* end of component methods & helpers */
 
 /* end of PortBase */
@@ -0,0 +1,469 @@
+/*
+ * tunnel_test.cpp, test of two tunneled components
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <OMX_Core.h>
+#include <OMX_Component.h>
+
+#include <componentbase.h>
+
+#include "../../utils/test/check.h"
+
+#define NR_BUFFERS      4
+#define BUFFER_SIZE     4096
+/* secs to wait for an event, longer than the tunnel return timeout */
+#define EVENT_TIMEOUT   15
+
+/* copies the input buffer to the output one */
+class PassThrough : public ComponentBase
+{
+public:
+    PassThrough() : ComponentBase((OMX_STRING)"OMX.test.passthrough") {}
+
+private:
+    virtual OMX_ERRORTYPE ComponentAllocatePorts(void)
+    {
+        OMX_PARAM_PORTDEFINITIONTYPE portdefinition;
+        OMX_U32 i;
+
+        ports = new PortBase *[2];
+        if (!ports)
+            return OMX_ErrorInsufficientResources;
+        nr_ports = 2;
+
+        for (i = 0; i < nr_ports; i++) {
+            memset(&portdefinition, 0, sizeof(portdefinition));
+            SetTypeHeader(&portdefinition, sizeof(portdefinition));
+            portdefinition.nPortIndex = i;
+            portdefinition.eDir = i ? OMX_DirOutput : OMX_DirInput;
+            portdefinition.nBufferCountActual = NR_BUFFERS;
+            portdefinition.nBufferCountMin = 2;
+            portdefinition.nBufferSize = BUFFER_SIZE;
+            portdefinition.bEnabled = OMX_TRUE;
+            portdefinition.eDomain = OMX_PortDomainOther;
+            portdefinition.format.other.eFormat = OMX_OTHER_FormatBinary;
+
+            ports[i] = new PortBase(&portdefinition);
+            if (!ports[i])
+                return OMX_ErrorInsufficientResources;
+        }
+
+        portparam.nPorts = nr_ports;
+        portparam.nStartPortNumber = 0;
+
+        return OMX_ErrorNone;
+    }
+
+    virtual OMX_ERRORTYPE ComponentGetParameter(OMX_INDEXTYPE, OMX_PTR)
+    {
+        return OMX_ErrorUnsupportedIndex;
+    }
+    virtual OMX_ERRORTYPE ComponentSetParameter(OMX_INDEXTYPE, OMX_PTR)
+    {
+        return OMX_ErrorUnsupportedIndex;
+    }
+    virtual OMX_ERRORTYPE ComponentGetConfig(OMX_INDEXTYPE, OMX_PTR)
+    {
+        return OMX_ErrorUnsupportedIndex;
+    }
+    virtual OMX_ERRORTYPE ComponentSetConfig(OMX_INDEXTYPE, OMX_PTR)
+    {
+        return OMX_ErrorUnsupportedIndex;
+    }
+
+    virtual OMX_ERRORTYPE ProcessorProcess(OMX_BUFFERHEADERTYPE **buffers,
+                                           buffer_retain_t *retain,
+                                           OMX_U32 nr_buffers)
+    {
+        OMX_BUFFERHEADERTYPE *in = buffers[0], *out = buffers[1];
+
+        (void)retain;
+        (void)nr_buffers;
+
+        memcpy(out->pBuffer, in->pBuffer + in->nOffset, in->nFilledLen);
+        out->nOffset = 0;
+        out->nFilledLen = in->nFilledLen;
+        out->nTimeStamp = in->nTimeStamp;
+        out->nFlags = in->nFlags;
+        in->nFilledLen = 0;
+
+        return OMX_ErrorNone;
+    }
+};
+
+/*
+ * the client of the pipeline, feeds the input port of src with sequence
+ * numbers and takes them from the output port of sink
+ */
+struct client_s {
+    OMX_HANDLETYPE src, sink;
+    OMX_BUFFERHEADERTYPE *in[NR_BUFFERS], *out[NR_BUFFERS];
+
+    sem_t src_event, sink_event;
+    OMX_ERRORTYPE src_error, sink_error;
+
+    /* resubmit the returned buffers */
+    volatile int flowing;
+    /* sends in order of sequence numbers, from main and the callbacks */
+    pthread_mutex_t send_lock;
+    long sent;
+    volatile long received;
+    long last;
+};
+
+static struct client_s client;
+
+static void wait_sem(sem_t *sem)
+{
+    struct timespec deadline;
+    int ret;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += EVENT_TIMEOUT;
+    while ((ret = sem_timedwait(sem, &deadline)) && errno == EINTR)
+        ;
+    CHECK(ret == 0);
+}
+
+static OMX_ERRORTYPE event_handler(OMX_HANDLETYPE hComponent, OMX_PTR pAppData,
+                                   OMX_EVENTTYPE eEvent, OMX_U32 nData1,
+                                   OMX_U32 nData2, OMX_PTR pEventData)
+{
+    struct client_s *c = (struct client_s *)pAppData;
+    bool src = hComponent == c->src;
+
+    (void)nData2;
+    (void)pEventData;
+
+    if (eEvent == OMX_EventCmdComplete)
+        sem_post(src ? &c->src_event : &c->sink_event);
+    else if (eEvent == OMX_EventError) {
+        if (src)
+            c->src_error = (OMX_ERRORTYPE)nData1;
+        else
+            c->sink_error = (OMX_ERRORTYPE)nData1;
+        sem_post(src ? &c->src_event : &c->sink_event);
+    }
+
+    return OMX_ErrorNone;
+}
+
+static void send_next(struct client_s *c, OMX_BUFFERHEADERTYPE *buffer)
+{
+    long seq;
+
+    pthread_mutex_lock(&c->send_lock);
+    seq = ++c->sent;
+    memcpy(buffer->pBuffer, &seq, sizeof(seq));
+    buffer->nOffset = 0;
+    buffer->nFilledLen = sizeof(seq);
+    OMX_EmptyThisBuffer(c->src, buffer);
+    pthread_mutex_unlock(&c->send_lock);
+}
+
+static OMX_ERRORTYPE empty_buffer_done(OMX_HANDLETYPE hComponent,
+                                       OMX_PTR pAppData,
+                                       OMX_BUFFERHEADERTYPE *pBuffer)
+{
+    struct client_s *c = (struct client_s *)pAppData;
+
+    CHECK(hComponent == c->src);
+    if (c->flowing)
+        send_next(c, pBuffer);
+
+    return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE fill_buffer_done(OMX_HANDLETYPE hComponent,
+                                      OMX_PTR pAppData,
+                                      OMX_BUFFERHEADERTYPE *pBuffer)
+{
+    struct client_s *c = (struct client_s *)pAppData;
+    long seq;
+
+    CHECK(hComponent == c->sink);
+
+    /* flushed empty while disabling or stopping */
+    if (pBuffer->nFilledLen) {
+        CHECK(pBuffer->nFilledLen == sizeof(seq));
+        memcpy(&seq, pBuffer->pBuffer + pBuffer->nOffset, sizeof(seq));
+        /* the ones lost in a flush leave a gap, never a reorder */
+        CHECK(seq > c->last);
+        c->last = seq;
+        __sync_add_and_fetch(&c->received, 1);
+    }
+
+    if (c->flowing) {
+        pBuffer->nFilledLen = 0;
+        OMX_FillThisBuffer(hComponent, pBuffer);
+    }
+
+    return OMX_ErrorNone;
+}
+
+static OMX_CALLBACKTYPE callbacks = {
+    event_handler, empty_buffer_done, fill_buffer_done,
+};
+
+static void set_state(OMX_HANDLETYPE handle, OMX_STATETYPE state)
+{
+    CHECK(OMX_SendCommand(handle, OMX_CommandStateSet, state, NULL) ==
+          OMX_ErrorNone);
+}
+
+static void check_state(OMX_HANDLETYPE handle, OMX_STATETYPE expected)
+{
+    OMX_STATETYPE state;
+
+    CHECK(OMX_GetState(handle, &state) == OMX_ErrorNone);
+    CHECK(state == expected);
+}
+
+/* src:1 -> sink:0, the input port supplies if supply_input */
+static void setup(PassThrough *src, PassThrough *sink, bool supply_input)
+{
+    const OMX_U8 *roles[] = { (const OMX_U8 *)"test.passthrough" };
+    OMX_PARAM_BUFFERSUPPLIERTYPE supplier;
+
+    memset(&client, 0, sizeof(client));
+    sem_init(&client.src_event, 0, 0);
+    sem_init(&client.sink_event, 0, 0);
+    pthread_mutex_init(&client.send_lock, NULL);
+
+    src->SetRolesOfComponent(1, roles);
+    src->SetCModule(new CModule((OMX_STRING)"libpassthrough.so"));
+    sink->SetRolesOfComponent(1, roles);
+    sink->SetCModule(new CModule((OMX_STRING)"libpassthrough.so"));
+    CHECK(src->GetHandle(&client.src, &client, &callbacks) == OMX_ErrorNone);
+    CHECK(sink->GetHandle(&client.sink, &client, &callbacks) ==
+          OMX_ErrorNone);
+
+    if (supply_input) {
+        memset(&supplier, 0, sizeof(supplier));
+        ComponentBase::SetTypeHeader(&supplier, sizeof(supplier));
+        supplier.nPortIndex = 0;
+        supplier.eBufferSupplier = OMX_BufferSupplyInput;
+        CHECK(OMX_SetParameter(client.sink, OMX_IndexParamCompBufferSupplier,
+                               &supplier) == OMX_ErrorNone);
+    }
+
+    CHECK(OMX_SetupTunnel(client.src, 1, client.sink, 0) == OMX_ErrorNone);
+}
+
+static void teardown(PassThrough *src, PassThrough *sink)
+{
+    src->FreeHandle(client.src);
+    sink->FreeHandle(client.sink);
+
+    sem_destroy(&client.src_event);
+    sem_destroy(&client.sink_event);
+    pthread_mutex_destroy(&client.send_lock);
+}
+
+static void to_idle_from_loaded(void)
+{
+    int i;
+
+    set_state(client.src, OMX_StateIdle);
+    set_state(client.sink, OMX_StateIdle);
+    for (i = 0; i < NR_BUFFERS; i++) {
+        CHECK(OMX_AllocateBuffer(client.src, &client.in[i], 0, NULL,
+                                 BUFFER_SIZE) == OMX_ErrorNone);
+        CHECK(OMX_AllocateBuffer(client.sink, &client.out[i], 1, NULL,
+                                 BUFFER_SIZE) == OMX_ErrorNone);
+    }
+    wait_sem(&client.src_event);
+    wait_sem(&client.sink_event);
+    check_state(client.src, OMX_StateIdle);
+    check_state(client.sink, OMX_StateIdle);
+}
+
+static void to_loaded_from_idle(void)
+{
+    int i;
+
+    set_state(client.src, OMX_StateLoaded);
+    set_state(client.sink, OMX_StateLoaded);
+    for (i = 0; i < NR_BUFFERS; i++) {
+        CHECK(OMX_FreeBuffer(client.src, 0, client.in[i]) == OMX_ErrorNone);
+        CHECK(OMX_FreeBuffer(client.sink, 1, client.out[i]) ==
+              OMX_ErrorNone);
+    }
+    wait_sem(&client.src_event);
+    wait_sem(&client.sink_event);
+    check_state(client.src, OMX_StateLoaded);
+    check_state(client.sink, OMX_StateLoaded);
+}
+
+static void to_executing(void)
+{
+    set_state(client.sink, OMX_StateExecuting);
+    set_state(client.src, OMX_StateExecuting);
+    wait_sem(&client.src_event);
+    wait_sem(&client.sink_event);
+}
+
+static void wait_received(long target)
+{
+    time_t deadline = time(NULL) + EVENT_TIMEOUT;
+
+    while (client.received < target) {
+        CHECK(time(NULL) < deadline);
+        usleep(1000);
+    }
+}
+
+/*
+ * stream through the tunnel, disabling and enabling the tunneled ports on
+ * the way, and stop with the buffers still flowing
+ */
+static void test_stream(bool supply_input, long nr_frames)
+{
+    PassThrough src, sink;
+    int cycle, i;
+
+    setup(&src, &sink, supply_input);
+
+    for (cycle = 0; cycle < 2; cycle++) {
+        to_idle_from_loaded();
+        to_executing();
+
+        client.flowing = 1;
+        client.sent = 0;
+        client.received = 0;
+        client.last = 0;
+        for (i = 0; i < NR_BUFFERS; i++)
+            OMX_FillThisBuffer(client.sink, client.out[i]);
+        for (i = 0; i < NR_BUFFERS; i++)
+            send_next(&client, client.in[i]);
+
+        wait_received(nr_frames / 2);
+
+        CHECK(OMX_SendCommand(client.sink, OMX_CommandPortDisable, 0,
+                              NULL) == OMX_ErrorNone);
+        CHECK(OMX_SendCommand(client.src, OMX_CommandPortDisable, 1,
+                              NULL) == OMX_ErrorNone);
+        wait_sem(&client.src_event);
+        wait_sem(&client.sink_event);
+        CHECK(client.src_error == OMX_ErrorNone);
+        CHECK(client.sink_error == OMX_ErrorNone);
+
+        CHECK(OMX_SendCommand(client.src, OMX_CommandPortEnable, 1,
+                              NULL) == OMX_ErrorNone);
+        CHECK(OMX_SendCommand(client.sink, OMX_CommandPortEnable, 0,
+                              NULL) == OMX_ErrorNone);
+        wait_sem(&client.src_event);
+        wait_sem(&client.sink_event);
+        CHECK(client.src_error == OMX_ErrorNone);
+        CHECK(client.sink_error == OMX_ErrorNone);
+
+        /* flows on through the enabled ports */
+        wait_received(client.received + nr_frames / 2);
+
+        /* the client keeps resubmitting until both're idle */
+        set_state(client.src, OMX_StateIdle);
+        set_state(client.sink, OMX_StateIdle);
+        wait_sem(&client.src_event);
+        wait_sem(&client.sink_event);
+        client.flowing = 0;
+        CHECK(client.src_error == OMX_ErrorNone);
+        CHECK(client.sink_error == OMX_ErrorNone);
+        check_state(client.src, OMX_StateIdle);
+        check_state(client.sink, OMX_StateIdle);
+
+        /* take back the ones resubmitted while stopping */
+        CHECK(OMX_SendCommand(client.src, OMX_CommandFlush, 0, NULL) ==
+              OMX_ErrorNone);
+        CHECK(OMX_SendCommand(client.sink, OMX_CommandFlush, 1, NULL) ==
+              OMX_ErrorNone);
+        wait_sem(&client.src_event);
+        wait_sem(&client.sink_event);
+
+        to_loaded_from_idle();
+        CHECK(client.src_error == OMX_ErrorNone);
+        CHECK(client.sink_error == OMX_ErrorNone);
+    }
+
+    teardown(&src, &sink);
+}
+
+/*
+ * the supplying src can't free its buffers held by the executing sink,
+ * gives up after the tunnel return timeout and stays idle
+ */
+static void test_return_timeout(void)
+{
+    PassThrough src, sink;
+    time_t start;
+    int i;
+
+    setup(&src, &sink, false);
+    to_idle_from_loaded();
+    to_executing();
+
+    /* no output buffer in the sink, it holds what the src sends */
+    for (i = 0; i < NR_BUFFERS; i++)
+        send_next(&client, client.in[i]);
+    usleep(100000);
+
+    set_state(client.src, OMX_StateIdle);
+    wait_sem(&client.src_event);
+    check_state(client.src, OMX_StateIdle);
+
+    start = time(NULL);
+    set_state(client.src, OMX_StateLoaded);
+    wait_sem(&client.src_event);
+    CHECK(client.src_error == OMX_ErrorTimeout);
+    CHECK(time(NULL) - start >= 4);
+    check_state(client.src, OMX_StateIdle);
+    client.src_error = OMX_ErrorNone;
+
+    /* the sink flushes the buffers back, then the src can free them */
+    set_state(client.sink, OMX_StateIdle);
+    wait_sem(&client.sink_event);
+    CHECK(client.sink_error == OMX_ErrorNone);
+
+    to_loaded_from_idle();
+    CHECK(client.src_error == OMX_ErrorNone);
+    CHECK(client.sink_error == OMX_ErrorNone);
+
+    teardown(&src, &sink);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+
+    test_stream(false, 20000);
+    test_stream(true, 20000);
+    test_return_timeout();
+
+    /* again on threads of the components' own */
+    if (!getenv("OMXIL_EXECUTOR_THREADS")) {
+        setenv("OMXIL_EXECUTOR_THREADS", "0", 1);
+        execv("/proc/self/exe", argv);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,491 @@
+/*
+ * omx_throughput.cpp, ETB/FTB throughput benchmark
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * pumps buffers through instances of the passthrough component, got by
+ * OMX_Init() and OMX_GetHandle(), for every combination of buffer size,
+ * port pairs and instances. every buffer's emptied again from
+ * EmptyBufferDone() and filled again from FillBufferDone(), so it measures
+ * the core, not the client. prints per combination
+ *   buffers/s      output buffers of all pairs and instances per second
+ *   cpu us/buf     user + system time of the process per output buffer
+ *   latency        from EmptyThisBuffer() to FillBufferDone() in usec
+ *
+ * usage: omx_throughput [-s sizes] [-p pairs] [-i instances]
+ *                       [-n buffers] [-b buffers per port] [-c library]
+ *   sizes, pairs and instances are comma separated lists.
+ *   -n buffers per pair per run. (default 20000)
+ *   -c component library, taken from OMXIL_COMPONENTS if set, or else
+ *      libomxil_passthrough.so next to the executable or in the library
+ *      path.
+ *
+ * the library's registered through OMXIL_COMPONENTS, which libOmxCore
+ * honours only when configured with --enable-omx-bench, as this directory
+ * is built.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <semaphore.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <OMX_Core.h>
+#include <OMX_Component.h>
+
+#include <histogram.h>
+#include <log.h>
+
+#include "passthrough.h"
+
+#define MAX_PAIRS       16
+#define MAX_INSTANCES   64
+#define MAX_LIST        16
+#define EVENT_TIMEOUT   10      /* sec */
+
+struct instance;
+
+struct pair {
+    struct instance *instance;
+    OMX_BUFFERHEADERTYPE **in;
+    OMX_BUFFERHEADERTYPE **out;
+    volatile long sent;
+    volatile long done;
+};
+
+struct instance {
+    OMX_HANDLETYPE handle;
+    sem_t event;                /* command complete or error */
+    sem_t finished;             /* all the pairs're done */
+    volatile int nr_finished;
+    struct pair pairs[MAX_PAIRS];
+};
+
+/* of the current run */
+static OMX_U32 g_size;
+static int g_nr_pairs;
+static long g_total;
+static struct histogram g_latency;
+
+static unsigned long long now_nsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned long long cpu_nsec(void)
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000ULL +
+        (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000ULL;
+}
+
+static void check(OMX_ERRORTYPE ret, const char *what)
+{
+    if (ret == OMX_ErrorNone)
+        return;
+
+    fprintf(stderr, "%s failed (0x%08x)\n", what, ret);
+    exit(1);
+}
+
+static void wait_event(sem_t *sem, const char *what)
+{
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += EVENT_TIMEOUT;
+
+    while (sem_timedwait(sem, &deadline)) {
+        if (errno == EINTR)
+            continue;
+        fprintf(stderr, "%s timed out\n", what);
+        exit(1);
+    }
+}
+
+static void empty(OMX_HANDLETYPE handle, OMX_BUFFERHEADERTYPE *buffer)
+{
+    buffer->nOffset = 0;
+    buffer->nFilledLen = g_size;
+    buffer->nFlags = 0;
+    buffer->nTimeStamp = (OMX_TICKS)now_nsec();
+    OMX_EmptyThisBuffer(handle, buffer);
+}
+
+static OMX_ERRORTYPE EventHandler(OMX_HANDLETYPE handle, OMX_PTR appdata,
+                                  OMX_EVENTTYPE event, OMX_U32 data1,
+                                  OMX_U32 data2, OMX_PTR eventdata)
+{
+    struct instance *instance = (struct instance *)appdata;
+
+    if (event == OMX_EventCmdComplete)
+        sem_post(&instance->event);
+    else if (event == OMX_EventError) {
+        fprintf(stderr, "error event 0x%08lx\n", (unsigned long)data1);
+        sem_post(&instance->event);
+    }
+
+    return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE EmptyBufferDone(OMX_HANDLETYPE handle, OMX_PTR appdata,
+                                     OMX_BUFFERHEADERTYPE *buffer)
+{
+    struct pair *pair = (struct pair *)buffer->pAppPrivate;
+
+    if (__sync_add_and_fetch(&pair->sent, 1) <= g_total)
+        empty(handle, buffer);
+
+    return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE FillBufferDone(OMX_HANDLETYPE handle, OMX_PTR appdata,
+                                    OMX_BUFFERHEADERTYPE *buffer)
+{
+    struct pair *pair = (struct pair *)buffer->pAppPrivate;
+    struct instance *instance = pair->instance;
+    long done;
+
+    /* the ones returned by going to Idle */
+    done = __sync_add_and_fetch(&pair->done, 1);
+    if (done > g_total)
+        return OMX_ErrorNone;
+
+    histogram_record(&g_latency, now_nsec() - buffer->nTimeStamp);
+
+    if (done < g_total)
+        OMX_FillThisBuffer(handle, buffer);
+    else if (__sync_add_and_fetch(&instance->nr_finished, 1) == g_nr_pairs)
+        sem_post(&instance->finished);
+
+    return OMX_ErrorNone;
+}
+
+static OMX_CALLBACKTYPE g_callbacks = {
+    EventHandler,
+    EmptyBufferDone,
+    FillBufferDone,
+};
+
+static void set_port(OMX_HANDLETYPE handle, OMX_U32 index,
+                     OMX_U32 nr_buffers)
+{
+    OMX_PARAM_PORTDEFINITIONTYPE portdefinition;
+
+    memset(&portdefinition, 0, sizeof(portdefinition));
+    portdefinition.nSize = sizeof(portdefinition);
+    portdefinition.nVersion.s.nVersionMajor = 1;
+    portdefinition.nVersion.s.nVersionMinor = 1;
+    portdefinition.nPortIndex = index;
+
+    check(OMX_GetParameter(handle, OMX_IndexParamPortDefinition,
+                           &portdefinition), "OMX_GetParameter(Port)");
+    portdefinition.nBufferCountActual = nr_buffers;
+    portdefinition.nBufferSize = g_size;
+    check(OMX_SetParameter(handle, OMX_IndexParamPortDefinition,
+                           &portdefinition), "OMX_SetParameter(Port)");
+}
+
+static void setup(struct instance *instance, OMX_U32 nr_buffers)
+{
+    OMX_PARAM_COMPONENTROLETYPE role;
+    OMX_U32 i, j;
+
+    memset(instance, 0, sizeof(*instance));
+    sem_init(&instance->event, 0, 0);
+    sem_init(&instance->finished, 0, 0);
+
+    check(OMX_GetHandle(&instance->handle, (OMX_STRING)PASSTHROUGH_NAME,
+                        instance, &g_callbacks), "OMX_GetHandle");
+
+    memset(&role, 0, sizeof(role));
+    role.nSize = sizeof(role);
+    role.nVersion.s.nVersionMajor = 1;
+    role.nVersion.s.nVersionMinor = 1;
+    snprintf((char *)role.cRole, sizeof(role.cRole), "%s%d",
+             PASSTHROUGH_ROLE_PREFIX, g_nr_pairs);
+    check(OMX_SetParameter(instance->handle,
+                           OMX_IndexParamStandardComponentRole, &role),
+          "OMX_SetParameter(Role)");
+
+    for (i = 0; i < (OMX_U32)g_nr_pairs * 2; i++)
+        set_port(instance->handle, i, nr_buffers);
+
+    check(OMX_SendCommand(instance->handle, OMX_CommandStateSet,
+                          OMX_StateIdle, NULL), "OMX_SendCommand(Idle)");
+
+    for (i = 0; i < (OMX_U32)g_nr_pairs; i++) {
+        struct pair *pair = &instance->pairs[i];
+
+        pair->instance = instance;
+        pair->in = (OMX_BUFFERHEADERTYPE **)
+            calloc(nr_buffers, sizeof(*pair->in));
+        pair->out = (OMX_BUFFERHEADERTYPE **)
+            calloc(nr_buffers, sizeof(*pair->out));
+        if (!pair->in || !pair->out) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+
+        for (j = 0; j < nr_buffers; j++) {
+            check(OMX_AllocateBuffer(instance->handle, &pair->in[j], i * 2,
+                                     pair, g_size), "OMX_AllocateBuffer");
+            check(OMX_AllocateBuffer(instance->handle, &pair->out[j],
+                                     i * 2 + 1, pair, g_size),
+                  "OMX_AllocateBuffer");
+            memset(pair->in[j]->pBuffer, j, g_size);
+        }
+    }
+    wait_event(&instance->event, "Loaded to Idle");
+
+    check(OMX_SendCommand(instance->handle, OMX_CommandStateSet,
+                          OMX_StateExecuting, NULL),
+          "OMX_SendCommand(Executing)");
+    wait_event(&instance->event, "Idle to Executing");
+}
+
+static void prime(struct instance *instance, OMX_U32 nr_buffers)
+{
+    OMX_U32 i, j;
+
+    for (i = 0; i < (OMX_U32)g_nr_pairs; i++) {
+        struct pair *pair = &instance->pairs[i];
+
+        for (j = 0; j < nr_buffers; j++)
+            OMX_FillThisBuffer(instance->handle, pair->out[j]);
+        for (j = 0; j < nr_buffers; j++) {
+            if (__sync_add_and_fetch(&pair->sent, 1) > g_total)
+                break;
+            empty(instance->handle, pair->in[j]);
+        }
+    }
+}
+
+static void teardown(struct instance *instance, OMX_U32 nr_buffers)
+{
+    OMX_U32 i, j;
+
+    check(OMX_SendCommand(instance->handle, OMX_CommandStateSet,
+                          OMX_StateIdle, NULL), "OMX_SendCommand(Idle)");
+    wait_event(&instance->event, "Executing to Idle");
+
+    check(OMX_SendCommand(instance->handle, OMX_CommandStateSet,
+                          OMX_StateLoaded, NULL), "OMX_SendCommand(Loaded)");
+    for (i = 0; i < (OMX_U32)g_nr_pairs; i++) {
+        struct pair *pair = &instance->pairs[i];
+
+        for (j = 0; j < nr_buffers; j++) {
+            OMX_FreeBuffer(instance->handle, i * 2, pair->in[j]);
+            OMX_FreeBuffer(instance->handle, i * 2 + 1, pair->out[j]);
+        }
+        free(pair->in);
+        free(pair->out);
+    }
+    wait_event(&instance->event, "Idle to Loaded");
+
+    check(OMX_FreeHandle(instance->handle), "OMX_FreeHandle");
+    sem_destroy(&instance->finished);
+    sem_destroy(&instance->event);
+}
+
+static void run(struct instance *instances, int nr_instances,
+                OMX_U32 nr_buffers)
+{
+    unsigned long long start, cpu, elapsed, nr;
+    int i;
+
+    histogram_reset(&g_latency);
+
+    for (i = 0; i < nr_instances; i++)
+        setup(&instances[i], nr_buffers);
+
+    cpu = cpu_nsec();
+    start = now_nsec();
+
+    for (i = 0; i < nr_instances; i++)
+        prime(&instances[i], nr_buffers);
+    for (i = 0; i < nr_instances; i++)
+        wait_event(&instances[i].finished, "run");
+
+    elapsed = now_nsec() - start;
+    cpu = cpu_nsec() - cpu;
+
+    for (i = 0; i < nr_instances; i++)
+        teardown(&instances[i], nr_buffers);
+
+    nr = (unsigned long long)g_total * g_nr_pairs * nr_instances;
+    printf("%8lu %5d %5d %12.0f %10.2f %9.1f %9.1f %9.1f %9.1f\n",
+           (unsigned long)g_size, g_nr_pairs, nr_instances,
+           nr * 1e9 / elapsed, cpu / 1000.0 / nr,
+           histogram_percentile(&g_latency, 500) / 1000.0,
+           histogram_percentile(&g_latency, 990) / 1000.0,
+           histogram_percentile(&g_latency, 999) / 1000.0,
+           g_latency.max / 1000.0);
+    fflush(stdout);
+}
+
+/* comma separated positive numbers, returns how many */
+static int parse_list(const char *arg, long *list, long max)
+{
+    char *end;
+    int nr = 0;
+
+    while (*arg && nr < MAX_LIST) {
+        list[nr] = strtol(arg, &end, 0);
+        if (end == arg || list[nr] < 1 || list[nr] > max)
+            return 0;
+        nr++;
+
+        if (*end == ',')
+            end++;
+        else if (*end)
+            return 0;
+        arg = end;
+    }
+
+    return nr;
+}
+
+static int is_role(long nr_pairs)
+{
+    return nr_pairs == 1 || nr_pairs == 2 || nr_pairs == 4 ||
+        nr_pairs == 8 || nr_pairs == 16;
+}
+
+/* next to the executable, or else by name in the library path */
+static void set_library(const char *library)
+{
+    static char path[256];
+    char *slash;
+    ssize_t len;
+
+    if (!library && getenv("OMXIL_COMPONENTS"))
+        return;
+
+    if (!library) {
+        library = PASSTHROUGH_LIBRARY;
+
+        len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+        if (len > 0) {
+            path[len] = '\0';
+            slash = strrchr(path, '/');
+            if (slash && (size_t)(slash - path + 1) +
+                strlen(PASSTHROUGH_LIBRARY) < sizeof(path)) {
+                strcpy(slash + 1, PASSTHROUGH_LIBRARY);
+                if (!access(path, R_OK))
+                    library = path;
+            }
+        }
+    }
+
+    setenv("OMXIL_COMPONENTS", library, 1);
+}
+
+int main(int argc, char **argv)
+{
+    long sizes[MAX_LIST] = { 64, 4096, 65536 }, pairs[MAX_LIST] = { 1, 2 };
+    long instances[MAX_LIST] = { 1, 2, 4 };
+    int nr_sizes = 3, nr_pairs = 2, nr_instances = 3;
+    long nr_buffers = 4;
+    const char *library = NULL;
+    struct instance *all;
+    int s, p, i, opt;
+
+    g_total = 20000;
+
+    while ((opt = getopt(argc, argv, "s:p:i:n:b:c:")) != -1) {
+        switch (opt) {
+        case 's':
+            nr_sizes = parse_list(optarg, sizes, 64 << 20);
+            break;
+        case 'p':
+            nr_pairs = parse_list(optarg, pairs, MAX_PAIRS);
+            for (p = 0; p < nr_pairs; p++) {
+                if (!is_role(pairs[p]))
+                    nr_pairs = 0;
+            }
+            break;
+        case 'i':
+            nr_instances = parse_list(optarg, instances, MAX_INSTANCES);
+            break;
+        case 'n':
+            g_total = atol(optarg);
+            break;
+        case 'b':
+            nr_buffers = atol(optarg);
+            break;
+        case 'c':
+            library = optarg;
+            break;
+        default:
+            nr_sizes = 0;
+            break;
+        }
+
+        if (!nr_sizes || !nr_pairs || !nr_instances)
+            break;
+    }
+    if (!nr_sizes || !nr_pairs || !nr_instances || g_total < 1 ||
+        nr_buffers < 1 || nr_buffers > 64) {
+        fprintf(stderr, "usage: %s [-s sizes] [-p pairs (1,2,4,8,16)] "
+                "[-i instances] [-n buffers] [-b buffers per port] "
+                "[-c library]\n", argv[0]);
+        return 1;
+    }
+
+    all = (struct instance *)malloc(sizeof(*all) * MAX_INSTANCES);
+    if (!all)
+        return 1;
+
+    /* the get and free handle info lines'd garble the table */
+    if (!getenv("OMXIL_LOG_LEVEL"))
+        omx_log_set_level(OMX_LOG_WARN);
+
+    set_library(library);
+    check(OMX_Init(), "OMX_Init");
+
+    printf("%ld buffers per pair, %ld buffers per port, %s\n", g_total,
+           nr_buffers, getenv("OMXIL_COMPONENTS"));
+    printf("%8s %5s %5s %12s %10s %9s %9s %9s %9s\n", "size", "pairs",
+           "inst", "buffers/s", "cpu us/buf", "p50 us", "p99 us",
+           "p99.9 us", "max us");
+
+    for (s = 0; s < nr_sizes; s++) {
+        g_size = sizes[s];
+
+        for (p = 0; p < nr_pairs; p++) {
+            g_nr_pairs = pairs[p];
+
+            for (i = 0; i < nr_instances; i++)
+                run(all, instances[i], nr_buffers);
+        }
+    }
+
+    OMX_Deinit();
+    free(all);
+    return 0;
+}
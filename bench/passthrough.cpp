@@ -0,0 +1,205 @@
+/*
+ * passthrough.cpp, passthrough filter component of the benchmark
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * copies every input buffer to the output buffer of its pair, with the
+ * timestamp and flags, so it costs the component framework and a memcpy.
+ *
+ * the role picks the number of pairs, "other.passthrough.<n>". port 2i is
+ * the input, port 2i + 1 the output of pair i, the pairs're processed
+ * independently of each other.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <OMX_Core.h>
+#include <OMX_Component.h>
+
+#include <cmodule.h>
+#include <componentbase.h>
+
+#include "passthrough.h"
+
+#define PASSTHROUGH_MAX_PAIRS       16
+#define PASSTHROUGH_BUFFER_COUNT    4
+#define PASSTHROUGH_BUFFER_SIZE     4096
+
+class Passthrough : public ComponentBase
+{
+public:
+    Passthrough() {};
+
+private:
+    virtual OMX_ERRORTYPE ComponentAllocatePorts(void);
+
+    virtual OMX_ERRORTYPE ComponentGetParameter(OMX_INDEXTYPE nIndex,
+                                                OMX_PTR pStructure);
+    virtual OMX_ERRORTYPE ComponentSetParameter(OMX_INDEXTYPE nIndex,
+                                                OMX_PTR pStructure);
+    virtual OMX_ERRORTYPE ComponentGetConfig(OMX_INDEXTYPE nIndex,
+                                             OMX_PTR pStructure);
+    virtual OMX_ERRORTYPE ComponentSetConfig(OMX_INDEXTYPE nIndex,
+                                             OMX_PTR pStructure);
+
+    virtual OMX_ERRORTYPE ProcessorProcess(OMX_BUFFERHEADERTYPE **buffers,
+                                           buffer_retain_t *retain,
+                                           OMX_U32 nr_buffers);
+};
+
+OMX_ERRORTYPE Passthrough::ComponentAllocatePorts(void)
+{
+    OMX_PARAM_PORTDEFINITIONTYPE portdefinition;
+    OMX_U32 masks[PASSTHROUGH_MAX_PAIRS];
+    OMX_U32 nr_pairs, i;
+    const char *role = GetWorkingRole();
+
+    nr_pairs = atoi(role + strlen(PASSTHROUGH_ROLE_PREFIX));
+    if (!nr_pairs || nr_pairs > PASSTHROUGH_MAX_PAIRS)
+        return OMX_ErrorBadParameter;
+
+    ports = new PortBase *[nr_pairs * 2];
+    if (!ports)
+        return OMX_ErrorInsufficientResources;
+
+    for (i = 0; i < nr_pairs * 2; i++) {
+        memset(&portdefinition, 0, sizeof(portdefinition));
+        SetTypeHeader(&portdefinition, sizeof(portdefinition));
+        portdefinition.nPortIndex = i;
+        portdefinition.eDir = i & 1 ? OMX_DirOutput : OMX_DirInput;
+        portdefinition.nBufferCountActual = PASSTHROUGH_BUFFER_COUNT;
+        portdefinition.nBufferCountMin = 1;
+        portdefinition.nBufferSize = PASSTHROUGH_BUFFER_SIZE;
+        portdefinition.bEnabled = OMX_TRUE;
+        portdefinition.eDomain = OMX_PortDomainOther;
+        portdefinition.format.other.eFormat = OMX_OTHER_FormatBinary;
+
+        ports[i] = new PortBase(&portdefinition);
+        if (!ports[i])
+            goto free_ports;
+        nr_ports++;
+    }
+
+    for (i = 0; i < nr_pairs; i++)
+        masks[i] = 3U << (i * 2);
+    SetRequiredPortMasks(masks, nr_pairs);
+
+    portparam.nPorts = nr_ports;
+    portparam.nStartPortNumber = 0;
+
+    return OMX_ErrorNone;
+
+free_ports:
+    for (i = 0; i < nr_ports; i++)
+        delete ports[i];
+    delete[] ports;
+    ports = NULL;
+    nr_ports = 0;
+    return OMX_ErrorInsufficientResources;
+}
+
+OMX_ERRORTYPE Passthrough::ComponentGetParameter(OMX_INDEXTYPE nIndex,
+                                                 OMX_PTR pStructure)
+{
+    return OMX_ErrorUnsupportedIndex;
+}
+
+OMX_ERRORTYPE Passthrough::ComponentSetParameter(OMX_INDEXTYPE nIndex,
+                                                 OMX_PTR pStructure)
+{
+    return OMX_ErrorUnsupportedIndex;
+}
+
+OMX_ERRORTYPE Passthrough::ComponentGetConfig(OMX_INDEXTYPE nIndex,
+                                              OMX_PTR pStructure)
+{
+    return OMX_ErrorUnsupportedIndex;
+}
+
+OMX_ERRORTYPE Passthrough::ComponentSetConfig(OMX_INDEXTYPE nIndex,
+                                              OMX_PTR pStructure)
+{
+    return OMX_ErrorUnsupportedIndex;
+}
+
+OMX_ERRORTYPE Passthrough::ProcessorProcess(OMX_BUFFERHEADERTYPE **buffers,
+                                            buffer_retain_t *retain,
+                                            OMX_U32 nr_buffers)
+{
+    OMX_BUFFERHEADERTYPE *in, *out;
+    OMX_U32 i, len;
+
+    /* the pair of the satisfied mask, the other ports're NULL */
+    for (i = 0; i + 1 < nr_buffers; i += 2) {
+        in = buffers[i];
+        out = buffers[i + 1];
+        if (!in || !out)
+            continue;
+
+        len = in->nFilledLen;
+        if (len > out->nAllocLen)
+            len = out->nAllocLen;
+
+        memcpy(out->pBuffer, in->pBuffer + in->nOffset, len);
+        out->nOffset = 0;
+        out->nFilledLen = len;
+        out->nTimeStamp = in->nTimeStamp;
+        out->nFlags = in->nFlags;
+
+        in->nFilledLen = 0;
+        break;
+    }
+
+    return OMX_ErrorNone;
+}
+
+/*
+ * CModule Entry
+ */
+static const char *g_roles[] = {
+    PASSTHROUGH_ROLE_PREFIX "1",
+    PASSTHROUGH_ROLE_PREFIX "2",
+    PASSTHROUGH_ROLE_PREFIX "4",
+    PASSTHROUGH_ROLE_PREFIX "8",
+    PASSTHROUGH_ROLE_PREFIX "16",
+};
+
+static OMX_ERRORTYPE wrs_omxil_cmodule_ops_instantiate(OMX_PTR *instance)
+{
+    ComponentBase *cbase;
+
+    cbase = new Passthrough;
+    if (!cbase) {
+        *instance = NULL;
+        return OMX_ErrorInsufficientResources;
+    }
+
+    *instance = cbase;
+    return OMX_ErrorNone;
+}
+
+static struct wrs_omxil_cmodule_ops_s cmodule_ops = {
+    instantiate: wrs_omxil_cmodule_ops_instantiate,
+};
+
+struct wrs_omxil_cmodule_s WRS_OMXIL_CMODULE_SYMBOL = {
+    name: PASSTHROUGH_NAME,
+    roles: g_roles,
+    nr_roles: sizeof(g_roles) / sizeof(g_roles[0]),
+    ops: &cmodule_ops,
+};
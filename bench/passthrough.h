@@ -0,0 +1,27 @@
+/*
+ * passthrough.h, passthrough filter component of the benchmark
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __PASSTHROUGH_H
+#define __PASSTHROUGH_H
+
+#define PASSTHROUGH_LIBRARY         "libomxil_passthrough.so"
+#define PASSTHROUGH_NAME            "OMX.Intel.bench.passthrough"
+/* followed by the number of input/output port pairs, 1, 2, 4, 8 or 16 */
+#define PASSTHROUGH_ROLE_PREFIX     "other.passthrough."
+
+#endif /* __PASSTHROUGH_H */
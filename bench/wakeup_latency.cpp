@@ -0,0 +1,164 @@
+/*
+ * wakeup_latency.cpp, WorkQueue wakeup latency benchmark
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * measures the time from ScheduleWork() to the start of Work() on an idle
+ * WorkQueue, and prints its distribution.
+ *
+ * usage: wakeup_latency [-n samples] [-i interval usec] [-x]
+ *   -x runs the works on the shared executor instead of an own thread.
+ *   the spin time of the own thread is taken from OMXIL_WAKEUP_SPIN_USEC.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <semaphore.h>
+
+#include <workqueue.h>
+
+#define NR_BUCKETS      24      /* log2 usec buckets */
+
+static unsigned long long now_nsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+class Probe : public WorkableInterface
+{
+public:
+    Probe() { sem_init(&done, 0, 0); };
+    ~Probe() { sem_destroy(&done); };
+
+    volatile unsigned long long scheduled;
+    unsigned long long latency;
+    sem_t done;
+
+private:
+    virtual void Work(void)
+    {
+        latency = now_nsec() - scheduled;
+        sem_post(&done);
+    };
+};
+
+static int compare(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(const unsigned long long *sorted, int n, double p)
+{
+    int i = (int)(p / 100.0 * (n - 1) + 0.5);
+
+    return sorted[i] / 1000.0;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long long *samples;
+    unsigned int buckets[NR_BUCKETS];
+    int nr_samples = 10000, interval = 1000, shared = 0;
+    int i, j, opt;
+    WorkQueue *wq;
+    Probe probe;
+
+    while ((opt = getopt(argc, argv, "n:i:x")) != -1) {
+        switch (opt) {
+        case 'n':
+            nr_samples = atoi(optarg);
+            break;
+        case 'i':
+            interval = atoi(optarg);
+            break;
+        case 'x':
+            shared = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n samples] [-i interval usec] "
+                    "[-x]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (nr_samples < 1)
+        nr_samples = 1;
+
+    samples = (unsigned long long *)malloc(sizeof(*samples) * nr_samples);
+    if (!samples)
+        return 1;
+
+    wq = new WorkQueue(shared ? true : false);
+    if (wq->StartWork(true)) {
+        fprintf(stderr, "cannot start the work queue\n");
+        return 1;
+    }
+
+    for (i = 0; i < nr_samples; i++) {
+        /* let the worker go idle */
+        usleep(interval);
+
+        probe.scheduled = now_nsec();
+        wq->ScheduleWork(&probe);
+        sem_wait(&probe.done);
+
+        samples[i] = probe.latency;
+    }
+
+    wq->StopWork();
+    delete wq;
+
+    qsort(samples, nr_samples, sizeof(*samples), compare);
+
+    printf("%s, %d samples, %d usec apart, spin %s usec\n",
+           shared ? "executor" : "own thread", nr_samples, interval,
+           getenv("OMXIL_WAKEUP_SPIN_USEC") ?
+           getenv("OMXIL_WAKEUP_SPIN_USEC") : "0");
+    printf("usec: min %.1f p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f\n",
+           samples[0] / 1000.0, percentile(samples, nr_samples, 50),
+           percentile(samples, nr_samples, 90),
+           percentile(samples, nr_samples, 99),
+           percentile(samples, nr_samples, 99.9),
+           samples[nr_samples - 1] / 1000.0);
+
+    memset(buckets, 0, sizeof(buckets));
+    for (i = 0; i < nr_samples; i++) {
+        unsigned long long usec = samples[i] / 1000;
+
+        for (j = 0; j < NR_BUCKETS - 1 && usec >= (1ULL << j); j++)
+            ;
+        buckets[j]++;
+    }
+
+    for (j = 0; j < NR_BUCKETS; j++) {
+        if (!buckets[j])
+            continue;
+        printf("  < %8llu usec: %7u %5.1f%%\n", 1ULL << j, buckets[j],
+               100.0 * buckets[j] / nr_samples);
+    }
+
+    free(samples);
+    return 0;
+}
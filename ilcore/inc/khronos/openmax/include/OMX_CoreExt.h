@@ -65,6 +65,148 @@ typedef struct OMX_CONFIG_CALLBACKREQUESTTYPE {
     OMX_BOOL bEnable;           /**< enable (OMX_TRUE) or disable (OMX_FALSE) the callback */
 } OMX_CONFIG_CALLBACKREQUESTTYPE;
 
+
+/** Keep the port buffers across OMX_EventPortSettingsChanged,
+ *  OMX_IndexParamIntelReconfigureInPlace */
+typedef struct OMX_PARAM_INTEL_RECONFIGUREINPLACETYPE {
+    OMX_U32 nSize;              /**< size of the structure in bytes */
+    OMX_VERSIONTYPE nVersion;   /**< OMX specification version information */
+    OMX_U32 nPortIndex;         /**< port that this structure applies to */
+    OMX_BOOL bEnable;           /**< enable (OMX_TRUE) or disable (OMX_FALSE) */
+} OMX_PARAM_INTEL_RECONFIGUREINPLACETYPE;
+
+
+/** Allocate the port buffers in memfd shared memory,
+ *  OMX_IndexParamIntelShareableBuffers */
+typedef struct OMX_PARAM_INTEL_SHAREABLEBUFFERSTYPE {
+    OMX_U32 nSize;              /**< size of the structure in bytes */
+    OMX_VERSIONTYPE nVersion;   /**< OMX specification version information */
+    OMX_U32 nPortIndex;         /**< port that this structure applies to */
+    OMX_BOOL bEnable;           /**< enable (OMX_TRUE) or disable (OMX_FALSE) */
+    OMX_BOOL bSeal;             /**< seal the memfd against resizing */
+} OMX_PARAM_INTEL_SHAREABLEBUFFERSTYPE;
+
+
+/** Where a shareable buffer lives, OMX_IndexParamIntelSharedBufferInfo */
+typedef struct OMX_PARAM_INTEL_SHAREDBUFFERINFOTYPE {
+    OMX_U32 nSize;              /**< size of the structure in bytes */
+    OMX_VERSIONTYPE nVersion;   /**< OMX specification version information */
+    OMX_U32 nPortIndex;         /**< port that this structure applies to */
+    OMX_BUFFERHEADERTYPE *pBufferHeader; /**< buffer given by OMX_AllocateBuffer */
+    OMX_S32 nFd;                /**< memfd, valid in the component's process */
+    OMX_U32 nOffset;            /**< offset of pBuffer in nFd */
+    OMX_U32 nLength;            /**< bytes mappable at nOffset */
+} OMX_PARAM_INTEL_SHAREDBUFFERINFOTYPE;
+
+
+/** Empty and fill many buffers in one call, OMX_IndexConfigIntelSubmitBuffers
+ *  given to OMX_SetConfig. Each header goes to the port it names, as if
+ *  passed to OMX_EmptyThisBuffer (input port) or OMX_FillThisBuffer
+ *  (output port) in array order. */
+typedef struct OMX_CONFIG_INTEL_SUBMITBUFFERSTYPE {
+    OMX_U32 nSize;              /**< size of the structure in bytes */
+    OMX_VERSIONTYPE nVersion;   /**< OMX specification version information */
+    OMX_U32 nBuffers;           /**< number of headers in ppBuffers */
+    OMX_BUFFERHEADERTYPE **ppBuffers; /**< headers to submit */
+    OMX_U32 nSubmitted;         /**< out: headers now owned by the component */
+} OMX_CONFIG_INTEL_SUBMITBUFFERSTYPE;
+
+
+/** Urgency of a component's works on the worker threads shared by the
+ *  components, a higher one is run first */
+typedef enum OMX_INTEL_WORKPRIORITYTYPE {
+    OMX_IntelWorkPriorityBatch = 0,     /**< e.g. transcoding */
+    OMX_IntelWorkPriorityNormal,        /**< default */
+    OMX_IntelWorkPriorityInteractive,   /**< e.g. video playback, capture */
+    OMX_IntelWorkPriorityRealtime,      /**< e.g. audio playback */
+    OMX_IntelWorkPriorityMax = 0x7FFFFFFF
+} OMX_INTEL_WORKPRIORITYTYPE;
+
+/** OMX_IndexConfigIntelWorkPriority */
+typedef struct OMX_CONFIG_INTEL_WORKPRIORITYTYPE {
+    OMX_U32 nSize;              /**< size of the structure in bytes */
+    OMX_VERSIONTYPE nVersion;   /**< OMX specification version information */
+    OMX_INTEL_WORKPRIORITYTYPE ePriority;
+    OMX_BOOL bTimestampDeadline; /**< among the same priority, process the
+                                      input of the earliest nTimeStamp
+                                      relative to the stream start first */
+} OMX_CONFIG_INTEL_WORKPRIORITYTYPE;
+
+/** threads of a component, see OMX_CONFIG_INTEL_THREADPLACEMENTTYPE */
+typedef enum OMX_INTEL_THREADROLETYPE {
+    OMX_IntelThreadRoleCommand = 0,     /**< command processing */
+    OMX_IntelThreadRoleBuffer,          /**< buffer processing */
+    OMX_IntelThreadRoleCallback,        /**< asynchronous client callbacks */
+    OMX_IntelThreadRoleMax = 0x7FFFFFFF
+} OMX_INTEL_THREADROLETYPE;
+
+typedef enum OMX_INTEL_THREADPOLICYTYPE {
+    OMX_IntelThreadPolicyInherit = 0,   /**< left as created */
+    OMX_IntelThreadPolicyOther,
+    OMX_IntelThreadPolicyFifo,
+    OMX_IntelThreadPolicyRoundRobin,
+    OMX_IntelThreadPolicyBatch,
+    OMX_IntelThreadPolicyIdle,
+    OMX_IntelThreadPolicyMax = 0x7FFFFFFF
+} OMX_INTEL_THREADPOLICYTYPE;
+
+/**
+ * OMX_IndexConfigIntelThreadPlacement
+ *
+ * placement of the thread of a role, replaces the one from the thread
+ * placement rules. the role must run on its own thread, not on the shared
+ * executor, otherwise OMX_ErrorUnsupportedSetting. a role matched by a
+ * placement rule when the component's handle is got has its own thread.
+ */
+typedef struct OMX_CONFIG_INTEL_THREADPLACEMENTTYPE {
+    OMX_U32 nSize;              /**< size of the structure in bytes */
+    OMX_VERSIONTYPE nVersion;   /**< OMX specification version information */
+    OMX_INTEL_THREADROLETYPE eRole;
+    OMX_U64 nCpuMask;           /**< bit n for cpu n, 0 to leave as created */
+    OMX_INTEL_THREADPOLICYTYPE ePolicy;
+    OMX_S32 nPriority;          /**< for Fifo and RoundRobin */
+    OMX_U32 nStackSize;         /**< 0 to leave as created, applies when
+                                     the thread's created next */
+    OMX_U8 cName[16];           /**< empty to leave as created */
+} OMX_CONFIG_INTEL_THREADPLACEMENTTYPE;
+
+/** latencies of the buffers passing a port, see OMX_CONFIG_INTEL_PORTLATENCYTYPE */
+typedef enum OMX_INTEL_LATENCYTYPE {
+    OMX_IntelLatencyQueueWait = 0,      /**< Empty/FillThisBuffer to the
+                                             first processing */
+    OMX_IntelLatencyProcessing,         /**< each processing */
+    OMX_IntelLatencyResidency,          /**< Empty/FillThisBuffer to the
+                                             buffer done */
+    OMX_IntelLatencyMax = 0x7FFFFFFF
+} OMX_INTEL_LATENCYTYPE;
+
+/**
+ * OMX_IndexConfigIntelPortLatency
+ *
+ * GetConfig reads a latency histogram of a port, SetConfig clears all the
+ * histograms of the port. times're in nsec, recorded since the port was
+ * created or cleared.
+ */
+typedef struct OMX_CONFIG_INTEL_PORTLATENCYTYPE {
+    OMX_U32 nSize;              /**< size of the structure in bytes */
+    OMX_VERSIONTYPE nVersion;   /**< OMX specification version information */
+    OMX_U32 nPortIndex;
+    OMX_INTEL_LATENCYTYPE eLatency;
+    OMX_U64 nCount;
+    OMX_U64 nMin;
+    OMX_U64 nMean;
+    OMX_U64 nMax;
+    OMX_U64 nP50;
+    OMX_U64 nP90;
+    OMX_U64 nP99;
+    OMX_U64 nP999;
+    OMX_U32 nBuckets;           /**< in: room of pBucketValues and
+                                     pBucketCounts, 0 to skip them.
+                                     out: the non-empty buckets copied */
+    OMX_U64 *pBucketValues;     /**< lowest value of the bucket, ascending */
+    OMX_U64 *pBucketCounts;
+} OMX_CONFIG_INTEL_PORTLATENCYTYPE;
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
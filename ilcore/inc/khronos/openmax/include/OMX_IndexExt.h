@@ -51,9 +51,16 @@ typedef enum OMX_INDEXEXTTYPE {
     OMX_IndexConfigCallbackRequest,                 /**< reference: OMX_CONFIG_CALLBACKREQUESTTYPE */
     OMX_IndexConfigCommitMode,                      /**< reference: OMX_CONFIG_COMMITMODETYPE */
     OMX_IndexConfigCommit,                          /**< reference: OMX_CONFIG_COMMITTYPE */
+    OMX_IndexConfigIntelSubmitBuffers,              /**< reference: OMX_CONFIG_INTEL_SUBMITBUFFERSTYPE */
+    OMX_IndexConfigIntelWorkPriority,               /**< reference: OMX_CONFIG_INTEL_WORKPRIORITYTYPE */
+    OMX_IndexConfigIntelThreadPlacement,            /**< reference: OMX_CONFIG_INTEL_THREADPLACEMENTTYPE */
 
     /* Port parameters and configurations */
     OMX_IndexExtPortStartUnused = OMX_IndexKhronosExtensions + 0x00200000,
+    OMX_IndexParamIntelReconfigureInPlace,          /**< reference: OMX_PARAM_INTEL_RECONFIGUREINPLACETYPE */
+    OMX_IndexParamIntelShareableBuffers,            /**< reference: OMX_PARAM_INTEL_SHAREABLEBUFFERSTYPE */
+    OMX_IndexParamIntelSharedBufferInfo,            /**< reference: OMX_PARAM_INTEL_SHAREDBUFFERINFOTYPE */
+    OMX_IndexConfigIntelPortLatency,                /**< reference: OMX_CONFIG_INTEL_PORTLATENCYTYPE */
 
     /* Audio parameters and configurations */
     OMX_IndexExtAudioStartUnused = OMX_IndexKhronosExtensions + 0x00400000,
@@ -2,7 +2,8 @@ LOCAL_PATH := $(call my-dir)
 include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES := \
-	wrs_omxcore.cpp
+	wrs_omxcore.cpp \
+	registry_cache.cpp
 
 LOCAL_MODULE_TAGS := optional
 LOCAL_MODULE := libwrs_omxil_core_pvwrapped
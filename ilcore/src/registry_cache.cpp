@@ -0,0 +1,370 @@
+/*
+ * registry_cache.cpp, on-disk cache of component names and roles
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <OMX_Core.h>
+
+#include <hash.h>
+#include <registry_cache.h>
+
+#include <sysdeps.h>
+
+#define REGISTRY_CACHE_MAGIC        "OMXILRC"
+#define REGISTRY_CACHE_VERSION      1
+#define REGISTRY_CACHE_MAX_ROLES    16
+#define REGISTRY_CACHE_PATH_SIZE    256
+
+struct registry_cache_header {
+    char magic[8];
+    OMX_U32 version;
+    OMX_U32 record_size;
+    OMX_U32 nr_records;
+    OMX_U32 search_path_hash; /* LD_LIBRARY_PATH */
+};
+
+struct registry_cache_record {
+    /* library file */
+    OMX_U64 size;
+    OMX_S64 mtime;
+    OMX_U64 ino;
+
+    char lname[OMX_MAX_STRINGNAME_SIZE];
+    char path[REGISTRY_CACHE_PATH_SIZE];
+
+    /* wrs_omxil_cmodule_s */
+    char cname[OMX_MAX_STRINGNAME_SIZE];
+    OMX_U32 nr_roles;
+    char roles[REGISTRY_CACHE_MAX_ROLES][OMX_MAX_STRINGNAME_SIZE];
+};
+
+struct registry_cache {
+    void *map;
+    size_t map_size;
+
+    const struct registry_cache_header *header;
+    const struct registry_cache_record *records;
+};
+
+static const char *get_cache_path(char *buf, size_t size)
+{
+    const char *env = getenv("OMXIL_REGISTRY_CACHE");
+
+    if (env)
+        return env[0] ? env : NULL;
+
+    snprintf(buf, size, "/var/tmp/omxil-core-registry-%u.cache",
+             (unsigned int)getuid());
+    return buf;
+}
+
+static OMX_U32 get_search_path_hash(void)
+{
+    const char *env = getenv("LD_LIBRARY_PATH");
+
+    return hash_string(env ? env : "");
+}
+
+struct registry_cache *registry_cache_open(void)
+{
+    struct registry_cache *cache;
+    const struct registry_cache_header *header;
+    char buf[REGISTRY_CACHE_PATH_SIZE];
+    const char *path;
+    struct stat st;
+    void *map;
+    int fd;
+
+    path = get_cache_path(buf, sizeof(buf));
+    if (!path)
+        return NULL;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    if (fstat(fd, &st)) {
+        close(fd);
+        goto invalid;
+    }
+
+    /*
+     * /var/tmp is shared, anybody else may have created the file first to
+     * spoof the registry. it's then left alone, rename() cannot replace it
+     */
+    if (!S_ISREG(st.st_mode) || st.st_uid != getuid() ||
+        (st.st_mode & (S_IWGRP | S_IWOTH))) {
+        close(fd);
+        omx_errorLog("%s(): %s is not a private file of uid %u, ignored",
+                     __FUNCTION__, path, (unsigned int)getuid());
+        return NULL;
+    }
+
+    if ((size_t)st.st_size < sizeof(*header)) {
+        close(fd);
+        goto invalid;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        goto invalid;
+
+    header = (const struct registry_cache_header *)map;
+    if (memcmp(header->magic, REGISTRY_CACHE_MAGIC,
+               sizeof(REGISTRY_CACHE_MAGIC)) ||
+        header->version != REGISTRY_CACHE_VERSION ||
+        header->record_size != sizeof(struct registry_cache_record) ||
+        (size_t)st.st_size != sizeof(*header) +
+            (size_t)header->nr_records * header->record_size ||
+        header->search_path_hash != get_search_path_hash()) {
+        munmap(map, st.st_size);
+        goto invalid;
+    }
+
+    cache = (struct registry_cache *)malloc(sizeof(*cache));
+    if (!cache) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    cache->map = map;
+    cache->map_size = st.st_size;
+    cache->header = header;
+    cache->records = (const struct registry_cache_record *)(header + 1);
+
+    omx_verboseLog("%s(): %s has %lu records", __FUNCTION__, path,
+                   header->nr_records);
+    return cache;
+
+invalid:
+    omx_infoLog("%s(): %s is out of date, will be rebuilt", __FUNCTION__,
+                path);
+    return NULL;
+}
+
+void registry_cache_close(struct registry_cache *cache)
+{
+    if (!cache)
+        return;
+
+    munmap(cache->map, cache->map_size);
+    free(cache);
+}
+
+static bool record_is_valid(const struct registry_cache_record *record)
+{
+    struct stat st;
+
+    if (!record->path[0] ||
+        record->path[REGISTRY_CACHE_PATH_SIZE-1] ||
+        record->cname[OMX_MAX_STRINGNAME_SIZE-1] ||
+        !record->nr_roles || record->nr_roles > REGISTRY_CACHE_MAX_ROLES)
+        return false;
+
+    if (stat(record->path, &st))
+        return false;
+
+    return (OMX_U64)st.st_size == record->size &&
+        (OMX_S64)st.st_mtime == record->mtime &&
+        (OMX_U64)st.st_ino == record->ino;
+}
+
+static const struct registry_cache_record *
+find_record(struct registry_cache *cache, const char *lname)
+{
+    OMX_U32 i;
+
+    if (!cache)
+        return NULL;
+
+    for (i = 0; i < cache->header->nr_records; i++) {
+        const struct registry_cache_record *record = &cache->records[i];
+
+        if (!strncmp(record->lname, lname, OMX_MAX_STRINGNAME_SIZE))
+            return record;
+    }
+
+    return NULL;
+}
+
+CModule *registry_cache_lookup(struct registry_cache *cache,
+                               const char *lname)
+{
+    const struct registry_cache_record *record;
+    const char *roles[REGISTRY_CACHE_MAX_ROLES];
+    CModule *cmodule;
+    OMX_U32 i;
+
+    record = find_record(cache, lname);
+    if (!record || !record_is_valid(record)) {
+        omx_verboseLog("%s(): %s not cached or changed", __FUNCTION__, lname);
+        return NULL;
+    }
+
+    for (i = 0; i < record->nr_roles; i++) {
+        if (record->roles[i][OMX_MAX_STRINGNAME_SIZE-1])
+            return NULL;
+        roles[i] = &record->roles[i][0];
+    }
+
+    cmodule = new CModule((OMX_STRING)lname);
+    if (!cmodule)
+        return NULL;
+
+    if (cmodule->SetComponentNameAndRoles(record->cname, roles,
+                                          record->nr_roles) != OMX_ErrorNone) {
+        delete cmodule;
+        return NULL;
+    }
+
+    return cmodule;
+}
+
+/* fills a record from a loaded CModule */
+static bool fill_record(struct registry_cache_record *record,
+                        CModule *cmodule)
+{
+    const char *path = cmodule->GetLibraryPath();
+    struct stat st;
+    OMX_U32 i;
+
+    if (!path || strlen(path) >= REGISTRY_CACHE_PATH_SIZE)
+        return false;
+
+    if (cmodule->GetNumberOfRoles() > REGISTRY_CACHE_MAX_ROLES)
+        return false;
+
+    if (stat(path, &st))
+        return false;
+
+    record->size = st.st_size;
+    record->mtime = st.st_mtime;
+    record->ino = st.st_ino;
+
+    strncpy(record->lname, cmodule->GetLibraryName(),
+            OMX_MAX_STRINGNAME_SIZE-1);
+    strncpy(record->path, path, REGISTRY_CACHE_PATH_SIZE-1);
+    strncpy(record->cname, cmodule->GetComponentName(),
+            OMX_MAX_STRINGNAME_SIZE-1);
+
+    record->nr_roles = cmodule->GetNumberOfRoles();
+    for (i = 0; i < record->nr_roles; i++)
+        strncpy(&record->roles[i][0], cmodule->GetRole(i),
+                OMX_MAX_STRINGNAME_SIZE-1);
+
+    return true;
+}
+
+int registry_cache_write(struct registry_cache *cache, struct list *head)
+{
+    struct registry_cache_header header;
+    struct registry_cache_record *records;
+    char buf[REGISTRY_CACHE_PATH_SIZE], temp[REGISTRY_CACHE_PATH_SIZE + 8];
+    const char *path;
+    struct list *entry;
+    OMX_U32 nr_records = 0;
+    size_t size;
+    int fd, ret = -1;
+
+    path = get_cache_path(buf, sizeof(buf));
+    if (!path)
+        return 0;
+
+    records = (struct registry_cache_record *)
+        calloc(list_length(head) + 1, sizeof(*records));
+    if (!records)
+        return -1;
+
+    list_foreach(head, entry) {
+        CModule *cmodule = static_cast<CModule *>(entry->data);
+        struct registry_cache_record *record = &records[nr_records];
+
+        if (cmodule->IsLoaded()) {
+            if (!fill_record(record, cmodule)) {
+                omx_verboseLog("%s(): %s is not cacheable", __FUNCTION__,
+                               cmodule->GetLibraryName());
+                memset(record, 0, sizeof(*record));
+                continue;
+            }
+        }
+        else {
+            const struct registry_cache_record *cached;
+
+            cached = find_record(cache, cmodule->GetLibraryName());
+            if (!cached)
+                continue;
+            memcpy(record, cached, sizeof(*record));
+        }
+        nr_records++;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, REGISTRY_CACHE_MAGIC, sizeof(REGISTRY_CACHE_MAGIC));
+    header.version = REGISTRY_CACHE_VERSION;
+    header.record_size = sizeof(struct registry_cache_record);
+    header.nr_records = nr_records;
+    header.search_path_hash = get_search_path_hash();
+
+    /* write and rename, readers never see a partial file */
+    snprintf(temp, sizeof(temp), "%s.XXXXXX", path);
+    fd = mkstemp(temp);
+    if (fd < 0) {
+        omx_verboseLog("%s(): cannot create %s", __FUNCTION__, temp);
+        goto free_records;
+    }
+
+    size = sizeof(*records) * nr_records;
+    if (write(fd, &header, sizeof(header)) != (ssize_t)sizeof(header) ||
+        write(fd, records, size) != (ssize_t)size) {
+        close(fd);
+        unlink(temp);
+        goto free_records;
+    }
+    fchmod(fd, 0644);
+    close(fd);
+
+    if (rename(temp, path)) {
+        unlink(temp);
+        goto free_records;
+    }
+
+    omx_infoLog("%s(): %lu records written to %s", __FUNCTION__,
+                nr_records, path);
+    ret = 0;
+
+free_records:
+    free(records);
+    return ret;
+}
+
+void registry_cache_remove(void)
+{
+    char buf[REGISTRY_CACHE_PATH_SIZE];
+    const char *path;
+
+    path = get_cache_path(buf, sizeof(buf));
+    if (path)
+        unlink(path);
+}
@@ -0,0 +1,60 @@
+/*
+ * registry_cache.h, on-disk cache of component names and roles
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __REGISTRY_CACHE_H
+#define __REGISTRY_CACHE_H
+
+#include <OMX_Core.h>
+
+#include <list.h>
+#include <cmodule.h>
+
+/*
+ * the cache file keeps a fixed size record per component library with the
+ * resolved path, size, mtime and inode of the file it was loaded from and
+ * the component name and roles. a record is used only while its file is
+ * unchanged and LD_LIBRARY_PATH is the same as when the cache was written.
+ *
+ * OMXIL_REGISTRY_CACHE environment variable overrides the file path
+ * (default /var/tmp/omxil-core-registry-<uid>.cache), empty string
+ * disables the cache. a file not owned by the user or writable by the
+ * group or others is ignored.
+ */
+struct registry_cache;
+
+/* maps the cache file, NULL if disabled, missing or invalid */
+struct registry_cache *registry_cache_open(void);
+void registry_cache_close(struct registry_cache *cache);
+
+/*
+ * a new CModule registered with the cached name and roles, not loaded.
+ * NULL if lname has no record or its library file has changed.
+ */
+CModule *registry_cache_lookup(struct registry_cache *cache,
+                               const char *lname);
+
+/*
+ * rewrites the cache file with the CModules in head, loaded ones or the
+ * ones from the previous cache
+ */
+int registry_cache_write(struct registry_cache *cache, struct list *head);
+
+/* called when a cached component turned out to be stale */
+void registry_cache_remove(void);
+
+#endif /* __REGISTRY_CACHE_H */
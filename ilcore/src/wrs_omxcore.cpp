@@ -21,14 +21,24 @@
 #include <string.h>
 
 #include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
 
 #include <OMX_Core.h>
 #include <OMX_Component.h>
 
 #include <list.h>
+#include <hash.h>
+#include <bufpool.h>
+#include <thread.h>
+#include <threadplace.h>
+#include <trace.h>
+#include <lockstat.h>
 #include <cmodule.h>
 #include <componentbase.h>
 
+#include "registry_cache.h"
+
 typedef struct component_handle {
 
     char comp_name[OMX_MAX_STRINGNAME_SIZE];
@@ -39,11 +49,28 @@ typedef struct component_handle {
 }ComponentHandle, *ComponentHandlePtr;
 
 static unsigned int g_initialized = 0;
-static unsigned int g_nr_instances = 0;
+/* changed atomically, OMX_Deinit() fails while it's not 0 */
+static volatile unsigned int g_nr_instances = 0;
 static struct list *preload_list=NULL;
 
 static struct list *g_module_list = NULL;
-static pthread_mutex_t g_module_lock = PTHREAD_MUTEX_INITIALIZER;
+/*
+ * the component list and registry don't change between OMX_Init() and
+ * OMX_Deinit(), which are the only writers. lookups share the read lock.
+ */
+static struct lockstat_rwlock g_module_lock =
+    LOCKSTAT_RWLOCK_INITIALIZER("g_module_lock");
+
+/*
+ * component registry, built from g_module_list once in OMX_Init()
+ *  g_modules       : indexed array for OMX_ComponentNameEnum()
+ *  g_module_names  : component name -> CModule
+ *  g_module_roles  : role -> list of CModules having the role
+ */
+static CModule **g_modules = NULL;
+static OMX_U32 g_nr_modules = 0;
+static struct hash *g_module_names = NULL;
+static struct hash *g_module_roles = NULL;
 
 static char *omx_components[][2] = {
 #if __USE_LIBYAMI__
@@ -117,6 +144,54 @@ delete_comphandle:
     return ret;
 }
 
+#ifdef __ENABLE_BENCH__
+/*
+ * OMXIL_COMPONENTS environment variable, colon separated libraries (names
+ * or paths) listed after omx_components[], e.g. the passthrough component
+ * of the benchmark. built with --enable-omx-bench only
+ */
+static bool add_env_components(void)
+{
+    ComponentHandlePtr component_handle;
+    const char *env = getenv("OMXIL_COMPONENTS"), *next;
+    size_t len;
+
+    for (; env && *env; env = *next ? next + 1 : next) {
+        struct list *entry;
+
+        next = strchr(env, ':');
+        if (!next)
+            next = env + strlen(env);
+
+        len = next - env;
+        if (!len)
+            continue;
+        if (len >= OMX_MAX_STRINGNAME_SIZE) {
+            omx_errorLog("OMXIL_COMPONENTS: %.*s is too long, ignored",
+                         (int)len, env);
+            continue;
+        }
+
+        component_handle = (ComponentHandlePtr)
+            calloc(1, sizeof(ComponentHandle));
+        if (!component_handle)
+            return false;
+        memcpy(component_handle->comp_name, env, len);
+
+        entry = list_alloc(component_handle);
+        if (!entry) {
+            free(component_handle);
+            return false;
+        }
+        preload_list = __list_add_tail(preload_list, entry);
+
+        omx_infoLog("Added component %s to list", component_handle->comp_name);
+    }
+
+    return true;
+}
+#endif
+
 bool create_preload_list(void)
 {
     ComponentHandlePtr component_handle;
@@ -148,13 +223,128 @@ bool create_preload_list(void)
 unload_comphandle:
         dlclose(component_handle->comp_handle);
     }
+
+#ifdef __ENABLE_BENCH__
+    if (!add_env_components())
+        ret = false;
+#endif
     return ret;
 }
 
+/*
+ * component libraries not found in the registry cache are loaded and queried
+ * on a few threads in parallel, results are merged into the component list
+ * in omx_components[] order
+ */
+#define MAX_LOADER_THREADS 4
+
+struct component_load {
+    ComponentHandlePtr component_handle;
+    CModule *cmodule; /* NULL if failed */
+    bool cached; /* registered from the cache, not loaded */
+
+    /* in usec */
+    long load_time;
+    long query_time;
+};
+
+static long elapsed_usec(const struct timeval *from)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - from->tv_sec) * 1000000L +
+        (now.tv_usec - from->tv_usec);
+}
+
+static void load_component(struct component_load *load)
+{
+    ComponentHandlePtr component_handle = load->component_handle;
+    CModule *cmodule;
+    struct timeval start;
+    OMX_ERRORTYPE ret;
+
+    load->cmodule = NULL;
+    load->load_time = 0;
+    load->query_time = 0;
+
+    cmodule = new CModule(component_handle->comp_name);
+    if (!cmodule)
+        return;
+
+    omx_verboseLog("found component library %s", component_handle->comp_name);
+
+    gettimeofday(&start, NULL);
+    ret = cmodule->Load(MODULE_NOW, component_handle->comp_handle);
+    load->load_time = elapsed_usec(&start);
+    if (ret != OMX_ErrorNone)
+        goto delete_cmodule;
+
+    ret = cmodule->SetParser(component_handle->parser_handle);
+    if (ret != OMX_ErrorNone)
+        goto delete_cmodule;
+
+    gettimeofday(&start, NULL);
+    ret = cmodule->QueryComponentNameAndRoles();
+    load->query_time = elapsed_usec(&start);
+    if (ret != OMX_ErrorNone)
+        goto unload_cmodule;
+
+    load->cmodule = cmodule;
+    return;
+
+unload_cmodule:
+    cmodule->Unload();
+delete_cmodule:
+    delete cmodule;
+}
+
+class ComponentLoader : public RunnableInterface
+{
+public:
+    ComponentLoader(struct component_load *loads, int nr_loads) {
+        this->loads = loads;
+        this->nr_loads = nr_loads;
+        next = 0;
+    }
+
+    /* shared by all loader threads, each takes the next library */
+    virtual void Run(void) {
+        int i;
+
+        while ((i = __sync_fetch_and_add(&next, 1)) < nr_loads) {
+            if (!loads[i].cached)
+                load_component(&loads[i]);
+        }
+    }
+
+private:
+    struct component_load *loads;
+    int nr_loads;
+    int next;
+};
+
+static int get_nr_loader_threads(int nr_loads)
+{
+    long nr = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (nr > MAX_LOADER_THREADS)
+        nr = MAX_LOADER_THREADS;
+    if (nr > nr_loads)
+        nr = nr_loads;
+    if (nr < 1)
+        nr = 1;
+
+    return (int)nr;
+}
+
 static struct list *construct_components(void)
 {
     struct list *head = NULL, *preload_entry;
-    ComponentHandlePtr component_handle;
+    struct component_load *loads;
+    struct registry_cache *cache;
+    int nr_loads = 0, nr_cached = 0, nr_loaded = 0, nr_threads, i;
+    struct timeval start;
 
     /* In Chromium OS, the OMX IL Client will call preload_components()
      * so that the preload_list is already populated. In non-chrome case,
@@ -165,51 +355,124 @@ static struct list *construct_components(void)
        }
     }
 
-    list_foreach(preload_list, preload_entry) {
-        CModule *cmodule;
-        struct list *entry;
-        OMX_ERRORTYPE ret;
+    loads = (struct component_load *)
+        malloc(sizeof(*loads) * (list_length(preload_list) + 1));
+    if (!loads)
+        return NULL;
 
-        component_handle = (ComponentHandlePtr) preload_entry->data;
+    list_foreach(preload_list, preload_entry) {
+        ComponentHandlePtr component_handle =
+            (ComponentHandlePtr) preload_entry->data;
 
         /* skip libraries starting with # */
         if (component_handle->comp_name[0] == '#')
             continue;
 
-        cmodule = new CModule(component_handle->comp_name);
+        loads[nr_loads].component_handle = component_handle;
+        loads[nr_loads].cmodule = NULL;
+        loads[nr_loads].cached = false;
+        loads[nr_loads].load_time = 0;
+        loads[nr_loads].query_time = 0;
+        nr_loads++;
+    }
+
+    gettimeofday(&start, NULL);
+
+    cache = registry_cache_open();
+    for (i = 0; cache && i < nr_loads; i++) {
+        ComponentHandlePtr component_handle = loads[i].component_handle;
+        CModule *cmodule;
+
+        /* preloaded libraries are already opened */
+        if (component_handle->comp_handle)
+            continue;
+
+        cmodule = registry_cache_lookup(cache, component_handle->comp_name);
         if (!cmodule)
             continue;
 
-        omx_verboseLog("found component library %s", component_handle->comp_name);
+        cmodule->SetParser(component_handle->parser_handle);
+        loads[i].cmodule = cmodule;
+        loads[i].cached = true;
+        nr_cached++;
+    }
 
-        ret = cmodule->Load(MODULE_NOW, component_handle->comp_handle);
-        if (ret != OMX_ErrorNone)
-            goto delete_cmodule;
+    nr_threads = get_nr_loader_threads(nr_loads - nr_cached);
+    if (nr_threads > 1) {
+        ComponentLoader loader(loads, nr_loads);
+        Thread *threads[MAX_LOADER_THREADS];
+        int nr_started = 0;
+
+        /* current thread is one of the loaders */
+        for (i = 0; i < nr_threads - 1; i++) {
+            threads[i] = new Thread(&loader);
+            if (threads[i]->Start()) {
+                delete threads[i];
+                break;
+            }
+            nr_started++;
+        }
 
-        ret = cmodule->SetParser(component_handle->parser_handle);
-        if (ret != OMX_ErrorNone)
-            goto delete_cmodule;
+        /* also covers thread creation failure */
+        loader.Run();
 
-        ret = cmodule->QueryComponentNameAndRoles();
-        if (ret != OMX_ErrorNone)
-            goto unload_cmodule;
+        for (i = 0; i < nr_started; i++) {
+            threads[i]->Join();
+            delete threads[i];
+        }
+    }
+    else {
+        for (i = 0; i < nr_loads; i++) {
+            if (!loads[i].cached)
+                load_component(&loads[i]);
+        }
+    }
+
+    for (i = 0; i < nr_loads; i++) {
+        CModule *cmodule = loads[i].cmodule;
+        struct list *entry;
+
+        if (loads[i].cached)
+            omx_infoLog("component library %s: cached",
+                        loads[i].component_handle->comp_name);
+        else
+            omx_infoLog("component library %s: load %ld.%03ldms, "
+                        "query %ld.%03ldms%s",
+                        loads[i].component_handle->comp_name,
+                        loads[i].load_time / 1000, loads[i].load_time % 1000,
+                        loads[i].query_time / 1000,
+                        loads[i].query_time % 1000,
+                        cmodule ? "" : " (failed)");
+
+        if (!cmodule)
+            continue;
+
+        if (!loads[i].cached)
+            nr_loaded++;
 
         entry = list_alloc(cmodule);
-        if (!entry)
-            goto unload_cmodule;
+        if (!entry) {
+            cmodule->Unload();
+            delete cmodule;
+            continue;
+        }
         head = __list_add_tail(head, entry);
 
         omx_verboseLog("module %s:%s added to component list",
              cmodule->GetLibraryName(), cmodule->GetComponentName());
+    }
 
-        continue;
+    /* libraries missing in the cache, or changed since */
+    if (nr_loaded)
+        registry_cache_write(cache, head);
+    registry_cache_close(cache);
 
-    unload_cmodule:
-        cmodule->Unload();
-    delete_cmodule:
-        delete cmodule;
-    }
+    omx_infoLog("%d component libraries (%d cached) loaded in %ld.%03ldms "
+                "with %d threads", nr_loads, nr_cached,
+                elapsed_usec(&start) / 1000, elapsed_usec(&start) % 1000,
+                nr_threads);
 
+    free(loads);
     return head;
 }
 
@@ -231,25 +494,129 @@ static struct list *destruct_components(struct list *head)
     return head;
 }
 
+static void destruct_registry(void)
+{
+    OMX_U32 i, j;
+
+    for (i = 0; i < g_nr_modules; i++) {
+        CModule *cmodule = g_modules[i];
+
+        for (j = 0; j < cmodule->GetNumberOfRoles(); j++) {
+            struct hash_entry *rentry;
+
+            rentry = hash_find(g_module_roles, cmodule->GetRole(j));
+            if (rentry) {
+                list_free_all(static_cast<struct list *>(rentry->data));
+                rentry->data = NULL;
+            }
+        }
+    }
+
+    hash_free_all(g_module_roles);
+    g_module_roles = NULL;
+    hash_free_all(g_module_names);
+    g_module_names = NULL;
+
+    free(g_modules);
+    g_modules = NULL;
+    g_nr_modules = 0;
+}
+
+static OMX_ERRORTYPE construct_registry(struct list *head)
+{
+    struct list *entry;
+    OMX_U32 nr_modules = list_length(head), nr_roles = 0;
+
+    list_foreach(head, entry) {
+        CModule *cmodule = static_cast<CModule *>(entry->data);
+
+        nr_roles += cmodule->GetNumberOfRoles();
+    }
+
+    g_modules = (CModule **)malloc(sizeof(CModule *) * (nr_modules + 1));
+    g_module_names = hash_alloc(nr_modules);
+    g_module_roles = hash_alloc(nr_roles);
+    if (!g_modules || !g_module_names || !g_module_roles)
+        goto free_registry;
+
+    list_foreach(head, entry) {
+        CModule *cmodule = static_cast<CModule *>(entry->data);
+        OMX_STRING cname = cmodule->GetComponentName();
+        OMX_U32 i;
+
+        g_modules[g_nr_modules++] = cmodule;
+
+        /* first one wins, as the list used to be searched from its head */
+        if (hash_lookup(g_module_names, cname))
+            omx_errorLog("%s(): %s of %s is already registered, ignored",
+                         __FUNCTION__, cname, cmodule->GetLibraryName());
+        else if (!hash_insert(g_module_names, cname, cmodule))
+            goto free_registry;
+
+        for (i = 0; i < cmodule->GetNumberOfRoles(); i++) {
+            OMX_STRING role = cmodule->GetRole(i);
+            struct hash_entry *rentry;
+            struct list *rlist, *rlist_entry;
+
+            rentry = hash_find(g_module_roles, role);
+            if (!rentry) {
+                rentry = hash_insert(g_module_roles, role, NULL);
+                if (!rentry)
+                    goto free_registry;
+            }
+
+            rlist = static_cast<struct list *>(rentry->data);
+            /* a role listed twice by a component */
+            if (rlist && __list_last(rlist)->data == cmodule)
+                continue;
+
+            rlist_entry = list_alloc(cmodule);
+            if (!rlist_entry)
+                goto free_registry;
+            rentry->data = __list_add_tail(rlist, rlist_entry);
+        }
+    }
+
+    omx_verboseLog("%s(): %lu components, %lu roles registered", __FUNCTION__,
+                   g_nr_modules, g_module_roles->nr_entries);
+    return OMX_ErrorNone;
+
+free_registry:
+    destruct_registry();
+    return OMX_ErrorInsufficientResources;
+}
+
 OMX_API OMX_ERRORTYPE OMX_APIENTRY OMX_Init(void)
 {
     int ret;
 
     omx_verboseLog("%s(): enter", __FUNCTION__);
 
-    pthread_mutex_lock(&g_module_lock);
+    lockstat_rwlock_wrlock(&g_module_lock);
     if (!g_initialized) {
+        /* applied to the threads of the components created from now */
+        thread_placement_load();
+        trace_load();
+
         g_module_list = construct_components();
         if (!g_module_list) {
-            pthread_mutex_unlock(&g_module_lock);
+            lockstat_rwlock_unlock(&g_module_lock);
             omx_errorLog("%s(): exit failure, construct_components failed",
                  __FUNCTION__);
             return OMX_ErrorInsufficientResources;
         }
 
+        if (construct_registry(g_module_list) != OMX_ErrorNone) {
+            g_module_list = destruct_components(g_module_list);
+            lockstat_rwlock_unlock(&g_module_lock);
+            omx_errorLog("%s(): exit failure, construct_registry failed",
+                 __FUNCTION__);
+            return OMX_ErrorInsufficientResources;
+        }
+
         g_initialized = 1;
     }
-    pthread_mutex_unlock(&g_module_lock);
+    lockstat_rwlock_unlock(&g_module_lock);
 
     omx_verboseLog("%s(): exit done", __FUNCTION__);
     return OMX_ErrorNone;
@@ -261,13 +628,18 @@ OMX_API OMX_ERRORTYPE OMX_APIENTRY OMX_Deinit(void)
 
     omx_verboseLog("%s(): enter", __FUNCTION__);
 
-    pthread_mutex_lock(&g_module_lock);
-    if (!g_nr_instances) {
+    lockstat_rwlock_wrlock(&g_module_lock);
+    if (!__sync_fetch_and_add(&g_nr_instances, 0)) {
+        destruct_registry();
         g_module_list = destruct_components(g_module_list);
+        /* no component's left to reuse the cached payloads */
+        bufpool_trim();
+        thread_placement_unload();
+        trace_unload();
         g_initialized = 0;
     } else
         ret = OMX_ErrorUndefined;
-    pthread_mutex_unlock(&g_module_lock);
+    lockstat_rwlock_unlock(&g_module_lock);
 
     omx_verboseLog("%s(): exit done (ret : 0x%08x)", __FUNCTION__, ret);
     return ret;
@@ -279,22 +651,19 @@ OMX_API OMX_ERRORTYPE OMX_APIENTRY OMX_ComponentNameEnum(
     OMX_IN OMX_U32 nIndex)
 {
     CModule *cmodule;
-    ComponentBase *cbase;
-    struct list *entry;
     OMX_STRING cname;
 
-    pthread_mutex_lock(&g_module_lock);
-    entry = __list_entry(g_module_list, nIndex);
-    if (!entry) {
-        pthread_mutex_unlock(&g_module_lock);
+    lockstat_rwlock_rdlock(&g_module_lock);
+    if (nIndex >= g_nr_modules) {
+        lockstat_rwlock_unlock(&g_module_lock);
         return OMX_ErrorNoMore;
     }
-    pthread_mutex_unlock(&g_module_lock);
+    cmodule = g_modules[nIndex];
 
-    cmodule = static_cast<CModule *>(entry->data);
     cname = cmodule->GetComponentName();
 
     strncpy(cComponentName, cname, nNameLength);
+    lockstat_rwlock_unlock(&g_module_lock);
 
     omx_verboseLog("%s(): found %luth component %s", __FUNCTION__, nIndex, cname);
     return OMX_ErrorNone;
@@ -306,60 +675,63 @@ OMX_API OMX_ERRORTYPE OMX_APIENTRY OMX_GetHandle(
     OMX_IN OMX_PTR pAppData,
     OMX_IN OMX_CALLBACKTYPE *pCallBacks)
 {
-    struct list *entry;
+    CModule *cmodule;
+    ComponentBase *cbase = NULL;
     OMX_ERRORTYPE ret;
 
     omx_verboseLog("%s(): enter, try to get %s", __FUNCTION__, cComponentName);
 
-    pthread_mutex_lock(&g_module_lock);
-    list_foreach(g_module_list, entry) {
-        CModule *cmodule;
-        OMX_STRING cname;
-
-        cmodule = static_cast<CModule *>(entry->data);
-
-        cname = cmodule->GetComponentName();
-        if (!strcmp(cComponentName, cname)) {
-            ComponentBase *cbase = NULL;
-
-            ret = cmodule->InstantiateComponent(&cbase);
-            if (ret != OMX_ErrorNone){
-                omx_errorLog("%s(): exit failure, cmodule->Instantiate failed\n",
-                     __FUNCTION__);
-                goto unload_cmodule;
-            }
-
-            ret = cbase->GetHandle(pHandle, pAppData, pCallBacks);
-            if (ret != OMX_ErrorNone) {
-                omx_errorLog("%s(): exit failure, cbase->GetHandle failed\n",
-                     __FUNCTION__);
-                goto delete_cbase;
-            }
-
-            cbase->SetCModule(cmodule);
+    lockstat_rwlock_rdlock(&g_module_lock);
+    cmodule = static_cast<CModule *>(hash_lookup(g_module_names,
+                                                 cComponentName));
+    if (!cmodule) {
+        lockstat_rwlock_unlock(&g_module_lock);
 
-            g_nr_instances++;
-            pthread_mutex_unlock(&g_module_lock);
+        omx_errorLog("%s(): exit failure, %s not found", __FUNCTION__,
+                     cComponentName);
+        return OMX_ErrorInvalidComponent;
+    }
+    /*
+     * counted before the lock is released, OMX_Deinit() can't free cmodule
+     * from now on. the component is built without any global lock held.
+     */
+    __sync_fetch_and_add(&g_nr_instances, 1);
+    lockstat_rwlock_unlock(&g_module_lock);
+
+    ret = cmodule->InstantiateComponent(&cbase);
+    if (ret != OMX_ErrorNone){
+        omx_errorLog("%s(): exit failure, cmodule->Instantiate failed\n",
+             __FUNCTION__);
+        /* the library was replaced after it was cached */
+        if (ret == OMX_ErrorInvalidComponent)
+            registry_cache_remove();
+        goto put_instance;
+    }
 
-            omx_infoLog("get handle of component %s successfully", cComponentName);
-            omx_verboseLog("%s(): exit done\n", __FUNCTION__);
-            return OMX_ErrorNone;
+    ret = cbase->GetHandle(pHandle, pAppData, pCallBacks);
+    if (ret != OMX_ErrorNone) {
+        omx_errorLog("%s(): exit failure, cbase->GetHandle failed\n",
+             __FUNCTION__);
+        goto delete_cbase;
+    }
 
-        delete_cbase:
-            delete cbase;
-        unload_cmodule:
-            cmodule->Unload();
-        unlock_list:
-            pthread_mutex_unlock(&g_module_lock);
+    cbase->SetCModule(cmodule);
 
-            omx_errorLog("%s(): exit failure, (ret : 0x%08x)\n", __FUNCTION__, ret);
-            return ret;
-        }
-    }
-    pthread_mutex_unlock(&g_module_lock);
+    omx_infoLog("get handle of component %s successfully", cComponentName);
+    omx_verboseLog("%s(): exit done\n", __FUNCTION__);
+    return OMX_ErrorNone;
 
-    omx_errorLog("%s(): exit failure, %s not found", __FUNCTION__, cComponentName);
-    return OMX_ErrorInvalidComponent;
+delete_cbase:
+    delete cbase;
+put_instance:
+    /*
+     * the library stays loaded, other instances may be running its code.
+     * it's unloaded by OMX_Deinit()
+     */
+    __sync_fetch_and_sub(&g_nr_instances, 1);
+
+    omx_errorLog("%s(): exit failure, (ret : 0x%08x)\n", __FUNCTION__, ret);
+    return ret;
 }
 
 OMX_API OMX_ERRORTYPE OMX_APIENTRY OMX_FreeHandle(
@@ -392,16 +764,15 @@ OMX_API OMX_ERRORTYPE OMX_APIENTRY OMX_FreeHandle(
         return ret;
     }
 
-    pthread_mutex_lock(&g_module_lock);
-    g_nr_instances--;
-    pthread_mutex_unlock(&g_module_lock);
-
     cmodule = cbase->GetCModule();
     if (!cmodule)
         omx_errorLog("fatal error, %s does not have cmodule\n", cbase->GetName());
 
     delete cbase;
 
+    /* after the library code (destructor) has run */
+    __sync_fetch_and_sub(&g_nr_instances, 1);
+
     omx_infoLog("free handle of component %s successfully", cname);
     omx_verboseLog("%s(): exit done", __FUNCTION__);
     return OMX_ErrorNone;
@@ -413,7 +784,49 @@ OMX_API OMX_ERRORTYPE OMX_APIENTRY OMX_SetupTunnel(
     OMX_IN OMX_HANDLETYPE hInput,
     OMX_IN OMX_U32 nPortInput)
 {
-    return OMX_ErrorNotImplemented;
+    OMX_COMPONENTTYPE *output = (OMX_COMPONENTTYPE *)hOutput;
+    OMX_COMPONENTTYPE *input = (OMX_COMPONENTTYPE *)hInput;
+    OMX_TUNNELSETUPTYPE setup;
+    OMX_ERRORTYPE ret;
+
+    if (!output && !input)
+        return OMX_ErrorBadParameter;
+
+    if ((output && !output->ComponentTunnelRequest) ||
+        (input && !input->ComponentTunnelRequest))
+        return OMX_ErrorNotImplemented;
+
+    setup.nTunnelFlags = 0;
+    setup.eSupplier = OMX_BufferSupplyUnspecified;
+
+    /* output first, it tells its supplier preference to the input */
+    if (output) {
+        ret = output->ComponentTunnelRequest(hOutput, nPortOutput,
+                                             hInput, nPortInput, &setup);
+        if (ret != OMX_ErrorNone) {
+            omx_errorLog("%s(): output port %lu refused tunnel (0x%08x)\n",
+                 __FUNCTION__, nPortOutput, ret);
+            return ret;
+        }
+    }
+
+    if (input) {
+        ret = input->ComponentTunnelRequest(hInput, nPortInput,
+                                            hOutput, nPortOutput, &setup);
+        if (ret != OMX_ErrorNone) {
+            omx_errorLog("%s(): input port %lu refused tunnel (0x%08x)\n",
+                 __FUNCTION__, nPortInput, ret);
+            if (output)
+                output->ComponentTunnelRequest(hOutput, nPortOutput,
+                                               NULL, 0, NULL);
+            return ret;
+        }
+    }
+
+    omx_verboseLog("%s(): tunnel %p:%lu -> %p:%lu set up, supplier %d\n",
+         __FUNCTION__, hOutput, nPortOutput, hInput, nPortInput,
+         setup.eSupplier);
+    return OMX_ErrorNone;
 }
 
 OMX_API OMX_ERRORTYPE   OMX_GetContentPipe(
@@ -431,28 +844,25 @@ OMX_API OMX_ERRORTYPE OMX_GetComponentsOfRole (
     struct list *entry;
     OMX_U32 nr_comps = 0, copied_nr_comps = 0;
 
-    pthread_mutex_lock(&g_module_lock);
-    list_foreach(g_module_list, entry) {
+    lockstat_rwlock_rdlock(&g_module_lock);
+    list_foreach(static_cast<struct list *>(hash_lookup(g_module_roles, role)),
+                 entry) {
         CModule *cmodule;
         OMX_STRING cname;
-        bool having_role;
 
         cmodule = static_cast<CModule *>(entry->data);
 
-        having_role = cmodule->QueryHavingThisRole(role);
-        if (having_role) {
-            if (compNames && compNames[nr_comps]) {
-                cname = cmodule->GetComponentName();
-                strncpy((OMX_STRING)&compNames[nr_comps][0], cname,
-                        OMX_MAX_STRINGNAME_SIZE);
-                copied_nr_comps++;
-                omx_verboseLog("%s(): component %s has %s role", __FUNCTION__,
-                     cname, role);
-            }
-            nr_comps++;
+        if (compNames && compNames[nr_comps]) {
+            cname = cmodule->GetComponentName();
+            strncpy((OMX_STRING)&compNames[nr_comps][0], cname,
+                    OMX_MAX_STRINGNAME_SIZE);
+            copied_nr_comps++;
+            omx_verboseLog("%s(): component %s has %s role", __FUNCTION__,
+                 cname, role);
         }
+        nr_comps++;
     }
-    pthread_mutex_unlock(&g_module_lock);
+    lockstat_rwlock_unlock(&g_module_lock);
 
     if (!copied_nr_comps)
         *pNumComps = nr_comps;
@@ -469,37 +879,28 @@ OMX_API OMX_ERRORTYPE OMX_GetRolesOfComponent (
     OMX_INOUT OMX_U32 *pNumRoles,
     OMX_OUT OMX_U8 **roles)
 {
-    struct list *entry;
+    CModule *cmodule;
+    OMX_ERRORTYPE ret;
 
-    pthread_mutex_lock(&g_module_lock);
-    list_foreach(g_module_list, entry) {
-        CModule *cmodule;
-        ComponentBase *cbase;
-        OMX_STRING cname;
-        OMX_ERRORTYPE ret;
+    lockstat_rwlock_rdlock(&g_module_lock);
+    cmodule = static_cast<CModule *>(hash_lookup(g_module_names, compName));
+    if (!cmodule) {
+        lockstat_rwlock_unlock(&g_module_lock);
+        return OMX_ErrorInvalidComponent;
+    }
 
-        cmodule = static_cast<CModule *>(entry->data);
+    ret = cmodule->GetComponentRoles(pNumRoles, roles);
+    lockstat_rwlock_unlock(&g_module_lock);
 
-        cname = cmodule->GetComponentName();
-        if (!strcmp(compName, cname)) {
-            pthread_mutex_unlock(&g_module_lock);
-#if LOG_NDEBUG
-            return cmodule->GetComponentRoles(pNumRoles, roles);
-#else
-            ret = cmodule->GetComponentRoles(pNumRoles, roles);
-            if (ret != OMX_ErrorNone) {
-                OMX_U32 i;
-
-                for (i = 0; i < *pNumRoles; i++) {
-                    omx_verboseLog("%s(): component %s has %s role", __FUNCTION__,
-                         compName, &roles[i][0]);
-                }
-            }
-            return ret;
-#endif
+#if !LOG_NDEBUG
+    if (ret != OMX_ErrorNone) {
+        OMX_U32 i;
+
+        for (i = 0; i < *pNumRoles; i++) {
+            omx_verboseLog("%s(): component %s has %s role", __FUNCTION__,
+                 compName, &roles[i][0]);
         }
     }
-    pthread_mutex_unlock(&g_module_lock);
-
-    return OMX_ErrorInvalidComponent;
+#endif
+    return ret;
 }
@@ -0,0 +1,62 @@
+/*
+ * bufpool.h, aligned buffer payload pool
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __BUFPOOL_H
+#define __BUFPOOL_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* payloads are aligned at least to this */
+#define BUFPOOL_ALIGN           64
+
+/*
+ * process-wide pool of buffer payloads.
+ *
+ * payloads are 64 bytes aligned, page aligned if larger than a page, and
+ * not zero-filled. freed payloads are cached and given to later requests
+ * of a similar size, so that the payloads survive component and port
+ * reallocation (Idle -> Loaded -> Idle, port disable -> enable, session
+ * churn) without page faults and memset. OMX_Deinit() trims the cache.
+ *
+ * environment variables
+ *   OMXIL_BUFFER_POOL_SIZE  max bytes cached, 0 disables the cache
+ *                           (default 64MiB)
+ *   OMXIL_BUFFER_POOL_ZERO  non-zero zero-fills a reused payload, so it
+ *                           doesn't show what its last owner left
+ *                           (default 0)
+ */
+
+/*
+ * *size is the requested size on entry, the usable size of the returned
+ * payload on return, must be passed to bufpool_free(). NULL on failure
+ */
+void *bufpool_alloc(size_t *size);
+void bufpool_free(void *data, size_t size);
+
+/* free all cached payloads */
+void bufpool_trim(void);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __BUFPOOL_H */
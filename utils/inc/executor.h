@@ -0,0 +1,166 @@
+/*
+ * executor.h, process-wide worker thread pool
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __EXECUTOR_H
+#define __EXECUTOR_H
+
+#include <pthread.h>
+#include <list.h>
+
+#include <thread.h>
+#include <lockstat.h>
+
+class WorkQueue;
+
+/*
+ * Executor runs the works of WorkQueues created in shared mode on a fixed
+ * set of worker threads, sized to the number of online cpus.
+ *
+ * a WorkQueue is submitted at most once at a time and is drained by one
+ * worker only, so the works scheduled on a WorkQueue never run concurrently
+ * with each other.
+ *
+ * the ready WorkQueues're run in order of their priority, then of their
+ * deadline, those without deadline last, then of their submission. a
+ * WorkQueue gives up its worker after a few works and's resubmitted, so a
+ * busy low priority WorkQueue doesn't hold back a higher one for long.
+ *
+ * the timers of the WorkQueues're kept in one queue sorted by their
+ * earliest due, an idle worker sleeps until the first one and a busy one
+ * checks it between WorkQueues. no thread is dedicated to the timers, so
+ * they fire late if all workers're busy in long works.
+ *
+ * a worker blocking in BeginBlocking() doesn't count against the number of
+ * threads, a spare worker's started for it. spare workers idle for
+ * EXECUTOR_SPARE_IDLE nsec exit, down to the number of threads.
+ *
+ * OMXIL_EXECUTOR_THREADS environment variable overrides the number of
+ * worker threads, 0 disables the shared executor. the workers're named
+ * omx-exec-<n> and placed by the executor/worker rules. (see threadplace.h)
+ */
+#define EXECUTOR_SPARE_IDLE     1000000000ULL
+
+class Executor
+{
+public:
+    /* get a reference of the process-wide executor, NULL if disabled */
+    static Executor *Get(void);
+    /* put the reference, the last one stops and joins the workers */
+    static void Put(Executor *executor);
+
+    /* called by WorkQueue when it has works to be drained */
+    void Submit(WorkQueue *wq);
+    /* remove wq from the ready queue, false if it's not there */
+    bool Cancel(WorkQueue *wq);
+    /* called by WorkQueue when its deadline got earlier while submitted */
+    void Reorder(WorkQueue *wq);
+
+    /*
+     * called by WorkQueue holding its wlock when the earliest due of its
+     * timers changed, 0 if it has no timer any more
+     */
+    void SetTimer(WorkQueue *wq, unsigned long long due);
+    /*
+     * wait for the worker firing wq's timers if any, wq's wlock must not be
+     * held. wq's timers must've been cleared
+     */
+    void WaitTimer(WorkQueue *wq);
+
+    /*
+     * must wrap a wait which can block for long in a work. (e.g. waiting
+     * for omx-il clients) if the calling thread is a worker and fewer
+     * workers than the number of threads're left unblocked, a spare worker
+     * is started so that the other WorkQueues keep running. may be nested,
+     * the outermost pair counts.
+     */
+    static void BeginBlocking(void);
+    static void EndBlocking(void);
+
+private:
+    /* a worker thread, runs Executor::Run() until stopped or retired */
+    class Worker : public RunnableInterface
+    {
+    public:
+        Worker(Executor *executor) : thread(this), executor(executor) {};
+
+        Thread thread;
+
+    private:
+        virtual void Run(void); /* RunnableInterface */
+
+        Executor *executor;
+    };
+
+    Executor(int nr_threads);
+    ~Executor();
+
+    int Start(void);
+    void Stop(void);
+    /* must be held lock */
+    int AddWorker(void);
+    /* worker's idle and spare, it exits after, must be held lock */
+    void RetireWorker(Worker *worker);
+    /* join the last retired worker, must be held lock */
+    void ReapWorker(void);
+
+    void Run(Worker *worker);
+
+    static int GetNumberOfThreads(void);
+
+    /* ready queue, must be held lock */
+    static bool IsBefore(const WorkQueue *a, const WorkQueue *b);
+    void InsertReady(WorkQueue *wq);
+    bool RemoveReady(WorkQueue *wq);
+
+    /* timer queue, must be held lock */
+    void InsertTimer(WorkQueue *wq);
+    bool RemoveTimer(WorkQueue *wq);
+    /* fire the timers of the first WorkQueue if due, false if none */
+    bool FireTimers(void);
+    /*
+     * sleep on cond until woken up or the first timer's due or until, 0 if
+     * none
+     */
+    void WaitIdle(unsigned long long until);
+
+    /* sorted by IsBefore(), linked through WorkQueue::ready_next */
+    WorkQueue *readyq;
+    /* sorted by WorkQueue::timer_due, linked through timer_next */
+    WorkQueue *timerq;
+    struct lockstat_mutex lock;
+    /* CLOCK_MONOTONIC */
+    pthread_cond_t cond;
+    /* wokeup when a worker's done with FireTimers() */
+    pthread_cond_t timer_idle;
+
+    /* Worker */
+    struct list *workers;
+    /* exited or exiting, not joined yet */
+    Worker *retired;
+    int nr_workers;
+    int nr_idle;
+    /* in BeginBlocking() */
+    int nr_blocking;
+    int nr_max_workers;
+    int nr_threads;
+    bool stop;
+
+    int ref_count;
+};
+
+#endif /* __EXECUTOR_H */
@@ -0,0 +1,59 @@
+/*
+ * hash.h, string keyed hash table
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HASH_H
+#define __HASH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * keys are not copied, they must be valid until the entry is freed.
+ * entries with the same key can coexist, hash_find() returns the last
+ * inserted one.
+ */
+struct hash_entry {
+	struct hash_entry *next;
+	unsigned int hashval;
+
+	const char *key;
+	void *data;
+};
+
+struct hash {
+	struct hash_entry **buckets;
+	unsigned int nr_buckets;	/* power of two */
+	unsigned int nr_entries;
+};
+
+unsigned int hash_string(const char *key);
+
+struct hash *hash_alloc(unsigned int nr_entries);
+/* frees entries, not keys and data */
+void hash_free_all(struct hash *hash);
+
+struct hash_entry *hash_insert(struct hash *hash, const char *key, void *data);
+struct hash_entry *hash_find(struct hash *hash, const char *key);
+void *hash_lookup(struct hash *hash, const char *key);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __HASH_H */
@@ -0,0 +1,70 @@
+/*
+ * histogram.h, lock-free log-linear histogram
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HISTOGRAM_H
+#define __HISTOGRAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * HDR style: values below HISTOGRAM_SUB_BUCKETS have a bucket each, then
+ * every power of two is split into HISTOGRAM_SUB_BUCKETS buckets, so a
+ * bucket is at most 1/16 (6.25%) of its value wide. values from
+ * 2^HISTOGRAM_MAX_BITS on fall in the last bucket.
+ *
+ * histogram_record() is lock-free and can be called concurrently, a
+ * reader sees a snapshot that's consistent only once the writers stop.
+ */
+#define HISTOGRAM_SUB_BITS      4
+#define HISTOGRAM_SUB_BUCKETS   (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_MAX_BITS      40
+#define HISTOGRAM_NR_BUCKETS    \
+    ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+struct histogram {
+    unsigned int counts[HISTOGRAM_NR_BUCKETS];
+    unsigned long long sum;
+    unsigned long long min;     /* ~0ULL if empty */
+    unsigned long long max;
+};
+
+void histogram_reset(struct histogram *h);
+void histogram_record(struct histogram *h, unsigned long long value);
+
+/* values recorded, the sum of the buckets */
+unsigned long long histogram_count(const struct histogram *h);
+
+/* bucket of value, and the lowest and highest value of a bucket */
+unsigned int histogram_index(unsigned long long value);
+unsigned long long histogram_lowest(unsigned int index);
+unsigned long long histogram_highest(unsigned int index);
+
+/*
+ * highest value of the bucket holding the permille-th value, not above
+ * max. 0 if empty
+ */
+unsigned long long histogram_percentile(const struct histogram *h,
+                                        unsigned int permille);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __HISTOGRAM_H */
@@ -0,0 +1,196 @@
+/*
+ * lockstat.h, named locks with contention statistics
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LOCKSTAT_H
+#define __LOCKSTAT_H
+
+#include <pthread.h>
+
+#include <histogram.h>
+#include <trace.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * pthread mutex and rwlock carrying a name. while recording, every
+ * acquisition counts against the statistics of its name, so all the
+ * ports' hdrs_lock add up to one entry:
+ *   acquisitions, the contended ones (trylock failed first),
+ *   wait time of the contended ones and hold time, in nsec.
+ * a rwlock's hold time is the writers' only.
+ *
+ * while tracing (trace.h), a contended wait's recorded as a "lock" event
+ * of the name and scope.
+ *
+ * OMXIL_LOCKSTAT environment variable, non-zero, starts recording when
+ * the library's loaded and writes lockstat_report() to stderr at exit.
+ * (default 0) not recording, a lock costs a flag test over pthread's.
+ */
+struct lockstat {
+    const char *name;
+    unsigned long long nr_acquired;
+    unsigned long long nr_contended;
+    struct histogram wait;      /* contended acquisitions */
+    struct histogram hold;
+};
+
+struct lockstat_mutex {
+    pthread_mutex_t mutex;
+    const char *name;           /* string literal */
+    const char *scope;          /* trace scope or NULL */
+    struct lockstat *stat;      /* looked up on the first recording */
+    unsigned long long acquired;    /* holder's start, 0 if unrecorded */
+};
+
+struct lockstat_rwlock {
+    pthread_rwlock_t rwlock;
+    const char *name;
+    const char *scope;
+    struct lockstat *stat;
+    unsigned long long acquired;    /* writer's start */
+};
+
+#define LOCKSTAT_MUTEX_INITIALIZER(name)                        \
+    { PTHREAD_MUTEX_INITIALIZER, name, NULL, NULL, 0ULL }
+#define LOCKSTAT_RWLOCK_INITIALIZER(name)                       \
+    { PTHREAD_RWLOCK_INITIALIZER, name, NULL, NULL, 0ULL }
+
+extern volatile int lockstat_enabled;
+
+/* start or stop recording at runtime */
+void lockstat_enable(int enable);
+/* clears the statistics of all the names */
+void lockstat_reset(void);
+
+/*
+ * copies the statistics of up to nr names into stats, most waited for
+ * first. returns the number of names recorded so far
+ */
+unsigned int lockstat_get(struct lockstat *stats, unsigned int nr);
+/* statistics of name. 0 or -1 if it's never been recorded */
+int lockstat_find(const char *name, struct lockstat *stat);
+
+/* writes a table of all the names to fd, most waited for first */
+void lockstat_report(int fd);
+
+void lockstat_mutex_init(struct lockstat_mutex *m, const char *name,
+                         const char *scope);
+void lockstat_mutex_destroy(struct lockstat_mutex *m);
+void lockstat_rwlock_init(struct lockstat_rwlock *l, const char *name,
+                          const char *scope);
+void lockstat_rwlock_destroy(struct lockstat_rwlock *l);
+
+/* recording or tracing paths of the below */
+int __lockstat_mutex_lock(struct lockstat_mutex *m);
+int __lockstat_mutex_trylock(struct lockstat_mutex *m);
+void __lockstat_mutex_release(struct lockstat_mutex *m);
+void __lockstat_mutex_reacquired(struct lockstat_mutex *m);
+int __lockstat_rwlock_lock(struct lockstat_rwlock *l, int write);
+void __lockstat_rwlock_release(struct lockstat_rwlock *l);
+
+#define LOCKSTAT_ON()   __builtin_expect(lockstat_enabled | trace_enabled, 0)
+
+static inline int lockstat_mutex_lock(struct lockstat_mutex *m)
+{
+    if (!LOCKSTAT_ON())
+        return pthread_mutex_lock(&m->mutex);
+
+    return __lockstat_mutex_lock(m);
+}
+
+static inline int lockstat_mutex_trylock(struct lockstat_mutex *m)
+{
+    if (!__builtin_expect(lockstat_enabled, 0))
+        return pthread_mutex_trylock(&m->mutex);
+
+    return __lockstat_mutex_trylock(m);
+}
+
+static inline int lockstat_mutex_unlock(struct lockstat_mutex *m)
+{
+    /* set only by a recording holder, us */
+    if (m->acquired)
+        __lockstat_mutex_release(m);
+
+    return pthread_mutex_unlock(&m->mutex);
+}
+
+/* the time spent waiting on cond isn't held */
+static inline int lockstat_cond_wait(pthread_cond_t *cond,
+                                     struct lockstat_mutex *m)
+{
+    int ret;
+
+    if (m->acquired)
+        __lockstat_mutex_release(m);
+
+    ret = pthread_cond_wait(cond, &m->mutex);
+
+    if (__builtin_expect(lockstat_enabled, 0))
+        __lockstat_mutex_reacquired(m);
+    return ret;
+}
+
+static inline int lockstat_cond_timedwait(pthread_cond_t *cond,
+                                          struct lockstat_mutex *m,
+                                          const struct timespec *abstime)
+{
+    int ret;
+
+    if (m->acquired)
+        __lockstat_mutex_release(m);
+
+    ret = pthread_cond_timedwait(cond, &m->mutex, abstime);
+
+    if (__builtin_expect(lockstat_enabled, 0))
+        __lockstat_mutex_reacquired(m);
+    return ret;
+}
+
+static inline int lockstat_rwlock_rdlock(struct lockstat_rwlock *l)
+{
+    if (!LOCKSTAT_ON())
+        return pthread_rwlock_rdlock(&l->rwlock);
+
+    return __lockstat_rwlock_lock(l, 0);
+}
+
+static inline int lockstat_rwlock_wrlock(struct lockstat_rwlock *l)
+{
+    if (!LOCKSTAT_ON())
+        return pthread_rwlock_wrlock(&l->rwlock);
+
+    return __lockstat_rwlock_lock(l, 1);
+}
+
+static inline int lockstat_rwlock_unlock(struct lockstat_rwlock *l)
+{
+    /* non-zero only while a recording writer holds it */
+    if (l->acquired)
+        __lockstat_rwlock_release(l);
+
+    return pthread_rwlock_unlock(&l->rwlock);
+}
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __LOCKSTAT_H */
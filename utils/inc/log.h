@@ -0,0 +1,68 @@
+/*
+ * log.h, asynchronous log backend of the omx_*Log macros
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LOG_H
+#define __LOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * omx_log() copies the format pointer and the binary arguments (strings
+ * by value) into a lock-free queue, a log thread formats and writes them
+ * to stderr. a full queue drops the record rather than block, the drops
+ * are reported later.
+ *
+ * each call site (format) may log OMXIL_LOG_RATE records per second, the
+ * ones over the rate're counted and reported as suppressed. errors're
+ * never suppressed.
+ *
+ * environment variables
+ *   OMXIL_LOG_LEVEL  error, warn, info, debug or verbose (default info,
+ *                    verbose if built with --enable-omx-debug)
+ *   OMXIL_LOG_RATE   records per second per call site, 0 unlimited
+ *                    (default 20)
+ *   OMXIL_LOG_SYNC   non-zero formats and writes in the caller
+ *
+ * the format must outlive the record, a module's records're flushed
+ * before it's unloaded (module_close()). the rate of a call site keeps
+ * a copy of the format.
+ */
+enum {
+    OMX_LOG_ERROR = 0,
+    OMX_LOG_WARN,
+    OMX_LOG_INFO,
+    OMX_LOG_DEBUG,
+    OMX_LOG_VERBOSE
+};
+
+extern volatile int omx_log_level;
+
+void omx_log(int level, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+void omx_log_set_level(int level);
+/* returns when the records logged by now've been written */
+void omx_log_flush(void);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __LOG_H */
@@ -0,0 +1,86 @@
+/*
+ * ring.h, bounded lock-free ring
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __RING_H
+#define __RING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RING_CACHELINE_SIZE	64
+
+struct ring_cell {
+	volatile unsigned long seq;
+	void *data;
+};
+
+/*
+ * fixed size ring of pointers, safe for concurrent pushers and poppers
+ * without locks. (bounded mpmc queue, each cell carries a sequence number)
+ *
+ * storage is allocated once by ring_init(), ring_push() and ring_pop()
+ * never allocate.
+ */
+struct ring {
+	struct ring_cell *cells;
+	unsigned long mask;
+	char pad0[RING_CACHELINE_SIZE];
+
+	volatile unsigned long head;	/* next position to push */
+	char pad1[RING_CACHELINE_SIZE];
+
+	volatile unsigned long tail;	/* next position to pop */
+	char pad2[RING_CACHELINE_SIZE];
+
+	volatile long length;		/* number of published entries */
+	char pad3[RING_CACHELINE_SIZE];
+};
+
+void __ring_init(struct ring *ring);
+/* capacity is rounded up to power of two, must be empty if initialized */
+int ring_init(struct ring *ring, unsigned int capacity);
+void ring_free(struct ring *ring);
+
+/* 0 on success, -1 if full */
+int ring_push(struct ring *ring, void *data);
+/*
+ * NULL if empty, or if the cell at the tail is reserved by a push not done
+ * yet. not waited for, the pusher's to tell the consumer to pop again
+ */
+void *ring_pop(struct ring *ring);
+
+/*
+ * a snapshot, nonzero if a push in progress at the tail holds back
+ * ring_pop(), the entries after it may be counted by ring_length()
+ */
+int ring_pushing(struct ring *ring);
+
+/*
+ * a snapshot, exact while nobody pushes or pops. entries being pushed at
+ * the moment may not be counted yet, entries being popped may still be
+ * counted
+ */
+int ring_length(struct ring *ring);
+unsigned int ring_capacity(struct ring *ring);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __RING_H */
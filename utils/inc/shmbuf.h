@@ -0,0 +1,63 @@
+/*
+ * shmbuf.h, shareable buffer slab backed by memfd
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SHMBUF_H
+#define __SHMBUF_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * fixed number of page aligned slots in one memfd mapped shared. not
+ * thread safe, the owner serializes the calls.
+ *
+ * another process given the fd (e.g. over a unix socket) maps the same
+ * pages and reads a slot at its offset without copying. if sealed, the
+ * memfd can't be shrunk or grown, so the mapping is safe for the peer.
+ */
+struct shmbuf {
+    int fd;
+    unsigned char *base;
+    size_t size;            /* whole mapping */
+    size_t slot_size;
+    unsigned int nr_slots;
+    unsigned int nr_used;
+    unsigned char *used;    /* per slot */
+};
+
+/* slot_size is rounded up to page size, NULL on failure */
+struct shmbuf *shmbuf_create(const char *name, size_t slot_size,
+                             unsigned int nr_slots, int seal);
+/* all slots must have been freed */
+void shmbuf_destroy(struct shmbuf *shm);
+
+/* NULL if all slots're in use, *offset is the offset in the memfd */
+void *shmbuf_alloc(struct shmbuf *shm, size_t *offset);
+void shmbuf_free(struct shmbuf *shm, void *data);
+
+/* offset of data in the memfd, -1 if data isn't a slot of shm */
+long shmbuf_offset(struct shmbuf *shm, const void *data);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __SHMBUF_H */
@@ -11,6 +11,8 @@
 #include <stdint.h>
 #include <assert.h>
 
+#include <log.h>
+
 #ifdef ANDROID
 
 #include <utils/Log.h>
@@ -30,34 +32,40 @@
 #endif
 #endif //ANDROID
 
+/* see log.h, the format is a string literal */
 #ifndef omx_errorLog
 #define omx_errorLog(format, ...) do { \
-	fprintf(stderr, "omxil-core error: "format"\n", ##__VA_ARGS__); \
+	if (omx_log_level >= OMX_LOG_ERROR) \
+		omx_log(OMX_LOG_ERROR, format, ##__VA_ARGS__); \
 }while (0)
 #endif
 
 #ifndef omx_infoLog
 #define omx_infoLog(format, ...) do { \
-	fprintf(stderr, "omxil-core info: "format"\n", ##__VA_ARGS__); \
+	if (omx_log_level >= OMX_LOG_INFO) \
+		omx_log(OMX_LOG_INFO, format, ##__VA_ARGS__); \
 }while (0)
 #endif
 
 #ifdef __ENABLE_DEBUG__
 #ifndef omx_verboseLog
 #define omx_verboseLog(format, ...) do { \
-	fprintf(stderr, "omxil-core verbose: "format"\n", ##__VA_ARGS__); \
+	if (omx_log_level >= OMX_LOG_VERBOSE) \
+		omx_log(OMX_LOG_VERBOSE, format, ##__VA_ARGS__); \
 }while (0)
 #endif
 
 #ifndef omx_warnLog
 #define omx_warnLog(format, ...) do { \
-	fprintf(stderr, "omxil-core warning: "format"\n", ##__VA_ARGS__); \
+	if (omx_log_level >= OMX_LOG_WARN) \
+		omx_log(OMX_LOG_WARN, format, ##__VA_ARGS__); \
 }while (0)
 #endif
 
 #ifndef omx_debugLog
 #define omx_debugLog(format, ...) do { \
-	fprintf(stderr, "omxil-core debug: "format"\n", ##__VA_ARGS__); \
+	if (omx_log_level >= OMX_LOG_DEBUG) \
+		omx_log(OMX_LOG_DEBUG, format, ##__VA_ARGS__); \
 }while (0)
 #endif
 #else //__ENABLE_DEBUG__
@@ -20,6 +20,25 @@
 #define __THREAD_H
 
 #include <pthread.h>
+#include <stddef.h>
+
+/* thread_attr.flags, the attributes set, the others're left as inherited */
+#define THREAD_ATTR_AFFINITY    (1 << 0)
+#define THREAD_ATTR_SCHED       (1 << 1)
+#define THREAD_ATTR_STACK       (1 << 2)
+#define THREAD_ATTR_NAME        (1 << 3)
+
+/* including terminating null, the limit of the kernel */
+#define THREAD_NAME_SIZE        16
+
+struct thread_attr {
+    unsigned int flags;
+    unsigned long long cpu_mask;    /* bit n for cpu n, first 64 cpus */
+    int policy;                     /* SCHED_OTHER, SCHED_FIFO, ... */
+    int priority;                   /* sched_priority, 0 but FIFO & RR */
+    size_t stack_size;
+    char name[THREAD_NAME_SIZE];
+};
 
 class RunnableInterface {
 public:
@@ -38,6 +57,14 @@ public:
     int Start(void);
     int Join(void);
 
+    /*
+     * placement of the thread. the stack size applies when the thread's
+     * created next, the others also to the running thread. failing to apply
+     * one (e.g. SCHED_FIFO without the privilege) is logged, not fatal.
+     */
+    void SetAttributes(const struct thread_attr *attr);
+    void GetAttributes(struct thread_attr *attr);
+
 protected:
     /*
      * overriden by the derived class
@@ -48,11 +75,18 @@ protected:
 private:
     static void *Instance(void *);
 
+    /* must be held attr_lock */
+    void ApplyAttributes(pthread_t tid);
+
     RunnableInterface *r;
     pthread_t id;
     bool created;
 
     pthread_mutex_t lock;
+
+    /* not lock, Join() holds it while the thread may be starting */
+    struct thread_attr attr;
+    pthread_mutex_t attr_lock;
 };
 
 #endif /* __THREAD_H */
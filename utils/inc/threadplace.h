@@ -0,0 +1,55 @@
+/*
+ * threadplace.h, thread placement rules
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __THREADPLACE_H
+#define __THREADPLACE_H
+
+#include <thread.h>
+
+/*
+ * process-wide rules giving the threads of a component role their
+ * affinity, scheduling policy, stack size and name. a rule is
+ *
+ *   <component>/<role> [cpus=<list>] [policy=<policy>] [priority=<n>]
+ *                      [stack=<size>] [name=<name>]
+ *
+ *   component  component name, shell wildcards (e.g. OMX.Intel.*)
+ *   role       cmd, buffer or callback, shell wildcards. the shared
+ *              executor's workers're matched as executor/worker
+ *   cpus       cpu list, e.g. 0-1,3
+ *   policy     other, fifo, rr, batch or idle, priority's for fifo & rr
+ *   stack      bytes, k or m suffix
+ *   name       thread name, up to 15 characters
+ *
+ * every rule matching a thread applies in order, a later one overrides the
+ * attributes an earlier one sets.
+ *
+ * rules're read from the file named by OMXIL_THREAD_PLACEMENT_FILE, one per
+ * line ('#' comments), then from OMXIL_THREAD_PLACEMENT environment
+ * variable, separated by ';'. a malformed rule is logged and skipped.
+ */
+
+/* (re)load the rules, called by OMX_Init() */
+void thread_placement_load(void);
+void thread_placement_unload(void);
+
+/* merge the attributes of the matching rules into attr, false if none */
+bool thread_placement_lookup(const char *component, const char *role,
+                             struct thread_attr *attr);
+
+#endif /* __THREADPLACE_H */
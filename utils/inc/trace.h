@@ -0,0 +1,90 @@
+/*
+ * trace.h, per-thread trace rings
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * every thread records binary events into its own fixed-size ring, the
+ * oldest events're overwritten. recording takes no lock and makes no
+ * syscall but the clock read, the dump copies the rings while they're
+ * being written and drops the events overwritten meanwhile.
+ *
+ * the rings're dumped as Chrome trace-event JSON (chrome://tracing,
+ * ui.perfetto.dev) by trace_dump() or on SIGUSR2.
+ *
+ * environment variables, read by trace_load() (OMX_Init())
+ *   OMXIL_TRACE         non-zero enables recording (default 0)
+ *   OMXIL_TRACE_EVENTS  events per thread, rounded up to a power of two
+ *                       (default 4096, 64 bytes each)
+ *   OMXIL_TRACE_FILE    SIGUSR2 dumps to <file>-<pid>-<n>.json
+ *                       (default /tmp/omxil-trace)
+ *
+ * cat and name must be string literals, they're kept by pointer. scope,
+ * the component name, is copied (up to TRACE_SCOPE_SIZE - 1 characters
+ * from its end).
+ */
+#define TRACE_SCOPE_SIZE    16
+/* no port */
+#define TRACE_NO_PORT       (~0U)
+
+extern volatile int trace_enabled;
+
+void trace_load(void);
+void trace_unload(void);
+/* start or stop recording at runtime */
+void trace_enable(int enable);
+
+/* CLOCK_MONOTONIC in nsec */
+unsigned long long trace_now(void);
+
+/* an instant event */
+void trace_instant(const char *cat, const char *name, const char *scope,
+                   unsigned long long id, unsigned int port);
+/* an event from start (trace_now()) to now */
+void trace_complete(const char *cat, const char *name, const char *scope,
+                    unsigned long long id, unsigned int port,
+                    unsigned long long start);
+
+/* writes the rings to path, NULL for the SIGUSR2 file. 0 or -1 */
+int trace_dump(const char *path);
+
+#define TRACE_ON()  __builtin_expect(trace_enabled, 0)
+
+#define TRACE_INSTANT(cat, name, scope, id, port) do {          \
+    if (TRACE_ON())                                             \
+        trace_instant(cat, name, scope, id, port);              \
+} while (0)
+
+/* start of a TRACE_COMPLETE(), 0 while not recording */
+#define TRACE_START()   (TRACE_ON() ? trace_now() : 0ULL)
+
+#define TRACE_COMPLETE(cat, name, scope, id, port, start) do {  \
+    if ((start))                                                \
+        trace_complete(cat, name, scope, id, port, start);      \
+} while (0)
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __TRACE_H */
@@ -0,0 +1,62 @@
+/*
+ * wakeup.h, spin-then-park wakeup of a single waiter
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __WAKEUP_H
+#define __WAKEUP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * event count for a waiter sleeping on a condition it can test without
+ * locks. the waiter spins for a while, then parks on a futex. the waker
+ * makes the condition true, then calls wakeup_signal(), which costs no
+ * syscall unless the waiter is parked.
+ *
+ * no wakeup is lost: the waiter announces itself before testing the
+ * condition the last time, the waker tests for a parked waiter after
+ * making the condition true.
+ *
+ * OMXIL_WAKEUP_SPIN_USEC environment variable sets the default spin time,
+ * 0 parks right away. (default 0) spinning is disabled on a single cpu.
+ */
+struct wakeup {
+    volatile int seq;           /* futex word, bumped by wakeup_signal() */
+    volatile int nr_parked;
+    unsigned int spin_usec;
+};
+
+void wakeup_init(struct wakeup *w);
+void wakeup_set_spin(struct wakeup *w, unsigned int usec);
+
+/* returns when ready(arg) is non-zero */
+void wakeup_wait(struct wakeup *w, int (*ready)(void *arg), void *arg);
+/*
+ * same, but gives up at CLOCK_MONOTONIC time timeout in nsec, 0 never.
+ * returns non-zero if ready(arg), 0 if timed out
+ */
+int wakeup_wait_until(struct wakeup *w, int (*ready)(void *arg), void *arg,
+                      unsigned long long timeout);
+void wakeup_signal(struct wakeup *w);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __WAKEUP_H */
@@ -20,21 +20,64 @@
 #define __WORKQUEUE_H
 
 #include <pthread.h>
-#include <list.h>
+#include <stddef.h>
 
 #include <thread.h>
+#include <executor.h>
+#include <wakeup.h>
+#include <lockstat.h>
 
 class WorkableInterface {
 public:
+    WorkableInterface() : work_next(NULL), work_pending(false),
+                          timer_next(NULL), timer_due(0), timer_period(0),
+                          timer_armed(false) {};
     virtual ~WorkableInterface() {};
 
     virtual void Work(void) = 0;
+
+private:
+    friend class WorkQueue;
+
+    /*
+     * link in the pending works of the WorkQueue it's scheduled on,
+     * protected by that WorkQueue's wlock. a work is pending at most once,
+     * and on one WorkQueue at a time.
+     */
+    WorkableInterface *work_next;
+    bool work_pending;
+
+    /*
+     * link in the armed timers of the WorkQueue, protected by its wlock.
+     * due is CLOCK_MONOTONIC time in nsec, period 0 if one-shot.
+     */
+    WorkableInterface *timer_next;
+    unsigned long long timer_due;
+    unsigned long long timer_period;
+    bool timer_armed;
 };
 
+/*
+ * scheduling class of a WorkQueue on the shared executor, a higher one's
+ * run first. ignored by a WorkQueue running on its own thread.
+ */
+typedef enum work_priority_e {
+    WORK_PRIORITY_BATCH = 0,
+    WORK_PRIORITY_NORMAL,
+    WORK_PRIORITY_INTERACTIVE,
+    WORK_PRIORITY_REALTIME,
+} work_priority_t;
+
 class WorkQueue : public Thread, public WorkableInterface
 {
 public:
     WorkQueue();
+    /*
+     * if shared is true, works are run by the process-wide Executor instead
+     * of a thread owned by this WorkQueue. falls back to own thread if the
+     * executor is disabled.
+     */
+    WorkQueue(bool shared);
     /*
      * if WorkQueue has the pending works not proccessed yet,
      * WorkQueue::Run() calls its own Work() instead of the derived class's.
@@ -42,16 +85,73 @@ public:
      */
     ~WorkQueue();
 
+    /*
+     * own thread only, how long the thread spins for works before it sleeps.
+     * trades cpu for wakeup latency. see wakeup.h (default
+     * OMXIL_WAKEUP_SPIN_USEC)
+     */
+    void SetWakeupSpin(unsigned int usec);
+
     /* start & stop & pause & resume work thread */
     int StartWork(bool executing);
     void StopWork(void);
     void PauseWork(void);
     void ResumeWork(void);
+    /*
+     * discard the scheduled works and wait for the work in progress like
+     * StopWork(), but keep the own thread sleeping so that next StartWork()
+     * doesn't create a new one. works scheduled while parked're run after
+     * StartWork().
+     */
+    void ParkWork(void);
 
+    /*
+     * scheduling a work already pending is a no-op, the work runs once for
+     * all of them. a work is no longer pending when it starts running, so
+     * scheduling it from or during its Work() runs it again.
+     */
     /* the class inheriting WorkQueue uses this method */
     void ScheduleWork(void);
     /* the class implementing WorkableInterface uses this method */
     void ScheduleWork(WorkableInterface *wi);
+    /*
+     * deadline is CLOCK_MONOTONIC time in nsec by which wi should run, 0 if
+     * none. the earliest deadline of the works scheduled since the queue
+     * was empty orders it among the ready ones of the same priority.
+     */
+    void ScheduleWork(WorkableInterface *wi, unsigned long long deadline);
+
+    /*
+     * false if works're run by the shared executor, whose workers're
+     * placed on their own. Thread::SetAttributes() has no effect then.
+     */
+    bool HasOwnThread(void);
+
+    /*
+     * timer works. when its timer expires, wi is scheduled like
+     * ScheduleWork() with the expiry as its deadline, so an expiry while wi
+     * is still pending is coalesced.
+     *
+     * ScheduleDelayedWork() runs wi once after delay nsec.
+     * SchedulePeriodicWork() runs wi every period nsec from one period
+     * from now, at the multiples of the period, periods missed by a late
+     * run're skipped. (re)scheduling an armed wi replaces its timer.
+     *
+     * ParkWork() and StopWork() cancel all the timers. no timer is fired
+     * while paused, the expired ones run when resumed.
+     */
+    void ScheduleDelayedWork(WorkableInterface *wi, unsigned long long delay);
+    void SchedulePeriodicWork(WorkableInterface *wi,
+                              unsigned long long period);
+    /* disarm wi's timer, doesn't remove wi from the pending works */
+    void CancelDelayedWork(WorkableInterface *wi);
+
+    /* CLOCK_MONOTONIC time in nsec, the clock of deadlines and timers */
+    static unsigned long long Now(void);
+
+    /* WORK_PRIORITY_NORMAL by default, applied when submitted next */
+    void SetPriority(work_priority_t priority);
+    work_priority_t GetPriority(void);
     /*
      * FIXME (BUG)
      *  must be called before the class implementing WorkableInterface or
@@ -60,10 +160,15 @@ public:
      *  the class.
      */
     void FlushWork(void);
-    /* remove all scheduled works matched with wi from workqueue list */
+    /* remove wi from the pending works if it's scheduled */
     void CancelScheduledWork(WorkableInterface *wi);
 
 private:
+    friend class Executor;
+
+    /* common routines for constructor */
+    void __WorkQueue(Executor *executor);
+
     /* inner class for flushing */
     class FlushBarrier : public WorkableInterface
     {
@@ -97,19 +202,84 @@ private:
      */
     void DoWork(WorkableInterface *wi);
 
-    struct list *works;
-    pthread_mutex_t wlock;
-    pthread_cond_t wcond;
+    /* wakeup Run() or submit this to executor, must be held wlock */
+    void SignalWorks(void);
+    /* wakeup_wait() condition of Run(), works or stop without wlock */
+    static int IsWakeupReady(void *arg);
+
+    /* called by Executor worker thread */
+    void RunQueuedWorks(void);
+
+    /* pending works list, must be held wlock */
+    void PushWork(WorkableInterface *wi);
+    WorkableInterface *PopWork(void);
+    /* PushWork() with the deadline, must be held wlock */
+    void QueueWork(WorkableInterface *wi, unsigned long long deadline);
+
+    /* timers, must be held wlock */
+    void ArmTimer(WorkableInterface *wi, unsigned long long due,
+                  unsigned long long period);
+    bool DisarmTimer(WorkableInterface *wi);
+    /* the earliest due changed, tell Run() or the executor */
+    void TimersChanged(void);
+    /*
+     * schedule the expired timer works, rearm the periodic ones. returns
+     * the earliest due left, 0 if none
+     */
+    unsigned long long ExpireTimers(unsigned long long now);
+    /* called by Executor worker thread when timer_due's passed */
+    void FireTimers(void);
+
+    /* pending works, linked through WorkableInterface::work_next */
+    WorkableInterface *works;
+    WorkableInterface *works_tail;
+    /* armed timers sorted by due, linked through timer_next */
+    WorkableInterface *timers;
+    /* own thread, Run() sleeps until a new earliest due */
+    volatile bool timers_changed;
+    struct lockstat_mutex wlock;
+    /* Run() sleeps on it for works */
+    struct wakeup wakeup;
 
     /* executing & pause */
     bool wait_for_works;
-    bool executing;
+    /* Run() reads it without executing_lock, locks only to pause */
+    volatile bool executing;
 
-    pthread_mutex_t executing_lock;
+    struct lockstat_mutex executing_lock;
     pthread_cond_t executing_wait;
     pthread_cond_t paused_wait;
 
     int stop;
+
+    /* between StartWork() and ParkWork() or StopWork() */
+    volatile bool started;
+    /* RunQueuedWorks() or Run() is running works */
+    bool running;
+    /* wokeup when running is cleared */
+    pthread_cond_t idle_wait;
+
+    /* shared mode */
+    Executor *executor;
+    bool queued;  /* in executor's ready queue */
+
+    /* SetPriority(), earliest deadline of the pending works */
+    work_priority_t priority;
+    unsigned long long deadline;
+
+    /* executor's ready queue, protected by the executor's lock */
+    WorkQueue *ready_next;
+    work_priority_t ready_priority;
+    unsigned long long ready_deadline;
+
+    /*
+     * executor's timer queue, protected by the executor's lock.
+     * timer_due is the earliest due of the timers, 0 if not queued
+     */
+    WorkQueue *timer_next;
+    unsigned long long timer_due;
+    /* a worker's in FireTimers() */
+    bool timer_firing;
 };
 
 #endif /* __WORKQUEUE_H */
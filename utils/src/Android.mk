@@ -4,9 +4,20 @@ include $(CLEAR_VARS)
 LOCAL_SRC_FILES := \
 	list.c \
 	queue.c \
+	hash.c \
+	ring.c \
+	bufpool.c \
+	shmbuf.c \
+	wakeup.c \
+	histogram.c \
+	trace.c \
+	log.c \
+	lockstat.c \
 	module.c \
 	thread.cpp \
 	workqueue.cpp \
+	executor.cpp \
+	threadplace.cpp \
 
 LOCAL_MODULE_TAGS := optional
 LOCAL_MODULE := libwrs_omxil_utils
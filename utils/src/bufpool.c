@@ -0,0 +1,167 @@
+/*
+ * bufpool.c, aligned buffer payload pool
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <bufpool.h>
+#include <lockstat.h>
+
+#include <sysdeps.h>
+
+#define BUFPOOL_DEFAULT_SIZE    (64 * 1024 * 1024)
+
+struct bufpool_chunk {
+    struct bufpool_chunk *next;
+    void *data;
+    size_t size;
+};
+
+static struct bufpool_chunk *g_chunks;  /* cached payloads */
+static size_t g_cached;                 /* bytes in g_chunks */
+static size_t g_max_cached;
+static int g_zero_reused;
+static size_t g_page_size;
+static struct lockstat_mutex g_lock =
+    LOCKSTAT_MUTEX_INITIALIZER("bufpool_lock");
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+
+static void bufpool_setup(void)
+{
+    const char *env = getenv("OMXIL_BUFFER_POOL_SIZE");
+    long page_size;
+
+    if (env)
+        g_max_cached = strtoul(env, NULL, 0);
+    else
+        g_max_cached = BUFPOOL_DEFAULT_SIZE;
+
+    env = getenv("OMXIL_BUFFER_POOL_ZERO");
+    g_zero_reused = env && atoi(env);
+
+    page_size = sysconf(_SC_PAGESIZE);
+    if (page_size < BUFPOOL_ALIGN)
+        page_size = 4096;
+    g_page_size = page_size;
+}
+
+void *bufpool_alloc(size_t *size)
+{
+    struct bufpool_chunk *chunk, **pos, **best = NULL;
+    size_t align, request;
+    void *data;
+
+    pthread_once(&g_once, bufpool_setup);
+
+    if (*size > g_page_size)
+        align = g_page_size;
+    else
+        align = BUFPOOL_ALIGN;
+    request = (*size + align - 1) & ~(align - 1);
+    if (!request)
+        request = align;
+
+    lockstat_mutex_lock(&g_lock);
+    /* best fit, not wasting more than the half */
+    for (pos = &g_chunks; *pos; pos = &(*pos)->next) {
+        chunk = *pos;
+
+        if (chunk->size < request || chunk->size / 2 > request)
+            continue;
+        if (!best || chunk->size < (*best)->size)
+            best = pos;
+        if (chunk->size == request)
+            break;
+    }
+
+    if (best) {
+        chunk = *best;
+        *best = chunk->next;
+        g_cached -= chunk->size;
+        lockstat_mutex_unlock(&g_lock);
+
+        data = chunk->data;
+        *size = chunk->size;
+        free(chunk);
+        if (g_zero_reused)
+            memset(data, 0, *size);
+        return data;
+    }
+    lockstat_mutex_unlock(&g_lock);
+
+    if (posix_memalign(&data, align, request))
+        return NULL;
+
+    *size = request;
+    return data;
+}
+
+void bufpool_free(void *data, size_t size)
+{
+    struct bufpool_chunk *chunk;
+
+    if (!data)
+        return;
+
+    pthread_once(&g_once, bufpool_setup);
+
+    lockstat_mutex_lock(&g_lock);
+    if (g_cached + size > g_max_cached) {
+        lockstat_mutex_unlock(&g_lock);
+        free(data);
+        return;
+    }
+    /* reserve the room, then allocate the chunk out of the lock */
+    g_cached += size;
+    lockstat_mutex_unlock(&g_lock);
+
+    chunk = malloc(sizeof(*chunk));
+    if (!chunk) {
+        lockstat_mutex_lock(&g_lock);
+        g_cached -= size;
+        lockstat_mutex_unlock(&g_lock);
+        free(data);
+        return;
+    }
+    chunk->data = data;
+    chunk->size = size;
+
+    lockstat_mutex_lock(&g_lock);
+    chunk->next = g_chunks;
+    g_chunks = chunk;
+    lockstat_mutex_unlock(&g_lock);
+}
+
+void bufpool_trim(void)
+{
+    struct bufpool_chunk *chunk, *next;
+
+    lockstat_mutex_lock(&g_lock);
+    chunk = g_chunks;
+    g_chunks = NULL;
+    g_cached = 0;
+    lockstat_mutex_unlock(&g_lock);
+
+    for (; chunk; chunk = next) {
+        next = chunk->next;
+        free(chunk->data);
+        free(chunk);
+    }
+}
@@ -0,0 +1,523 @@
+/*
+ * executor.cpp, process-wide worker thread pool
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <executor.h>
+#include <workqueue.h>
+#include <threadplace.h>
+
+#include <sysdeps.h>
+
+static Executor *g_executor;
+static struct lockstat_mutex g_executor_lock =
+    LOCKSTAT_MUTEX_INITIALIZER("g_executor_lock");
+
+/* set to the executor in its worker threads */
+static pthread_key_t g_worker_key;
+static pthread_once_t g_worker_key_once = PTHREAD_ONCE_INIT;
+/* the nesting depth of BeginBlocking() in a worker thread */
+static pthread_key_t g_blocking_key;
+
+static void create_worker_key(void)
+{
+    pthread_key_create(&g_worker_key, NULL);
+    pthread_key_create(&g_blocking_key, NULL);
+}
+
+Executor::Executor(int nr_threads)
+{
+    pthread_condattr_t attr;
+
+    readyq = NULL;
+    timerq = NULL;
+    lockstat_mutex_init(&lock, "Executor::lock", NULL);
+
+    /* timer dues're CLOCK_MONOTONIC */
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_cond_init(&timer_idle, NULL);
+
+    workers = NULL;
+    retired = NULL;
+    nr_workers = 0;
+    nr_idle = 0;
+    nr_blocking = 0;
+    this->nr_threads = nr_threads;
+    nr_max_workers = nr_threads * 4 > 8 ? nr_threads * 4 : 8;
+    stop = false;
+
+    ref_count = 0;
+}
+
+Executor::~Executor()
+{
+    Stop();
+
+    pthread_cond_destroy(&timer_idle);
+    pthread_cond_destroy(&cond);
+    lockstat_mutex_destroy(&lock);
+}
+
+int Executor::GetNumberOfThreads(void)
+{
+    const char *env = getenv("OMXIL_EXECUTOR_THREADS");
+    long nr;
+
+    if (env)
+        return atoi(env);
+
+    nr = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nr < 1)
+        nr = 1;
+
+    return (int)nr;
+}
+
+Executor *Executor::Get(void)
+{
+    Executor *executor;
+
+    pthread_once(&g_worker_key_once, create_worker_key);
+
+    lockstat_mutex_lock(&g_executor_lock);
+    if (!g_executor) {
+        int nr_threads = GetNumberOfThreads();
+
+        if (nr_threads <= 0) {
+            lockstat_mutex_unlock(&g_executor_lock);
+            return NULL;
+        }
+
+        g_executor = new Executor(nr_threads);
+        if (g_executor->Start()) {
+            omx_errorLog("failed to start executor threads\n");
+            delete g_executor;
+            g_executor = NULL;
+            lockstat_mutex_unlock(&g_executor_lock);
+            return NULL;
+        }
+
+        omx_verboseLog("executor started with %d threads", nr_threads);
+    }
+    executor = g_executor;
+    executor->ref_count++;
+    lockstat_mutex_unlock(&g_executor_lock);
+
+    return executor;
+}
+
+void Executor::Put(Executor *executor)
+{
+    if (!executor)
+        return;
+
+    lockstat_mutex_lock(&g_executor_lock);
+    executor->ref_count--;
+    /*
+     * a worker cannot join itself, the executor is kept in that case and
+     * reused by next Get()
+     */
+    if (!executor->ref_count && !pthread_getspecific(g_worker_key)) {
+        delete executor;
+        g_executor = NULL;
+        omx_verboseLog("executor stopped");
+    }
+    lockstat_mutex_unlock(&g_executor_lock);
+}
+
+int Executor::Start(void)
+{
+    int i, ret = 0;
+
+    lockstat_mutex_lock(&lock);
+    for (i = 0; i < nr_threads; i++) {
+        ret = AddWorker();
+        if (ret)
+            break;
+    }
+    lockstat_mutex_unlock(&lock);
+
+    if (ret)
+        Stop();
+
+    return ret;
+}
+
+void Executor::Stop(void)
+{
+    struct list *entry;
+
+    lockstat_mutex_lock(&lock);
+    stop = true;
+    pthread_cond_broadcast(&cond);
+    lockstat_mutex_unlock(&lock);
+
+    while ((entry = workers)) {
+        Worker *worker = static_cast<Worker *>(entry->data);
+
+        worker->thread.Join();
+        delete worker;
+        workers = __list_delete(workers, entry);
+    }
+    nr_workers = 0;
+
+    /* the workers're gone, nobody retires any more */
+    ReapWorker();
+}
+
+/* must be held lock */
+int Executor::AddWorker(void)
+{
+    Worker *worker;
+    struct list *entry;
+    struct thread_attr attr;
+    int ret;
+
+    ReapWorker();
+
+    worker = new Worker(this);
+    if (!worker)
+        return -1;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.flags = THREAD_ATTR_NAME;
+    snprintf(attr.name, sizeof(attr.name), "omx-exec-%d", nr_workers);
+    thread_placement_lookup("executor", "worker", &attr);
+    worker->thread.SetAttributes(&attr);
+
+    entry = list_alloc(worker);
+    if (!entry) {
+        delete worker;
+        return -1;
+    }
+
+    ret = worker->thread.Start();
+    if (ret) {
+        __list_free(entry);
+        delete worker;
+        return ret;
+    }
+
+    workers = __list_add_tail(workers, entry);
+    nr_workers++;
+
+    return 0;
+}
+
+void Executor::RetireWorker(Worker *worker)
+{
+    ReapWorker();
+
+    workers = list_delete(workers, worker);
+    nr_workers--;
+    retired = worker;
+
+    omx_verboseLog("executor retired a spare worker (%d)", nr_workers);
+}
+
+/* the retired worker doesn't take lock on its way out */
+void Executor::ReapWorker(void)
+{
+    if (!retired)
+        return;
+
+    delete retired; /* joins it */
+    retired = NULL;
+}
+
+bool Executor::IsBefore(const WorkQueue *a, const WorkQueue *b)
+{
+    if (a->ready_priority != b->ready_priority)
+        return a->ready_priority > b->ready_priority;
+
+    if (!a->ready_deadline)
+        return false;
+    if (!b->ready_deadline)
+        return true;
+
+    return a->ready_deadline < b->ready_deadline;
+}
+
+/* behind the ones of the same priority and deadline */
+void Executor::InsertReady(WorkQueue *wq)
+{
+    WorkQueue **pos;
+
+    wq->ready_priority = wq->priority;
+    wq->ready_deadline = wq->deadline;
+
+    for (pos = &readyq; *pos; pos = &(*pos)->ready_next) {
+        if (IsBefore(wq, *pos))
+            break;
+    }
+    wq->ready_next = *pos;
+    *pos = wq;
+}
+
+bool Executor::RemoveReady(WorkQueue *wq)
+{
+    WorkQueue **pos;
+
+    for (pos = &readyq; *pos; pos = &(*pos)->ready_next) {
+        if (*pos == wq) {
+            *pos = wq->ready_next;
+            wq->ready_next = NULL;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* the caller holds wq->wlock, wq->priority and wq->deadline're stable */
+void Executor::Submit(WorkQueue *wq)
+{
+    lockstat_mutex_lock(&lock);
+    InsertReady(wq);
+    if (nr_idle)
+        pthread_cond_signal(&cond);
+    lockstat_mutex_unlock(&lock);
+}
+
+bool Executor::Cancel(WorkQueue *wq)
+{
+    bool removed;
+
+    lockstat_mutex_lock(&lock);
+    removed = RemoveReady(wq);
+    lockstat_mutex_unlock(&lock);
+
+    return removed;
+}
+
+void Executor::Reorder(WorkQueue *wq)
+{
+    lockstat_mutex_lock(&lock);
+    if (RemoveReady(wq))
+        InsertReady(wq);
+    lockstat_mutex_unlock(&lock);
+}
+
+/* behind the ones of the same due */
+void Executor::InsertTimer(WorkQueue *wq)
+{
+    WorkQueue **pos;
+
+    for (pos = &timerq; *pos; pos = &(*pos)->timer_next) {
+        if (wq->timer_due < (*pos)->timer_due)
+            break;
+    }
+    wq->timer_next = *pos;
+    *pos = wq;
+}
+
+bool Executor::RemoveTimer(WorkQueue *wq)
+{
+    WorkQueue **pos;
+
+    for (pos = &timerq; *pos; pos = &(*pos)->timer_next) {
+        if (*pos == wq) {
+            *pos = wq->timer_next;
+            wq->timer_next = NULL;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Executor::SetTimer(WorkQueue *wq, unsigned long long due)
+{
+    lockstat_mutex_lock(&lock);
+    if (wq->timer_due)
+        RemoveTimer(wq);
+    wq->timer_due = due;
+    if (due)
+        InsertTimer(wq);
+
+    /*
+     * idle workers sleep until the first due, let them see the new one.
+     * a later first due only costs them a spurious wakeup
+     */
+    if (due && timerq == wq)
+        pthread_cond_broadcast(&cond);
+    lockstat_mutex_unlock(&lock);
+}
+
+void Executor::WaitTimer(WorkQueue *wq)
+{
+    lockstat_mutex_lock(&lock);
+    if (wq->timer_due) {
+        RemoveTimer(wq);
+        wq->timer_due = 0;
+    }
+    /* wokeup by FireTimers() */
+    while (wq->timer_firing)
+        lockstat_cond_wait(&timer_idle, &lock);
+    lockstat_mutex_unlock(&lock);
+}
+
+/* must be held lock */
+bool Executor::FireTimers(void)
+{
+    WorkQueue *wq = timerq;
+
+    if (!wq || wq->timer_due > WorkQueue::Now())
+        return false;
+
+    timerq = wq->timer_next;
+    wq->timer_next = NULL;
+    wq->timer_due = 0;
+    wq->timer_firing = true;
+    lockstat_mutex_unlock(&lock);
+
+    /* queues the expired works, SetTimer() for the rest */
+    wq->FireTimers();
+
+    lockstat_mutex_lock(&lock);
+    wq->timer_firing = false;
+    pthread_cond_broadcast(&timer_idle);
+
+    return true;
+}
+
+/* must be held lock */
+void Executor::WaitIdle(unsigned long long until)
+{
+    struct timespec ts;
+
+    if (timerq && (!until || timerq->timer_due < until))
+        until = timerq->timer_due;
+
+    nr_idle++;
+    if (until) {
+        ts.tv_sec = until / 1000000000ULL;
+        ts.tv_nsec = until % 1000000000ULL;
+        lockstat_cond_timedwait(&cond, &lock, &ts);
+    }
+    else
+        lockstat_cond_wait(&cond, &lock);
+    nr_idle--;
+}
+
+void Executor::BeginBlocking(void)
+{
+    Executor *executor;
+    long depth;
+
+    executor = static_cast<Executor *>(pthread_getspecific(g_worker_key));
+    if (!executor)
+        return;
+
+    /* a nested one is already counted */
+    depth = (long)pthread_getspecific(g_blocking_key);
+    pthread_setspecific(g_blocking_key, (void *)(depth + 1));
+    if (depth)
+        return;
+
+    lockstat_mutex_lock(&executor->lock);
+    executor->nr_blocking++;
+    if ((executor->nr_workers - executor->nr_blocking <
+         executor->nr_threads) &&
+        (executor->nr_workers < executor->nr_max_workers)) {
+        if (!executor->AddWorker()) {
+            omx_verboseLog("executor started a spare worker (%d)",
+                           executor->nr_workers);
+        }
+    }
+    lockstat_mutex_unlock(&executor->lock);
+}
+
+void Executor::EndBlocking(void)
+{
+    Executor *executor;
+    long depth;
+
+    executor = static_cast<Executor *>(pthread_getspecific(g_worker_key));
+    if (!executor)
+        return;
+
+    depth = (long)pthread_getspecific(g_blocking_key) - 1;
+    pthread_setspecific(g_blocking_key, (void *)depth);
+    if (depth)
+        return;
+
+    lockstat_mutex_lock(&executor->lock);
+    executor->nr_blocking--;
+    lockstat_mutex_unlock(&executor->lock);
+}
+
+void Executor::Worker::Run(void)
+{
+    executor->Run(this);
+}
+
+void Executor::Run(Worker *worker)
+{
+    unsigned long long idle_since = 0;
+
+    pthread_setspecific(g_worker_key, this);
+
+    lockstat_mutex_lock(&lock);
+    while (!stop) {
+        WorkQueue *wq;
+
+        /* the timers first, they queue works */
+        if (timerq && FireTimers())
+            continue;
+
+        wq = readyq;
+        if (!wq) {
+            /* a spare one, the blocking workers aside */
+            if (nr_workers - nr_blocking > nr_threads) {
+                unsigned long long now = WorkQueue::Now();
+
+                if (!idle_since)
+                    idle_since = now;
+                else if (now - idle_since >= EXECUTOR_SPARE_IDLE) {
+                    RetireWorker(worker);
+                    break;
+                }
+            }
+            else
+                idle_since = 0;
+
+            /* wokeup by Submit() or SetTimer() or Stop() or the timer */
+            WaitIdle(idle_since ? idle_since + EXECUTOR_SPARE_IDLE : 0);
+            continue;
+        }
+        idle_since = 0;
+        readyq = wq->ready_next;
+        wq->ready_next = NULL;
+        lockstat_mutex_unlock(&lock);
+
+        wq->RunQueuedWorks();
+
+        lockstat_mutex_lock(&lock);
+    }
+    lockstat_mutex_unlock(&lock);
+
+    pthread_setspecific(g_worker_key, NULL);
+}
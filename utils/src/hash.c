@@ -0,0 +1,166 @@
+/*
+ * hash.c, string keyed hash table
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <hash.h>
+
+/* fnv-1a */
+unsigned int hash_string(const char *key)
+{
+	unsigned int hashval = 2166136261U;
+
+	while (*key) {
+		hashval ^= (unsigned char)*key++;
+		hashval *= 16777619U;
+	}
+
+	return hashval;
+}
+
+static struct hash_entry **__hash_alloc_buckets(unsigned int nr_buckets)
+{
+	return calloc(nr_buckets, sizeof(struct hash_entry *));
+}
+
+struct hash *hash_alloc(unsigned int nr_entries)
+{
+	struct hash *hash;
+	unsigned int nr_buckets = 8;
+
+	while (nr_buckets < nr_entries * 2)
+		nr_buckets <<= 1;
+
+	hash = malloc(sizeof(*hash));
+	if (!hash)
+		return NULL;
+
+	hash->buckets = __hash_alloc_buckets(nr_buckets);
+	if (!hash->buckets) {
+		free(hash);
+		return NULL;
+	}
+	hash->nr_buckets = nr_buckets;
+	hash->nr_entries = 0;
+
+	return hash;
+}
+
+void hash_free_all(struct hash *hash)
+{
+	struct hash_entry *entry, *next;
+	unsigned int i;
+
+	if (!hash)
+		return;
+
+	for (i = 0; i < hash->nr_buckets; i++) {
+		for (entry = hash->buckets[i]; entry; entry = next) {
+			next = entry->next;
+			free(entry);
+		}
+	}
+
+	free(hash->buckets);
+	free(hash);
+}
+
+/* keeps the load factor under 1, silently stays as is on failure */
+static void __hash_grow(struct hash *hash)
+{
+	struct hash_entry **buckets, *entry, *next;
+	unsigned int nr_buckets = hash->nr_buckets << 1;
+	unsigned int i;
+
+	buckets = __hash_alloc_buckets(nr_buckets);
+	if (!buckets)
+		return;
+
+	/* keeps the order of the entries with the same key */
+	for (i = 0; i < hash->nr_buckets; i++) {
+		struct hash_entry *reversed = NULL;
+
+		for (entry = hash->buckets[i]; entry; entry = next) {
+			next = entry->next;
+			entry->next = reversed;
+			reversed = entry;
+		}
+
+		for (entry = reversed; entry; entry = next) {
+			unsigned int b = entry->hashval & (nr_buckets - 1);
+
+			next = entry->next;
+			entry->next = buckets[b];
+			buckets[b] = entry;
+		}
+	}
+
+	free(hash->buckets);
+	hash->buckets = buckets;
+	hash->nr_buckets = nr_buckets;
+}
+
+struct hash_entry *hash_insert(struct hash *hash, const char *key, void *data)
+{
+	struct hash_entry *entry;
+	unsigned int b;
+
+	entry = malloc(sizeof(*entry));
+	if (!entry)
+		return NULL;
+
+	if (hash->nr_entries >= hash->nr_buckets)
+		__hash_grow(hash);
+
+	entry->hashval = hash_string(key);
+	entry->key = key;
+	entry->data = data;
+
+	b = entry->hashval & (hash->nr_buckets - 1);
+	entry->next = hash->buckets[b];
+	hash->buckets[b] = entry;
+	hash->nr_entries++;
+
+	return entry;
+}
+
+struct hash_entry *hash_find(struct hash *hash, const char *key)
+{
+	struct hash_entry *entry;
+	unsigned int hashval;
+
+	if (!hash || !key)
+		return NULL;
+
+	hashval = hash_string(key);
+	entry = hash->buckets[hashval & (hash->nr_buckets - 1)];
+	for (; entry; entry = entry->next) {
+		if (entry->hashval == hashval && !strcmp(entry->key, key))
+			return entry;
+	}
+
+	return NULL;
+}
+
+void *hash_lookup(struct hash *hash, const char *key)
+{
+	struct hash_entry *entry = hash_find(hash, key);
+
+	return entry ? entry->data : NULL;
+}
@@ -0,0 +1,121 @@
+/*
+ * histogram.c, lock-free log-linear histogram
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <histogram.h>
+
+void histogram_reset(struct histogram *h)
+{
+    memset(h->counts, 0, sizeof(h->counts));
+    h->sum = 0;
+    h->min = ~0ULL;
+    h->max = 0;
+}
+
+unsigned int histogram_index(unsigned long long value)
+{
+    unsigned int msb;
+
+    if (value < HISTOGRAM_SUB_BUCKETS)
+        return value;
+
+    msb = 63 - __builtin_clzll(value);
+    if (msb >= HISTOGRAM_MAX_BITS)
+        return HISTOGRAM_NR_BUCKETS - 1;
+
+    /* the power of two, then the top HISTOGRAM_SUB_BITS under the msb */
+    return (msb - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS +
+        ((value >> (msb - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+unsigned long long histogram_lowest(unsigned int index)
+{
+    unsigned int shift, sub;
+
+    if (index < HISTOGRAM_SUB_BUCKETS)
+        return index;
+
+    shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+    sub = index % HISTOGRAM_SUB_BUCKETS;
+
+    return (unsigned long long)(HISTOGRAM_SUB_BUCKETS + sub) << shift;
+}
+
+unsigned long long histogram_highest(unsigned int index)
+{
+    if (index >= HISTOGRAM_NR_BUCKETS - 1)
+        return ~0ULL;
+
+    return histogram_lowest(index + 1) - 1;
+}
+
+void histogram_record(struct histogram *h, unsigned long long value)
+{
+    unsigned long long old;
+
+    __sync_fetch_and_add(&h->counts[histogram_index(value)], 1);
+    __sync_fetch_and_add(&h->sum, value);
+
+    /* rarely taken once the extremes're seen */
+    while (value < (old = h->min)) {
+        if (__sync_bool_compare_and_swap(&h->min, old, value))
+            break;
+    }
+    while (value > (old = h->max)) {
+        if (__sync_bool_compare_and_swap(&h->max, old, value))
+            break;
+    }
+}
+
+unsigned long long histogram_count(const struct histogram *h)
+{
+    unsigned long long total = 0;
+    unsigned int i;
+
+    for (i = 0; i < HISTOGRAM_NR_BUCKETS; i++)
+        total += h->counts[i];
+
+    return total;
+}
+
+unsigned long long histogram_percentile(const struct histogram *h,
+                                        unsigned int permille)
+{
+    unsigned long long total = histogram_count(h), rank, seen = 0, value;
+    unsigned int i;
+
+    if (!total)
+        return 0;
+
+    /* 1-based rank of the value, at least the first one */
+    rank = (total * permille + 999) / 1000;
+    if (!rank)
+        rank = 1;
+
+    for (i = 0; i < HISTOGRAM_NR_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank)
+            break;
+    }
+    if (i == HISTOGRAM_NR_BUCKETS)
+        i--;
+
+    value = histogram_highest(i);
+    return value > h->max ? h->max : value;
+}
@@ -0,0 +1,397 @@
+/*
+ * lockstat.c, named locks with contention statistics
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <lockstat.h>
+
+#include <sysdeps.h>
+
+#define LOCKSTAT_MAX_NAMES  64
+#define LOCKSTAT_NAME_SIZE  48
+
+volatile int lockstat_enabled;
+
+/*
+ * appended under g_lock, never removed. an entry's filled before
+ * g_nr_stats counts it, so the lookup reads the table without the lock.
+ * the names're copied, a lock's may go away with its module
+ */
+static struct lockstat g_stats[LOCKSTAT_MAX_NAMES];
+static char g_names[LOCKSTAT_MAX_NAMES][LOCKSTAT_NAME_SIZE];
+static volatile unsigned int g_nr_stats;
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct lockstat *search(const char *name, unsigned int nr)
+{
+    unsigned int i;
+
+    for (i = 0; i < nr; i++) {
+        if (!strcmp(g_stats[i].name, name))
+            return &g_stats[i];
+    }
+
+    return NULL;
+}
+
+static struct lockstat *lookup(const char *name)
+{
+    struct lockstat *stat;
+    unsigned int nr;
+
+    stat = search(name, g_nr_stats);
+    if (stat)
+        return stat;
+
+    pthread_mutex_lock(&g_lock);
+    nr = g_nr_stats;
+    stat = search(name, nr);
+    if (!stat && nr < LOCKSTAT_MAX_NAMES) {
+        stat = &g_stats[nr];
+        snprintf(g_names[nr], LOCKSTAT_NAME_SIZE, "%s", name);
+        stat->name = g_names[nr];
+        stat->nr_acquired = 0;
+        stat->nr_contended = 0;
+        histogram_reset(&stat->wait);
+        histogram_reset(&stat->hold);
+        __sync_synchronize();
+        g_nr_stats = nr + 1;
+    }
+    else if (!stat)
+        omx_errorLog("lockstat: more than %d names, %s not recorded\n",
+                     LOCKSTAT_MAX_NAMES, name);
+    pthread_mutex_unlock(&g_lock);
+
+    return stat;
+}
+
+/* the same for everybody, so racing stores are harmless */
+static inline struct lockstat *stat_of(struct lockstat **cache,
+                                       const char *name)
+{
+    if (__builtin_expect(*cache != NULL, 1))
+        return *cache;
+
+    *cache = lookup(name);
+    return *cache;
+}
+
+static inline void acquired(struct lockstat *stat, int contended,
+                            unsigned long long start,
+                            unsigned long long now)
+{
+    if (!stat)
+        return;
+
+    __sync_fetch_and_add(&stat->nr_acquired, 1);
+    if (contended) {
+        __sync_fetch_and_add(&stat->nr_contended, 1);
+        histogram_record(&stat->wait, now - start);
+    }
+}
+
+static inline void released(struct lockstat *stat,
+                            unsigned long long start)
+{
+    if (stat)
+        histogram_record(&stat->hold, trace_now() - start);
+}
+
+/*
+ * mutex
+ */
+void lockstat_mutex_init(struct lockstat_mutex *m, const char *name,
+                         const char *scope)
+{
+    pthread_mutex_init(&m->mutex, NULL);
+    m->name = name;
+    m->scope = scope;
+    m->stat = NULL;
+    m->acquired = 0;
+}
+
+void lockstat_mutex_destroy(struct lockstat_mutex *m)
+{
+    pthread_mutex_destroy(&m->mutex);
+}
+
+int __lockstat_mutex_lock(struct lockstat_mutex *m)
+{
+    unsigned long long start = 0, now;
+    int contended, ret = 0;
+
+    contended = pthread_mutex_trylock(&m->mutex) != 0;
+    if (contended) {
+        start = trace_now();
+        ret = pthread_mutex_lock(&m->mutex);
+        if (ret)
+            return ret;
+    }
+
+    if (!lockstat_enabled && !contended)
+        return 0;
+
+    now = trace_now();
+    if (lockstat_enabled) {
+        acquired(stat_of(&m->stat, m->name), contended, start, now);
+        m->acquired = now;
+    }
+
+    if (contended && TRACE_ON())
+        trace_complete("lock", m->name, m->scope, 0, TRACE_NO_PORT, start);
+
+    return 0;
+}
+
+int __lockstat_mutex_trylock(struct lockstat_mutex *m)
+{
+    int ret;
+
+    ret = pthread_mutex_trylock(&m->mutex);
+    if (ret)
+        return ret;
+
+    m->acquired = trace_now();
+    acquired(stat_of(&m->stat, m->name), 0, 0, m->acquired);
+
+    return 0;
+}
+
+void __lockstat_mutex_release(struct lockstat_mutex *m)
+{
+    unsigned long long start = m->acquired;
+
+    m->acquired = 0;
+    released(stat_of(&m->stat, m->name), start);
+}
+
+void __lockstat_mutex_reacquired(struct lockstat_mutex *m)
+{
+    m->acquired = trace_now();
+}
+
+/*
+ * rwlock
+ */
+void lockstat_rwlock_init(struct lockstat_rwlock *l, const char *name,
+                          const char *scope)
+{
+    pthread_rwlock_init(&l->rwlock, NULL);
+    l->name = name;
+    l->scope = scope;
+    l->stat = NULL;
+    l->acquired = 0;
+}
+
+void lockstat_rwlock_destroy(struct lockstat_rwlock *l)
+{
+    pthread_rwlock_destroy(&l->rwlock);
+}
+
+int __lockstat_rwlock_lock(struct lockstat_rwlock *l, int write)
+{
+    unsigned long long start = 0, now;
+    int contended, ret = 0;
+
+    if (write)
+        contended = pthread_rwlock_trywrlock(&l->rwlock) != 0;
+    else
+        contended = pthread_rwlock_tryrdlock(&l->rwlock) != 0;
+    if (contended) {
+        start = trace_now();
+        if (write)
+            ret = pthread_rwlock_wrlock(&l->rwlock);
+        else
+            ret = pthread_rwlock_rdlock(&l->rwlock);
+        if (ret)
+            return ret;
+    }
+
+    if (!lockstat_enabled && !contended)
+        return 0;
+
+    now = trace_now();
+    if (lockstat_enabled) {
+        acquired(stat_of(&l->stat, l->name), contended, start, now);
+        if (write)
+            l->acquired = now;
+    }
+
+    if (contended && TRACE_ON())
+        trace_complete("lock", l->name, l->scope, 0, TRACE_NO_PORT, start);
+
+    return 0;
+}
+
+void __lockstat_rwlock_release(struct lockstat_rwlock *l)
+{
+    unsigned long long start = l->acquired;
+
+    l->acquired = 0;
+    released(stat_of(&l->stat, l->name), start);
+}
+
+/*
+ * statistics
+ */
+void lockstat_enable(int enable)
+{
+    lockstat_enabled = !!enable;
+}
+
+void lockstat_reset(void)
+{
+    unsigned int i, nr = g_nr_stats;
+
+    for (i = 0; i < nr; i++) {
+        g_stats[i].nr_acquired = 0;
+        g_stats[i].nr_contended = 0;
+        histogram_reset(&g_stats[i].wait);
+        histogram_reset(&g_stats[i].hold);
+    }
+}
+
+static int compare_wait(const void *a, const void *b)
+{
+    const struct lockstat *sa = (const struct lockstat *)a;
+    const struct lockstat *sb = (const struct lockstat *)b;
+
+    if (sa->wait.sum != sb->wait.sum)
+        return sa->wait.sum < sb->wait.sum ? 1 : -1;
+    if (sa->nr_acquired != sb->nr_acquired)
+        return sa->nr_acquired < sb->nr_acquired ? 1 : -1;
+    return 0;
+}
+
+unsigned int lockstat_get(struct lockstat *stats, unsigned int nr)
+{
+    unsigned int nr_stats = g_nr_stats;
+
+    if (!nr)
+        return nr_stats;
+
+    if (nr >= nr_stats) {
+        memcpy(stats, g_stats, sizeof(*stats) * nr_stats);
+        qsort(stats, nr_stats, sizeof(*stats), compare_wait);
+        return nr_stats;
+    }
+
+    /* the most waited for nr of them */
+    {
+        struct lockstat *all;
+
+        all = (struct lockstat *)malloc(sizeof(*all) * nr_stats);
+        if (!all)
+            return 0;
+
+        memcpy(all, g_stats, sizeof(*all) * nr_stats);
+        qsort(all, nr_stats, sizeof(*all), compare_wait);
+        memcpy(stats, all, sizeof(*stats) * nr);
+        free(all);
+    }
+
+    return nr_stats;
+}
+
+int lockstat_find(const char *name, struct lockstat *stat)
+{
+    struct lockstat *found = search(name, g_nr_stats);
+
+    if (!found)
+        return -1;
+
+    memcpy(stat, found, sizeof(*stat));
+    return 0;
+}
+
+static void write_all(int fd, const char *buf, size_t len)
+{
+    ssize_t written;
+
+    while (len) {
+        written = write(fd, buf, len);
+        if (written <= 0)
+            return;
+        buf += written;
+        len -= written;
+    }
+}
+
+void lockstat_report(int fd)
+{
+    struct lockstat *stats;
+    unsigned int nr, i;
+    char line[256];
+    int len;
+
+    nr = lockstat_get(NULL, 0);
+    if (!nr)
+        return;
+
+    stats = (struct lockstat *)malloc(sizeof(*stats) * nr);
+    if (!stats)
+        return;
+    nr = lockstat_get(stats, nr);
+
+    len = snprintf(line, sizeof(line),
+                   "%-32s %10s %10s %10s %8s %8s %8s %8s %8s %8s\n",
+                   "lock (nsec)", "acquired", "contended", "wait msec",
+                   "wait p50", "p99", "max", "hold p50", "p99", "max");
+    write_all(fd, line, len);
+
+    for (i = 0; i < nr; i++) {
+        struct lockstat *s = &stats[i];
+
+        len = snprintf(line, sizeof(line),
+                       "%-32s %10llu %10llu %10llu %8llu %8llu %8llu "
+                       "%8llu %8llu %8llu\n",
+                       s->name, s->nr_acquired, s->nr_contended,
+                       s->wait.sum / 1000000,
+                       histogram_percentile(&s->wait, 500),
+                       histogram_percentile(&s->wait, 990),
+                       s->wait.max,
+                       histogram_percentile(&s->hold, 500),
+                       histogram_percentile(&s->hold, 990),
+                       s->hold.max);
+        if (len >= (int)sizeof(line))
+            len = sizeof(line) - 1;
+        write_all(fd, line, len);
+    }
+
+    free(stats);
+}
+
+__attribute__((constructor)) static void lockstat_init(void)
+{
+    const char *env = getenv("OMXIL_LOCKSTAT");
+
+    lockstat_enabled = env && atoi(env);
+}
+
+/* straight to stderr, the log thread may be gone by now */
+__attribute__((destructor)) static void lockstat_exit(void)
+{
+    const char *env = getenv("OMXIL_LOCKSTAT");
+
+    if (env && atoi(env))
+        lockstat_report(STDERR_FILENO);
+}
@@ -0,0 +1,811 @@
+/*
+ * log.c, asynchronous log backend of the omx_*Log macros
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include <log.h>
+#include <wakeup.h>
+
+#define LOG_NR_RECORDS      512         /* power of two */
+#define LOG_ARGS_SIZE       224
+#define LOG_LINE_SIZE       1024
+#define LOG_OUT_SIZE        4096
+#define LOG_NR_SITES        256         /* power of two */
+#define LOG_DEFAULT_RATE    20
+#define LOG_SITE_TEXT       80          /* of the format quoted */
+
+#ifdef __ENABLE_DEBUG__
+#define LOG_DEFAULT_LEVEL   OMX_LOG_VERBOSE
+#else
+#define LOG_DEFAULT_LEVEL   OMX_LOG_INFO
+#endif
+
+/* sweep of the suppressed counts while idle */
+#define LOG_IDLE_NSEC       1000000000ULL
+
+struct log_record {
+    volatile unsigned long seq;
+    int level;
+    const char *format;
+    unsigned short nr_bytes;            /* of args used */
+    unsigned char truncated;
+    unsigned long long args[LOG_ARGS_SIZE / 8];
+};
+
+/*
+ * rate of a call site, keyed by the format. the key's never dereferenced,
+ * the text's copied as the module owning the format may be unloaded
+ */
+struct log_site {
+    const char *volatile format;
+    volatile int ready;                 /* text copied */
+    int level;
+    char text[LOG_SITE_TEXT];
+    volatile unsigned int second;
+    volatile unsigned int count;
+    volatile unsigned int suppressed;
+};
+
+volatile int omx_log_level = LOG_DEFAULT_LEVEL;
+
+static struct log_record g_records[LOG_NR_RECORDS];
+static volatile unsigned long g_tail;   /* claimed by the producers */
+static volatile unsigned long g_head;   /* consumed by the log thread */
+static volatile unsigned int g_dropped;
+static struct wakeup g_wakeup;
+
+static struct log_site g_sites[LOG_NR_SITES];
+static unsigned int g_rate = LOG_DEFAULT_RATE;
+static int g_sync;
+
+static pthread_once_t g_start_once = PTHREAD_ONCE_INIT;
+static pthread_t g_thread;
+static volatile int g_running;
+static volatile int g_stop;
+
+static const char *g_prefix[] = {
+    "omxil-core error: ",
+    "omxil-core warning: ",
+    "omxil-core info: ",
+    "omxil-core debug: ",
+    "omxil-core verbose: ",
+};
+
+static const char g_suppressed_format[] =
+    "%u similar messages suppressed: %.*s";
+
+/*
+ * printf conversions, walked the same way when the arguments're captured
+ * and when they're formatted
+ */
+struct log_spec {
+    char text[24];          /* '%', flags, width and precision */
+    char conv;
+    char length;            /* 'H'h, 'h', 'l', 'q'll, 'L', 'j', 'z', 't' */
+    int nr_stars;
+    int precision;          /* literal, -1 if none */
+};
+
+/* p points at '%', returns the end of the conversion or NULL if unknown */
+static const char *parse_spec(const char *p, struct log_spec *s)
+{
+    unsigned int n = 0;
+
+    s->nr_stars = 0;
+    s->precision = -1;
+    s->length = 0;
+    s->text[n++] = *p++;
+
+    while (*p && strchr("-+ #0'", *p) && n < sizeof(s->text) - 4)
+        s->text[n++] = *p++;
+
+    if (*p == '*') {
+        s->nr_stars++;
+        s->text[n++] = *p++;
+    }
+    else {
+        while (*p >= '0' && *p <= '9' && n < sizeof(s->text) - 4)
+            s->text[n++] = *p++;
+    }
+
+    if (*p == '.') {
+        s->text[n++] = *p++;
+        if (*p == '*') {
+            s->nr_stars++;
+            s->text[n++] = *p++;
+        }
+        else {
+            s->precision = 0;
+            while (*p >= '0' && *p <= '9' && n < sizeof(s->text) - 4) {
+                s->precision = s->precision * 10 + (*p - '0');
+                s->text[n++] = *p++;
+            }
+        }
+    }
+
+    switch (*p) {
+    case 'h':
+        p++;
+        s->length = 'h';
+        if (*p == 'h') {
+            p++;
+            s->length = 'H';
+        }
+        break;
+    case 'l':
+        p++;
+        s->length = 'l';
+        if (*p == 'l') {
+            p++;
+            s->length = 'q';
+        }
+        break;
+    case 'q':
+    case 'L':
+    case 'j':
+    case 'z':
+    case 'Z':
+    case 't':
+        s->length = *p == 'Z' ? 'z' : *p;
+        p++;
+        break;
+    }
+
+    if (!*p || !strchr("diouxXcspeEfFgGaAn%", *p))
+        return NULL;
+
+    s->conv = *p++;
+    s->text[n] = '\0';
+    return p;
+}
+
+static int is_integer(char conv)
+{
+    return strchr("diouxX", conv) != NULL;
+}
+
+static int is_double(char conv)
+{
+    return strchr("eEfFgGaA", conv) != NULL;
+}
+
+/* binary arguments of format, strings by value */
+static void capture(struct log_record *r, const char *format, va_list ap)
+{
+    unsigned char *args = (unsigned char *)r->args;
+    unsigned int used = 0, i;
+    struct log_spec s;
+    const char *p = format;
+    int precision;
+
+    r->truncated = 0;
+
+    while ((p = strchr(p, '%'))) {
+        p = parse_spec(p, &s);
+        if (!p) {
+            r->truncated = 1;
+            break;
+        }
+        if (s.conv == '%')
+            continue;
+
+        precision = s.precision;
+        for (i = 0; i < (unsigned int)s.nr_stars; i++) {
+            int star = va_arg(ap, int);
+
+            if (used + 8 > LOG_ARGS_SIZE)
+                goto truncated;
+            *(long long *)(args + used) = star;
+            used += 8;
+            /* a '*' after '.' is the precision */
+            if (i == (unsigned int)s.nr_stars - 1 && strstr(s.text, ".*"))
+                precision = star;
+        }
+
+        if (s.conv == 'n') {
+            (void)va_arg(ap, void *);
+            continue;
+        }
+
+        if (s.conv == 's') {
+            const char *str = va_arg(ap, const char *);
+            size_t len;
+
+            if (!str)
+                str = "(null)";
+            for (len = 0; str[len] && (precision < 0 || (int)len < precision);
+                 len++)
+                ;
+            if (used + 8 > LOG_ARGS_SIZE)
+                goto truncated;
+            if (len > LOG_ARGS_SIZE - used - 1) {
+                len = LOG_ARGS_SIZE - used - 1;
+                r->truncated = 1;
+            }
+            memcpy(args + used, str, len);
+            args[used + len] = '\0';
+            used += (len + 1 + 7) & ~7U;
+            continue;
+        }
+
+        if (used + 8 > LOG_ARGS_SIZE)
+            goto truncated;
+
+        if (is_double(s.conv)) {
+            double d;
+
+            if (s.length == 'L')
+                d = (double)va_arg(ap, long double);
+            else
+                d = va_arg(ap, double);
+            memcpy(args + used, &d, sizeof(d));
+        }
+        else if (s.conv == 'p')
+            *(unsigned long long *)(args + used) =
+                (uintptr_t)va_arg(ap, void *);
+        else if (s.conv == 'c')
+            *(long long *)(args + used) = va_arg(ap, int);
+        else if (s.conv == 'd' || s.conv == 'i') {
+            long long v;
+
+            if (s.length == 'l')
+                v = va_arg(ap, long);
+            else if (s.length == 'q' || s.length == 'L')
+                v = va_arg(ap, long long);
+            else if (s.length == 'j')
+                v = va_arg(ap, intmax_t);
+            else if (s.length == 'z')
+                v = va_arg(ap, ssize_t);
+            else if (s.length == 't')
+                v = va_arg(ap, ptrdiff_t);
+            else if (s.length == 'h')
+                v = (short)va_arg(ap, int);
+            else if (s.length == 'H')
+                v = (signed char)va_arg(ap, int);
+            else
+                v = va_arg(ap, int);
+            *(long long *)(args + used) = v;
+        }
+        else {
+            unsigned long long v;
+
+            if (s.length == 'l')
+                v = va_arg(ap, unsigned long);
+            else if (s.length == 'q' || s.length == 'L')
+                v = va_arg(ap, unsigned long long);
+            else if (s.length == 'j')
+                v = va_arg(ap, uintmax_t);
+            else if (s.length == 'z')
+                v = va_arg(ap, size_t);
+            else if (s.length == 't')
+                v = va_arg(ap, ptrdiff_t);
+            else if (s.length == 'h')
+                v = (unsigned short)va_arg(ap, unsigned int);
+            else if (s.length == 'H')
+                v = (unsigned char)va_arg(ap, unsigned int);
+            else
+                v = va_arg(ap, unsigned int);
+            *(unsigned long long *)(args + used) = v;
+        }
+        used += 8;
+    }
+
+    r->nr_bytes = used;
+    return;
+
+truncated:
+    r->nr_bytes = used;
+    r->truncated = 1;
+}
+
+/* the message of r into line, returns its length */
+static size_t format_record(const struct log_record *r, char *line,
+                            size_t size)
+{
+    const unsigned char *args = (const unsigned char *)r->args;
+    const char *p = r->format, *next;
+    unsigned int used = 0, i;
+    size_t n = 0;
+    struct log_spec s;
+    char spec[32];
+    int stars[2], ret;
+
+    size--;                     /* room for '\0' */
+    while (*p && n < size) {
+        if (*p != '%') {
+            line[n++] = *p++;
+            continue;
+        }
+
+        next = parse_spec(p, &s);
+        if (!next)
+            break;
+        p = next;
+        if (s.conv == '%') {
+            line[n++] = '%';
+            continue;
+        }
+        if (s.conv == 'n')
+            continue;
+
+        for (i = 0; i < (unsigned int)s.nr_stars; i++) {
+            if (used + 8 > r->nr_bytes)
+                goto truncated;
+            stars[i] = (int)*(const long long *)(args + used);
+            used += 8;
+        }
+        if (used + 8 > r->nr_bytes)
+            goto truncated;
+
+        /* every integer's been widened to long long */
+        snprintf(spec, sizeof(spec), "%s%s%c", s.text,
+                 is_integer(s.conv) ? "ll" : "", s.conv);
+
+#define FORMAT(value)                                                   \
+        if (s.nr_stars == 2)                                            \
+            ret = snprintf(line + n, size + 1 - n, spec, stars[0],      \
+                           stars[1], value);                            \
+        else if (s.nr_stars == 1)                                       \
+            ret = snprintf(line + n, size + 1 - n, spec, stars[0], value); \
+        else                                                            \
+            ret = snprintf(line + n, size + 1 - n, spec, value)
+
+        if (s.conv == 's') {
+            const char *str = (const char *)(args + used);
+            size_t len = strlen(str);
+
+            FORMAT(str);
+            used += (len + 1 + 7) & ~7U;
+        }
+        else if (is_double(s.conv)) {
+            double d;
+
+            memcpy(&d, args + used, sizeof(d));
+            FORMAT(d);
+            used += 8;
+        }
+        else if (s.conv == 'p') {
+            FORMAT((void *)(uintptr_t)*(const unsigned long long *)
+                   (args + used));
+            used += 8;
+        }
+        else if (s.conv == 'c') {
+            FORMAT((int)*(const long long *)(args + used));
+            used += 8;
+        }
+        else {
+            FORMAT(*(const long long *)(args + used));
+            used += 8;
+        }
+#undef FORMAT
+
+        if (ret < 0)
+            break;
+        n += (size_t)ret < size - n ? (size_t)ret : size - n;
+    }
+
+    if (!r->truncated) {
+        line[n] = '\0';
+        return n;
+    }
+
+truncated:
+    if (n + 3 > size)
+        n = size - 3;
+    memcpy(line + n, "...", 3);
+    n += 3;
+    line[n] = '\0';
+    return n;
+}
+
+static void write_all(const char *buffer, size_t size)
+{
+    ssize_t ret;
+
+    while (size) {
+        ret = write(STDERR_FILENO, buffer, size);
+        if (ret <= 0)
+            break;
+        buffer += ret;
+        size -= ret;
+    }
+}
+
+/* appends the line of r to out, writes out when it's full */
+static void emit(const struct log_record *r, char *out, size_t *nr_out)
+{
+    char line[LOG_LINE_SIZE];
+    size_t len;
+    int level = r->level;
+
+    if (level < OMX_LOG_ERROR || level > OMX_LOG_VERBOSE)
+        level = OMX_LOG_ERROR;
+
+    len = strlen(g_prefix[level]);
+    memcpy(line, g_prefix[level], len);
+    len += format_record(r, line + len, sizeof(line) - len - 1);
+    line[len++] = '\n';
+
+    if (*nr_out + len > LOG_OUT_SIZE) {
+        write_all(out, *nr_out);
+        *nr_out = 0;
+    }
+    memcpy(out + *nr_out, line, len);
+    *nr_out += len;
+}
+
+static unsigned int now_second(void)
+{
+    struct timespec now;
+
+#ifdef CLOCK_MONOTONIC_COARSE
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &now);
+#endif
+    return (unsigned int)now.tv_sec;
+}
+
+/*
+ * queue, bounded multi-producer single-consumer. a slot's free for
+ * position pos when its seq is pos, filled when pos + 1
+ */
+static struct log_record *claim(void)
+{
+    struct log_record *r;
+    unsigned long pos = g_tail;
+    long diff;
+
+    for (;;) {
+        r = &g_records[pos & (LOG_NR_RECORDS - 1)];
+        diff = (long)(r->seq - pos);
+
+        if (!diff) {
+            if (__sync_bool_compare_and_swap(&g_tail, pos, pos + 1))
+                return r;
+        }
+        else if (diff < 0) {
+            __sync_fetch_and_add(&g_dropped, 1);
+            return NULL;
+        }
+        pos = g_tail;
+    }
+}
+
+static void publish(struct log_record *r, unsigned long pos)
+{
+    __sync_synchronize();
+    r->seq = pos + 1;
+    wakeup_signal(&g_wakeup);
+}
+
+static int log_ready(void *arg)
+{
+    (void)arg;
+
+    return g_stop ||
+        g_records[g_head & (LOG_NR_RECORDS - 1)].seq == g_head + 1;
+}
+
+static void enqueue(int level, const char *format, va_list ap)
+{
+    struct log_record local, *r;
+    char out[LOG_LINE_SIZE + 1];
+    size_t nr_out = 0;
+    unsigned long pos;
+
+    if (!g_running) {
+        local.level = level;
+        local.format = format;
+        capture(&local, format, ap);
+        emit(&local, out, &nr_out);
+        write_all(out, nr_out);
+        return;
+    }
+
+    r = claim();
+    if (!r)
+        return;
+    pos = r->seq;
+
+    r->level = level;
+    r->format = format;
+    capture(r, format, ap);
+    publish(r, pos);
+}
+
+static void enqueue_args(int level, const char *format, ...)
+{
+    va_list ap;
+
+    va_start(ap, format);
+    enqueue(level, format, ap);
+    va_end(ap);
+}
+
+/* a new second, report what the last ones suppressed */
+static void roll_site(struct log_site *site, unsigned int second,
+                      unsigned int now)
+{
+    unsigned int suppressed;
+
+    if (!site->ready ||
+        !__sync_bool_compare_and_swap(&site->second, second, now))
+        return;
+
+    site->count = 0;
+    suppressed = __sync_lock_test_and_set(&site->suppressed, 0);
+    if (!suppressed)
+        return;
+
+    enqueue_args(site->level, g_suppressed_format, suppressed,
+                 (int)strlen(site->text), site->text);
+}
+
+/* the format quoted on one line, by its owner after the slot's claimed */
+static void copy_site_text(struct log_site *site, const char *format)
+{
+    size_t len = strcspn(format, "\n");
+
+    if (len > sizeof(site->text) - 1)
+        len = sizeof(site->text) - 1;
+    memcpy(site->text, format, len);
+    site->text[len] = '\0';
+
+    __sync_synchronize();
+    site->ready = 1;
+}
+
+static struct log_site *find_site(const char *format, int level)
+{
+    struct log_site *site;
+    unsigned int i, slot = (unsigned int)(((uintptr_t)format >> 3) *
+                                          2654435761U);
+
+    for (i = 0; i < LOG_NR_SITES; i++, slot++) {
+        site = &g_sites[slot & (LOG_NR_SITES - 1)];
+
+        if (site->format == format)
+            return site;
+        if (!site->format) {
+            site->level = level;
+            site->second = now_second();
+            if (__sync_bool_compare_and_swap(&site->format, NULL, format)) {
+                copy_site_text(site, format);
+                return site;
+            }
+            if (site->format == format)
+                return site;
+        }
+    }
+
+    /* full, these call sites go unlimited */
+    return NULL;
+}
+
+static int rate_limited(const char *format, int level)
+{
+    struct log_site *site;
+    unsigned int now, second;
+
+    /* errors're never suppressed */
+    if (!g_rate || level == OMX_LOG_ERROR)
+        return 0;
+
+    site = find_site(format, level);
+    if (!site)
+        return 0;
+
+    now = now_second();
+    second = site->second;
+    if (second != now)
+        roll_site(site, second, now);
+
+    if (__sync_add_and_fetch(&site->count, 1) <= g_rate)
+        return 0;
+
+    __sync_fetch_and_add(&site->suppressed, 1);
+    return 1;
+}
+
+static void sweep_sites(void)
+{
+    struct log_site *site;
+    unsigned int i, now = now_second(), second;
+
+    for (i = 0; i < LOG_NR_SITES; i++) {
+        site = &g_sites[i];
+        second = site->second;
+        if (site->format && site->suppressed && second != now)
+            roll_site(site, second, now);
+    }
+}
+
+static void *log_thread(void *arg)
+{
+    struct log_record *r;
+    char out[LOG_OUT_SIZE];
+    size_t nr_out;
+    unsigned int dropped;
+    struct log_record note;
+
+    (void)arg;
+
+    while (!g_stop) {
+        if (!wakeup_wait_until(&g_wakeup, log_ready, NULL,
+                               (unsigned long long)now_second() *
+                               1000000000ULL + 2 * LOG_IDLE_NSEC))
+            sweep_sites();
+
+        nr_out = 0;
+        for (;;) {
+            r = &g_records[g_head & (LOG_NR_RECORDS - 1)];
+            if (r->seq != g_head + 1)
+                break;
+            __sync_synchronize();
+
+            emit(r, out, &nr_out);
+
+            r->seq = g_head + LOG_NR_RECORDS;
+            __sync_synchronize();
+            g_head++;
+        }
+
+        dropped = __sync_lock_test_and_set(&g_dropped, 0);
+        if (dropped) {
+            note.level = OMX_LOG_ERROR;
+            note.format = "%u log records dropped, queue full";
+            note.truncated = 0;
+            note.nr_bytes = 8;
+            note.args[0] = dropped;
+            emit(&note, out, &nr_out);
+        }
+
+        if (nr_out)
+            write_all(out, nr_out);
+    }
+
+    return NULL;
+}
+
+/* the log thread isn't forked, the child writes by itself */
+static void log_child(void)
+{
+    g_running = 0;
+}
+
+static void log_start(void)
+{
+    unsigned int i;
+
+    if (g_sync)
+        return;
+
+    for (i = 0; i < LOG_NR_RECORDS; i++)
+        g_records[i].seq = i;
+    g_tail = g_head = 0;
+    wakeup_init(&g_wakeup);
+
+    if (!pthread_create(&g_thread, NULL, log_thread, NULL)) {
+        g_running = 1;
+        pthread_atfork(NULL, NULL, log_child);
+    }
+}
+
+static int parse_level(const char *value)
+{
+    static const char *names[] = {
+        "error", "warn", "info", "debug", "verbose",
+    };
+    unsigned int i;
+
+    for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (!strcmp(value, names[i]))
+            return i;
+    }
+
+    if (value[0] >= '0' && value[0] <= '9')
+        return atoi(value);
+
+    return -1;
+}
+
+__attribute__((constructor)) static void log_init(void)
+{
+    const char *env;
+    int level;
+
+    env = getenv("OMXIL_LOG_LEVEL");
+    if (env) {
+        level = parse_level(env);
+        if (level >= 0)
+            omx_log_set_level(level);
+    }
+
+    env = getenv("OMXIL_LOG_RATE");
+    if (env)
+        g_rate = (unsigned int)atoi(env);
+
+    env = getenv("OMXIL_LOG_SYNC");
+    g_sync = env && atoi(env);
+}
+
+__attribute__((destructor)) static void log_exit(void)
+{
+    if (!g_running)
+        return;
+
+    omx_log_flush();
+
+    g_stop = 1;
+    wakeup_signal(&g_wakeup);
+    pthread_join(g_thread, NULL);
+    g_running = 0;
+}
+
+void omx_log(int level, const char *format, ...)
+{
+    va_list ap;
+
+    if (level > omx_log_level)
+        return;
+
+    pthread_once(&g_start_once, log_start);
+
+    if (rate_limited(format, level))
+        return;
+
+    va_start(ap, format);
+    enqueue(level, format, ap);
+    va_end(ap);
+}
+
+void omx_log_set_level(int level)
+{
+    if (level < OMX_LOG_ERROR)
+        level = OMX_LOG_ERROR;
+    else if (level > OMX_LOG_VERBOSE)
+        level = OMX_LOG_VERBOSE;
+
+    omx_log_level = level;
+}
+
+void omx_log_flush(void)
+{
+    unsigned long tail = g_tail;
+
+    /* a producer may still be filling a claimed record, wait for it too */
+    while (g_running && (long)(g_head - tail) < 0) {
+        wakeup_signal(&g_wakeup);
+        sched_yield();
+    }
+}
@@ -21,13 +21,15 @@
 #include <pthread.h>
 
 #include <module.h>
+#include <lockstat.h>
 
 #include <sysdeps.h>
 
 static struct module *g_module_head;
 static char *g_module_err;
 
-static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct lockstat_mutex g_lock =
+    LOCKSTAT_MUTEX_INITIALIZER("module_lock");
 
 #define for_each_module(__module, __head)               \
     for ((__module) = (__head); (__module) != NULL;     \
@@ -122,23 +124,22 @@ const char *module_error(void)
 struct module *module_open(const char *file, int flag, void *preload)
 {
     struct module *new, *existing;
-    void *handle;
     const char *dlerr;
     int init_ret = 0;
 
-    pthread_mutex_lock(&g_lock);
+    lockstat_mutex_lock(&g_lock);
 
     existing = module_find_with_name(g_module_head, file);
     if (existing) {
         omx_errorLog("found opened module %s\n", existing->name);
         existing->ref_count++;
-        pthread_mutex_unlock(&g_lock);
+        lockstat_mutex_unlock(&g_lock);
         return existing;
     }
 
     new = malloc(sizeof(*new));
     if (!new) {
-        pthread_mutex_unlock(&g_lock);
+        lockstat_mutex_unlock(&g_lock);
         return NULL;
     }
 
@@ -146,17 +147,22 @@ struct module *module_open(const char *file, int flag, void *preload)
     new->priv = NULL;
     new->next = NULL;
 
-    dlerror();
     if(preload) {
         new->handle= preload;
     }
     else {
+        /*
+         * dlopen() can take long (RTLD_NOW relocations, constructors), don't
+         * hold the lock so that other libraries are opened in parallel
+         */
+        lockstat_mutex_unlock(&g_lock);
+        dlerror();
         new->handle = dlopen(file, flag);
         dlerr = dlerror();
-        if (dlerr) {
+        lockstat_mutex_lock(&g_lock);
+        if (!new->handle) {
             omx_errorLog("dlopen failed (%s)\n", dlerr);
             module_set_error(dlerr);
-            pthread_mutex_unlock(&g_lock);
             goto free_new;
         }
     }
@@ -166,8 +172,11 @@ struct module *module_open(const char *file, int flag, void *preload)
         omx_errorLog("found opened module %s\n", existing->name);
         existing->ref_count++;
 
+        /* opened by another thread meanwhile, drop the reference just taken */
+        if (!preload)
+            dlclose(new->handle);
         free(new);
-        pthread_mutex_unlock(&g_lock);
+        lockstat_mutex_unlock(&g_lock);
         return existing;
     }
 
@@ -175,13 +184,12 @@ struct module *module_open(const char *file, int flag, void *preload)
     new->init = dlsym(new->handle, "module_init");
     dlerr = dlerror();
     if (!dlerr) {
-        omx_errorLog("module %s has init(), call the symbol\n", new->name);
+        omx_errorLog("module %s has init(), call the symbol\n", file);
         init_ret = new->init(new);
     }
 
     if (init_ret) {
-        omx_errorLog("module %s init() failed (%d)\n", new->name, init_ret);
-        pthread_mutex_unlock(&g_lock);
+        omx_errorLog("module %s init() failed (%d)\n", file, init_ret);
         goto free_handle;
     }
 
@@ -200,16 +208,17 @@ struct module *module_open(const char *file, int flag, void *preload)
 
     g_module_head = module_add_list(g_module_head, new);
 
-    pthread_mutex_unlock(&g_lock);
+    lockstat_mutex_unlock(&g_lock);
     return new;
 
 free_handle:
+    omx_log_flush();
     dlclose(new->handle);
 
 free_new:
     free(new);
 
-    pthread_mutex_unlock(&g_lock);
+    lockstat_mutex_unlock(&g_lock);
     return NULL;
 }
 
@@ -221,7 +230,7 @@ int module_close(struct module *module, unsigned int preload)
     if (!module || !module->handle)
         return 0;
 
-    pthread_mutex_lock(&g_lock);
+    lockstat_mutex_lock(&g_lock);
 
     if(module->ref_count==0) {
         omx_errorLog("module %s decrease refcont (%d)------\n", module->name, module->ref_count);
@@ -238,6 +247,8 @@ int module_close(struct module *module, unsigned int preload)
             module->exit(module);
 
         if (!preload) {
+            /* the queued log records may point at its formats */
+            omx_log_flush();
             dlerror();
             dlclose(module->handle);
             dlerr = dlerror();
@@ -257,7 +268,7 @@ int module_close(struct module *module, unsigned int preload)
         }
     }
 
-    pthread_mutex_unlock(&g_lock);
+    lockstat_mutex_unlock(&g_lock);
     return ret;
 }
 
@@ -269,7 +280,7 @@ void *module_symbol(struct module *module, const char *string)
     if (!module || !module->handle || !string)
         return NULL;
 
-    pthread_mutex_lock(&g_lock);
+    lockstat_mutex_lock(&g_lock);
 
     dlerror();
     symbol = dlsym(module->handle, string);
@@ -280,9 +291,10 @@ void *module_symbol(struct module *module, const char *string)
         module_set_error(dlerr);
         symbol = NULL;
     }
-    else
+    else {
         omx_verboseLog("found symbol %s in module %s", string, module->name);
+    }
 
-    pthread_mutex_unlock(&g_lock);
+    lockstat_mutex_unlock(&g_lock);
     return symbol;
 }
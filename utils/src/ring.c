@@ -0,0 +1,158 @@
+/*
+ * ring.c, bounded lock-free ring
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include <ring.h>
+
+void __ring_init(struct ring *ring)
+{
+	ring->cells = NULL;
+	ring->mask = 0;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->length = 0;
+}
+
+int ring_init(struct ring *ring, unsigned int capacity)
+{
+	struct ring_cell *cells;
+	unsigned long size = 1, i;
+
+	while (size < capacity)
+		size <<= 1;
+
+	cells = malloc(sizeof(*cells) * size);
+	if (!cells)
+		return -1;
+
+	for (i = 0; i < size; i++) {
+		cells[i].seq = i;
+		cells[i].data = NULL;
+	}
+
+	free(ring->cells);
+	__ring_init(ring);
+	ring->cells = cells;
+	ring->mask = size - 1;
+
+	return 0;
+}
+
+void ring_free(struct ring *ring)
+{
+	free(ring->cells);
+	__ring_init(ring);
+}
+
+int ring_push(struct ring *ring, void *data)
+{
+	struct ring_cell *cell;
+	unsigned long pos, seq;
+	long diff;
+
+	if (!ring->cells)
+		return -1;
+
+	pos = ring->head;
+	for (;;) {
+		cell = &ring->cells[pos & ring->mask];
+		seq = cell->seq;
+		__sync_synchronize();
+
+		diff = (long)seq - (long)pos;
+		if (!diff) {
+			/* the cell is free, reserve it */
+			if (__sync_bool_compare_and_swap(&ring->head, pos, pos + 1))
+				break;
+			pos = ring->head;
+		}
+		else if (diff < 0)
+			return -1; /* full */
+		else
+			pos = ring->head; /* raced with another pusher */
+	}
+
+	cell->data = data;
+	__sync_synchronize();
+	cell->seq = pos + 1; /* publish */
+
+	__sync_fetch_and_add(&ring->length, 1);
+	return 0;
+}
+
+void *ring_pop(struct ring *ring)
+{
+	struct ring_cell *cell;
+	unsigned long pos, seq;
+	long diff;
+	void *data;
+
+	if (!ring->cells)
+		return NULL;
+
+	pos = ring->tail;
+	for (;;) {
+		cell = &ring->cells[pos & ring->mask];
+		seq = cell->seq;
+		__sync_synchronize();
+
+		diff = (long)seq - (long)(pos + 1);
+		if (!diff) {
+			if (__sync_bool_compare_and_swap(&ring->tail, pos, pos + 1))
+				break;
+			pos = ring->tail;
+		}
+		else if (diff < 0)
+			return NULL; /* empty, or reserved by a pusher not done */
+		else
+			pos = ring->tail; /* raced with another popper */
+	}
+
+	data = cell->data;
+	__sync_synchronize();
+	cell->seq = pos + ring->mask + 1; /* release the cell to pushers */
+
+	__sync_fetch_and_sub(&ring->length, 1);
+	return data;
+}
+
+int ring_pushing(struct ring *ring)
+{
+	unsigned long pos;
+
+	if (!ring->cells)
+		return 0;
+
+	pos = ring->tail;
+	__sync_synchronize();
+	return ring->head != pos && ring->cells[pos & ring->mask].seq != pos + 1;
+}
+
+int ring_length(struct ring *ring)
+{
+	long length = ring->length;
+
+	/* a popper can get ahead of the pusher's length increment */
+	return length > 0 ? (int)length : 0;
+}
+
+unsigned int ring_capacity(struct ring *ring)
+{
+	return ring->cells ? (unsigned int)(ring->mask + 1) : 0;
+}
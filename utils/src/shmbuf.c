@@ -0,0 +1,183 @@
+/*
+ * shmbuf.c, shareable buffer slab backed by memfd
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <shmbuf.h>
+
+#include <sysdeps.h>
+
+/* older libc headers */
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC             0x0001U
+#define MFD_ALLOW_SEALING       0x0002U
+#endif
+
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS             (1024 + 9)
+#define F_SEAL_SEAL             0x0001
+#define F_SEAL_SHRINK           0x0002
+#define F_SEAL_GROW             0x0004
+#endif
+
+static int shmbuf_memfd_create(const char *name, unsigned int flags)
+{
+#ifdef __NR_memfd_create
+    return syscall(__NR_memfd_create, name, flags);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+struct shmbuf *shmbuf_create(const char *name, size_t slot_size,
+                             unsigned int nr_slots, int seal)
+{
+    struct shmbuf *shm;
+    long page_size;
+    unsigned int flags = MFD_CLOEXEC;
+
+    if (!nr_slots)
+        return NULL;
+
+    page_size = sysconf(_SC_PAGESIZE);
+    if (page_size <= 0)
+        page_size = 4096;
+    if (!slot_size)
+        slot_size = 1;
+    slot_size = (slot_size + page_size - 1) & ~((size_t)page_size - 1);
+
+    shm = calloc(1, sizeof(*shm));
+    if (!shm)
+        return NULL;
+
+    shm->used = calloc(nr_slots, sizeof(*shm->used));
+    if (!shm->used)
+        goto free_shm;
+
+    if (seal)
+        flags |= MFD_ALLOW_SEALING;
+
+    shm->fd = shmbuf_memfd_create(name, flags);
+    if (shm->fd < 0) {
+        omx_errorLog("shmbuf: memfd_create() failed (%d)\n", errno);
+        goto free_used;
+    }
+
+    shm->slot_size = slot_size;
+    shm->nr_slots = nr_slots;
+    shm->size = slot_size * nr_slots;
+
+    if (ftruncate(shm->fd, shm->size)) {
+        omx_errorLog("shmbuf: ftruncate(%lu) failed (%d)\n",
+                     (unsigned long)shm->size, errno);
+        goto close_fd;
+    }
+
+    if (seal && fcntl(shm->fd, F_ADD_SEALS,
+                      F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)) {
+        omx_errorLog("shmbuf: cannot seal memfd (%d)\n", errno);
+        goto close_fd;
+    }
+
+    shm->base = mmap(NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     shm->fd, 0);
+    if (shm->base == MAP_FAILED) {
+        omx_errorLog("shmbuf: mmap(%lu) failed (%d)\n",
+                     (unsigned long)shm->size, errno);
+        goto close_fd;
+    }
+
+    return shm;
+
+close_fd:
+    close(shm->fd);
+free_used:
+    free(shm->used);
+free_shm:
+    free(shm);
+    return NULL;
+}
+
+void shmbuf_destroy(struct shmbuf *shm)
+{
+    if (!shm)
+        return;
+
+    if (shm->nr_used)
+        omx_errorLog("shmbuf: %u slots still in use\n", shm->nr_used);
+
+    munmap(shm->base, shm->size);
+    close(shm->fd);
+    free(shm->used);
+    free(shm);
+}
+
+void *shmbuf_alloc(struct shmbuf *shm, size_t *offset)
+{
+    unsigned int i;
+
+    for (i = 0; i < shm->nr_slots; i++) {
+        if (!shm->used[i])
+            break;
+    }
+    if (i == shm->nr_slots)
+        return NULL;
+
+    shm->used[i] = 1;
+    shm->nr_used++;
+
+    *offset = i * shm->slot_size;
+    return shm->base + *offset;
+}
+
+long shmbuf_offset(struct shmbuf *shm, const void *data)
+{
+    const unsigned char *p = data;
+
+    if (p < shm->base || p >= shm->base + shm->size)
+        return -1;
+    if ((size_t)(p - shm->base) % shm->slot_size)
+        return -1;
+
+    return p - shm->base;
+}
+
+void shmbuf_free(struct shmbuf *shm, void *data)
+{
+    long offset = shmbuf_offset(shm, data);
+    unsigned int i;
+
+    if (offset < 0)
+        return;
+
+    i = offset / shm->slot_size;
+    if (shm->used[i]) {
+        shm->used[i] = 0;
+        shm->nr_used--;
+    }
+}
@@ -16,29 +16,38 @@
  * limitations under the License.
  */
 
+#include <string.h>
+#include <sched.h>
 #include <pthread.h>
 #include <thread.h>
 
+#include <sysdeps.h>
+
 Thread::Thread()
 {
     r = NULL;
     created = false;
+    memset(&attr, 0, sizeof(attr));
 
     pthread_mutex_init(&lock, NULL);
+    pthread_mutex_init(&attr_lock, NULL);
 }
 
 Thread::Thread(RunnableInterface *r)
 {
     this->r = r;
     created = false;
+    memset(&attr, 0, sizeof(attr));
 
     pthread_mutex_init(&lock, NULL);
+    pthread_mutex_init(&attr_lock, NULL);
 }
 
 Thread::~Thread()
 {
     Join();
 
+    pthread_mutex_destroy(&attr_lock);
     pthread_mutex_destroy(&lock);
 }
 
@@ -48,9 +57,22 @@ int Thread::Start(void)
 
     pthread_mutex_lock(&lock);
     if (!created) {
-        ret = pthread_create(&id, NULL, Instance, this);
+        pthread_attr_t pattr;
+
+        pthread_attr_init(&pattr);
+        pthread_mutex_lock(&attr_lock);
+        if (attr.flags & THREAD_ATTR_STACK) {
+            if (pthread_attr_setstacksize(&pattr, attr.stack_size))
+                omx_errorLog("thread: invalid stack size %lu\n",
+                             (unsigned long)attr.stack_size);
+        }
+        pthread_mutex_unlock(&attr_lock);
+
+        /* Instance() applies the rest before Run() */
+        ret = pthread_create(&id, &pattr, Instance, this);
         if (!ret)
             created = true;
+        pthread_attr_destroy(&pattr);
     }
     pthread_mutex_unlock(&lock);
 
@@ -71,10 +93,74 @@ int Thread::Join(void)
     return ret;
 }
 
+void Thread::SetAttributes(const struct thread_attr *attr)
+{
+    /* lock keeps the thread from being joined while applying */
+    pthread_mutex_lock(&lock);
+    pthread_mutex_lock(&attr_lock);
+    this->attr = *attr;
+    this->attr.name[THREAD_NAME_SIZE - 1] = '\0';
+    if (created)
+        ApplyAttributes(id);
+    pthread_mutex_unlock(&attr_lock);
+    pthread_mutex_unlock(&lock);
+}
+
+void Thread::GetAttributes(struct thread_attr *attr)
+{
+    pthread_mutex_lock(&attr_lock);
+    *attr = this->attr;
+    pthread_mutex_unlock(&attr_lock);
+}
+
+void Thread::ApplyAttributes(pthread_t tid)
+{
+    int ret;
+
+    if (attr.flags & THREAD_ATTR_AFFINITY) {
+        cpu_set_t cpus;
+        int i;
+
+        CPU_ZERO(&cpus);
+        for (i = 0; i < 64; i++) {
+            if (attr.cpu_mask & (1ULL << i))
+                CPU_SET(i, &cpus);
+        }
+
+        ret = pthread_setaffinity_np(tid, sizeof(cpus), &cpus);
+        if (ret)
+            omx_errorLog("thread: cannot set affinity 0x%llx (%d)\n",
+                         attr.cpu_mask, ret);
+    }
+
+    if (attr.flags & THREAD_ATTR_SCHED) {
+        struct sched_param param;
+
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = attr.priority;
+
+        ret = pthread_setschedparam(tid, attr.policy, &param);
+        if (ret)
+            omx_errorLog("thread: cannot set policy %d priority %d (%d)\n",
+                         attr.policy, attr.priority, ret);
+    }
+
+    if (attr.flags & THREAD_ATTR_NAME) {
+        ret = pthread_setname_np(tid, attr.name);
+        if (ret)
+            omx_errorLog("thread: cannot set name %s (%d)\n",
+                         attr.name, ret);
+    }
+}
+
 void *Thread::Instance(void *p)
 {
     Thread *t = static_cast<Thread *>(p);
 
+    pthread_mutex_lock(&t->attr_lock);
+    t->ApplyAttributes(pthread_self());
+    pthread_mutex_unlock(&t->attr_lock);
+
     t->Run();
 
     return NULL;
@@ -0,0 +1,326 @@
+/*
+ * threadplace.cpp, thread placement rules
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <fnmatch.h>
+#include <pthread.h>
+
+#include <threadplace.h>
+
+#include <sysdeps.h>
+
+#define RULE_MAX_LENGTH         256
+
+struct placement_rule {
+    struct placement_rule *next;
+    char *component;
+    char *role;
+    struct thread_attr attr;
+};
+
+static struct placement_rule *g_rules;
+static struct placement_rule **g_rules_tail = &g_rules;
+static pthread_mutex_t g_rules_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const struct {
+    const char *name;
+    int policy;
+} g_policies[] = {
+    { "other", SCHED_OTHER },
+    { "fifo", SCHED_FIFO },
+    { "rr", SCHED_RR },
+#ifdef SCHED_BATCH
+    { "batch", SCHED_BATCH },
+#endif
+#ifdef SCHED_IDLE
+    { "idle", SCHED_IDLE },
+#endif
+};
+
+/* "0-1,3", false if malformed */
+static bool parse_cpus(const char *value, unsigned long long *mask)
+{
+    const char *p = value;
+    char *end;
+    unsigned long first, last;
+
+    *mask = 0;
+    while (*p) {
+        first = strtoul(p, &end, 10);
+        if (end == p)
+            return false;
+        last = first;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtoul(p, &end, 10);
+            if (end == p || last < first)
+                return false;
+        }
+        if (last >= 64)
+            return false;
+
+        for (; first <= last; first++)
+            *mask |= 1ULL << first;
+
+        if (*end == ',')
+            end++;
+        else if (*end)
+            return false;
+        p = end;
+    }
+
+    return *mask != 0;
+}
+
+static bool parse_policy(const char *value, int *policy)
+{
+    unsigned int i;
+
+    for (i = 0; i < sizeof(g_policies) / sizeof(g_policies[0]); i++) {
+        if (!strcmp(value, g_policies[i].name)) {
+            *policy = g_policies[i].policy;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool parse_size(const char *value, size_t *size)
+{
+    char *end;
+    unsigned long n;
+
+    n = strtoul(value, &end, 0);
+    if (end == value)
+        return false;
+
+    if (*end == 'k' || *end == 'K') {
+        n *= 1024;
+        end++;
+    }
+    else if (*end == 'm' || *end == 'M') {
+        n *= 1024 * 1024;
+        end++;
+    }
+    if (*end || !n)
+        return false;
+
+    *size = n;
+    return true;
+}
+
+/* parse one rule in place, false if malformed */
+static bool parse_rule(char *line, struct placement_rule *rule)
+{
+    char *token, *save, *value, *slash;
+    bool has_priority = false;
+
+    memset(rule, 0, sizeof(*rule));
+
+    token = strtok_r(line, " \t", &save);
+    if (!token)
+        return false;
+    slash = strchr(token, '/');
+    if (!slash || slash == token || !slash[1])
+        return false;
+    *slash = '\0';
+    rule->component = token;
+    rule->role = slash + 1;
+
+    while ((token = strtok_r(NULL, " \t", &save))) {
+        value = strchr(token, '=');
+        if (!value)
+            return false;
+        *value++ = '\0';
+
+        if (!strcmp(token, "cpus")) {
+            if (!parse_cpus(value, &rule->attr.cpu_mask))
+                return false;
+            rule->attr.flags |= THREAD_ATTR_AFFINITY;
+        }
+        else if (!strcmp(token, "policy")) {
+            if (!parse_policy(value, &rule->attr.policy))
+                return false;
+            rule->attr.flags |= THREAD_ATTR_SCHED;
+        }
+        else if (!strcmp(token, "priority")) {
+            rule->attr.priority = atoi(value);
+            has_priority = true;
+        }
+        else if (!strcmp(token, "stack")) {
+            if (!parse_size(value, &rule->attr.stack_size))
+                return false;
+            rule->attr.flags |= THREAD_ATTR_STACK;
+        }
+        else if (!strcmp(token, "name")) {
+            if (!*value || strlen(value) >= THREAD_NAME_SIZE)
+                return false;
+            strcpy(rule->attr.name, value);
+            rule->attr.flags |= THREAD_ATTR_NAME;
+        }
+        else
+            return false;
+    }
+
+    /* priority means nothing without its policy */
+    if (has_priority && !(rule->attr.flags & THREAD_ATTR_SCHED))
+        return false;
+
+    return rule->attr.flags != 0;
+}
+
+/* must be held g_rules_lock */
+static void add_rule(const char *text)
+{
+    struct placement_rule parsed, *rule;
+    char line[RULE_MAX_LENGTH];
+    size_t len;
+
+    while (*text == ' ' || *text == '\t')
+        text++;
+    len = strcspn(text, "#\r\n");
+    while (len && (text[len - 1] == ' ' || text[len - 1] == '\t'))
+        len--;
+    if (!len)
+        return;
+
+    if (len >= sizeof(line)) {
+        omx_errorLog("thread placement: rule too long\n");
+        return;
+    }
+    memcpy(line, text, len);
+    line[len] = '\0';
+
+    if (!parse_rule(line, &parsed)) {
+        omx_errorLog("thread placement: invalid rule \"%.*s\"\n",
+                     (int)len, text);
+        return;
+    }
+
+    /* component and role strings follow the rule */
+    rule = (struct placement_rule *)malloc(sizeof(*rule) +
+                                           strlen(parsed.component) + 1 +
+                                           strlen(parsed.role) + 1);
+    if (!rule)
+        return;
+    *rule = parsed;
+    rule->next = NULL;
+    rule->component = (char *)(rule + 1);
+    strcpy(rule->component, parsed.component);
+    rule->role = rule->component + strlen(parsed.component) + 1;
+    strcpy(rule->role, parsed.role);
+
+    *g_rules_tail = rule;
+    g_rules_tail = &rule->next;
+}
+
+/* must be held g_rules_lock */
+static void free_rules(void)
+{
+    struct placement_rule *rule, *next;
+
+    for (rule = g_rules; rule; rule = next) {
+        next = rule->next;
+        free(rule);
+    }
+    g_rules = NULL;
+    g_rules_tail = &g_rules;
+}
+
+void thread_placement_load(void)
+{
+    const char *env;
+    char line[RULE_MAX_LENGTH];
+    FILE *fp;
+
+    pthread_mutex_lock(&g_rules_lock);
+    free_rules();
+
+    env = getenv("OMXIL_THREAD_PLACEMENT_FILE");
+    if (env) {
+        fp = fopen(env, "r");
+        if (fp) {
+            while (fgets(line, sizeof(line), fp))
+                add_rule(line);
+            fclose(fp);
+        }
+        else
+            omx_errorLog("thread placement: cannot open %s\n", env);
+    }
+
+    env = getenv("OMXIL_THREAD_PLACEMENT");
+    while (env && *env) {
+        size_t len = strcspn(env, ";");
+
+        if (len < sizeof(line)) {
+            memcpy(line, env, len);
+            line[len] = '\0';
+            add_rule(line);
+        }
+        else
+            omx_errorLog("thread placement: rule too long\n");
+
+        env += len;
+        if (*env == ';')
+            env++;
+    }
+    pthread_mutex_unlock(&g_rules_lock);
+}
+
+void thread_placement_unload(void)
+{
+    pthread_mutex_lock(&g_rules_lock);
+    free_rules();
+    pthread_mutex_unlock(&g_rules_lock);
+}
+
+bool thread_placement_lookup(const char *component, const char *role,
+                             struct thread_attr *attr)
+{
+    struct placement_rule *rule;
+    bool found = false;
+
+    pthread_mutex_lock(&g_rules_lock);
+    for (rule = g_rules; rule; rule = rule->next) {
+        const struct thread_attr *r = &rule->attr;
+
+        if (fnmatch(rule->component, component, 0) ||
+            fnmatch(rule->role, role, 0))
+            continue;
+
+        if (r->flags & THREAD_ATTR_AFFINITY)
+            attr->cpu_mask = r->cpu_mask;
+        if (r->flags & THREAD_ATTR_SCHED) {
+            attr->policy = r->policy;
+            attr->priority = r->priority;
+        }
+        if (r->flags & THREAD_ATTR_STACK)
+            attr->stack_size = r->stack_size;
+        if (r->flags & THREAD_ATTR_NAME)
+            strcpy(attr->name, r->name);
+        attr->flags |= r->flags;
+        found = true;
+    }
+    pthread_mutex_unlock(&g_rules_lock);
+
+    return found;
+}
@@ -0,0 +1,454 @@
+/*
+ * trace.c, per-thread trace rings
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+
+#include <trace.h>
+
+#include <sysdeps.h>
+
+#define TRACE_DEFAULT_EVENTS    4096
+#define TRACE_MIN_EVENTS        64
+#define TRACE_MAX_EVENTS        (1 << 20)
+#define TRACE_NAME_SIZE         16
+
+/* orders the stores of an event before its head, x86 doesn't reorder them */
+#if defined(__i386__) || defined(__x86_64__)
+#define write_barrier()     __asm__ __volatile__("" ::: "memory")
+#else
+#define write_barrier()     __sync_synchronize()
+#endif
+
+struct trace_event {
+    unsigned long long ts;
+    unsigned long long dur;             /* 'X' */
+    unsigned long long id;
+    const char *cat;
+    const char *name;
+    char scope[TRACE_SCOPE_SIZE];
+    unsigned int port;
+    char phase;
+};
+
+/*
+ * written by its thread only. a ring's never freed, a thread exiting
+ * leaves its events to the dumps until another thread takes the ring over
+ */
+struct trace_ring {
+    struct trace_ring *next;
+    volatile unsigned long long head;   /* events ever written */
+    volatile unsigned int generation;   /* bumped on take-over */
+    volatile int live;
+    int tid;
+    char name[TRACE_NAME_SIZE];
+    unsigned int mask;
+    struct trace_event events[1];
+};
+
+volatile int trace_enabled;
+
+static struct trace_ring *volatile g_rings;
+static pthread_mutex_t g_rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t g_ring_key;
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+static unsigned int g_nr_events = TRACE_DEFAULT_EVENTS;
+
+/* SIGUSR2 dumps */
+static pthread_mutex_t g_load_lock = PTHREAD_MUTEX_INITIALIZER;
+static char g_file[PATH_MAX] = "/tmp/omxil-trace";
+static unsigned int g_dump_seq;
+static sem_t g_dump_sem;
+static pthread_t g_dumper;
+static int g_dumper_running;
+static volatile int g_dumper_stop;
+static struct sigaction g_old_sigusr2;
+
+static void release_ring(void *arg)
+{
+    struct trace_ring *ring = (struct trace_ring *)arg;
+
+    ring->live = 0;
+}
+
+static void trace_setup(void)
+{
+    pthread_key_create(&g_ring_key, release_ring);
+}
+
+static struct trace_ring *acquire_ring(void)
+{
+    struct trace_ring *ring;
+    unsigned int nr_events = g_nr_events;
+
+    pthread_mutex_lock(&g_rings_lock);
+    for (ring = g_rings; ring; ring = ring->next) {
+        if (!ring->live && ring->mask == nr_events - 1)
+            break;
+    }
+
+    if (ring) {
+        ring->generation++;
+        __sync_synchronize();
+        ring->head = 0;
+    }
+    else {
+        ring = (struct trace_ring *)malloc(sizeof(*ring) +
+            sizeof(ring->events[0]) * (nr_events - 1));
+        if (!ring) {
+            pthread_mutex_unlock(&g_rings_lock);
+            return NULL;
+        }
+        ring->head = 0;
+        ring->generation = 0;
+        ring->mask = nr_events - 1;
+    }
+
+    ring->tid = (int)syscall(SYS_gettid);
+    memset(ring->name, 0, sizeof(ring->name));
+    prctl(PR_GET_NAME, (unsigned long)ring->name, 0, 0, 0);
+    ring->live = 1;
+
+    if (ring->generation == 0) {
+        /* the dump walks the list without the lock */
+        ring->next = g_rings;
+        __sync_synchronize();
+        g_rings = ring;
+    }
+    pthread_mutex_unlock(&g_rings_lock);
+
+    pthread_setspecific(g_ring_key, ring);
+    return ring;
+}
+
+static inline struct trace_ring *get_ring(void)
+{
+    struct trace_ring *ring;
+
+    /* g_ring_key's been created by trace_enable() */
+    ring = (struct trace_ring *)pthread_getspecific(g_ring_key);
+    if (__builtin_expect(ring != NULL, 1))
+        return ring;
+
+    return acquire_ring();
+}
+
+unsigned long long trace_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void record(char phase, const char *cat, const char *name,
+                   const char *scope, unsigned long long id,
+                   unsigned int port, unsigned long long ts,
+                   unsigned long long dur)
+{
+    struct trace_ring *ring = get_ring();
+    struct trace_event *e;
+    unsigned long long head;
+    size_t len;
+
+    if (!ring)
+        return;
+
+    head = ring->head;
+    e = &ring->events[head & ring->mask];
+
+    e->ts = ts;
+    e->dur = dur;
+    e->id = id;
+    e->cat = cat;
+    e->name = name;
+    e->port = port;
+    e->phase = phase;
+
+    /* the end of a component name tells it apart */
+    if (!scope)
+        scope = "";
+    len = strlen(scope);
+    if (len >= TRACE_SCOPE_SIZE) {
+        scope += len - (TRACE_SCOPE_SIZE - 1);
+        len = TRACE_SCOPE_SIZE - 1;
+    }
+    memcpy(e->scope, scope, len);
+    e->scope[len] = '\0';
+
+    write_barrier();
+    ring->head = head + 1;
+}
+
+void trace_instant(const char *cat, const char *name, const char *scope,
+                   unsigned long long id, unsigned int port)
+{
+    record('i', cat, name, scope, id, port, trace_now(), 0);
+}
+
+void trace_complete(const char *cat, const char *name, const char *scope,
+                    unsigned long long id, unsigned int port,
+                    unsigned long long start)
+{
+    unsigned long long now = trace_now();
+
+    record('X', cat, name, scope, id, port, start, now - start);
+}
+
+void trace_enable(int enable)
+{
+    pthread_once(&g_once, trace_setup);
+    trace_enabled = enable ? 1 : 0;
+}
+
+/*
+ * dump
+ */
+static void write_string(FILE *fp, const char *s)
+{
+    fputc('"', fp);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\' || (unsigned char)*s < 0x20)
+            fputc('_', fp);
+        else
+            fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+/* the live threads may have been renamed since */
+static void thread_name(const struct trace_ring *ring, char *name)
+{
+    char path[64];
+    FILE *fp;
+    size_t len;
+
+    memcpy(name, ring->name, TRACE_NAME_SIZE);
+    name[TRACE_NAME_SIZE - 1] = '\0';
+    if (!ring->live)
+        return;
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/comm", ring->tid);
+    fp = fopen(path, "r");
+    if (!fp)
+        return;
+    if (fgets(name, TRACE_NAME_SIZE, fp)) {
+        len = strcspn(name, "\n");
+        name[len] = '\0';
+    }
+    fclose(fp);
+}
+
+static void dump_ring(FILE *fp, struct trace_ring *ring,
+                      struct trace_event *copy, int pid, int *first)
+{
+    unsigned long long head, base, start, valid, i;
+    unsigned int size = ring->mask + 1, generation;
+    char name[TRACE_NAME_SIZE];
+    int tid;
+
+    generation = ring->generation;
+    __sync_synchronize();
+    tid = ring->tid;
+    thread_name(ring, name);
+    head = ring->head;
+    __sync_synchronize();
+
+    base = head > size ? head - size : 0;
+    for (i = base; i < head; i++)
+        copy[i - base] = ring->events[i & ring->mask];
+
+    /* drop the events the thread overwrote meanwhile, or all if taken over */
+    __sync_synchronize();
+    if (ring->generation != generation)
+        return;
+    valid = ring->head;
+    valid = valid >= size ? valid - size + 1 : 0;
+    start = valid > base ? valid : base;
+
+    fprintf(fp, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,"
+            "\"tid\":%d,\"args\":{\"name\":", *first ? "" : ",\n", pid, tid);
+    write_string(fp, name);
+    fprintf(fp, "}}");
+    *first = 0;
+
+    for (i = start; i < head; i++) {
+        const struct trace_event *e = &copy[i - base];
+
+        fprintf(fp, ",\n{\"ph\":\"%c\",\"cat\":\"%s\",\"name\":\"%s\","
+                "\"pid\":%d,\"tid\":%d,\"ts\":%llu.%03llu",
+                e->phase, e->cat, e->name, pid, tid,
+                e->ts / 1000, e->ts % 1000);
+        if (e->phase == 'X')
+            fprintf(fp, ",\"dur\":%llu.%03llu", e->dur / 1000, e->dur % 1000);
+        else
+            fprintf(fp, ",\"s\":\"t\"");
+
+        fprintf(fp, ",\"args\":{\"comp\":");
+        write_string(fp, e->scope);
+        fprintf(fp, ",\"id\":\"0x%llx\"", e->id);
+        if (e->port != TRACE_NO_PORT)
+            fprintf(fp, ",\"port\":%u", e->port);
+        fprintf(fp, "}}");
+    }
+}
+
+int trace_dump(const char *path)
+{
+    char file[PATH_MAX + 32];
+    struct trace_ring *ring;
+    struct trace_event *copy = NULL;
+    unsigned int copy_size = 0;
+    int first = 1, pid = (int)getpid(), ret = 0;
+    FILE *fp;
+
+    if (!path) {
+        pthread_mutex_lock(&g_load_lock);
+        snprintf(file, sizeof(file), "%s-%d-%u.json", g_file, pid,
+                 g_dump_seq++);
+        pthread_mutex_unlock(&g_load_lock);
+        path = file;
+    }
+
+    fp = fopen(path, "w");
+    if (!fp) {
+        omx_errorLog("trace: cannot open %s\n", path);
+        return -1;
+    }
+
+    fprintf(fp, "{\"traceEvents\":[\n");
+    for (ring = g_rings; ring; ring = ring->next) {
+        if (copy_size < ring->mask + 1) {
+            free(copy);
+            copy_size = ring->mask + 1;
+            copy = (struct trace_event *)malloc(sizeof(*copy) * copy_size);
+            if (!copy) {
+                ret = -1;
+                break;
+            }
+        }
+        dump_ring(fp, ring, copy, pid, &first);
+    }
+    fprintf(fp, "\n],\"displayTimeUnit\":\"ns\"}\n");
+    free(copy);
+
+    if (fclose(fp) || ret) {
+        omx_errorLog("trace: cannot write %s\n", path);
+        return -1;
+    }
+
+    omx_infoLog("trace: dumped to %s\n", path);
+    return 0;
+}
+
+/* a signal handler can't do much, a thread dumps for it */
+static void trace_signal(int sig)
+{
+    (void)sig;
+    sem_post(&g_dump_sem);
+}
+
+static void *trace_dumper(void *arg)
+{
+    (void)arg;
+
+    for (;;) {
+        while (sem_wait(&g_dump_sem) && errno == EINTR)
+            ;
+        if (g_dumper_stop)
+            break;
+        trace_dump(NULL);
+    }
+
+    return NULL;
+}
+
+void trace_load(void)
+{
+    struct sigaction sa;
+    const char *env;
+    unsigned int nr_events = TRACE_DEFAULT_EVENTS;
+    int enable;
+
+    pthread_mutex_lock(&g_load_lock);
+
+    env = getenv("OMXIL_TRACE_EVENTS");
+    if (env && atoi(env) > 0) {
+        unsigned int want = (unsigned int)atoi(env);
+
+        if (want > TRACE_MAX_EVENTS)
+            want = TRACE_MAX_EVENTS;
+        for (nr_events = TRACE_MIN_EVENTS; nr_events < want; nr_events <<= 1)
+            ;
+    }
+    g_nr_events = nr_events;
+
+    env = getenv("OMXIL_TRACE_FILE");
+    if (env && *env)
+        snprintf(g_file, sizeof(g_file), "%s", env);
+
+    env = getenv("OMXIL_TRACE");
+    enable = env && atoi(env);
+
+    /* SIGUSR2 belongs to the application unless it asks for tracing */
+    if (enable && !g_dumper_running) {
+        sem_init(&g_dump_sem, 0, 0);
+        g_dumper_stop = 0;
+        if (!pthread_create(&g_dumper, NULL, trace_dumper, NULL)) {
+            memset(&sa, 0, sizeof(sa));
+            sa.sa_handler = trace_signal;
+            sigemptyset(&sa.sa_mask);
+            sa.sa_flags = SA_RESTART;
+            sigaction(SIGUSR2, &sa, &g_old_sigusr2);
+            g_dumper_running = 1;
+        }
+        else {
+            sem_destroy(&g_dump_sem);
+            omx_errorLog("trace: cannot start dumper, no SIGUSR2 dumps\n");
+        }
+    }
+    pthread_mutex_unlock(&g_load_lock);
+
+    trace_enable(enable);
+}
+
+void trace_unload(void)
+{
+    trace_enable(0);
+
+    pthread_mutex_lock(&g_load_lock);
+    if (g_dumper_running) {
+        sigaction(SIGUSR2, &g_old_sigusr2, NULL);
+        g_dumper_stop = 1;
+        sem_post(&g_dump_sem);
+        pthread_join(g_dumper, NULL);
+        sem_destroy(&g_dump_sem);
+        g_dumper_running = 0;
+    }
+    pthread_mutex_unlock(&g_load_lock);
+}
@@ -0,0 +1,168 @@
+/*
+ * wakeup.c, spin-then-park wakeup of a single waiter
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include <wakeup.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#define cpu_relax()     __asm__ __volatile__("pause" ::: "memory")
+#else
+#define cpu_relax()     __sync_synchronize()
+#endif
+
+static unsigned int g_default_spin;
+static int g_spin_allowed;
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+
+static void wakeup_setup(void)
+{
+    const char *env = getenv("OMXIL_WAKEUP_SPIN_USEC");
+
+    /* nobody can make the condition true while we spin on a single cpu */
+    g_spin_allowed = sysconf(_SC_NPROCESSORS_ONLN) > 1;
+
+    if (env)
+        g_default_spin = strtoul(env, NULL, 0);
+}
+
+/* relative timeout, NULL forever */
+static void futex_wait(volatile int *addr, int val,
+                       const struct timespec *timeout)
+{
+    syscall(__NR_futex, addr, FUTEX_WAIT_PRIVATE, val, timeout, NULL, 0);
+}
+
+static void futex_wake(volatile int *addr)
+{
+    syscall(__NR_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+void wakeup_init(struct wakeup *w)
+{
+    pthread_once(&g_once, wakeup_setup);
+
+    w->seq = 0;
+    w->nr_parked = 0;
+    w->spin_usec = 0;
+    wakeup_set_spin(w, g_default_spin);
+}
+
+void wakeup_set_spin(struct wakeup *w, unsigned int usec)
+{
+    w->spin_usec = g_spin_allowed ? usec : 0;
+}
+
+static int wakeup_spin(struct wakeup *w, int (*ready)(void *arg), void *arg)
+{
+    struct timespec start, now;
+    unsigned long elapsed;
+    unsigned int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 1; ; i++) {
+        cpu_relax();
+        if (ready(arg))
+            return 1;
+
+        /* don't call clock_gettime() on every turn */
+        if (i & 63)
+            continue;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsed = (now.tv_sec - start.tv_sec) * 1000000UL +
+            (now.tv_nsec - start.tv_nsec) / 1000;
+        if (elapsed >= w->spin_usec)
+            return 0;
+    }
+}
+
+void wakeup_wait(struct wakeup *w, int (*ready)(void *arg), void *arg)
+{
+    wakeup_wait_until(w, ready, arg, 0);
+}
+
+/* time left until timeout, 0 if it's passed */
+static int wakeup_time_left(unsigned long long timeout, struct timespec *left)
+{
+    struct timespec now;
+    unsigned long long t;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    t = now.tv_sec * 1000000000ULL + now.tv_nsec;
+    if (t >= timeout)
+        return 0;
+
+    t = timeout - t;
+    left->tv_sec = t / 1000000000ULL;
+    left->tv_nsec = t % 1000000000ULL;
+    return 1;
+}
+
+int wakeup_wait_until(struct wakeup *w, int (*ready)(void *arg), void *arg,
+                      unsigned long long timeout)
+{
+    struct timespec left;
+    int seq;
+
+    if (ready(arg))
+        return 1;
+
+    if (w->spin_usec && wakeup_spin(w, ready, arg))
+        return 1;
+
+    for (;;) {
+        if (timeout && !wakeup_time_left(timeout, &left))
+            return 0;
+
+        /* pairs with the barrier in wakeup_signal() */
+        __sync_fetch_and_add(&w->nr_parked, 1);
+        seq = w->seq;
+        __sync_synchronize();
+
+        /* the waker didn't see us parked, it made the condition true */
+        if (ready(arg)) {
+            __sync_fetch_and_sub(&w->nr_parked, 1);
+            return 1;
+        }
+
+        /* returns at once if seq's already been bumped */
+        futex_wait(&w->seq, seq, timeout ? &left : NULL);
+        __sync_fetch_and_sub(&w->nr_parked, 1);
+
+        if (ready(arg))
+            return 1;
+    }
+}
+
+void wakeup_signal(struct wakeup *w)
+{
+    /* the condition is made true before nr_parked is tested */
+    __sync_synchronize();
+    if (!w->nr_parked)
+        return;
+
+    __sync_fetch_and_add(&w->seq, 1);
+    futex_wake(&w->seq);
+}
@@ -16,178 +16,569 @@
  * limitations under the License.
  */
 
+#include <time.h>
+
 #include <workqueue.h>
 
-WorkQueue::WorkQueue()
+void WorkQueue::__WorkQueue(Executor *executor)
 {
     stop = false;
     executing = true;
     wait_for_works = false;
     works = NULL;
+    works_tail = NULL;
+    timers = NULL;
+    timers_changed = false;
 
-    pthread_mutex_init(&wlock, NULL);
-    pthread_cond_init(&wcond, NULL);
+    lockstat_mutex_init(&wlock, "WorkQueue::wlock", NULL);
+    wakeup_init(&wakeup);
 
-    pthread_mutex_init(&executing_lock, NULL);
+    lockstat_mutex_init(&executing_lock, "WorkQueue::executing_lock", NULL);
     pthread_cond_init(&executing_wait, NULL);
     pthread_cond_init(&paused_wait, NULL);
+
+    this->executor = executor;
+    started = false;
+    queued = false;
+    running = false;
+    pthread_cond_init(&idle_wait, NULL);
+
+    priority = WORK_PRIORITY_NORMAL;
+    deadline = 0;
+    ready_next = NULL;
+    ready_priority = WORK_PRIORITY_NORMAL;
+    ready_deadline = 0;
+
+    timer_next = NULL;
+    timer_due = 0;
+    timer_firing = false;
+}
+
+WorkQueue::WorkQueue()
+{
+    __WorkQueue(NULL);
+}
+
+WorkQueue::WorkQueue(bool shared)
+{
+    __WorkQueue(shared ? Executor::Get() : NULL);
 }
 
 WorkQueue::~WorkQueue()
 {
     StopWork();
 
-    pthread_cond_destroy(&wcond);
-    pthread_mutex_destroy(&wlock);
+    if (executor)
+        Executor::Put(executor);
+    pthread_cond_destroy(&idle_wait);
+
+    lockstat_mutex_destroy(&wlock);
 
     pthread_cond_destroy(&paused_wait);
     pthread_cond_destroy(&executing_wait);
-    pthread_mutex_destroy(&executing_lock);
+    lockstat_mutex_destroy(&executing_lock);
 }
 
 int WorkQueue::StartWork(bool executing)
 {
+    if (executor) {
+        lockstat_mutex_lock(&wlock);
+        this->executing = executing;
+        started = true;
+        SignalWorks();
+        lockstat_mutex_unlock(&wlock);
+        return 0;
+    }
+
+    lockstat_mutex_lock(&wlock);
     this->executing = executing;
+    started = true;
+    /*
+     * Run() is not running or parked, so it's safe to clear stop flag of
+     * last StopWork
+     */
+    stop = false;
+    wakeup_signal(&wakeup); /* wakeup Run() if it's parked */
+    lockstat_mutex_unlock(&wlock);
 
+    /* no-op if the thread's been started before and not stopped */
     return Start();
 }
 
-void WorkQueue::StopWork(void)
+void WorkQueue::ParkWork(void)
 {
-    /* discard all scheduled works */
-    pthread_mutex_lock(&wlock);
+    /* discard all scheduled works and timers */
+    lockstat_mutex_lock(&wlock);
     while (works)
-        works = __list_delete(works, works);
-    pthread_mutex_unlock(&wlock);
+        PopWork();
+    while (timers)
+        DisarmTimer(timers);
+    started = false;
+
+    if (executor) {
+        lockstat_mutex_unlock(&wlock);
+        /* a worker in FireTimers() finds no timer, it needs wlock */
+        executor->WaitTimer(this);
+
+        lockstat_mutex_lock(&wlock);
+        if (queued && executor->Cancel(this))
+            queued = false;
+        /* wokeup by RunQueuedWorks() */
+        while (queued || running)
+            lockstat_cond_wait(&idle_wait, &wlock);
+        lockstat_mutex_unlock(&wlock);
+        return;
+    }
+    lockstat_mutex_unlock(&wlock);
 
-    /*  wakeup DoWork() if it's sleeping */
-    /*
-     * FIXME
-     *
-     * if DoWork() is sleeping, Work()'s called one more time at this moment.
-     * if DoWork()::wi->Work() called ScheduleWork() (self-rescheduling),
-     * this function would be sleeping forever at Join() because works list
-     * never be empty.
-     */
+    /* wakeup Run() if it's paused, it drops the work in hand */
     ResumeWork();
 
-    pthread_mutex_lock(&wlock);
+    lockstat_mutex_lock(&wlock);
+    /* wokeup by Run() */
+    while (running)
+        lockstat_cond_wait(&idle_wait, &wlock);
+    lockstat_mutex_unlock(&wlock);
+}
+
+void WorkQueue::StopWork(void)
+{
+    ParkWork();
+    if (executor)
+        return;
+
+    lockstat_mutex_lock(&wlock);
     stop = true;
-    pthread_cond_signal(&wcond); /* wakeup Run() if it's sleeping */
-    pthread_mutex_unlock(&wlock);
+    wakeup_signal(&wakeup); /* wakeup Run() if it's sleeping */
+    lockstat_mutex_unlock(&wlock);
 
     Join();
 }
 
-/* it returns when Run() is sleeping at executing_wait or at wcond */
+/* it returns when Run() is sleeping at executing_wait or at wakeup */
 void WorkQueue::PauseWork(void)
 {
-    pthread_mutex_lock(&executing_lock);
+    if (executor) {
+        lockstat_mutex_lock(&wlock);
+        executing = false;
+        /* wokeup by RunQueuedWorks() */
+        while (running)
+            lockstat_cond_wait(&idle_wait, &wlock);
+        lockstat_mutex_unlock(&wlock);
+        return;
+    }
+
+    lockstat_mutex_lock(&executing_lock);
     executing = false;
-    /* this prevents deadlock if Run() is sleeping with locking wcond */
-    if (!wait_for_works)
-        pthread_cond_wait(&paused_wait, &executing_lock); /* wokeup by Run() */
-    pthread_mutex_unlock(&executing_lock);
+    /* this prevents deadlock if Run() is sleeping for works */
+    if (!wait_for_works) /* wokeup by Run() */
+        lockstat_cond_wait(&paused_wait, &executing_lock);
+    lockstat_mutex_unlock(&executing_lock);
 }
 
 void WorkQueue::ResumeWork(void)
 {
-    pthread_mutex_lock(&executing_lock);
+    if (executor) {
+        lockstat_mutex_lock(&wlock);
+        executing = true;
+        SignalWorks();
+        lockstat_mutex_unlock(&wlock);
+        return;
+    }
+
+    lockstat_mutex_lock(&executing_lock);
     executing = true;
     pthread_cond_signal(&executing_wait);
-    pthread_mutex_unlock(&executing_lock);
+    lockstat_mutex_unlock(&executing_lock);
 }
 
 void WorkQueue::Run(void)
 {
     while (!stop) {
-        pthread_mutex_lock(&wlock);
+        unsigned long long due = 0;
+
+        lockstat_mutex_lock(&wlock);
+
+        timers_changed = false;
+        if (timers)
+            due = ExpireTimers(Now());
 
-        if (!works) {
-            pthread_mutex_lock(&executing_lock);
+        if (!works || !started) {
+            lockstat_mutex_lock(&executing_lock);
             wait_for_works = true;
             /* wake up PauseWork() if it's sleeping */
             pthread_cond_signal(&paused_wait);
-            pthread_mutex_unlock(&executing_lock);
+            lockstat_mutex_unlock(&executing_lock);
+            lockstat_mutex_unlock(&wlock);
 
             /*
-             * sleeps until works're available.
-             * wokeup by ScheduleWork() or FlushWork() or ~WorkQueue()
+             * spins, then sleeps until works're available and started or
+             * the first timer's due. wokeup by ScheduleWork() or
+             * FlushWork() or StartWork() or StopWork() or a new first timer
              */
-            pthread_cond_wait(&wcond, &wlock);
+            wakeup_wait_until(&wakeup, IsWakeupReady, this, due);
 
-            pthread_mutex_lock(&executing_lock);
+            lockstat_mutex_lock(&executing_lock);
             wait_for_works = false;
-            pthread_mutex_unlock(&executing_lock);
+            lockstat_mutex_unlock(&executing_lock);
+
+            lockstat_mutex_lock(&wlock);
         }
 
-        while (works) {
-            struct list *entry = works;
-            WorkableInterface *wi =
-                static_cast<WorkableInterface *>(entry->data);
+        running = true;
+        while (works && started) {
+            WorkableInterface *wi = PopWork();
 
-            works = __list_delete(works, entry);
-            pthread_mutex_unlock(&wlock);
+            lockstat_mutex_unlock(&wlock);
 
             /*
-             * 1. if PauseWork() locks executing_lock right before Run() locks
-             *    the lock, Run() sends the paused signal and go to sleep.
-             * 2. if Run() locks executing_lock first, DoWork() is called and
-             *    PausedWork() waits for paused_wait signal. Run() sends the
-             *    signal during next loop processing or at the end of loop
-             *    in case of works're not available.
+             * 1. if PauseWork() cleared executing before Run() reads it,
+             *    Run() sends the paused signal and go to sleep.
+             * 2. if Run() reads it first, DoWork() is called and PausedWork()
+             *    waits for paused_wait signal. Run() sends the signal during
+             *    next loop processing or at the end of loop in case of works
+             *    're not available.
+             * executing_lock is taken only to pause, not per work.
              */
-            pthread_mutex_lock(&executing_lock);
             if (!executing) {
-                pthread_cond_signal(&paused_wait);
-                pthread_cond_wait(&executing_wait, &executing_lock);
+                lockstat_mutex_lock(&executing_lock);
+                if (!executing) {
+                    pthread_cond_signal(&paused_wait);
+                    lockstat_cond_wait(&executing_wait, &executing_lock);
+                }
+                lockstat_mutex_unlock(&executing_lock);
             }
-            pthread_mutex_unlock(&executing_lock);
 
-            DoWork(wi);
+            /* parked while paused, the works've been discarded */
+            if (started)
+                DoWork(wi);
 
-            pthread_mutex_lock(&wlock);
+            lockstat_mutex_lock(&wlock);
+            /* a busy queue doesn't delay its timers */
+            if (timers)
+                ExpireTimers(Now());
         }
+        running = false;
+        /* wakeup ParkWork() if it's sleeping */
+        pthread_cond_broadcast(&idle_wait);
 
-        pthread_mutex_unlock(&wlock);
+        lockstat_mutex_unlock(&wlock);
     }
 }
 
+int WorkQueue::IsWakeupReady(void *arg)
+{
+    WorkQueue *wq = static_cast<WorkQueue *>(arg);
+
+    /* a hint, Run() takes wlock to pop works */
+    return (*(WorkableInterface * volatile *)&wq->works && wq->started) ||
+        wq->timers_changed || *(volatile int *)&wq->stop;
+}
+
+void WorkQueue::SetWakeupSpin(unsigned int usec)
+{
+    wakeup_set_spin(&wakeup, usec);
+}
+
 void WorkQueue::DoWork(WorkableInterface *wi)
 {
     if (wi)
         wi->Work();
 }
 
+void WorkQueue::SignalWorks(void)
+{
+    if (!executor) {
+        wakeup_signal(&wakeup); /* wakeup Run() if it's sleeping */
+        return;
+    }
+
+    if (started && executing && works && !queued && !running) {
+        queued = true;
+        executor->Submit(this);
+    }
+}
+
+/*
+ * runs a limited number of works so that a busy WorkQueue does not hold
+ * an executor thread forever, then resubmits itself if works remain.
+ */
+void WorkQueue::RunQueuedWorks(void)
+{
+    int budget = 16;
+
+    lockstat_mutex_lock(&wlock);
+    queued = false;
+    running = true;
+
+    while (works && started && executing && budget--) {
+        WorkableInterface *wi = PopWork();
+
+        lockstat_mutex_unlock(&wlock);
+
+        DoWork(wi);
+
+        lockstat_mutex_lock(&wlock);
+        /*
+         * a busy queue doesn't delay its timers. the executor's copy of
+         * the first due may be stale, FireTimers() fixes it up
+         */
+        if (timers)
+            ExpireTimers(Now());
+    }
+
+    running = false;
+    /* wakeup StopWork() or PauseWork() if it's sleeping */
+    pthread_cond_broadcast(&idle_wait);
+    SignalWorks();
+    lockstat_mutex_unlock(&wlock);
+}
+
 void WorkQueue::Work(void)
 {
     return;
 }
 
+void WorkQueue::PushWork(WorkableInterface *wi)
+{
+    if (wi->work_pending)
+        return;
+
+    wi->work_pending = true;
+    wi->work_next = NULL;
+    if (works_tail)
+        works_tail->work_next = wi;
+    else
+        works = wi;
+    works_tail = wi;
+}
+
+/* the work can be scheduled again as soon as it's popped */
+WorkableInterface *WorkQueue::PopWork(void)
+{
+    WorkableInterface *wi = works;
+
+    if (!wi)
+        return NULL;
+
+    works = wi->work_next;
+    if (!works) {
+        works_tail = NULL;
+        deadline = 0;
+    }
+    wi->work_next = NULL;
+    wi->work_pending = false;
+
+    return wi;
+}
+
 void WorkQueue::ScheduleWork(void)
 {
-    pthread_mutex_lock(&wlock);
-    works = list_add_tail(works, static_cast<WorkableInterface *>(this));
-    pthread_cond_signal(&wcond); /* wakeup Run() if it's sleeping */
-    pthread_mutex_unlock(&wlock);
+    lockstat_mutex_lock(&wlock);
+    PushWork(this);
+    SignalWorks();
+    lockstat_mutex_unlock(&wlock);
 }
 
 void WorkQueue::ScheduleWork(WorkableInterface *wi)
 {
-    pthread_mutex_lock(&wlock);
-    if (wi)
-        works = list_add_tail(works, wi);
-    else
-        works = list_add_tail(works, static_cast<WorkableInterface *>(this));
-    pthread_cond_signal(&wcond); /* wakeup Run() if it's sleeping */
-    pthread_mutex_unlock(&wlock);
+    ScheduleWork(wi, 0);
+}
+
+void WorkQueue::ScheduleWork(WorkableInterface *wi,
+                             unsigned long long deadline)
+{
+    lockstat_mutex_lock(&wlock);
+    QueueWork(wi ? wi : this, deadline);
+    SignalWorks();
+    lockstat_mutex_unlock(&wlock);
+}
+
+void WorkQueue::QueueWork(WorkableInterface *wi, unsigned long long deadline)
+{
+    PushWork(wi);
+
+    if (deadline && (!this->deadline || deadline < this->deadline)) {
+        this->deadline = deadline;
+        /* move ahead in the executor's ready queue */
+        if (executor && queued)
+            executor->Reorder(this);
+    }
+}
+
+unsigned long long WorkQueue::Now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void WorkQueue::ScheduleDelayedWork(WorkableInterface *wi,
+                                    unsigned long long delay)
+{
+    unsigned long long first;
+
+    lockstat_mutex_lock(&wlock);
+    first = timers ? timers->timer_due : 0;
+    ArmTimer(wi ? wi : this, Now() + delay, 0);
+    if (timers->timer_due != first)
+        TimersChanged();
+    lockstat_mutex_unlock(&wlock);
+}
+
+void WorkQueue::SchedulePeriodicWork(WorkableInterface *wi,
+                                     unsigned long long period)
+{
+    unsigned long long first;
+
+    if (!period)
+        return;
+
+    lockstat_mutex_lock(&wlock);
+    first = timers ? timers->timer_due : 0;
+    ArmTimer(wi ? wi : this, Now() + period, period);
+    if (timers->timer_due != first)
+        TimersChanged();
+    lockstat_mutex_unlock(&wlock);
+}
+
+void WorkQueue::CancelDelayedWork(WorkableInterface *wi)
+{
+    WorkableInterface *first;
+
+    lockstat_mutex_lock(&wlock);
+    first = timers;
+    if (DisarmTimer(wi ? wi : this) && first != timers)
+        TimersChanged();
+    lockstat_mutex_unlock(&wlock);
+}
+
+/* behind the ones of the same due */
+void WorkQueue::ArmTimer(WorkableInterface *wi, unsigned long long due,
+                         unsigned long long period)
+{
+    WorkableInterface **pos;
+
+    DisarmTimer(wi);
+
+    wi->timer_due = due;
+    wi->timer_period = period;
+    wi->timer_armed = true;
+
+    for (pos = &timers; *pos; pos = &(*pos)->timer_next) {
+        if (due < (*pos)->timer_due)
+            break;
+    }
+    wi->timer_next = *pos;
+    *pos = wi;
+}
+
+bool WorkQueue::DisarmTimer(WorkableInterface *wi)
+{
+    WorkableInterface **pos;
+
+    if (!wi->timer_armed)
+        return false;
+
+    for (pos = &timers; *pos; pos = &(*pos)->timer_next) {
+        if (*pos == wi) {
+            *pos = wi->timer_next;
+            break;
+        }
+    }
+    wi->timer_next = NULL;
+    wi->timer_armed = false;
+
+    return true;
+}
+
+void WorkQueue::TimersChanged(void)
+{
+    if (executor) {
+        executor->SetTimer(this, timers ? timers->timer_due : 0);
+        return;
+    }
+
+    /* Run() goes round and sleeps until the new first due */
+    timers_changed = true;
+    wakeup_signal(&wakeup);
+}
+
+unsigned long long WorkQueue::ExpireTimers(unsigned long long now)
+{
+    WorkableInterface *wi;
+    unsigned long long due, period;
+
+    while ((wi = timers) && wi->timer_due <= now) {
+        due = wi->timer_due;
+        period = wi->timer_period;
+
+        DisarmTimer(wi);
+        /* next multiple of the period after now */
+        if (period)
+            ArmTimer(wi, due + ((now - due) / period + 1) * period, period);
+
+        QueueWork(wi, due);
+    }
+
+    return timers ? timers->timer_due : 0;
+}
+
+void WorkQueue::FireTimers(void)
+{
+    unsigned long long due;
+
+    lockstat_mutex_lock(&wlock);
+    due = ExpireTimers(Now());
+    SignalWorks();
+    /* dequeued from the executor's timer queue, requeue for the rest */
+    executor->SetTimer(this, due);
+    lockstat_mutex_unlock(&wlock);
+}
+
+bool WorkQueue::HasOwnThread(void)
+{
+    return !executor;
+}
+
+void WorkQueue::SetPriority(work_priority_t priority)
+{
+    lockstat_mutex_lock(&wlock);
+    this->priority = priority;
+    lockstat_mutex_unlock(&wlock);
+}
+
+work_priority_t WorkQueue::GetPriority(void)
+{
+    return priority;
 }
 
 void WorkQueue::CancelScheduledWork(WorkableInterface *wi)
 {
-    pthread_mutex_lock(&wlock);
-    works = list_delete_all(works, wi);
-    pthread_mutex_unlock(&wlock);
+    WorkableInterface *prev = NULL, *cur;
+
+    lockstat_mutex_lock(&wlock);
+    if (wi && wi->work_pending) {
+        for (cur = works; cur && cur != wi; cur = cur->work_next)
+            prev = cur;
+
+        if (cur) {
+            if (prev)
+                prev->work_next = cur->work_next;
+            else
+                works = cur->work_next;
+            if (works_tail == cur)
+                works_tail = prev;
+            cur->work_next = NULL;
+            cur->work_pending = false;
+
+            /* as PopWork(), the next work sets its own deadline */
+            if (!works)
+                deadline = 0;
+        }
+    }
+    lockstat_mutex_unlock(&wlock);
 }
 
 void WorkQueue::FlushWork(void)
@@ -195,14 +586,14 @@ void WorkQueue::FlushWork(void)
     FlushBarrier fb;
     bool needtowait = false;
 
-    pthread_mutex_lock(&wlock);
+    lockstat_mutex_lock(&wlock);
     if (works) {
-        list_add_tail(works, &fb);
-        pthread_cond_signal(&wcond); /* wakeup Run() if it's sleeping */
+        PushWork(&fb);
+        SignalWorks();
 
         needtowait = true;
     }
-    pthread_mutex_unlock(&wlock);
+    lockstat_mutex_unlock(&wlock);
 
     if (needtowait)
         fb.WaitCompletion(); /* wokeup by FlushWork::Work() */
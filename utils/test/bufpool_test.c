@@ -0,0 +1,126 @@
+/*
+ * bufpool_test.c, unit test of the payload pool
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <bufpool.h>
+
+#include "check.h"
+
+static int is_zero(const unsigned char *p, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        if (p[i])
+            return 0;
+    }
+    return 1;
+}
+
+static void test_size_classes(void)
+{
+    size_t page = sysconf(_SC_PAGESIZE), size;
+    void *p;
+
+    bufpool_trim();
+
+    size = 0;
+    p = bufpool_alloc(&size);
+    CHECK(p);
+    CHECK(size == BUFPOOL_ALIGN);
+    bufpool_free(p, size);
+
+    /* small ones by BUFPOOL_ALIGN */
+    size = 100;
+    p = bufpool_alloc(&size);
+    CHECK(p);
+    CHECK(size == 128);
+    CHECK(!((uintptr_t)p & (BUFPOOL_ALIGN - 1)));
+    bufpool_free(p, size);
+
+    /* larger than a page by pages */
+    size = page + 1;
+    p = bufpool_alloc(&size);
+    CHECK(p);
+    CHECK(size == 2 * page);
+    CHECK(!((uintptr_t)p & (page - 1)));
+    bufpool_free(p, size);
+
+    bufpool_trim();
+}
+
+static void test_reuse(void)
+{
+    size_t big = 3 << 20, size;
+    void *p, *q;
+
+    p = bufpool_alloc(&big);
+    CHECK(p);
+    memset(p, 0xa5, big);
+    bufpool_free(p, big);
+
+    /* more than half of it, the cached one with its usable size */
+    size = 2 << 20;
+    q = bufpool_alloc(&size);
+    CHECK(q == p);
+    CHECK(size == big);
+    /* what the last owner wrote's shown unless asked otherwise */
+    if (getenv("OMXIL_BUFFER_POOL_ZERO") &&
+        atoi(getenv("OMXIL_BUFFER_POOL_ZERO")))
+        CHECK(is_zero(q, size));
+    else
+        CHECK(((unsigned char *)q)[0] == 0xa5 &&
+              ((unsigned char *)q)[big - 1] == 0xa5);
+    bufpool_free(q, size);
+
+    /* less than half of it would waste it */
+    size = 1 << 20;
+    q = bufpool_alloc(&size);
+    CHECK(q && q != p);
+    CHECK(size == 1 << 20);
+    bufpool_free(q, size);
+
+    /* best fit of the two cached ones */
+    size = 1 << 20;
+    q = bufpool_alloc(&size);
+    CHECK(q != p);
+    CHECK(size == 1 << 20);
+    bufpool_free(q, size);
+
+    bufpool_trim();
+    bufpool_free(NULL, 0);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+
+    test_size_classes();
+    test_reuse();
+
+    /* again with zero-filled reuse, read when the pool's set up */
+    if (!getenv("OMXIL_BUFFER_POOL_ZERO")) {
+        setenv("OMXIL_BUFFER_POOL_ZERO", "1", 1);
+        execv("/proc/self/exe", argv);
+        return 1;
+    }
+    return 0;
+}
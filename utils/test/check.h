@@ -0,0 +1,34 @@
+/*
+ * check.h, assertions of the utils unit tests
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CHECK_H
+#define __CHECK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* not assert(), checked with NDEBUG too */
+#define CHECK(cond) do {                                                \
+    if (!(cond)) {                                                      \
+        fprintf(stderr, "%s:%d: %s: check failed: %s\n", __FILE__,      \
+                __LINE__, __func__, #cond);                             \
+        exit(1);                                                        \
+    }                                                                   \
+} while (0)
+
+#endif /* __CHECK_H */
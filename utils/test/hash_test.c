@@ -0,0 +1,96 @@
+/*
+ * hash_test.c, unit test of the string hash
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <hash.h>
+
+#include "check.h"
+
+#define NR_KEYS 200
+
+static char g_keys[NR_KEYS][16];
+
+/* the 8 initial buckets're shared by many keys, and grow under them */
+static void test_collisions(void)
+{
+    struct hash *hash;
+    unsigned int i;
+
+    hash = hash_alloc(1);
+    CHECK(hash);
+    CHECK(hash->nr_buckets == 8);
+
+    for (i = 0; i < NR_KEYS; i++) {
+        snprintf(g_keys[i], sizeof(g_keys[i]), "key%u", i);
+        CHECK(hash_insert(hash, g_keys[i], (void *)(uintptr_t)(i + 1)));
+    }
+    CHECK(hash->nr_entries == NR_KEYS);
+    CHECK(hash->nr_buckets >= NR_KEYS);
+
+    for (i = 0; i < NR_KEYS; i++)
+        CHECK(hash_lookup(hash, g_keys[i]) == (void *)(uintptr_t)(i + 1));
+
+    /* compared by value, not by pointer */
+    CHECK(hash_lookup(hash, "key7") == (void *)8);
+    CHECK(!hash_lookup(hash, "key"));
+    CHECK(!hash_lookup(hash, "key200"));
+    CHECK(!hash_find(hash, NULL));
+    CHECK(!hash_find(NULL, "key0"));
+
+    hash_free_all(hash);
+}
+
+/* the same key again shadows the older entry, across growing too */
+static void test_duplicates(void)
+{
+    struct hash *hash;
+    struct hash_entry *first, *last;
+    unsigned int i;
+
+    hash = hash_alloc(2);
+    CHECK(hash);
+
+    first = hash_insert(hash, "dup", (void *)1);
+    CHECK(first);
+    last = hash_insert(hash, "dup", (void *)2);
+    CHECK(last && last != first);
+    CHECK(hash_find(hash, "dup") == last);
+
+    for (i = 0; i < NR_KEYS; i++) {
+        snprintf(g_keys[i], sizeof(g_keys[i]), "other%u", i);
+        CHECK(hash_insert(hash, g_keys[i], NULL));
+    }
+    CHECK(hash_find(hash, "dup") == last);
+    CHECK(hash_lookup(hash, "dup") == (void *)2);
+
+    /* freed with the table, keys and data aren't the hash's */
+    hash_free_all(hash);
+    hash_free_all(NULL);
+}
+
+int main(void)
+{
+    CHECK(hash_string("") == 2166136261U);
+    CHECK(hash_string("a") != hash_string("b"));
+
+    test_collisions();
+    test_duplicates();
+    return 0;
+}
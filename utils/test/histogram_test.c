@@ -0,0 +1,101 @@
+/*
+ * histogram_test.c, unit test of the log-linear histogram
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <histogram.h>
+
+#include "check.h"
+
+static void test_buckets(void)
+{
+    unsigned int i;
+
+    /* one bucket per value below HISTOGRAM_SUB_BUCKETS */
+    for (i = 0; i < HISTOGRAM_SUB_BUCKETS; i++) {
+        CHECK(histogram_index(i) == i);
+        CHECK(histogram_lowest(i) == i);
+        CHECK(histogram_highest(i) == i);
+    }
+
+    /* the buckets tile the values without gaps */
+    for (i = 0; i < HISTOGRAM_NR_BUCKETS - 1; i++) {
+        CHECK(histogram_index(histogram_lowest(i)) == i);
+        CHECK(histogram_index(histogram_highest(i)) == i);
+        CHECK(histogram_highest(i) + 1 == histogram_lowest(i + 1));
+    }
+
+    /* the last one's open ended, from 2^HISTOGRAM_MAX_BITS on too */
+    CHECK(histogram_lowest(HISTOGRAM_NR_BUCKETS - 1) <
+          1ULL << HISTOGRAM_MAX_BITS);
+    CHECK(histogram_index((1ULL << HISTOGRAM_MAX_BITS) - 1) ==
+          HISTOGRAM_NR_BUCKETS - 1);
+    CHECK(histogram_index(1ULL << HISTOGRAM_MAX_BITS) ==
+          HISTOGRAM_NR_BUCKETS - 1);
+    CHECK(histogram_index(~0ULL) == HISTOGRAM_NR_BUCKETS - 1);
+    CHECK(histogram_highest(HISTOGRAM_NR_BUCKETS - 1) == ~0ULL);
+
+    /* at most 1/16 of the value wide */
+    for (i = HISTOGRAM_SUB_BUCKETS; i < HISTOGRAM_NR_BUCKETS - 1; i++)
+        CHECK((histogram_highest(i) - histogram_lowest(i) + 1) *
+              HISTOGRAM_SUB_BUCKETS <= histogram_lowest(i));
+}
+
+static void test_percentiles(void)
+{
+    struct histogram h;
+    unsigned long long p;
+    unsigned int i;
+
+    histogram_reset(&h);
+    CHECK(histogram_count(&h) == 0);
+    CHECK(h.min == ~0ULL && h.max == 0);
+    CHECK(histogram_percentile(&h, 500) == 0);
+
+    /* a single value, clamped to max */
+    histogram_record(&h, 1000);
+    CHECK(histogram_percentile(&h, 0) == 1000);
+    CHECK(histogram_percentile(&h, 500) == 1000);
+    CHECK(histogram_percentile(&h, 1000) == 1000);
+
+    histogram_reset(&h);
+    for (i = 1; i <= 1000; i++)
+        histogram_record(&h, i);
+    CHECK(histogram_count(&h) == 1000);
+    CHECK(h.sum == 500500);
+    CHECK(h.min == 1 && h.max == 1000);
+
+    /* the first value even for 0 */
+    CHECK(histogram_percentile(&h, 0) == 1);
+    CHECK(histogram_percentile(&h, 1) == 1);
+
+    p = histogram_percentile(&h, 500);
+    CHECK(p >= 500 && p == histogram_highest(histogram_index(500)));
+    p = histogram_percentile(&h, 990);
+    CHECK(p >= 990 && p <= 1000);
+    CHECK(histogram_percentile(&h, 1000) == 1000);
+
+    /* the last bucket's reported as max */
+    histogram_record(&h, 1ULL << 50);
+    CHECK(histogram_percentile(&h, 1000) == 1ULL << 50);
+}
+
+int main(void)
+{
+    test_buckets();
+    test_percentiles();
+    return 0;
+}
@@ -0,0 +1,212 @@
+/*
+ * log_test.c, unit test of the log backend
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <log.h>
+
+#include "check.h"
+
+#define PREFIX_INFO     "omxil-core info: "
+#define PREFIX_ERROR    "omxil-core error: "
+
+static char g_out[64 * 1024];
+static int g_saved_fd = -1;
+static FILE *g_file;
+
+/* stderr into g_out, the records're written by the caller (OMXIL_LOG_SYNC) */
+static void capture_begin(void)
+{
+    fflush(stderr);
+    g_file = tmpfile();
+    CHECK(g_file);
+    g_saved_fd = dup(STDERR_FILENO);
+    CHECK(g_saved_fd >= 0);
+    CHECK(dup2(fileno(g_file), STDERR_FILENO) == STDERR_FILENO);
+}
+
+static const char *capture_end(void)
+{
+    size_t len;
+
+    omx_log_flush();
+    CHECK(dup2(g_saved_fd, STDERR_FILENO) == STDERR_FILENO);
+    close(g_saved_fd);
+
+    rewind(g_file);
+    len = fread(g_out, 1, sizeof(g_out) - 1, g_file);
+    g_out[len] = '\0';
+    fclose(g_file);
+
+    return g_out;
+}
+
+static unsigned int count_lines(const char *out, const char *line)
+{
+    unsigned int n = 0;
+    size_t len = strlen(line);
+
+    while ((out = strstr(out, line))) {
+        n++;
+        out += len;
+    }
+    return n;
+}
+
+/* the rate's counted per second of CLOCK_MONOTONIC_COARSE */
+static void wait_next_second(void)
+{
+    struct timespec start, now;
+
+#ifdef CLOCK_MONOTONIC_COARSE
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &start);
+    do {
+        usleep(1000);
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    } while (now.tv_sec == start.tv_sec);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        usleep(1000);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while (now.tv_sec == start.tv_sec);
+#endif
+}
+
+static void test_format(void)
+{
+    char expected[1024], line[512], *str;
+    /* not seen as NULL by the compiler's format checks */
+    char *volatile none = NULL;
+    const char *out;
+    void *ptr = &expected;
+
+    capture_begin();
+    omx_log(OMX_LOG_INFO, "%d %u %ld %lld %hd %hhu %zu %x %lX %o %c|%-4d|%*d|"
+            "%.*s|%5.2f %e %p %%", -1, 4000000000U, -2L, 1LL << 40,
+            (short)70000, (unsigned char)300, (size_t)12, 0xbeef, 0xcafeUL,
+            8, 'z', 7, 5, 42, 3, "abcdef", 3.14159, 1e-9, ptr);
+    omx_log(OMX_LOG_INFO, "null %s", none);
+    out = capture_end();
+
+    snprintf(line, sizeof(line), "%d %u %ld %lld %hd %hhu %zu %x %lX %o %c|"
+             "%-4d|%*d|%.*s|%5.2f %e %p %%", -1, 4000000000U, -2L, 1LL << 40,
+             (short)70000, (unsigned char)300, (size_t)12, 0xbeef, 0xcafeUL,
+             8, 'z', 7, 5, 42, 3, "abcdef", 3.14159, 1e-9, ptr);
+    snprintf(expected, sizeof(expected), PREFIX_INFO "%s\n"
+             PREFIX_INFO "null (null)\n", line);
+    CHECK(!strcmp(out, expected));
+
+    /* the strings're copied, cut to what the record holds */
+    str = malloc(1000);
+    CHECK(str);
+    memset(str, 'x', 999);
+    str[999] = '\0';
+    capture_begin();
+    omx_log(OMX_LOG_INFO, "long %s", str);
+    memset(str, 'y', 999);
+    out = capture_end();
+    free(str);
+
+    CHECK(!strncmp(out, PREFIX_INFO "long xxx", strlen(PREFIX_INFO) + 8));
+    CHECK(!strchr(out, 'y'));
+    CHECK(strlen(out) < 400);
+    CHECK(!strcmp(out + strlen(out) - 4, "...\n"));
+}
+
+static void test_level(void)
+{
+    const char *out;
+
+    omx_log_set_level(OMX_LOG_INFO);
+    capture_begin();
+    omx_log(OMX_LOG_DEBUG, "debug hidden");
+    omx_log(OMX_LOG_WARN, "warn shown");
+    out = capture_end();
+    CHECK(!strstr(out, "hidden"));
+    CHECK(strstr(out, "warn shown"));
+
+    omx_log_set_level(OMX_LOG_VERBOSE + 1);
+    CHECK(omx_log_level == OMX_LOG_VERBOSE);
+    omx_log_set_level(-1);
+    CHECK(omx_log_level == OMX_LOG_ERROR);
+    omx_log_set_level(OMX_LOG_INFO);
+}
+
+static void test_rate(void)
+{
+    char *format;
+    const char *out;
+    unsigned int i;
+
+    /* freed and reused before the suppressed ones're reported */
+    format = strdup("rated %u\nsecond line");
+    CHECK(format);
+
+    wait_next_second();
+    capture_begin();
+    for (i = 0; i < 50; i++) {
+        omx_log(OMX_LOG_INFO, format, i);
+        omx_log(OMX_LOG_ERROR, "error %u", i);
+    }
+    out = capture_end();
+
+    CHECK(count_lines(out, PREFIX_INFO "rated ") == 20);
+    CHECK(strstr(out, PREFIX_INFO "rated 19\n"));
+    CHECK(!strstr(out, "rated 20\n"));
+    /* errors aren't limited */
+    CHECK(count_lines(out, PREFIX_ERROR "error ") == 50);
+    CHECK(strstr(out, PREFIX_ERROR "error 49\n"));
+
+    strcpy(format, "XXXXX %u");
+    wait_next_second();
+    capture_begin();
+    omx_log(OMX_LOG_INFO, format, 0U);
+    out = capture_end();
+
+    /* the format as it was, on one line */
+    CHECK(strstr(out, PREFIX_INFO "30 similar messages suppressed: "
+                 "rated %u\n"));
+    CHECK(strstr(out, PREFIX_INFO "XXXXX 0\n"));
+    free(format);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+
+    /* read when the library's loaded */
+    if (!getenv("OMXIL_LOG_SYNC")) {
+        setenv("OMXIL_LOG_SYNC", "1", 1);
+        setenv("OMXIL_LOG_RATE", "20", 1);
+        unsetenv("OMXIL_LOG_LEVEL");
+        execv("/proc/self/exe", argv);
+        return 1;
+    }
+
+    omx_log_set_level(OMX_LOG_INFO);
+
+    test_format();
+    test_level();
+    test_rate();
+    return 0;
+}
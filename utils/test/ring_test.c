@@ -0,0 +1,135 @@
+/*
+ * ring_test.c, unit test of the bounded lock-free ring
+ *
+ * Copyright (c) 2009-2010 Wind River Systems, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include <ring.h>
+
+#include "check.h"
+
+#define ITEM(n) ((void *)(uintptr_t)((n) + 1))
+
+static void test_full_empty(void)
+{
+    struct ring ring;
+    unsigned int i;
+
+    __ring_init(&ring);
+    CHECK(ring_push(&ring, ITEM(0)) == -1);
+    CHECK(ring_pop(&ring) == NULL);
+
+    /* rounded up to a power of two */
+    CHECK(!ring_init(&ring, 5));
+    CHECK(ring_capacity(&ring) == 8);
+    CHECK(ring_length(&ring) == 0);
+    CHECK(ring_pop(&ring) == NULL);
+
+    for (i = 0; i < 8; i++)
+        CHECK(!ring_push(&ring, ITEM(i)));
+    CHECK(ring_length(&ring) == 8);
+    CHECK(ring_push(&ring, ITEM(8)) == -1);
+    CHECK(ring_length(&ring) == 8);
+
+    for (i = 0; i < 8; i++)
+        CHECK(ring_pop(&ring) == ITEM(i));
+    CHECK(ring_length(&ring) == 0);
+    CHECK(ring_pop(&ring) == NULL);
+
+    ring_free(&ring);
+    CHECK(ring_pop(&ring) == NULL);
+}
+
+/* the positions go round the cells many times, order's kept */
+static void test_wraparound(void)
+{
+    struct ring ring;
+    unsigned int pushed = 0, popped = 0, round, i;
+
+    __ring_init(&ring);
+    CHECK(!ring_init(&ring, 4));
+
+    for (round = 0; round < 1000; round++) {
+        for (i = 0; i < 1 + round % 3; i++)
+            CHECK(!ring_push(&ring, ITEM(pushed++)));
+        CHECK(ring_length(&ring) == (int)(pushed - popped));
+
+        for (i = 0; i < 1 + (round + 1) % 3 && popped < pushed; i++)
+            CHECK(ring_pop(&ring) == ITEM(popped++));
+        CHECK(ring_length(&ring) == (int)(pushed - popped));
+
+        /* leaves one behind every other round */
+        while (pushed - popped > round % 2)
+            CHECK(ring_pop(&ring) == ITEM(popped++));
+    }
+
+    while (popped < pushed)
+        CHECK(ring_pop(&ring) == ITEM(popped++));
+    CHECK(ring_pop(&ring) == NULL);
+    CHECK(ring_length(&ring) == 0);
+
+    /* full again after wrapping */
+    for (i = 0; i < 4; i++)
+        CHECK(!ring_push(&ring, ITEM(i)));
+    CHECK(ring_push(&ring, ITEM(4)) == -1);
+
+    /* init of an empty ring resizes it */
+    while (ring_pop(&ring))
+        ;
+    CHECK(!ring_init(&ring, 16));
+    CHECK(ring_capacity(&ring) == 16);
+    CHECK(ring_length(&ring) == 0);
+
+    ring_free(&ring);
+}
+
+/* a push reserved but not published holds back the ones after it */
+static void test_push_in_progress(void)
+{
+    struct ring ring;
+
+    __ring_init(&ring);
+    CHECK(!ring_init(&ring, 4));
+    CHECK(!ring_pushing(&ring));
+
+    /* reserve the tail cell as ring_push() does, publish later */
+    ring.head++;
+    CHECK(ring_pushing(&ring));
+    CHECK(!ring_push(&ring, ITEM(1)));
+    CHECK(ring_length(&ring) == 1);
+    CHECK(ring_pop(&ring) == NULL);
+    CHECK(ring_pushing(&ring));
+
+    ring.cells[0].data = ITEM(0);
+    ring.cells[0].seq = 1;
+    ring.length++;
+    CHECK(!ring_pushing(&ring));
+    CHECK(ring_pop(&ring) == ITEM(0));
+    CHECK(ring_pop(&ring) == ITEM(1));
+    CHECK(ring_pop(&ring) == NULL);
+    CHECK(!ring_pushing(&ring));
+
+    ring_free(&ring);
+}
+
+int main(void)
+{
+    test_full_empty();
+    test_wraparound();
+    test_push_in_progress();
+    return 0;
+}